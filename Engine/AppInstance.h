@@ -302,6 +302,13 @@ public:
 
     virtual void renderAllViewers() {}
 
+    /**
+     * @brief Same as renderAllViewers() except that the output of changedEffect only changed within changedRegion,
+     * in canonical coordinates, at the given time: the viewers displaying this time may only re-render the portion
+     * of their image that depends on it.
+     **/
+    virtual void renderAllViewersInRegion(const EffectInstancePtr& /*changedEffect*/, const RectD& /*changedRegion*/, TimeValue /*changedRegionTime*/) { renderAllViewers(); }
+
     virtual void abortAllViewers(bool /*autoRestartPlayback*/) {}
 
     virtual void refreshAllPreviews() {}
@@ -98,6 +98,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Global/FStreamsSupport.h"
 #include "Engine/GroupInput.h"
 #include "Engine/GroupOutput.h"
+#include "Engine/Hash64.h"
 #include "Engine/JoinViewsNode.h"
 #include "Engine/LibraryBinary.h"
 #include "Engine/KeybindShortcut.h"
@@ -110,6 +111,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/OSGLContext.h"
 #include "Engine/OSGLFunctions.h"
 #include "Engine/OneViewNode.h"
+#include "Engine/PixelExpressionNode.h"
 #include "Engine/ProcessHandler.h" // ProcessInputChannel
 #include "Engine/Project.h"
 #include "Engine/PrecompNode.h"
@@ -122,6 +124,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/StubNode.h"
 #include "Engine/Settings.h"
 #include "Engine/TrackerNode.h"
+#include "Engine/ThreadAffinity.h"
 #include "Engine/ThreadPool.h"
 #include "Engine/ViewIdx.h"
 #include "Engine/ViewerInstance.h" // RenderStatsMap
@@ -626,6 +629,16 @@ AppManager::~AppManager()
 
     _imp->_backgroundIPC.reset();
 
+    if ( !_imp->cacheStatsFilePath.isEmpty() ) {
+        FStreamsSupport::ofstream ofile;
+        FStreamsSupport::open( &ofile, _imp->cacheStatsFilePath.toStdString() );
+        if (ofile) {
+            ofile << getTileCacheStatisticsJSON();
+        } else {
+            std::cerr << tr("Could not write cache statistics to %1").arg(_imp->cacheStatsFilePath).toStdString() << std::endl;
+        }
+    }
+
     // Ensure the cache is synced on disk when exiting.
     _imp->tileCache->flushCacheOnDisk(false /*async*/);
 
@@ -890,6 +903,18 @@ AppManager::loadInternal(const CLArgs& cl)
         _imp->_settings->loadSettingsFromFile(Settings::eLoadSettingsTypeKnobs);
     }
 
+    // Threads of the thread pool are pinned when they start: set the policy before any render is launched
+    {
+        ThreadAffinityPolicyEnum affinityPolicy;
+        if ( !cl.getThreadAffinityPolicy(&affinityPolicy) ) {
+            affinityPolicy = _imp->_settings->getThreadAffinityPolicy();
+        }
+        ThreadAffinity::setPolicy(affinityPolicy);
+    }
+
+    // The keys of the cache depend on the hashing algorithm: select it before any entry is looked up
+    Hash64::setDefaultAlgorithm(_imp->_settings->getCacheKeyHashingAlgorithm());
+
     // Create cache once we loaded the cache directory path wanted by the user
     _imp->generalPurposeCache = Cache<false>::create(false /*enableTileStorage*/);
     try {
@@ -905,6 +930,13 @@ AppManager::loadInternal(const CLArgs& cl)
     }
     _imp->tileCache->setMaximumCacheSize(_imp->_settings->getTileCacheSize());
     _imp->generalPurposeCache->setMaximumCacheSize(_imp->_settings->getGeneralPurposeCacheSize());
+    _imp->tileCache->setEvictionPolicy(_imp->_settings->getCacheEvictionPolicy());
+    _imp->generalPurposeCache->setEvictionPolicy(_imp->_settings->getCacheEvictionPolicy());
+    _imp->tileCache->setCompressedTierParameters(_imp->_settings->getCacheCompression(), _imp->_settings->getCompressedTilesCacheSize());
+    _imp->cacheStatsFilePath = cl.getCacheStatsFilePath();
+    if ( !_imp->cacheStatsFilePath.isEmpty() ) {
+        _imp->tileCache->setStatisticsEnabled(true);
+    }
 
     _imp->storageDeleteThread.reset(new StorageDeleterThread);
 
@@ -1616,6 +1648,7 @@ AppManager::loadBuiltinNodePlugins(IOPluginsMap* /*readersMap*/,
     registerPlugin(TrackerNode::createPlugin());
     registerPlugin(JoinViewsNode::createPlugin());
     registerPlugin(OneViewNode::createPlugin());
+    registerPlugin(PixelExpressionNode::createPlugin());
     registerPlugin(ReadNode::createPlugin());
     registerPlugin(RemovePlaneNode::createPlugin());
     registerPlugin(StubNode::createPlugin());
@@ -2532,6 +2565,8 @@ AppManager::printCacheMemoryStats() const
     QString reportStr;
     std::size_t totalBytes = 0;
     int totalNEntries = 0;
+    int totalNPrefetchedEntries = 0;
+    int totalNPrefetchHits = 0;
     reportStr += QLatin1String("\n");
     if (!infos.empty()) {
         for (std::map<std::string, CacheReportInfo>::iterator it = infos.begin(); it!= infos.end(); ++it) {
@@ -2540,6 +2575,8 @@ AppManager::printCacheMemoryStats() const
             }
             totalBytes += it->second.nBytes;
             totalNEntries += it->second.nEntries;
+            totalNPrefetchedEntries += it->second.nPrefetchedEntries;
+            totalNPrefetchHits += it->second.nPrefetchHits;
             
             reportStr += QString::fromUtf8(it->first.c_str());
             reportStr += QLatin1String("--> ");
@@ -2559,12 +2596,135 @@ AppManager::printCacheMemoryStats() const
     reportStr += QLatin1String("--> ");
     reportStr += printAsRAM(totalBytes);
     reportStr += tr(" taken by %1 cache entries.").arg(QString::number(totalNEntries));
+    if (totalNPrefetchedEntries > 0) {
+        reportStr += QLatin1String("\n");
+        reportStr += tr("%1 entries were prefetched, %2 of them were used (%3% prefetch hit rate).").arg(totalNPrefetchedEntries).arg(totalNPrefetchHits).arg(QString::number(totalNPrefetchHits * 100. / totalNPrefetchedEntries, 'f', 1));
+    }
+
+    CacheWarmStartStats warmStart;
+    _imp->tileCache->getWarmStartStats(&warmStart);
+    reportStr += QLatin1String("\n");
+    reportStr += tr("Cache opened in %1 s.").arg(QString::number(warmStart.initializationDuration, 'f', 3));
+    if (warmStart.firstHitLatency >= 0) {
+        reportStr += tr(" First entry found %1 s after start-up.").arg(QString::number(warmStart.firstHitLatency, 'f', 3));
+    }
+    reportStr += QLatin1String("\n");
+    reportStr += tr("%1 buckets verified, %2 inconsistent buckets were reset.").arg(warmStart.nBucketsVerified).arg(warmStart.nBucketsQuarantined);
+
+    if ( _imp->tileCache->isStatisticsEnabled() ) {
+        std::vector<CacheBucketStats> buckets;
+        _imp->tileCache->getBucketStats(&buckets);
+        CacheBucketStats total;
+        for (std::size_t i = 0; i < buckets.size(); ++i) {
+            total.merge(buckets[i]);
+        }
+        reportStr += QLatin1String("\n");
+        reportStr += tr("%1 look-ups: %2 hits, %3 pending hits, %4 misses. Look-up latency p50: %5 ms, p99: %6 ms.")
+                     .arg(total.nLookups).arg(total.nHits).arg(total.nPendingHits).arg(total.nMisses)
+                     .arg( QString::number(total.lookupLatency.getPercentile(50) * 1000., 'f', 3) )
+                     .arg( QString::number(total.lookupLatency.getPercentile(99) * 1000., 'f', 3) );
+        reportStr += QLatin1String("\n");
+        reportStr += tr("%1 lock contentions, %2 tiles allocated, %3 entries evicted (%4).")
+                     .arg(total.nLockContentions).arg(total.nTilesAllocated).arg(total.nEvictions)
+                     .arg( printAsRAM(total.nEvictedBytes) );
+    }
 
     appPTR->writeToErrorLog_mt_safe(tr("Cache Report"), QDateTime::currentDateTime(), reportStr);
 
     appPTR->showErrorLog();
 } // printCacheMemoryStats
 
+static void
+writeLatencyHistogramJSON(const char* name,
+                          const CacheLatencyHistogram& histogram,
+                          std::stringstream& ss)
+{
+    ss << "\"" << name << "\": { \"count\": " << histogram.count
+       << ", \"totalSeconds\": " << histogram.totalSeconds
+       << ", \"maxSeconds\": " << histogram.maxSeconds
+       << ", \"p50Seconds\": " << histogram.getPercentile(50)
+       << ", \"p90Seconds\": " << histogram.getPercentile(90)
+       << ", \"p99Seconds\": " << histogram.getPercentile(99)
+       << ", \"bins\": [";
+    for (int i = 0; i < NATRON_CACHE_LATENCY_HISTOGRAM_BINS; ++i) {
+        if (i > 0) {
+            ss << ", ";
+        }
+        ss << histogram.bins[i];
+    }
+    ss << "] }";
+}
+
+static void
+writeBucketStatsJSON(const CacheBucketStats& stats,
+                     std::stringstream& ss)
+{
+    ss << "\"lookups\": " << stats.nLookups
+       << ", \"hits\": " << stats.nHits
+       << ", \"pendingHits\": " << stats.nPendingHits
+       << ", \"misses\": " << stats.nMisses
+       << ", \"lockContentions\": " << stats.nLockContentions
+       << ", \"tilesAllocated\": " << stats.nTilesAllocated
+       << ", \"evictions\": " << stats.nEvictions
+       << ", \"evictedBytes\": " << stats.nEvictedBytes
+       << ", ";
+    writeLatencyHistogramJSON("lookupLatency", stats.lookupLatency, ss);
+    ss << ", ";
+    writeLatencyHistogramJSON("pendingEntryWaitLatency", stats.pendingEntryWaitLatency, ss);
+    ss << ", ";
+    writeLatencyHistogramJSON("tileAllocationLatency", stats.tileAllocationLatency, ss);
+}
+
+void
+AppManager::setTileCacheStatisticsEnabled(bool enabled)
+{
+    _imp->tileCache->setStatisticsEnabled(enabled);
+}
+
+std::string
+AppManager::getTileCacheStatisticsJSON() const
+{
+    std::vector<CacheBucketStats> buckets;
+    _imp->tileCache->getBucketStats(&buckets);
+
+    std::stringstream ss;
+    ss.precision(9);
+    ss << "{\n";
+    ss << "  \"enabled\": " << (_imp->tileCache->isStatisticsEnabled() ? "true" : "false") << ",\n";
+    ss << "  \"histogramBinUpperBoundsSeconds\": [";
+    for (int i = 0; i < NATRON_CACHE_LATENCY_HISTOGRAM_BINS; ++i) {
+        if (i > 0) {
+            ss << ", ";
+        }
+        ss << CacheLatencyHistogram::getBinUpperBound(i);
+    }
+    ss << "],\n";
+
+    CacheBucketStats total;
+    ss << "  \"buckets\": [";
+    bool first = true;
+    for (std::size_t i = 0; i < buckets.size(); ++i) {
+        total.merge(buckets[i]);
+
+        // Skip buckets that were never accessed to keep the dump small
+        if ( (buckets[i].nLookups == 0) && (buckets[i].nTilesAllocated == 0) && (buckets[i].nEvictions == 0) ) {
+            continue;
+        }
+        ss << (first ? "\n" : ",\n");
+        first = false;
+        ss << "    { \"index\": " << i << ", ";
+        writeBucketStatsJSON(buckets[i], ss);
+        ss << " }";
+    }
+    ss << "\n  ],\n";
+    ss << "  \"total\": { ";
+    writeBucketStatsJSON(total, ss);
+    ss << " }\n";
+    ss << "}\n";
+
+    return ss.str();
+} // getTileCacheStatisticsJSON
+
 
 
 const QString &
@@ -3387,6 +3547,12 @@ AppManager::getMultiThreadHandler() const
     return _imp->multiThreadSuite.get();
 }
 
+InFlightRequestTable*
+AppManager::getInFlightRequestTable() const
+{
+    return _imp->inFlightRequests.get();
+}
+
 GPUContextPool*
 AppManager::getGPUContextPool() const
 {
@@ -184,6 +184,14 @@ public:
 
     CacheBasePtr getTileCache() const;
 
+    /**
+     * @brief Returns the per-bucket statistics of the tile cache as a JSON document. The statistics are only
+     * recorded if enabled with CacheBase::setStatisticsEnabled() or with the --cache-stats command line option.
+     **/
+    std::string getTileCacheStatisticsJSON() const;
+
+    void setTileCacheStatisticsEnabled(bool enabled);
+
     void deleteCacheEntriesInSeparateThread(const std::list<ImageStorageBasePtr> & entriesToDelete);
 
     /**
@@ -360,6 +368,11 @@ public:
 
     const MultiThread* getMultiThreadHandler() const;
 
+    /**
+     * @brief Returns the table through which concurrent renders share the requests they have in common.
+     **/
+    InFlightRequestTable* getInFlightRequestTable() const;
+
 
     /**
      * @brief Return the concatenation of all search paths of Natron, i.e:
@@ -55,6 +55,7 @@
 #include "Engine/Cache.h"
 #include "Engine/ExistenceCheckThread.h"
 #include "Engine/Format.h"
+#include "Engine/InFlightRequestTable.h"
 #include "Engine/MultiThread.h"
 #include "Engine/Image.h"
 #include "Engine/OfxHost.h"
@@ -85,9 +86,11 @@ AppManagerPrivate::AppManagerPrivate()
     , ofxHost( new OfxHost() )
     , pythonTLS(new TLSHolder<AppManager::PythonTLSData>())
     , multiThreadSuite(new MultiThread())
+    , inFlightRequests(new InFlightRequestTable())
     , _knobFactory( new KnobFactory() )
     , generalPurposeCache()
     , tileCache()
+    , cacheStatsFilePath()
     , _backgroundIPC()
     , _loaded(false)
     , _binaryPath()
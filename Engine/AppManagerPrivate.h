@@ -112,10 +112,16 @@ public:
     // Multi-thread handler
     boost::scoped_ptr<MultiThread> multiThreadSuite;
 
+    // The requests in flight shared by concurrent renders
+    boost::scoped_ptr<InFlightRequestTable> inFlightRequests;
+
     boost::scoped_ptr<KnobFactory> _knobFactory; //< knob maker
 
     CacheBasePtr generalPurposeCache, tileCache; 
 
+    // If not empty, the statistics of the tile cache are written to this file on exit
+    QString cacheStatsFilePath;
+
     boost::scoped_ptr<StorageDeleterThread> storageDeleteThread; // thread used to kill cache entries without blocking a render thread
 
     boost::scoped_ptr<ProcessInputChannel> _backgroundIPC; //< object used to communicate with the main app
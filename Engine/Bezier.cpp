@@ -49,6 +49,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/BezierCP.h"
 #include "Engine/FeatherPoint.h"
 #include "Engine/Interpolation.h"
+#include "Engine/MergingEnum.h"
 #include "Engine/TimeLine.h"
 #include "Engine/Image.h"
 #include "Engine/Hash64.h"
@@ -129,12 +130,24 @@ struct BezierPrivate
     // When it is a render clone, we cache the result of getBoundingBox()
     boost::scoped_ptr<std::map<TimeValue,RectD> > renderCloneBBoxCache;
 
+    // The region covered by the shape at the last significant evaluation, only accessed on the main thread.
+    // It is only valid if the RotoPaint node did not entirely change since, i.e: if its
+    // EffectInstance::getFullEvaluationsCount() is still lastEvaluatedFullEvaluationsCount
+    RectD lastEvaluatedBbox;
+    TimeValue lastEvaluatedBboxTime;
+    bool lastEvaluatedBboxSet;
+    U64 lastEvaluatedFullEvaluationsCount;
+
     BezierPrivate(const std::string& baseName, bool isOpenBezier)
     : itemMutex()
     , viewShapes()
     , isOpenBezier(isOpenBezier)
     , baseName(baseName)
     , renderCloneBBoxCache()
+    , lastEvaluatedBbox()
+    , lastEvaluatedBboxTime(0)
+    , lastEvaluatedBboxSet(false)
+    , lastEvaluatedFullEvaluationsCount(0)
     {
         viewShapes.insert(std::make_pair(ViewIdx(0), BezierShape()));
     }
@@ -143,6 +156,10 @@ struct BezierPrivate
     : itemMutex()
     , viewShapes()
     , renderCloneBBoxCache()
+    , lastEvaluatedBbox()
+    , lastEvaluatedBboxTime(0)
+    , lastEvaluatedBboxSet(false)
+    , lastEvaluatedFullEvaluationsCount(0)
     {
         isOpenBezier = other.isOpenBezier;
         baseName = other.baseName;
@@ -1308,6 +1325,110 @@ Bezier::evaluateCurveModified()
     
 }
 
+/**
+ * @brief Returns true if the merge operator leaves B unchanged where A is transparent black,
+ * i.e: a shape merged with it only changes the image within its bounding box.
+ **/
+static bool
+isMergeOperatorLocalToA(const std::string& operatorID)
+{
+    static const MergingFunctionEnum localOperators[] = {
+        eMergeATop, eMergeOver, eMergePlus, eMergeScreen, eMergeStencil, eMergeUnder, eMergeXOR
+    };
+
+    for (std::size_t i = 0; i < sizeof(localOperators) / sizeof(localOperators[0]); ++i) {
+        if ( operatorID == Merge::getOperatorString(localOperators[i]) ) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Returns in region the region of the RotoPaint output covered by the shape at the given time for all views.
+ * Returns false if the shape may change the output outside of this region.
+ **/
+static bool
+getShapeOutputRegion(Bezier* shape,
+                     const RotoPaintPtr& rotoPaintEffect,
+                     TimeValue time,
+                     RectD* region)
+{
+    if ( shape->isOpenBezier() || !rotoPaintEffect ||
+         ( (RotoMotionBlurModeEnum)rotoPaintEffect->getMotionBlurTypeKnob()->getValue() == eRotoMotionBlurModeGlobal ) ) {
+        return false;
+    }
+
+    KnobButtonPtr invertKnob = shape->getInvertedKnob();
+    KnobChoicePtr operatorKnob = shape->getOperatorKnob();
+    std::list<ViewIdx> views = shape->getViewsList();
+    for (std::list<ViewIdx>::const_iterator it = views.begin(); it != views.end(); ++it) {
+        if ( invertKnob && invertKnob->getValueAtTime(time, DimIdx(0), *it) ) {
+            return false;
+        }
+        if ( operatorKnob && !isMergeOperatorLocalToA(operatorKnob->getActiveEntry(*it).id) ) {
+            return false;
+        }
+
+        // With motion-blur the shape is also rendered at other times
+        RangeD range;
+        int divisions;
+        shape->getMotionBlurSettings(time, *it, &range, &divisions);
+        if ( (divisions > 1) || (range.min != range.max) ) {
+            return false;
+        }
+
+        RectD viewBbox = shape->getBoundingBox(time, *it);
+        if ( viewBbox.isNull() ) {
+            continue;
+        }
+        if ( region->isNull() ) {
+            *region = viewBbox;
+        } else {
+            region->merge(viewBbox);
+        }
+    }
+
+    return true;
+} // getShapeOutputRegion
+
+void
+Bezier::evaluate(bool isSignificant,
+                 bool refreshMetadata)
+{
+    KnobItemsTablePtr model = getModel();
+    NodePtr node = model ? model->getNode() : NodePtr();
+    if ( !isSignificant || !node || (getIndexInParent() == -1) || isRenderClone() ) {
+        RotoDrawableItem::evaluate(isSignificant, refreshMetadata);
+
+        return;
+    }
+    EffectInstancePtr effect = node->getEffectInstance();
+
+    // Outside of the region covered by the shape before and after the change, the output of the RotoPaint node is unchanged
+    TimeValue time = getTimelineCurrentTime();
+    RectD bbox;
+    bool bboxValid = getShapeOutputRegion(this, toRotoPaint(effect), time, &bbox);
+    if ( bboxValid && _imp->lastEvaluatedBboxSet && (_imp->lastEvaluatedBboxTime == time) &&
+         ( _imp->lastEvaluatedFullEvaluationsCount == effect->getFullEvaluationsCount() ) ) {
+        RectD changedRegion = _imp->lastEvaluatedBbox;
+        if ( changedRegion.isNull() ) {
+            changedRegion = bbox;
+        } else if ( !bbox.isNull() ) {
+            changedRegion.merge(bbox);
+        }
+        effect->addChangedRegionForNextEvaluation(changedRegion, time);
+    }
+
+    RotoDrawableItem::evaluate(isSignificant, refreshMetadata);
+
+    _imp->lastEvaluatedBbox = bbox;
+    _imp->lastEvaluatedBboxTime = time;
+    _imp->lastEvaluatedBboxSet = bboxValid;
+    _imp->lastEvaluatedFullEvaluationsCount = effect->getFullEvaluationsCount();
+} // evaluate
+
 BezierCPPtr
 Bezier::addControlPointAfterIndexInternal(int index, double t, ViewIdx view)
 {
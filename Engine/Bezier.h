@@ -592,6 +592,12 @@ public:
 
 public:
 
+    /**
+     * @brief Reports to the RotoPaint node the region covered by the shape before and after the change,
+     * so that the viewers only re-render this region when possible.
+     **/
+    virtual void evaluate(bool isSignificant, bool refreshMetadata) OVERRIDE FINAL;
+
 
 
     bool isAutoKeyingEnabled() const;
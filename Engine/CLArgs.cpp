@@ -41,6 +41,7 @@
 #include "Global/StrUtils.h"
 
 #include "Engine/AppManager.h"
+#include "Engine/ThreadAffinity.h"
 
 NATRON_NAMESPACE_ENTER;
 
@@ -75,6 +76,9 @@ public:
     QString breakpadProcessFilePath;
     qint64 breakpadProcessPID;
     QString exportDocsPath;
+    QString cacheStatsFilePath;
+    bool threadAffinityPolicySet;
+    ThreadAffinityPolicyEnum threadAffinityPolicy;
 
     CLArgsPrivate()
         : args()
@@ -102,6 +106,9 @@ public:
         , breakpadProcessFilePath()
         , breakpadProcessPID(-1)
         , exportDocsPath()
+        , cacheStatsFilePath()
+        , threadAffinityPolicySet(false)
+        , threadAffinityPolicy(eThreadAffinityPolicyNone)
     {
     }
 
@@ -233,6 +240,9 @@ CLArgs::operator=(const CLArgs& other)
     _imp->isEmpty = other._imp->isEmpty;
     _imp->imageFilename = other._imp->imageFilename;
     _imp->exportDocsPath = other._imp->exportDocsPath;
+    _imp->cacheStatsFilePath = other._imp->cacheStatsFilePath;
+    _imp->threadAffinityPolicySet = other._imp->threadAffinityPolicySet;
+    _imp->threadAffinityPolicy = other._imp->threadAffinityPolicy;
 }
 
 bool
@@ -332,6 +342,18 @@ CLArgs::printUsage(const std::string& programName)
         "    executing the callbacks onProjectLoaded and onProjectCreated.\n"
         "    The rules on the execution of Python scripts (see below) also apply to\n"
         "    this script.\n"
+        "  --cache-stats <filename>\n"
+        "     Record statistics of the image cache: look-ups, hit rate, lock\n"
+        "     contention, tile allocations, evictions and latency histograms for\n"
+        "     each cache bucket. They are written to the given file in JSON format\n"
+        "     when the process exits.\n"
+        "  --thread-affinity <none|core|numa>\n"
+        "     Pin the render threads to the CPUs, overriding the \"Render threads\n"
+        "     affinity\" preference. With core, each thread is pinned to a single\n"
+        "     core. With numa, each thread is pinned to a NUMA node and all the\n"
+        "     nodes of a frame are rendered on the same NUMA node, so that the\n"
+        "     images of the frame are allocated in its local memory. This is only\n"
+        "     supported on Linux, threads are not pinned on other systems.\n"
         "  -s [ --render-stats]\n"
         "     Enable render statistics that will be produced for\n"
         "     each frame in form of a file located next to the image produced by\n"
@@ -553,6 +575,23 @@ CLArgs::getExportDocsPath() const
     return _imp->exportDocsPath;
 }
 
+const QString&
+CLArgs::getCacheStatsFilePath() const
+{
+    return _imp->cacheStatsFilePath;
+}
+
+bool
+CLArgs::getThreadAffinityPolicy(ThreadAffinityPolicyEnum* policy) const
+{
+    if (!_imp->threadAffinityPolicySet) {
+        return false;
+    }
+    *policy = _imp->threadAffinityPolicy;
+
+    return true;
+}
+
 QStringList::iterator
 CLArgsPrivate::findFileNameWithExtension(const QString& extension)
 {
@@ -888,6 +927,41 @@ CLArgsPrivate::parse()
         }
     }
 
+    {
+        QStringList::iterator it = hasToken( QString::fromUtf8("cache-stats"), QString() );
+        if ( it != args.end() ) {
+            it = args.erase(it);
+            if ( it != args.end() ) {
+                cacheStatsFilePath = *it;
+#ifdef __NATRON_UNIX__
+                cacheStatsFilePath = AppManager::qt_tildeExpansion(cacheStatsFilePath);
+#endif
+                args.erase(it);
+            } else {
+                std::cout << tr("You must specify the file path of the cache statistics").toStdString() << std::endl;
+                error = 1;
+
+                return;
+            }
+        }
+    }
+
+    {
+        QStringList::iterator it = hasToken( QString::fromUtf8("thread-affinity"), QString() );
+        if ( it != args.end() ) {
+            it = args.erase(it);
+            if ( ( it != args.end() ) && ThreadAffinity::getPolicyFromString(it->toStdString(), &threadAffinityPolicy) ) {
+                threadAffinityPolicySet = true;
+                args.erase(it);
+            } else {
+                std::cout << tr("You must specify the thread affinity policy: none, core or numa").toStdString() << std::endl;
+                error = 1;
+
+                return;
+            }
+        }
+    }
+
     {
         QStringList::iterator it = hasToken( QString::fromUtf8("IPCpipe"), QString() );
         if ( it != args.end() ) {
@@ -140,6 +140,12 @@ public:
     const QString& getBreakpadComPipeFilePath() const;
     const QString& getExportDocsPath() const;
 
+    // If not empty, statistics of the tile cache are recorded and written to this file in JSON format on exit
+    const QString& getCacheStatsFilePath() const;
+
+    // Returns true if the thread affinity policy was set with --thread-affinity, overriding the preferences
+    bool getThreadAffinityPolicy(ThreadAffinityPolicyEnum* policy) const;
+
 private:
 
     boost::scoped_ptr<CLArgsPrivate> _imp;
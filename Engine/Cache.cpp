@@ -24,9 +24,14 @@
 
 #include "Cache.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstring> // memcpy
 #include <stdexcept>
+#include <limits>
 #include <set>
+#include <map>
 #include <list>
 
 #ifdef __NATRON_UNIX__
@@ -38,6 +43,8 @@
 #include <QWaitCondition>
 #include <QDebug>
 #include <QReadWriteLock>
+#include <QAtomicInt>
+#include <QByteArray>
 
 GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
 GCC_DIAG_OFF(unused-parameter)
@@ -65,6 +72,7 @@ GCC_DIAG_OFF(unused-parameter)
 #include <boost/thread/shared_mutex.hpp> // local r-w mutex
 #include <boost/thread/locks.hpp>
 #include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp> // buckets verification and prefetch threads
 GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 GCC_DIAG_ON(unused-parameter)
 
@@ -76,6 +84,7 @@ GCC_DIAG_ON(unused-parameter)
 #include "Global/QtCompat.h"
 
 #include "Engine/AppManager.h"
+#include "Engine/CancellationToken.h"
 #include "Engine/StorageDeleterThread.h"
 #include "Global/FStreamsSupport.h"
 #include "Engine/MemoryFile.h"
@@ -85,6 +94,7 @@ GCC_DIAG_ON(unused-parameter)
 #include "Engine/RamBuffer.h"
 #include "Engine/Timer.h"
 #include "Engine/ThreadPool.h"
+#include "Engine/WorkStealingExecutor.h"
 
 
 // The number of buckets. This must be a power of 16 since the buckets will be identified by a digit of a hash
@@ -99,7 +109,37 @@ GCC_DIAG_ON(unused-parameter)
 #define NATRON_CACHE_SERIALIZATION_VERSION 5
 
 // If we change the MemorySegmentEntryHeader struct, we must increment this version so we do not attempt to read an invalid structure.
-#define NATRON_MEMORY_SEGMENT_ENTRY_HEADER_VERSION 1
+#define NATRON_MEMORY_SEGMENT_ENTRY_HEADER_VERSION 5
+
+// The number of values in CacheEvictionPolicyEnum
+#define NATRON_CACHE_EVICTION_POLICIES_COUNT 3
+
+// Policies other than eCacheEvictionPolicyLRU select the entry to evict among this amount of
+// least recently used entries of a bucket. This bounds the cost of an eviction and still gives priority to recency.
+#define NATRON_CACHE_EVICTION_CANDIDATES_COUNT 8
+
+// With eCacheEvictionPolicyScanResistant, entries of the probation queue are evicted first as long as they represent more
+// than this percentage of the entries of the bucket (Kin in the 2Q paper).
+#define NATRON_CACHE_2Q_PROBATION_PERCENT 25
+
+// Number of hashes of entries evicted from the probation queue remembered by each bucket (Kout in the 2Q paper).
+// An entry inserted again while its hash is remembered goes directly to the protected queue.
+#define NATRON_CACHE_2Q_GHOST_COUNT 64
+
+// Maximum number of threads running prefetch tasks, see CacheBase::prefetch()
+#define NATRON_CACHE_PREFETCH_MAX_THREADS 2
+
+// Maximum number of prefetch tasks waiting for a thread. Older tasks are cancelled first.
+#define NATRON_CACHE_PREFETCH_MAX_PENDING_TASKS 64
+
+// Interval at which a prefetch thread checks whether interactive renders are done before starting its next task
+#define NATRON_CACHE_PREFETCH_YIELD_POLL_MS 10
+
+// The compressed tier of the tiles storage may not use more than this percentage of the maximum size of the cache
+#define NATRON_CACHE_COMPRESSED_TIER_MAX_BUDGET_PERCENT 25
+
+// Maximum amount of uncompressed bytes of evicted tiles waiting to be compressed. Tiles evicted beyond are dropped.
+#define NATRON_CACHE_COMPRESSION_MAX_PENDING_BYTES 268435456 // = 256 * 1024 * 1024
 
 
 // After this amount of milliseconds, if a thread is not able to access a mutex, the cache is assumed to be inconsistent
@@ -108,17 +148,22 @@ GCC_DIAG_ON(unused-parameter)
 #endif
 
 // Each file is 1GB
-// Note that we don't split the free tiles list across each buckets, otherwise 1 bucket could have only 256 tiles available per 1GiB of memory.
-// But a single HD image could already take up a full bucket worth of tiles, hence we group the free tiles list of all buckets into the free tiles list
-// of the first bucket.
+// Each bucket owns NATRON_NUM_TILES_PER_BUCKET_FILE tiles of each file in its own free tiles list, so that
+// threads allocating tiles for different images do not contend on a single list.
+// Tiles of an image are spread across buckets (see getBucketIndexForTile) and allocated/released
+// in batches: each bucket lock is taken once per call for all the tiles it owns.
 #define NATRON_NUM_TILES_PER_BUCKET_FILE 256
 #define NATRON_NUM_TILES_PER_FILE (NATRON_NUM_TILES_PER_BUCKET_FILE * NATRON_CACHE_BUCKETS_COUNT)
 #define NATRON_TILE_STORAGE_FILE_SIZE (NATRON_TILE_SIZE_BYTES * NATRON_NUM_TILES_PER_FILE)
 
+// Interval at which a thread polls a pending entry once its render is aborted
+#define NATRON_CACHE_CANCELLED_WAIT_POLL_MS 5
+
 //#define CACHE_TRACE_ENTRY_ACCESS
 //#define CACHE_TRACE_TIMEOUTS
 //#define CACHE_TRACE_FILE_MAPPING
 //#define CACHE_TRACE_TILES_ALLOCATION
+//#define CACHE_TRACE_PREFETCH
 
 namespace bip = boost::interprocess;
 
@@ -524,11 +569,19 @@ public:
  **/
 class CorruptedCacheException : public std::exception
 {
+    // The index of the bucket that was found inconsistent
+    int _bucketIndex;
 
 public:
 
-    CorruptedCacheException()
+    CorruptedCacheException(int bucketIndex)
+    : _bucketIndex(bucketIndex)
+    {
+    }
+
+    int getBucketIndex() const
     {
+        return _bucketIndex;
     }
 
     virtual ~CorruptedCacheException() throw()
@@ -598,13 +651,11 @@ void disconnectLinkedListNode(const LRUListNodePtr& node)
         node->prev->next = node->next;
     }
 
-    node->prev = 0;
-
-
     // Make the next item predecessor point to this item predecessor
     if (node->next) {
         node->next->prev = node->prev;
     }
+    node->prev = 0;
     node->next = 0;
 }
 
@@ -625,6 +676,39 @@ void insertLinkedListNode(const LRUListNodePtr& node, const LRUListNodePtr& prev
     node->next = next;
 }
 
+/**
+ * @brief Appends the node at the back of the list given by its front and back pointers.
+ **/
+inline
+void appendQueueNode(const LRUListNodePtr& node, LRUListNodePtr* front, LRUListNodePtr* back)
+{
+    if (!*back) {
+        assert(!*front);
+        node->prev = 0;
+        node->next = 0;
+        *front = node;
+        *back = node;
+    } else {
+        insertLinkedListNode(node, *back, LRUListNodePtr(0));
+        *back = node;
+    }
+}
+
+/**
+ * @brief Removes the node from the list given by its front and back pointers.
+ **/
+inline
+void removeQueueNode(const LRUListNodePtr& node, LRUListNodePtr* front, LRUListNodePtr* back)
+{
+    if (*front == node) {
+        *front = node->next;
+    }
+    if (*back == node) {
+        *back = node->prev;
+    }
+    disconnectLinkedListNode(node);
+}
+
 /**
  * @brief This struct represents the minimum required data for a cache entry in the global bucket memory segment.
  * It is associated to a hash in the LRU linked list.
@@ -660,15 +744,57 @@ struct MemorySegmentEntryHeaderBase
     // The corresponding node in the LRU list
     LRUListNode lruNode;
 
+    // The corresponding node in the probation or protected queue of the 2Q policy, see CacheBucketIPCData.
+    // Protected by lruListMutex
+    LRUListNode queueNode;
+
+    // Whether queueNode is in the protected queue or in the probation queue.
+    // Protected by lruListMutex
+    bool isProtected;
+
+    // The number of look-ups that found this entry since its insertion.
+    // Protected by lruListMutex
+    U64 nHits;
+
+    // Time in seconds it took to compute this entry. Used by eCacheEvictionPolicyCostAware.
+    // Protected by lruListMutex
+    double computeCost;
+
+    enum EntryPrefetchStateEnum
+    {
+        // The entry was computed by a regular render
+        eEntryPrefetchStateNone,
+
+        // The entry was computed by a prefetch render and was not found by a regular look-up yet
+        eEntryPrefetchStatePrefetched,
+
+        // The entry was computed by a prefetch render and then found by a regular look-up
+        eEntryPrefetchStateHit
+    };
+
+    // Whether the entry was computed by a prefetch render. Used for the prefetch hit rate in getMemoryStats.
+    // Protected by lruListMutex
+    EntryPrefetchStateEnum prefetchState;
+
     // List of tile indices allocated for this entry
     ExternalSegmentTypeULongLongList tileIndices;
 
+    // For each tile in tileIndices, in the same order, the index that was passed in tilesToAlloc
+    // to retrieveAndLockTiles. This identifies the tile in the compressed tier once the entry is evicted.
+    ExternalSegmentTypeULongLongList tileLocalIndices;
+
     MemorySegmentEntryHeaderBase(const void_allocator& allocator)
     : size(0)
     , status(eEntryStatusNull)
     , computeThreadMagic(0)
     , lruNode()
+    , queueNode()
+    , isProtected(false)
+    , nHits(0)
+    , computeCost(0)
+    , prefetchState(eEntryPrefetchStateNone)
     , tileIndices(allocator)
+    , tileLocalIndices(allocator)
     {}
 
 };
@@ -769,6 +895,22 @@ struct CacheBucketIPCData
     // Protected by lruListMutex
     LRUListNodePtr lruListFront, lruListBack;
 
+    // The queues of the 2Q algorithm used by eCacheEvictionPolicyScanResistant. They are maintained whatever
+    // the policy so that it can be changed at any time. Every entry is in exactly one of them.
+    // - Entries are inserted at the back of the probation queue (A1in), which is FIFO: a scan only goes
+    // through this queue and cannot flush the protected queue.
+    // - An entry of the probation queue that is accessed again moves to the protected queue (Am), which is LRU.
+    // - The hashes of the entries evicted from the probation queue are remembered in ghostHashes (A1out):
+    // an entry that is inserted again shortly after its eviction goes directly to the protected queue.
+    // Protected by lruListMutex
+    LRUListNodePtr probationFront, probationBack, protectedFront, protectedBack;
+    std::size_t probationCount, protectedCount;
+
+    // Ring buffer of the hashes evicted from the probation queue. 0 means empty.
+    // Protected by lruListMutex
+    U64 ghostHashes[NATRON_CACHE_2Q_GHOST_COUNT];
+    unsigned int ghostNextIndex;
+
     // A version indicator for the serialization. If the cache version doesn't correspond
     // to NATRON_MEMORY_SEGMENT_ENTRY_HEADER_VERSION, we wipe it.
     // Never changes, thread-safe
@@ -795,23 +937,59 @@ struct CacheBucketIPCData
     CacheBucketIPCData(const void_allocator& allocator)
     : lruListFront(0)
     , lruListBack(0)
+    , probationFront(0)
+    , probationBack(0)
+    , protectedFront(0)
+    , protectedBack(0)
+    , probationCount(0)
+    , protectedCount(0)
+    , ghostNextIndex(0)
     , version(NATRON_MEMORY_SEGMENT_ENTRY_HEADER_VERSION)
     , bucketState(eBucketStateOk)
     , size(0)
     , entriesMap(allocator)
     , freeTiles(allocator)
     {
+        std::fill(ghostHashes, ghostHashes + NATRON_CACHE_2Q_GHOST_COUNT, 0);
     }
 
     CacheBucketIPCData()
     : lruListFront(0)
     , lruListBack(0)
+    , probationFront(0)
+    , probationBack(0)
+    , protectedFront(0)
+    , protectedBack(0)
+    , probationCount(0)
+    , protectedCount(0)
+    , ghostNextIndex(0)
     , version(NATRON_MEMORY_SEGMENT_ENTRY_HEADER_VERSION)
     , bucketState(eBucketStateOk)
     , size(0)
     , entriesMap()
     , freeTiles()
     {
+        std::fill(ghostHashes, ghostHashes + NATRON_CACHE_2Q_GHOST_COUNT, 0);
+    }
+
+    /**
+     * @brief Returns true and forgets the hash if it was evicted recently from the probation queue.
+     **/
+    bool takeGhostHash(U64 hash)
+    {
+        for (int i = 0; i < NATRON_CACHE_2Q_GHOST_COUNT; ++i) {
+            if (ghostHashes[i] == hash) {
+                ghostHashes[i] = 0;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void addGhostHash(U64 hash)
+    {
+        ghostHashes[ghostNextIndex] = hash;
+        ghostNextIndex = (ghostNextIndex + 1) % NATRON_CACHE_2Q_GHOST_COUNT;
     }
 
 };
@@ -858,12 +1036,23 @@ struct CacheBucket
     // as long as tocFile is mapped
     IPCData *ipc;
 
+    // Statistics recorded by this process for each eviction policy.
+    // This lives in process memory.
+    // nHits is protected by lruListMutex, nMisses and nEvictions are protected by bucketMutex
+    CacheEvictionStats evictionStats[NATRON_CACHE_EVICTION_POLICIES_COUNT];
+
+    // Set to 1 once this process checked the consistency of the bucket, @see CachePrivate::ensureBucketVerified
+    // This lives in process memory.
+    QAtomicInt verified;
+
     CacheBucket()
     : cache()
     , tocFileManager()
     , bucketIndex(-1)
     , tocFile()
     , ipc(0)
+    , evictionStats()
+    , verified(0)
     {
 
     }
@@ -887,6 +1076,16 @@ struct CacheBucket
      **/
     bool tryCacheLookupImpl(U64 hash, typename EntriesMap::iterator* found, EntriesMap** storage);
 
+    /**
+     * @brief Returns the hash of the entry of this bucket that should be evicted first according to the given policy,
+     * or 0 if the bucket is empty.
+     * This function assumes that the tocData.segmentMutex is taken at least in read mode and that the bucketMutex is taken
+     * in write mode.
+     *
+     * This function may throw a AbandonnedLockException
+     **/
+    U64 selectEntryToEvict(CacheEvictionPolicyEnum policy);
+
     enum ShmEntryReadRetCodeEnum
     {
         eShmEntryReadRetCodeOk,
@@ -940,6 +1139,17 @@ struct CacheBucket
      **/
     void growToCFile(Sharable_WriteLock& tocFileLock, std::size_t bytesToAdd);
 
+    /**
+     * @brief Checks that the data of the bucket in the ToC file can be trusted: the bucket state,
+     * the LRU list against the entries map and the tile indices against the tiles owned by this bucket.
+     * This function assumes that the tocData.segmentMutex and the bucketMutex are taken at least in read mode.
+     * @param maxFileIndex[out] The greatest tiles storage file index referenced by the bucket, or -1
+     * @returns False if the bucket is inconsistent
+     *
+     * This function may throw a AbandonnedLockException
+     **/
+    bool checkConsistency(int* maxFileIndex);
+
 };
 
 
@@ -971,6 +1181,9 @@ struct CacheEntryLockerPrivate
     // The status of the entry, @see CacheEntryStatusEnum
     CacheEntryLockerBase::CacheEntryStatusEnum status;
 
+    // Started when this thread becomes responsible for computing the entry, to record its compute cost in insertInCache()
+    boost::scoped_ptr<TimeLapse> computeTimer;
+
     CacheEntryLockerPrivate(CacheEntryLocker<persistent>* publicInterface, const boost::shared_ptr<Cache<persistent> >& cache, const CacheEntryBasePtr& entry);
 
     // This function may throw a AbandonnedLockException
@@ -1130,6 +1343,411 @@ struct CacheIPCData
 };
 
 
+/**
+ * @brief Process local storage for the tiles of entries evicted from the tiles storage.
+ * Instead of being dropped, each tile is compressed and indexed by the hash of the entry that owned it
+ * and the index that was passed in tilesToAlloc to retrieveAndLockTiles.
+ * When the tier exceeds its maximum size, the tiles that were compressed first are dropped.
+ *
+ * Evicting an entry only copies its tiles to pendingTiles, under the locks of the cache: they are compressed
+ * by compressionThread, without any lock of the cache taken, so that threads allocating tiles do not wait for zlib.
+ **/
+struct CacheCompressedTier
+{
+    typedef std::pair<U64, U64> TileKey;
+    typedef std::list<TileKey> TileKeyList;
+
+    struct CompressedTile
+    {
+        QByteArray data;
+
+        // Position of the tile in lruList
+        TileKeyList::iterator lruIt;
+    };
+
+    typedef std::map<TileKey, CompressedTile> CompressedTilesMap;
+
+    // The uncompressed tiles of an evicted entry waiting for compressionThread
+    struct PendingEntryTiles
+    {
+        U64 entryHash;
+        int compressionLevel;
+
+        // Local index and uncompressed data of each tile
+        std::list<std::pair<U64, QByteArray> > tiles;
+    };
+
+    // Protects all members
+    mutable boost::mutex lock;
+
+    // Signaled when tiles are pending or when compressionThread must quit
+    boost::condition_variable cond;
+
+    CacheCompressionEnum compression;
+
+    // The maximum size in bytes of the compressed data, as set by the user
+    std::size_t maximumSize;
+
+    // The maximum size in bytes of the cache: the tier may not use more than NATRON_CACHE_COMPRESSED_TIER_MAX_BUDGET_PERCENT of it
+    std::size_t cacheMaximumSize;
+
+    // The size in bytes of the compressed data
+    std::size_t size;
+
+    CompressedTilesMap tiles;
+
+    // Tiles in the order they were compressed: the front is dropped first
+    TileKeyList lruList;
+
+    // Tiles waiting to be compressed, the oldest first, and their size in bytes
+    std::list<PendingEntryTiles> pendingTiles;
+    std::size_t pendingSize;
+
+    // The entry whose tiles are being compressed by compressionThread and whether
+    // it was removed from the tier in the meantime
+    U64 compressingEntryHash;
+    bool compressingEntryRemoved;
+
+    // Created lazily by queueEntryTiles
+    boost::scoped_ptr<boost::thread> compressionThread;
+    bool mustQuit;
+
+    // nCompressedTiles, compressedSize and uncompressedSize are not maintained here
+    CacheTierStats stats;
+
+    CacheCompressedTier()
+    : lock()
+    , cond()
+    , compression(eCacheCompressionNone)
+    , maximumSize(0)
+    , cacheMaximumSize(0)
+    , size(0)
+    , tiles()
+    , lruList()
+    , pendingTiles()
+    , pendingSize(0)
+    , compressingEntryHash(0)
+    , compressingEntryRemoved(false)
+    , compressionThread()
+    , mustQuit(false)
+    , stats()
+    {
+
+    }
+
+    ~CacheCompressedTier()
+    {
+        {
+            boost::unique_lock<boost::mutex> k(lock);
+            mustQuit = true;
+            cond.notify_all();
+        }
+        if (compressionThread) {
+            compressionThread->join();
+        }
+    }
+
+    // Must be called with lock taken
+    std::size_t getEffectiveMaximumSize() const
+    {
+        if (compression == eCacheCompressionNone) {
+            return 0;
+        }
+        std::size_t budget = (std::size_t)( (double)cacheMaximumSize * NATRON_CACHE_COMPRESSED_TIER_MAX_BUDGET_PERCENT / 100. );
+        if (cacheMaximumSize == 0) {
+            // No limit on the cache size
+            return maximumSize;
+        }
+        return std::min(maximumSize, budget);
+    }
+
+    // Must be called with lock taken
+    void removeTile(CompressedTilesMap::iterator it)
+    {
+        size -= it->second.data.size();
+        lruList.erase(it->second.lruIt);
+        tiles.erase(it);
+    }
+
+    // Must be called with lock taken
+    void shrinkToSize(std::size_t maxSize)
+    {
+        while (size > maxSize && !lruList.empty()) {
+            CompressedTilesMap::iterator found = tiles.find(lruList.front());
+            assert(found != tiles.end());
+            removeTile(found);
+        }
+    }
+
+    // Must be called with lock taken
+    void insertTile(U64 entryHash, U64 localIndex, const QByteArray& data)
+    {
+        if (compression == eCacheCompressionNone) {
+            return;
+        }
+        TileKey key(entryHash, localIndex);
+        CompressedTilesMap::iterator found = tiles.find(key);
+        if (found != tiles.end()) {
+            removeTile(found);
+        }
+        CompressedTile& tile = tiles[key];
+        tile.data = data;
+        tile.lruIt = lruList.insert(lruList.end(), key);
+        size += data.size();
+        shrinkToSize( getEffectiveMaximumSize() );
+    }
+
+    /**
+     * @brief Queue the uncompressed tiles of an evicted entry for compression.
+     * @returns False if too many tiles are already waiting: the tiles should be dropped.
+     **/
+    bool queueEntryTiles(PendingEntryTiles* entryTiles, std::size_t entryTilesSize)
+    {
+        boost::unique_lock<boost::mutex> k(lock);
+        if (pendingSize + entryTilesSize > NATRON_CACHE_COMPRESSION_MAX_PENDING_BYTES) {
+            stats.nDroppedTiles += entryTiles->tiles.size();
+            return false;
+        }
+        pendingTiles.push_back(PendingEntryTiles());
+        pendingTiles.back().entryHash = entryTiles->entryHash;
+        pendingTiles.back().compressionLevel = entryTiles->compressionLevel;
+        pendingTiles.back().tiles.swap(entryTiles->tiles);
+        pendingSize += entryTilesSize;
+        if (!compressionThread) {
+            compressionThread.reset( new boost::thread(&CacheCompressedTier::runCompression, this) );
+        }
+        cond.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Takes the tile out of the tier. If it was still waiting to be compressed, isCompressed is set to false.
+     **/
+    bool takeTile(U64 entryHash, U64 localIndex, QByteArray* data, bool* isCompressed)
+    {
+        boost::unique_lock<boost::mutex> k(lock);
+        for (std::list<PendingEntryTiles>::iterator it = pendingTiles.begin(); it != pendingTiles.end(); ++it) {
+            if (it->entryHash != entryHash) {
+                continue;
+            }
+            for (std::list<std::pair<U64, QByteArray> >::iterator it2 = it->tiles.begin(); it2 != it->tiles.end(); ++it2) {
+                if (it2->first == localIndex) {
+                    *data = it2->second;
+                    *isCompressed = false;
+                    pendingSize -= it2->second.size();
+                    it->tiles.erase(it2);
+                    ++stats.nCompressedTierHits;
+                    return true;
+                }
+            }
+        }
+        CompressedTilesMap::iterator found = tiles.find(TileKey(entryHash, localIndex));
+        if (found == tiles.end()) {
+            ++stats.nCompressedTierMisses;
+            return false;
+        }
+        *data = found->second.data;
+        *isCompressed = true;
+        removeTile(found);
+        ++stats.nCompressedTierHits;
+        return true;
+    }
+
+    void removeEntryTiles(U64 entryHash)
+    {
+        boost::unique_lock<boost::mutex> k(lock);
+        for (std::list<PendingEntryTiles>::iterator it = pendingTiles.begin(); it != pendingTiles.end();) {
+            if (it->entryHash == entryHash) {
+                for (std::list<std::pair<U64, QByteArray> >::iterator it2 = it->tiles.begin(); it2 != it->tiles.end(); ++it2) {
+                    pendingSize -= it2->second.size();
+                }
+                it = pendingTiles.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (compressingEntryHash == entryHash) {
+            compressingEntryRemoved = true;
+        }
+        CompressedTilesMap::iterator it = tiles.lower_bound(TileKey(entryHash, 0));
+        while (it != tiles.end() && it->first.first == entryHash) {
+            CompressedTilesMap::iterator next = it;
+            ++next;
+            removeTile(it);
+            it = next;
+        }
+    }
+
+    void clear()
+    {
+        boost::unique_lock<boost::mutex> k(lock);
+        tiles.clear();
+        lruList.clear();
+        size = 0;
+        pendingTiles.clear();
+        pendingSize = 0;
+        if (compressingEntryHash != 0) {
+            compressingEntryRemoved = true;
+        }
+    }
+
+    /**
+     * @brief Returns the memory used by the tier in bytes, including the tiles waiting to be compressed.
+     **/
+    std::size_t getMemorySize() const
+    {
+        boost::unique_lock<boost::mutex> k(lock);
+        return size + pendingSize;
+    }
+
+    // Entry point of compressionThread
+    static void runCompression(CacheCompressedTier* tier);
+};
+
+void
+CacheCompressedTier::runCompression(CacheCompressedTier* tier)
+{
+    for (;;) {
+        PendingEntryTiles entryTiles;
+        {
+            boost::unique_lock<boost::mutex> k(tier->lock);
+            while (!tier->mustQuit && tier->pendingTiles.empty()) {
+                tier->cond.wait(k);
+            }
+            if (tier->mustQuit) {
+                return;
+            }
+            entryTiles.entryHash = tier->pendingTiles.front().entryHash;
+            entryTiles.compressionLevel = tier->pendingTiles.front().compressionLevel;
+            entryTiles.tiles.swap(tier->pendingTiles.front().tiles);
+            tier->pendingTiles.pop_front();
+            for (std::list<std::pair<U64, QByteArray> >::iterator it = entryTiles.tiles.begin(); it != entryTiles.tiles.end(); ++it) {
+                tier->pendingSize -= it->second.size();
+            }
+            tier->compressingEntryHash = entryTiles.entryHash;
+            tier->compressingEntryRemoved = false;
+        }
+
+        // Compress without holding any lock
+        for (std::list<std::pair<U64, QByteArray> >::iterator it = entryTiles.tiles.begin(); it != entryTiles.tiles.end(); ++it) {
+            it->second = qCompress(it->second, entryTiles.compressionLevel);
+        }
+
+        boost::unique_lock<boost::mutex> k(tier->lock);
+        if (!tier->compressingEntryRemoved) {
+            for (std::list<std::pair<U64, QByteArray> >::iterator it = entryTiles.tiles.begin(); it != entryTiles.tiles.end(); ++it) {
+                tier->insertTile(entryTiles.entryHash, it->first, it->second);
+            }
+        }
+        tier->compressingEntryHash = 0;
+        tier->compressingEntryRemoved = false;
+    }
+} // runCompression
+
+/**
+ * @brief The prefetch tasks of a cache. It is shared with the prefetch threads so that they may outlive the cache.
+ **/
+struct CachePrefetchQueue
+{
+    // Protects all fields below
+    boost::mutex lock;
+
+    // Signaled when a task is queued or when the threads must quit
+    boost::condition_variable cond;
+
+    // Tasks waiting for a thread, the oldest first
+    std::list<CachePrefetchTaskPtr> pendingTasks;
+
+    // Tasks currently in run()
+    std::list<CachePrefetchTaskPtr> runningTasks;
+
+    // The threads running the tasks, created lazily
+    std::vector<boost::shared_ptr<boost::thread> > threads;
+
+    bool mustQuit;
+
+    CachePrefetchQueue()
+    : lock()
+    , cond()
+    , pendingTasks()
+    , runningTasks()
+    , threads()
+    , mustQuit(false)
+    {
+
+    }
+
+    // Must be called with lock taken
+    void cancelAllTasks()
+    {
+        for (std::list<CachePrefetchTaskPtr>::iterator it = pendingTasks.begin(); it != pendingTasks.end(); ++it) {
+            (*it)->cancel();
+        }
+        pendingTasks.clear();
+        for (std::list<CachePrefetchTaskPtr>::iterator it = runningTasks.begin(); it != runningTasks.end(); ++it) {
+            (*it)->cancel();
+        }
+    }
+
+    // Entry point of the prefetch threads
+    static void runTasks(boost::shared_ptr<CachePrefetchQueue> queue);
+};
+
+typedef boost::shared_ptr<CachePrefetchQueue> CachePrefetchQueuePtr;
+
+void
+CachePrefetchQueue::runTasks(boost::shared_ptr<CachePrefetchQueue> queue)
+{
+    for (;;) {
+        CachePrefetchTaskPtr task;
+        {
+            boost::unique_lock<boost::mutex> k(queue->lock);
+            for (;;) {
+                if (queue->mustQuit) {
+                    break;
+                }
+                if ( queue->pendingTasks.empty() ) {
+                    queue->cond.wait(k);
+                } else if ( WorkStealingExecutor::isHighPriorityExecutorRunning() ) {
+                    // Prefetching must not compete with interactive renders: only start a task once they are done.
+                    // The renders of a task that was already started have a normal priority and yield as well.
+                    queue->cond.timed_wait( k, boost::posix_time::milliseconds(NATRON_CACHE_PREFETCH_YIELD_POLL_MS) );
+                } else {
+                    break;
+                }
+            }
+            if (queue->mustQuit) {
+                return;
+            }
+            task = queue->pendingTasks.front();
+            queue->pendingTasks.pop_front();
+            queue->runningTasks.push_back(task);
+        }
+
+        if (!task->isCancelled()) {
+            try {
+                task->run();
+            } catch (const std::exception& e) {
+#ifdef CACHE_TRACE_PREFETCH
+                qDebug() << "Prefetch task failed:" << e.what();
+#else
+                Q_UNUSED(e);
+#endif
+            } catch (...) {
+#ifdef CACHE_TRACE_PREFETCH
+                qDebug() << "Prefetch task failed";
+#endif
+            }
+        }
+
+        boost::unique_lock<boost::mutex> k(queue->lock);
+        std::list<CachePrefetchTaskPtr>::iterator found = std::find(queue->runningTasks.begin(), queue->runningTasks.end(), task);
+        if (found != queue->runningTasks.end()) {
+            queue->runningTasks.erase(found);
+        }
+    }
+} // runTasks
+
 template <bool persistent>
 struct CachePrivate
 {
@@ -1151,6 +1769,13 @@ struct CachePrivate
     // only protects against threads.
     boost::mutex maximumSizeMutex;
 
+    // The CacheEvictionPolicyEnum used in evictLRUEntries().
+    // This is local to the process and read on every look-up, hence atomic.
+    QAtomicInt evictionPolicy;
+
+    // Tiles of evicted entries, compressed. Only used if useTileStorage is true.
+    CacheCompressedTier compressedTier;
+
     // Each bucket handle entries with the 2 first hexadecimal numbers of the hash
     // This allows to hopefully dispatch threads and processes in 256 different buckets so that they are less likely
     // to take the same lock.
@@ -1215,10 +1840,39 @@ struct CachePrivate
 
     bool useTileStorage;
 
+    // Started when the cache is created, used for the warm start statistics
+    TimeLapse startupTimer;
+
+    // Protected by warmStartStatsMutex
+    CacheWarmStartStats warmStartStats;
+    mutable boost::mutex warmStartStatsMutex;
+
+    // Set to 1 once a look-up found a cached entry
+    QAtomicInt firstHitRecorded;
+
+    // Ensures a single thread of this process resets buckets at a time
+    boost::mutex quarantineMutex;
+
+    // Verifies in the background the buckets of a persistent cache that were reopened from disk.
+    // Only valid for a persistent cache.
+    boost::scoped_ptr<boost::thread> verificationThread;
+
+    // Tasks scheduled with prefetch()
+    CachePrefetchQueuePtr prefetchQueue;
+
+    // Set to 1 if the statistics of each bucket must be recorded
+    QAtomicInt statisticsEnabled;
+
+    // The statistics of each bucket, process-local: each is protected by the mutex of the same index
+    CacheBucketStats bucketStats[NATRON_CACHE_BUCKETS_COUNT];
+    mutable boost::mutex bucketStatsMutex[NATRON_CACHE_BUCKETS_COUNT];
+
     CachePrivate(Cache<persistent>* publicInterface, bool enableTileStorage)
     : _publicInterface(publicInterface)
     , maximumSize((std::size_t)8 * 1024 * 1024 * 1024) // 8GB max by default
     , maximumSizeMutex()
+    , evictionPolicy((int)eCacheEvictionPolicyLRU)
+    , compressedTier()
     , buckets()
     , tilesStorage()
 #ifdef NATRON_CACHE_INTERPROCESS_ROBUST
@@ -1231,6 +1885,16 @@ struct CachePrivate
     , timerFrequency(getPerformanceFrequency())
 #endif
     , useTileStorage(enableTileStorage)
+    , startupTimer()
+    , warmStartStats()
+    , warmStartStatsMutex()
+    , firstHitRecorded(0)
+    , quarantineMutex()
+    , verificationThread()
+    , prefetchQueue(new CachePrefetchQueue)
+    , statisticsEnabled(0)
+    , bucketStats()
+    , bucketStatsMutex()
     {
 
     }
@@ -1242,6 +1906,11 @@ struct CachePrivate
 
     void initializeCacheDirPath();
 
+    CacheEvictionPolicyEnum getEvictionPolicy() const
+    {
+        return (CacheEvictionPolicyEnum)(int)evictionPolicy;
+    }
+
     void ensureCacheDirectoryExists();
 
     QString getBucketAbsoluteDirPath(int bucketIndex) const;
@@ -1260,11 +1929,17 @@ struct CachePrivate
 #endif
 
 
-    // This function may throw a AbandonnedLockException
-    void clearCacheBucket(int bucket_i);
+    /**
+     * @brief Re-creates the ToC file of the given bucket, dropping all its entries and free tiles.
+     * @param minFreeSize The ToC file is grown so that it has at least this amount of free bytes.
+     * This function may throw a AbandonnedLockException
+     **/
+    void clearCacheBucket(int bucket_i, std::size_t minFreeSize = 0);
 
     /**
-     * @brief Ensure the cache returns to a correct state. Currently it wipes the cache.
+     * @brief Ensure the cache returns to a correct state. This must be called from an exception handler:
+     * if the exception is a CorruptedCacheException, only the inconsistent bucket is reset with quarantineBucket(),
+     * otherwise the whole cache is wiped.
      **/
     void recoverFromInconsistentState(
 #ifdef NATRON_CACHE_INTERPROCESS_ROBUST
@@ -1276,11 +1951,65 @@ struct CachePrivate
 
     void freeAllocatedTiles(U64 entryHash, const std::vector<U64>& tilesToAlloc, const std::vector<std::pair<U64, void*> >& allocatedTiles);
 
+    /**
+     * @brief Queue the tiles of the given entry for compression to the compressedTier. The bucket owning the entry must be locked.
+     * This function may throw a AbandonnedLockException
+     **/
+    void compressEntryTiles(U64 entryHash, const EntryType& entry);
+
     /**
      * @brief Scan for existing tile files. This function throws an exception if the cache is corrupted
      **/
     void reOpenTileStorage();
 
+    /**
+     * @brief Records the time elapsed since the creation of the cache the first time a look-up finds a cached entry.
+     **/
+    void recordFirstHit();
+
+    bool isStatisticsEnabled() const
+    {
+        return (int)statisticsEnabled != 0;
+    }
+
+    /**
+     * @brief Functions updating bucketStats. They should only be called if isStatisticsEnabled() returns true.
+     **/
+    void recordLookup(int bucket_i, CacheEntryLockerBase::CacheEntryStatusEnum status, double seconds);
+    void recordPendingEntryWait(int bucket_i, double seconds);
+    void recordLockContention(int bucket_i);
+    void recordTilesAllocation(int bucket_i, std::size_t nTiles, double seconds);
+    void recordEviction(int bucket_i, std::size_t nBytes);
+
+    /**
+     * @brief Checks the consistency of the given bucket if this process did not do it yet, and quarantines the bucket
+     * if it is inconsistent. This is called by the verification thread and before any look-up in the bucket,
+     * so that entries of a bucket are never read before it is verified.
+     * No lock of the cache may be taken by the caller.
+     **/
+    void ensureBucketVerified(int bucket_i);
+
+    /**
+     * @brief Resets the ToC of the given bucket: all its entries are dropped, but unlike recoverFromInconsistentState()
+     * the other buckets are kept. The tiles that are not used anymore are then given back to the buckets owning them.
+     **/
+    void quarantineBucket(int bucket_i);
+
+    /**
+     * @brief Adds to the free tiles of each bucket the tiles it owns that are not referenced by any entry.
+     * The tilesStorageMutex is taken in write mode, hence bucket locks can only be tried.
+     * Nothing is reclaimed if a bucket is inconsistent: this is done once that bucket gets quarantined too.
+     * @returns False if a bucket lock could not be taken, in which case it should be tried again later.
+     *
+     * This function may throw a AbandonnedLockException
+     **/
+    bool reclaimUnusedTiles();
+
+    /**
+     * @brief Entry point of the verificationThread: verifies all buckets unless the cache gets destroyed in the meantime.
+     **/
+    static void runBucketsVerification(boost::weak_ptr<Cache<persistent> > cache);
+
 };
 
 
@@ -1301,7 +2030,7 @@ public:
         // The bucketMutex must be taken in write mode
 
         if (bucket->ipc->bucketState != eBucketStateOk) {
-            throw CorruptedCacheException();
+            throw CorruptedCacheException(bucket->bucketIndex);
         }
 
         bucket->ipc->bucketState = eBucketStateInconsistent;
@@ -1371,6 +2100,28 @@ void createTimedLock(CachePrivate* imp,  boost::scoped_ptr<LOCK>& lock, typename
 }
 #endif // #ifdef NATRON_CACHE_INTERPROCESS_ROBUST
 
+/**
+ * @brief Same as createTimedLock but gives up if the mutex cannot be taken right away.
+ * This is used to take bucket locks whilst holding the tilesStorageMutex in write mode: other threads
+ * may hold a bucket lock while waiting for the tilesStorageMutex, so waiting could dead-lock.
+ **/
+template <bool persistent, typename LOCK>
+bool tryCreateLock(CachePrivate<persistent>* imp, boost::scoped_ptr<LOCK>& lock, typename LOCK::mutex_type* mutex)
+{
+#ifndef NATRON_CACHE_INTERPROCESS_ROBUST
+    Q_UNUSED(imp);
+    lock.reset(new LOCK(*mutex, boost::try_to_lock));
+    if (!lock->owns_lock()) {
+#else
+    lock.reset(new LOCK(*mutex, imp->timerFrequency));
+    if (!lock->timed_lock(1)) {
+#endif
+        lock.reset();
+        return false;
+    }
+    return true;
+}
+
 template <bool persistent>
 CacheEntryLockerPrivate<persistent>::CacheEntryLockerPrivate(CacheEntryLocker<persistent>* publicInterface, const boost::shared_ptr<Cache<persistent> >& cache, const CacheEntryBasePtr& entry)
 : _publicInterface(publicInterface)
@@ -1379,6 +2130,7 @@ CacheEntryLockerPrivate<persistent>::CacheEntryLockerPrivate(CacheEntryLocker<pe
 , hash(entry->getHashKey())
 , bucket(0)
 , status(CacheEntryLockerBase::eCacheEntryStatusMustCompute)
+, computeTimer()
 {
 
 }
@@ -1405,11 +2157,20 @@ CacheEntryLocker<persistent>::create(const boost::shared_ptr<Cache<persistent> >
     boost::scoped_ptr<SharedMemoryProcessLocalReadLocker> shmAccess(new SharedMemoryProcessLocalReadLocker(cache->_imp.get()));
 #endif
 
+    boost::scoped_ptr<TimeLapse> lookupTimer;
+    if (cache->_imp->isStatisticsEnabled()) {
+        lookupTimer.reset(new TimeLapse);
+    }
+
     // Lookup and find an existing entry.
     // Never take over an entry upon timeout.
     std::size_t timeSpentWaiting = 0;
     ret->_imp->lookupAndSetStatus(&timeSpentWaiting, 0);
 
+    if (lookupTimer) {
+        cache->_imp->recordLookup(ret->_imp->bucket->bucketIndex, ret->_imp->status, lookupTimer->getTimeSinceCreation());
+    }
+
     return ret;
 }
 
@@ -1676,6 +2437,173 @@ CacheBucket<persistent>::tryCacheLookupImpl(U64 hash, typename EntriesMap::itera
     return *found != (*storage)->end();
 } // tryCacheLookupImpl
 
+template <bool persistent>
+bool
+CacheBucket<persistent>::checkConsistency(int* maxFileIndex)
+{
+    boost::shared_ptr<Cache<persistent> > c = cache.lock();
+    *maxFileIndex = -1;
+
+    // Since the bucketMutex is taken, no operation may be in progress on the bucket: if the state is not ok,
+    // a process stopped in the middle of an operation.
+    if (ipc->bucketState != eBucketStateOk || ipc->version != NATRON_MEMORY_SEGMENT_ENTRY_HEADER_VERSION) {
+        return false;
+    }
+
+    // Each node of the LRU list must be the node of an entry of this bucket
+    {
+        boost::scoped_ptr<ExclusiveLock> lruWriteLock;
+#ifndef NATRON_CACHE_INTERPROCESS_ROBUST
+        lruWriteLock.reset(new ExclusiveLock(c->_imp->ipc->bucketsData[bucketIndex].lruListMutex));
+#else
+        createTimedLock<ExclusiveLock>(c->_imp.get(), lruWriteLock, &c->_imp->ipc->bucketsData[bucketIndex].lruListMutex);
+#endif
+
+        std::size_t nNodes = 0;
+        LRUListNodePtr prev(0);
+        for (LRUListNodePtr it = ipc->lruListFront; it; it = it->next) {
+            // More nodes than entries: the list loops
+            if (++nNodes > ipc->entriesMap.size()) {
+                return false;
+            }
+            if (it->prev != prev || CacheBase::getBucketCacheBucketIndex(it->hash) != bucketIndex) {
+                return false;
+            }
+            typename EntriesMap::iterator found = ipc->entriesMap.find(it->hash);
+            if (found == ipc->entriesMap.end() || !found->second || &found->second->lruNode != getRawPointer(it)) {
+                return false;
+            }
+            prev = it;
+        }
+        if (ipc->lruListBack != prev) {
+            return false;
+        }
+
+        // Every entry must be in exactly one of the 2Q queues
+        const LRUListNodePtr queueFronts[2] = {ipc->probationFront, ipc->protectedFront};
+        const LRUListNodePtr queueBacks[2] = {ipc->probationBack, ipc->protectedBack};
+        const std::size_t queueCounts[2] = {ipc->probationCount, ipc->protectedCount};
+        if (queueCounts[0] + queueCounts[1] != nNodes) {
+            return false;
+        }
+        for (int q = 0; q < 2; ++q) {
+            std::size_t nQueueNodes = 0;
+            prev = 0;
+            for (LRUListNodePtr it = queueFronts[q]; it; it = it->next) {
+                if (++nQueueNodes > queueCounts[q]) {
+                    return false;
+                }
+                if (it->prev != prev) {
+                    return false;
+                }
+                typename EntriesMap::iterator found = ipc->entriesMap.find(it->hash);
+                if (found == ipc->entriesMap.end() || !found->second || &found->second->queueNode != getRawPointer(it) || found->second->isProtected != (q == 1)) {
+                    return false;
+                }
+                prev = it;
+            }
+            if (nQueueNodes != queueCounts[q] || queueBacks[q] != prev) {
+                return false;
+            }
+        }
+    } // lruWriteLock
+
+    // Tiles used by entries may belong to any bucket
+    for (typename EntriesMap::const_iterator it = ipc->entriesMap.begin(); it != ipc->entriesMap.end(); ++it) {
+        for (ExternalSegmentTypeULongLongList::const_iterator it2 = it->second->tileIndices.begin(); it2 != it->second->tileIndices.end(); ++it2) {
+            U32 fileIndex = (U32)*it2;
+            U32 tileIndex = (U32)(*it2 >> 32);
+            if (tileIndex >= NATRON_NUM_TILES_PER_FILE) {
+                return false;
+            }
+            *maxFileIndex = std::max(*maxFileIndex, (int)fileIndex);
+        }
+    }
+
+    // Free tiles must be in the range of tiles owned by this bucket
+    for (U64_Set::const_iterator it = ipc->freeTiles.begin(); it != ipc->freeTiles.end(); ++it) {
+        U32 fileIndex = (U32)*it;
+        U32 tileIndex = (U32)(*it >> 32);
+        if (tileIndex < (U32)bucketIndex * NATRON_NUM_TILES_PER_BUCKET_FILE || tileIndex >= (U32)(bucketIndex + 1) * NATRON_NUM_TILES_PER_BUCKET_FILE) {
+            return false;
+        }
+        *maxFileIndex = std::max(*maxFileIndex, (int)fileIndex);
+    }
+    return true;
+} // checkConsistency
+
+template <bool persistent>
+U64
+CacheBucket<persistent>::selectEntryToEvict(CacheEvictionPolicyEnum policy)
+{
+    boost::shared_ptr<Cache<persistent> > c = cache.lock();
+
+    // The bucket mutex is assumed to be taken in write mode
+    assert(!c->_imp->ipc->bucketsData[bucketIndex].bucketMutex.try_lock());
+
+    // Lock the LRU list
+    boost::scoped_ptr<ExclusiveLock> lruWriteLock;
+#ifndef NATRON_CACHE_INTERPROCESS_ROBUST
+    lruWriteLock.reset(new ExclusiveLock(c->_imp->ipc->bucketsData[bucketIndex].lruListMutex));
+#else
+    createTimedLock<ExclusiveLock>(c->_imp.get(), lruWriteLock, &c->_imp->ipc->bucketsData[bucketIndex].lruListMutex);
+#endif
+
+    // The least recently used entry is the one at the front of the linked list
+    if (!ipc->lruListFront) {
+        return 0;
+    }
+    U64 candidateHash = ipc->lruListFront->hash;
+    if (policy == eCacheEvictionPolicyLRU) {
+        return candidateHash;
+    }
+
+    if (policy == eCacheEvictionPolicyScanResistant) {
+        // 2Q: evict from the probation queue while it holds more than its share of the bucket, then from the protected queue.
+        std::size_t nEntries = ipc->probationCount + ipc->protectedCount;
+        bool evictFromProbation = ipc->probationFront && ( !ipc->protectedFront || (ipc->probationCount * 100 > nEntries * NATRON_CACHE_2Q_PROBATION_PERCENT) );
+        if (evictFromProbation) {
+            // The caller evicts the entry: remember its hash so that it is protected if it is inserted again
+            U64 hash = ipc->probationFront->hash;
+            ipc->addGhostHash(hash);
+            return hash;
+        } else if (ipc->protectedFront) {
+            return ipc->protectedFront->hash;
+        }
+        return candidateHash;
+    }
+
+    double candidateScore = std::numeric_limits<double>::infinity();
+    int nCandidates = 0;
+    for (LRUListNodePtr it = ipc->lruListFront; it && nCandidates < NATRON_CACHE_EVICTION_CANDIDATES_COUNT; it = it->next, ++nCandidates) {
+
+        typename EntriesMap::iterator found;
+        EntriesMap* storage;
+        if (!tryCacheLookupImpl(it->hash, &found, &storage)) {
+            continue;
+        }
+        const EntryType* entry = found->second.get();
+
+        switch (policy) {
+            case eCacheEvictionPolicyCostAware: {
+                // Evict the entry that is the cheapest to re-compute per byte it takes.
+                // Entries that are often accessed are weighted up since evicting them would
+                // likely incur their compute cost again.
+                std::size_t entrySize = entry->size + entry->tileIndices.size() * NATRON_TILE_SIZE_BYTES;
+                double score = entry->computeCost * (1. + entry->nHits) / std::max(entrySize, (std::size_t)1);
+                if (score < candidateScore) {
+                    candidateScore = score;
+                    candidateHash = it->hash;
+                }
+            }   break;
+            case eCacheEvictionPolicyLRU:
+            case eCacheEvictionPolicyScanResistant:
+                break;
+        }
+    }
+    return candidateHash;
+} // selectEntryToEvict
+
 template <>
 typename CacheBucket<false>::ShmEntryReadRetCodeEnum
 CacheBucket<false>::deserializeEntry(EntryType* /*cacheEntry*/, const CacheEntryBasePtr& /*processLocalEntry*/, U64 /*hash*/, bool /*hasWriteRights*/) { return eShmEntryReadRetCodeOk; }
@@ -1778,6 +2706,15 @@ CacheBucket<persistent>::readFromSharedMemoryEntryImpl(EntryType* cacheEntry,
         createTimedLock<ExclusiveLock>(c->_imp.get(), lruWriteLock, &c->_imp->ipc->bucketsData[bucketIndex].lruListMutex);
 #endif
 
+        ++cacheEntry->nHits;
+        ++evictionStats[c->_imp->getEvictionPolicy()].nHits;
+        c->_imp->recordFirstHit();
+
+        // Only account the first regular look-up of a prefetched entry, look-ups from other prefetch renders do not count
+        if (cacheEntry->prefetchState == MemorySegmentEntryHeaderBase::eEntryPrefetchStatePrefetched && !processLocalEntry->isPrefetched()) {
+            cacheEntry->prefetchState = MemorySegmentEntryHeaderBase::eEntryPrefetchStateHit;
+        }
+
         assert(ipc->lruListBack && !ipc->lruListBack->next);
         if (getRawPointer(ipc->lruListBack) != &cacheEntry->lruNode) {
 
@@ -1788,6 +2725,21 @@ CacheBucket<persistent>::readFromSharedMemoryEntryImpl(EntryType* cacheEntry,
             insertLinkedListNode(entryNode, ipc->lruListBack, LRUListNodePtr(0));
             ipc->lruListBack = entryNode;
         }
+
+        // An entry accessed again moves to the back of the protected queue of the 2Q policy
+        LRUListNodePtr queueNodePtr(&cacheEntry->queueNode);
+        if (cacheEntry->isProtected) {
+            if (ipc->protectedBack != queueNodePtr) {
+                removeQueueNode(queueNodePtr, &ipc->protectedFront, &ipc->protectedBack);
+                appendQueueNode(queueNodePtr, &ipc->protectedFront, &ipc->protectedBack);
+            }
+        } else {
+            removeQueueNode(queueNodePtr, &ipc->probationFront, &ipc->probationBack);
+            --ipc->probationCount;
+            appendQueueNode(queueNodePtr, &ipc->protectedFront, &ipc->protectedBack);
+            ++ipc->protectedCount;
+            cacheEntry->isProtected = true;
+        }
     } // lruWriteLock
 
     return eShmEntryReadRetCodeOk;
@@ -1836,6 +2788,9 @@ CacheBucket<persistent>::deallocateCacheEntryImpl(typename EntriesMap::iterator
         createTimedLock<Sharable_ReadLock>(c->_imp.get(), tileAlignedFileLock, &c->_imp->ipc->tilesStorageMutex);
 #endif
 
+        // Tiles to give back to each bucket free list
+        std::map<int, std::vector<U64> > freedTilesPerBucket;
+
         for (ExternalSegmentTypeULongLongList::const_iterator it = cacheEntryIt->second->tileIndices.begin(); it != cacheEntryIt->second->tileIndices.end(); ++it) {
 
             U32 fileIndex, tileIndex;
@@ -1855,8 +2810,15 @@ CacheBucket<persistent>::deallocateCacheEntryImpl(typename EntriesMap::iterator
             }
 
             // Retrieve the bucket index directly from the tile index: we know that each file contains exactly NATRON_NUM_TILES_PER_BUCKET_FILE * NATRON_CACHE_BUCKETS_COUNT
-            int tileBucketIndex = tileIndex % NATRON_NUM_TILES_PER_BUCKET_FILE;
+            // and that the tiles of bucket i are in [i * NATRON_NUM_TILES_PER_BUCKET_FILE, (i + 1) * NATRON_NUM_TILES_PER_BUCKET_FILE[
+            int tileBucketIndex = tileIndex / NATRON_NUM_TILES_PER_BUCKET_FILE;
             assert(tileBucketIndex >= 0 && tileBucketIndex < NATRON_CACHE_BUCKETS_COUNT);
+            freedTilesPerBucket[tileBucketIndex].push_back(*it);
+        }
+
+        for (std::map<int, std::vector<U64> >::const_iterator it = freedTilesPerBucket.begin(); it != freedTilesPerBucket.end(); ++it) {
+            const int tileBucketIndex = it->first;
+
             // Take the bucket mutex except if this is the current bucket
             boost::scoped_ptr<Sharable_WriteLock> bucketWriteLock;
             if (tileBucketIndex != bucketIndex) {
@@ -1867,16 +2829,18 @@ CacheBucket<persistent>::deallocateCacheEntryImpl(typename EntriesMap::iterator
 #endif
             }
 
-            // Make this tile free again
+            // Make the tiles free again in the bucket that owns them
+            for (std::vector<U64>::const_iterator it2 = it->second.begin(); it2 != it->second.end(); ++it2) {
+                std::pair<U64_Set::iterator, bool>  insertOk = c->_imp->buckets[tileBucketIndex].ipc->freeTiles.insert(*it2);
+                assert(insertOk.second);
+                (void)insertOk;
+            }
 #ifdef CACHE_TRACE_TILES_ALLOCATION
-            qDebug() << "Bucket" << bucketIndex << ": tile freed" << tileIndex << " Nb free tiles left:" << c->_imp->buckets[tileBucketIndex].ipc->freeTiles.size();
+            qDebug() << "Bucket" << bucketIndex << ":" << it->second.size() << "tiles freed in bucket" << tileBucketIndex << " Nb free tiles left:" << c->_imp->buckets[tileBucketIndex].ipc->freeTiles.size();
 #endif
-            // free tiles are all shared in the FIRST bucket
-            std::pair<U64_Set::iterator, bool>  insertOk = c->_imp->buckets[tileBucketIndex].ipc->freeTiles.insert(*it);
-            assert(insertOk.second);
-            (void)insertOk;
         }
         cacheEntryIt->second->tileIndices.clear();
+        cacheEntryIt->second->tileLocalIndices.clear();
     }
 
 
@@ -1896,11 +2860,23 @@ CacheBucket<persistent>::deallocateCacheEntryImpl(typename EntriesMap::iterator
             ipc->lruListBack = cacheEntryIt->second->lruNode.prev;
         }
         if (&cacheEntryIt->second->lruNode == getRawPointer(ipc->lruListFront)) {
-            ipc->lruListFront = cacheEntryIt->second->lruNode.prev;
+            ipc->lruListFront = cacheEntryIt->second->lruNode.next;
         }
 
         // Remove this entry's node from the list
         disconnectLinkedListNode(&cacheEntryIt->second->lruNode);
+
+        // Remove it from its 2Q queue. Entries that are still being computed were not inserted in any queue.
+        if (cacheEntryIt->second->status == EntryType::eEntryStatusReady) {
+            LRUListNodePtr queueNodePtr(&cacheEntryIt->second->queueNode);
+            if (cacheEntryIt->second->isProtected) {
+                removeQueueNode(queueNodePtr, &ipc->protectedFront, &ipc->protectedBack);
+                --ipc->protectedCount;
+            } else {
+                removeQueueNode(queueNodePtr, &ipc->probationFront, &ipc->probationBack);
+                --ipc->probationCount;
+            }
+        }
     }
     try {
         tocFileManager->destroy_ptr<EntryType>(cacheEntryIt->second.get());
@@ -2079,6 +3055,7 @@ CacheEntryLockerPrivate<persistent>::lookupAndSetStatusInternal(bool hasWriteRig
         assert(hasWriteRights);
         found->second->status = MemorySegmentEntryHeaderBase::eEntryStatusPending;
         status = CacheEntryLockerBase::eCacheEntryStatusMustCompute;
+        computeTimer.reset(new TimeLapse);
     }
 
     // If the entry is still pending, that means the thread that originally should have computed this entry failed to do so.
@@ -2207,6 +3184,10 @@ CacheEntryLockerPrivate<persistent>::lookupAndCreate(boost::scoped_ptr<Sharable_
 
     cacheEntry->pluginID.append(processLocalEntry->getKey()->getHolderPluginID().c_str());
 
+    if (processLocalEntry->isPrefetched()) {
+        cacheEntry->prefetchState = MemorySegmentEntryHeaderBase::eEntryPrefetchStatePrefetched;
+    }
+
     // Lock the statusMutex: this will lock-out other threads interested in this entry.
     // This mutex is unlocked in deallocateCacheEntryImpl() or in insertInCache()
     // We must get the lock since we are the first thread to create it and we own the write lock on the segmentMutex
@@ -2223,6 +3204,9 @@ CacheEntryLockerPrivate<persistent>::lookupAndCreate(boost::scoped_ptr<Sharable_
     // Note that this value has no meaning outside this process and is set back to 0 in insertInCache()
     cacheEntry->computeThreadMagic = reinterpret_cast<U64>(QThread::currentThread());
 
+    ++bucket->evictionStats[cache->_imp->getEvictionPolicy()].nMisses;
+    computeTimer.reset(new TimeLapse);
+
     return CacheEntryLockerPrivate::eLookupAndCreateRetCodeCreated;
 } // lookupAndCreate
 
@@ -2267,6 +3251,9 @@ CacheEntryLockerPrivate<persistent>::lookupAndSetStatus(std::size_t* timeSpentWa
         bucket = &cache->_imp->buckets[CacheBase::getBucketCacheBucketIndex(hash)];
     }
 
+    // Do not wait for the verification thread to reach this bucket
+    cache->_imp->ensureBucketVerified(bucket->bucketIndex);
+
 #ifdef NATRON_CACHE_INTERPROCESS_ROBUST
     SHMReadLockerPtr shmAccess(new SharedMemoryProcessLocalReadLocker(cache->_imp.get()));
 #endif
@@ -2283,7 +3270,15 @@ CacheEntryLockerPrivate<persistent>::lookupAndSetStatus(std::size_t* timeSpentWa
             // Take the bucket lock in read mode
             boost::scoped_ptr<Sharable_ReadLock> bucketReadLock;
 #ifndef NATRON_CACHE_INTERPROCESS_ROBUST
-            bucketReadLock.reset(new Sharable_ReadLock(cache->_imp->ipc->bucketsData[bucket->bucketIndex].bucketMutex));
+            if (cache->_imp->isStatisticsEnabled()) {
+                bucketReadLock.reset(new Sharable_ReadLock(cache->_imp->ipc->bucketsData[bucket->bucketIndex].bucketMutex, boost::try_to_lock));
+                if (!bucketReadLock->owns_lock()) {
+                    cache->_imp->recordLockContention(bucket->bucketIndex);
+                    bucketReadLock->lock();
+                }
+            } else {
+                bucketReadLock.reset(new Sharable_ReadLock(cache->_imp->ipc->bucketsData[bucket->bucketIndex].bucketMutex));
+            }
 #else
             createTimedLock<Sharable_ReadLock>(cache->_imp.get(), bucketReadLock, &cache->_imp->ipc->bucketsData[bucket->bucketIndex].bucketMutex);
 #endif
@@ -2476,6 +3471,10 @@ CacheEntryLockerPrivate<persistent>::insertInternal()
         cacheEntryIt->second->lruNode.next = 0;
         cacheEntryIt->second->lruNode.hash = hash;
 
+        if (computeTimer) {
+            cacheEntryIt->second->computeCost += computeTimer->getTimeSinceCreation();
+        }
+
         LRUListNodePtr thisNodePtr = LRUListNodePtr(&cacheEntryIt->second->lruNode);
         if (!bucket->ipc->lruListBack) {
             assert(!bucket->ipc->lruListFront);
@@ -2493,6 +3492,20 @@ CacheEntryLockerPrivate<persistent>::insertInternal()
             bucket->ipc->lruListBack = thisNodePtr;
 
         }
+
+        // Insert in the 2Q queues: an entry that was evicted from the probation queue recently is re-used,
+        // protect it right away.
+        cacheEntryIt->second->queueNode.hash = hash;
+        LRUListNodePtr queueNodePtr = LRUListNodePtr(&cacheEntryIt->second->queueNode);
+        if ( bucket->ipc->takeGhostHash(hash) ) {
+            cacheEntryIt->second->isProtected = true;
+            appendQueueNode(queueNodePtr, &bucket->ipc->protectedFront, &bucket->ipc->protectedBack);
+            ++bucket->ipc->protectedCount;
+        } else {
+            cacheEntryIt->second->isProtected = false;
+            appendQueueNode(queueNodePtr, &bucket->ipc->probationFront, &bucket->ipc->probationBack);
+            ++bucket->ipc->probationCount;
+        }
     } // lruWriteLock
     cacheEntryIt->second->computeThreadMagic = 0;
     cacheEntryIt->second->status = MemorySegmentEntryHeaderBase::eEntryStatusReady;
@@ -2581,7 +3594,8 @@ CacheEntryLocker<persistent>::insertInCache()
 
 template <bool persistent>
 CacheEntryLockerBase::CacheEntryStatusEnum
-CacheEntryLocker<persistent>::waitForPendingEntry(std::size_t timeout)
+CacheEntryLocker<persistent>::waitForPendingEntry(std::size_t timeout,
+                                                  const CancellationTokenPtr& cancellationToken)
 {
 
     // The thread can only wait if the status was set to eCacheEntryStatusComputationPending
@@ -2619,6 +3633,11 @@ CacheEntryLocker<persistent>::waitForPendingEntry(std::size_t timeout)
     std::size_t timeSpentWaitingForPendingEntryMS = 0;
     std::size_t timeToWaitMS = 20;
 
+    boost::scoped_ptr<TimeLapse> waitTimer;
+    if (_imp->cache->_imp->isStatisticsEnabled()) {
+        waitTimer.reset(new TimeLapse);
+    }
+
     do {
         // Look up the cache and sleep if not found
         _imp->lookupAndSetStatus(&timeSpentWaitingForPendingEntryMS, timeout);
@@ -2627,11 +3646,18 @@ CacheEntryLocker<persistent>::waitForPendingEntry(std::size_t timeout)
 
             timeSpentWaitingForPendingEntryMS += timeToWaitMS;
             if (timeout == 0 || timeSpentWaitingForPendingEntryMS < timeout) {
-                CacheEntryLockerBase::sleep_milliseconds(timeToWaitMS);
-
-                // Increase the time to wait at the next iteration
-                timeToWaitMS *= 1.2;
-
+                if (!cancellationToken) {
+                    CacheEntryLockerBase::sleep_milliseconds(timeToWaitMS);
+
+                    // Increase the time to wait at the next iteration
+                    timeToWaitMS *= 1.2;
+                } else if ( !cancellationToken->waitForCancellation(timeToWaitMS) ) {
+                    timeToWaitMS *= 1.2;
+                } else {
+                    // The render is aborted: the entry should be released shortly, do not back off anymore
+                    timeToWaitMS = NATRON_CACHE_CANCELLED_WAIT_POLL_MS;
+                    CacheEntryLockerBase::sleep_milliseconds(timeToWaitMS);
+                }
             }
         }
 
@@ -2639,6 +3665,10 @@ CacheEntryLocker<persistent>::waitForPendingEntry(std::size_t timeout)
 
     // Concurrency resumes!
 
+    if (waitTimer) {
+        _imp->cache->_imp->recordPendingEntryWait(_imp->bucket->bucketIndex, waitTimer->getTimeSinceCreation());
+    }
+
     if (hasReleasedThread) {
         QThreadPool::globalInstance()->reserveThread();
     }
@@ -2712,8 +3742,34 @@ Cache<persistent>::Cache(bool enableTileStorage)
 template <bool persistent>
 Cache<persistent>::~Cache()
 {
+    if (_imp->verificationThread) {
+        // The verification thread only holds a weak reference to the cache: it stops at the next bucket.
+        // It may also be the thread that released the last reference.
+        if (_imp->verificationThread->get_id() == boost::this_thread::get_id()) {
+            _imp->verificationThread->detach();
+        } else {
+            _imp->verificationThread->join();
+        }
+        _imp->verificationThread.reset();
+    }
 
-}
+    // Prefetch threads own the queue, they may be detached
+    std::vector<boost::shared_ptr<boost::thread> > prefetchThreads;
+    {
+        boost::unique_lock<boost::mutex> k(_imp->prefetchQueue->lock);
+        _imp->prefetchQueue->mustQuit = true;
+        _imp->prefetchQueue->cancelAllTasks();
+        prefetchThreads.swap(_imp->prefetchQueue->threads);
+    }
+    _imp->prefetchQueue->cond.notify_all();
+    for (std::size_t i = 0; i < prefetchThreads.size(); ++i) {
+        if (prefetchThreads[i]->get_id() == boost::this_thread::get_id()) {
+            prefetchThreads[i]->detach();
+        } else {
+            prefetchThreads[i]->join();
+        }
+    }
+} // ~Cache
 
 template <bool persistent>
 std::string
@@ -2893,6 +3949,7 @@ Cache<persistent>::initialize(const boost::shared_ptr<Cache<persistent> >& thisS
     } // for each bucket
 
     // Remap each bucket, this may potentially fail
+    std::vector<int> resetBuckets;
     for (int i = 0; i < NATRON_CACHE_BUCKETS_COUNT; ++i) {
         try {
 
@@ -2908,12 +3965,18 @@ Cache<persistent>::initialize(const boost::shared_ptr<Cache<persistent> >& thisS
                 _imp->buckets[i].remapToCMemoryFile(*tocWriteLock, 0);
             }
         } catch (...) {
-            // Any exception caught here means the cache is corrupted
-            _imp->recoverFromInconsistentState(
+            // Any exception caught here means the bucket is corrupted: re-create it empty.
+            // Its free tiles are given back once the tiles storage is opened below.
+            try {
+                _imp->clearCacheBucket(i);
+                resetBuckets.push_back(i);
+            } catch (...) {
+                _imp->recoverFromInconsistentState(
 #ifdef NATRON_CACHE_INTERPROCESS_ROBUST
-                                               shmReader
+                                                   shmReader
 #endif
-                                               );
+                                                   );
+            }
 
         }
     } // for each bucket
@@ -2945,9 +4008,29 @@ Cache<persistent>::initialize(const boost::shared_ptr<Cache<persistent> >& thisS
         } catch (const CorruptedCacheException&) {
             clear();
         }
+
+        for (std::size_t i = 0; i < resetBuckets.size(); ++i) {
+            _imp->quarantineBucket(resetBuckets[i]);
+        }
     } // persistent
-    
-    
+
+    {
+        boost::unique_lock<boost::mutex> k(_imp->warmStartStatsMutex);
+        _imp->warmStartStats.initializationDuration = _imp->startupTimer.getTimeSinceCreation();
+    }
+
+    if (persistent) {
+        // Look-ups can be served right away: the buckets reopened from disk are verified in the background
+        // or on their first look-up, whichever comes first.
+        _imp->verificationThread.reset(new boost::thread(&CachePrivate<persistent>::runBucketsVerification, boost::weak_ptr<Cache<persistent> >(thisShared)));
+    } else {
+        // Nothing was read from disk
+        for (int i = 0; i < NATRON_CACHE_BUCKETS_COUNT; ++i) {
+            _imp->buckets[i].verified.fetchAndStoreRelease(1);
+        }
+        boost::unique_lock<boost::mutex> k(_imp->warmStartStatsMutex);
+        _imp->warmStartStats.nBucketsVerified = NATRON_CACHE_BUCKETS_COUNT;
+    }
 
 } // initialize
 
@@ -3147,15 +4230,33 @@ static int getBucketIndexForTile(U64 entryHash, U64 tileIndex)
     //(Cache::getBucketCacheBucketIndex(entryHash) + (*tilesToAlloc)[i]) % NATRON_CACHE_BUCKETS_COUNT;
 }
 
+// For each bucket index, the positions in the tiles vector of the tiles that map to this bucket
+typedef std::map<int, std::vector<std::size_t> > TilesPerBucketMap;
+
+/**
+ * @brief Dispatch the given local tile indices into the bucket they belong to so that
+ * callers can process all tiles of a bucket under a single lock.
+ **/
+static void groupTilesPerBucket(U64 entryHash, const std::vector<U64>& localTileIndices, TilesPerBucketMap* tilesPerBucket)
+{
+    for (std::size_t i = 0; i < localTileIndices.size(); ++i) {
+        int bucketIndex = getBucketIndexForTile(entryHash, localTileIndices[i]);
+        (*tilesPerBucket)[bucketIndex].push_back(i);
+    }
+}
+
 template <bool persistent>
 void
 CachePrivate<persistent>::freeAllocatedTiles(U64 entryHash, const std::vector<U64>& tilesToAlloc, const std::vector<std::pair<U64, void*> >& allocatedTiles)
 {
     // If somehow the cache entry is no longer in the cache, we must make free again all tile indices
-    for (std::size_t i = 0; i < tilesToAlloc.size(); ++i) {
+    TilesPerBucketMap tilesPerBucket;
+    groupTilesPerBucket(entryHash, tilesToAlloc, &tilesPerBucket);
+
+    for (TilesPerBucketMap::const_iterator bucketIt = tilesPerBucket.begin(); bucketIt != tilesPerBucket.end(); ++bucketIt) {
 
         // Recover the bucket index for this tile
-        int bucketIndex = getBucketIndexForTile(entryHash, tilesToAlloc[i]);
+        int bucketIndex = bucketIt->first;
         CacheBucket<persistent>& tileBucket = buckets[bucketIndex];
 
         boost::scoped_ptr<Sharable_WriteLock> bucketWriteLock;
@@ -3174,14 +4275,67 @@ CachePrivate<persistent>::freeAllocatedTiles(U64 entryHash, const std::vector<U6
 #endif
         }
 
-        // Re-insert the tile index in the freeTiles list. Since we are adding data, this may throw an exception
+        // Re-insert the tile indices in the freeTiles list. Since we are adding data, this may throw an exception
         // because the ToC might run out of memory. In this case, we grow it and try again.
-        tileBucket.ipc->freeTiles.insert(allocatedTiles[i].first);
+        for (std::vector<std::size_t>::const_iterator it = bucketIt->second.begin(); it != bucketIt->second.end(); ++it) {
+            tileBucket.ipc->freeTiles.insert(allocatedTiles[*it].first);
+        }
 
-    } // for each allocated tile
+    } // for each bucket
 
 } // freeAllocatedTiles
 
+template <bool persistent>
+void
+CachePrivate<persistent>::compressEntryTiles(U64 entryHash, const EntryType& entry)
+{
+    CacheCompressedTier::PendingEntryTiles entryTiles;
+    entryTiles.entryHash = entryHash;
+    entryTiles.compressionLevel = 1;
+    {
+        boost::unique_lock<boost::mutex> k(compressedTier.lock);
+        switch (compressedTier.compression) {
+            case eCacheCompressionNone:
+                return;
+            case eCacheCompressionFast:
+                entryTiles.compressionLevel = 1;
+                break;
+            case eCacheCompressionHigh:
+                entryTiles.compressionLevel = 9;
+                break;
+        }
+    }
+
+    if (entry.tileIndices.empty() || entry.tileIndices.size() != entry.tileLocalIndices.size()) {
+        return;
+    }
+
+    // Take the tilesStorageMutex in read mode so the tiles storage does not change while we read it
+    boost::scoped_ptr<Sharable_ReadLock> tileReadLock;
+#ifndef NATRON_CACHE_INTERPROCESS_ROBUST
+    tileReadLock.reset(new Sharable_ReadLock(ipc->tilesStorageMutex));
+#else
+    createTimedLock<Sharable_ReadLock>(this, tileReadLock, &ipc->tilesStorageMutex);
+#endif
+
+    // Only copy the tiles here since the bucket is locked: they are compressed by the compression thread of the tier
+    std::size_t entryTilesSize = 0;
+    ExternalSegmentTypeULongLongList::const_iterator localIt = entry.tileLocalIndices.begin();
+    for (ExternalSegmentTypeULongLongList::const_iterator it = entry.tileIndices.begin(); it != entry.tileIndices.end(); ++it, ++localIt) {
+        U32 fileIndex, tileIndex;
+        getTileIndex(*it, &tileIndex, &fileIndex);
+        if (fileIndex >= tilesStorage.size()) {
+            continue;
+        }
+        const char* tileData = tilesStorage[fileIndex]->getData() + tileIndex * NATRON_TILE_SIZE_BYTES;
+        entryTiles.tiles.push_back( std::make_pair( *localIt, QByteArray(tileData, NATRON_TILE_SIZE_BYTES) ) );
+        entryTilesSize += NATRON_TILE_SIZE_BYTES;
+    }
+    if (!entryTiles.tiles.empty()) {
+        compressedTier.queueEntryTiles(&entryTiles, entryTilesSize);
+    }
+} // compressEntryTiles
+
 
 template <bool persistent>
 bool
@@ -3232,102 +4386,137 @@ Cache<persistent>::retrieveAndLockTiles(const CacheEntryBasePtr& entry,
         if (tilesToAlloc && tilesToAlloc->size() > 0) {
             allocatedTilesData->resize(tilesToAlloc->size());
 
-            for (std::size_t i = 0; i < tilesToAlloc->size(); ++i) {
-
-                // The bucket index for the tile depends on the bucket of the cache entry + a number based off the tile index so that
-                // we ensure that we distribute uniformly all tiles across buckets.
-                int bucketIndex = getBucketIndexForTile(entryHash, (*tilesToAlloc)[i]);
-
-                CacheBucket<persistent>& tileBucket = _imp->buckets[bucketIndex];
-
-                boost::scoped_ptr<Sharable_WriteLock> bucketWriteLock;
-                boost::scoped_ptr<Sharable_ReadLock> tocReadLock;
-                boost::scoped_ptr<Sharable_WriteLock> tocWriteLock;
-
-
-                // Take the read lock on the toc file mapping of the bucket
-                if (!tocReadLock && !tocWriteLock) {
-                    tileBucket.checkToCMemorySegmentStatus(&tocReadLock, &tocWriteLock);
-                }
-
-                // Lock the bucket in write mode to edit the freeTiles list
-                if (!bucketWriteLock) {
-#ifndef NATRON_CACHE_INTERPROCESS_ROBUST
-                    bucketWriteLock.reset(new Sharable_WriteLock(_imp->ipc->bucketsData[bucketIndex].bucketMutex));
-#else
-                    createTimedLock<Sharable_WriteLock>(_imp.get(), bucketWriteLock, &_imp->ipc->bucketsData[bucketIndex].bucketMutex);
-#endif
-                }
-
-
-                if (tileBucket.ipc->freeTiles.empty()) {
-                    // No free tile in the bucket: make a new file
-                    // To create a file, we need a write lock on the tiles storage, release the read lock now
-                    tilesLock->tileReadLock.reset();
+            // Group the tiles to allocate by bucket so that each bucket lock is taken only once per call
+            // instead of once per tile: allocating a 4K image would otherwise lock/unlock bucket mutexes
+            // thousands of times, which becomes the main contention point with many render threads.
+            TilesPerBucketMap tilesPerBucket;
+            groupTilesPerBucket(entryHash, *tilesToAlloc, &tilesPerBucket);
+
+            // The tiles extracted from the free tiles of a bucket are only recorded in the entry once all buckets are done.
+            // Until then they are neither free nor used by an entry: the tilesStorageMutex must remain locked in read mode,
+            // otherwise reclaimUnusedTiles() could take it in write mode and give them back to the free tiles.
+            // Hence if a bucket does not have enough free tiles, the tiles extracted from the previous buckets are given back
+            // before releasing the read lock to create a new storage file, and the allocation starts over.
+            for (;;) {
+                TilesPerBucketMap::const_iterator bucketIt = tilesPerBucket.begin();
+                for (; bucketIt != tilesPerBucket.end(); ++bucketIt) {
+
+                    // The bucket index for the tile depends on the bucket of the cache entry + a number based off the tile index so that
+                    // we ensure that we distribute uniformly all tiles across buckets.
+                    const int bucketIndex = bucketIt->first;
+                    const std::vector<std::size_t>& tilesInBucket = bucketIt->second;
+
+                    CacheBucket<persistent>& tileBucket = _imp->buckets[bucketIndex];
+
+                    boost::scoped_ptr<TimeLapse> allocTimer;
+                    if (_imp->isStatisticsEnabled()) {
+                        allocTimer.reset(new TimeLapse);
+                    }
 
-                    // Release the locks before calling createTileStorage
-                    tocReadLock.reset();
-                    tocWriteLock.reset();
-                    bucketWriteLock.reset();
+                    boost::scoped_ptr<Sharable_WriteLock> bucketWriteLock;
+                    boost::scoped_ptr<Sharable_ReadLock> tocReadLock;
+                    boost::scoped_ptr<Sharable_WriteLock> tocWriteLock;
 
-                    _imp->createTileStorage();
 
-                    // Take back the locks
+                    // Take the read lock on the toc file mapping of the bucket
                     if (!tocReadLock && !tocWriteLock) {
                         tileBucket.checkToCMemorySegmentStatus(&tocReadLock, &tocWriteLock);
                     }
 
-                    // Take the tilesStorageMutex in read mode to indicate that we are operating on it
-#ifndef NATRON_CACHE_INTERPROCESS_ROBUST
-                    tilesLock->tileReadLock.reset(new Sharable_ReadLock(_imp->ipc->tilesStorageMutex));
-#else
-                    // Take read lock on the tile data
-                    createTimedLock<Sharable_ReadLock>(_imp.get(), tilesLock->tileReadLock, &_imp->ipc->tilesStorageMutex);
-#endif
-
+                    // Lock the bucket in write mode to edit the freeTiles list
                     if (!bucketWriteLock) {
 #ifndef NATRON_CACHE_INTERPROCESS_ROBUST
-                        bucketWriteLock.reset(new Sharable_WriteLock(_imp->ipc->bucketsData[bucketIndex].bucketMutex));
+                        if (allocTimer) {
+                            bucketWriteLock.reset(new Sharable_WriteLock(_imp->ipc->bucketsData[bucketIndex].bucketMutex, boost::try_to_lock));
+                            if (!bucketWriteLock->owns_lock()) {
+                                _imp->recordLockContention(bucketIndex);
+                                bucketWriteLock->lock();
+                            }
+                        } else {
+                            bucketWriteLock.reset(new Sharable_WriteLock(_imp->ipc->bucketsData[bucketIndex].bucketMutex));
+                        }
 #else
                         createTimedLock<Sharable_WriteLock>(_imp.get(), bucketWriteLock, &_imp->ipc->bucketsData[bucketIndex].bucketMutex);
 #endif
                     }
 
-                }
 
-                // Extract the first free tile
-                assert(tileBucket.ipc->freeTiles.size() >= 1);
-                U64 freeTileEncodedIndex;
-                {
+                    if (tileBucket.ipc->freeTiles.size() < tilesInBucket.size()) {
+                        // Not enough free tiles in the bucket: a new file must be created. The bucket locks are released
+                        // when leaving the scope.
+                        break;
+                    }
+
+                    // Extract all free tiles needed for this bucket at once
+                    assert(tileBucket.ipc->freeTiles.size() >= tilesInBucket.size());
                     U64_Set::iterator freeTileIt = tileBucket.ipc->freeTiles.begin();
-                    freeTileEncodedIndex = *freeTileIt;
-                    tileBucket.ipc->freeTiles.erase(freeTileIt);
+                    for (std::size_t t = 0; t < tilesInBucket.size(); ++t, ++freeTileIt) {
+                        const std::size_t i = tilesInBucket[t];
+                        U64 freeTileEncodedIndex = *freeTileIt;
+
+                        // Get the pointer to the data corresponding to the free tile index
+                        U32 fileIndex, tileIndex;
+                        getTileIndex(freeTileEncodedIndex, &tileIndex, &fileIndex);
+                        typename CachePrivate<persistent>::StoragePtrType* storage = 0;
+                        if (fileIndex < _imp->tilesStorage.size()) {
+                            storage = &_imp->tilesStorage[fileIndex];
+                        }
+                        if (!storage) {
+                            assert(false);
+                            return false;
+                        }
+
+                        char* data = (*storage)->getData();
+
+                        // Set the tile index on the entry so we can free it afterwards.
+                        char* ptr = data + tileIndex * NATRON_TILE_SIZE_BYTES;
+                        assert((ptr >= data) && (ptr < (data + NATRON_NUM_TILES_PER_FILE * NATRON_TILE_SIZE_BYTES)));
+                        (*allocatedTilesData)[i] = std::make_pair(freeTileEncodedIndex, ptr);
+                    }
+                    tileBucket.ipc->freeTiles.erase(tileBucket.ipc->freeTiles.begin(), freeTileIt);
 #ifdef CACHE_TRACE_TILES_ALLOCATION
-                    qDebug() << "Bucket" << bucketIndex << ": removing tile" << freeTileEncodedIndex << " Nb free tiles left:" << tileBucket.ipc->freeTiles.size();
+                    qDebug() << "Bucket" << bucketIndex << ": removing" << tilesInBucket.size() << "tiles. Nb free tiles left:" << tileBucket.ipc->freeTiles.size();
 #endif
-                }
 
+                    if (allocTimer) {
+                        _imp->recordTilesAllocation(bucketIndex, tilesInBucket.size(), allocTimer->getTimeSinceCreation());
+                    }
 
-                // Get the pointer to the data corresponding to the free tile index
-                U32 fileIndex, tileIndex;
-                getTileIndex(freeTileEncodedIndex, &tileIndex, &fileIndex);
-                typename CachePrivate<persistent>::StoragePtrType* storage = 0;
-                if (fileIndex < _imp->tilesStorage.size()) {
-                    storage = &_imp->tilesStorage[fileIndex];
+                } // for each bucket
+
+                if ( bucketIt == tilesPerBucket.end() ) {
+                    // All tiles were extracted
+                    break;
                 }
-                if (!storage) {
-                    assert(false);
-                    return false;
+
+                // Give back the tiles extracted from the previous buckets while still holding the read lock
+                {
+                    std::vector<U64> extractedTiles;
+                    std::vector<std::pair<U64, void*> > extractedTilesData;
+                    for (TilesPerBucketMap::const_iterator it = tilesPerBucket.begin(); it != bucketIt; ++it) {
+                        for (std::vector<std::size_t>::const_iterator it2 = it->second.begin(); it2 != it->second.end(); ++it2) {
+                            extractedTiles.push_back( (*tilesToAlloc)[*it2] );
+                            extractedTilesData.push_back( (*allocatedTilesData)[*it2] );
+                        }
+                    }
+                    if ( !extractedTiles.empty() ) {
+                        _imp->freeAllocatedTiles(entryHash, extractedTiles, extractedTilesData);
+                    }
                 }
 
-                char* data = (*storage)->getData();
+                // To create a file, we need a write lock on the tiles storage, release the read lock now
+                tilesLock->tileReadLock.reset();
 
-                // Set the tile index on the entry so we can free it afterwards.
-                char* ptr = data + tileIndex * NATRON_TILE_SIZE_BYTES;
-                assert((ptr >= data) && (ptr < (data + NATRON_NUM_TILES_PER_FILE * NATRON_TILE_SIZE_BYTES)));
-                (*allocatedTilesData)[i] = std::make_pair(freeTileEncodedIndex, ptr);
+                _imp->createTileStorage();
 
-            } // for each tile to allocate
+                // Take the tilesStorageMutex in read mode to indicate that we are operating on it
+#ifndef NATRON_CACHE_INTERPROCESS_ROBUST
+                tilesLock->tileReadLock.reset(new Sharable_ReadLock(_imp->ipc->tilesStorageMutex));
+#else
+                // Take read lock on the tile data
+                createTimedLock<Sharable_ReadLock>(_imp.get(), tilesLock->tileReadLock, &_imp->ipc->tilesStorageMutex);
+#endif
+            } // for (;;)
         } // tilesToAlloc
 
         // Now for each tile to allocate, add the tile cache indices to the corresponding cache entry so that when deallocating
@@ -3384,13 +4573,20 @@ Cache<persistent>::retrieveAndLockTiles(const CacheEntryBasePtr& entry,
 
             // First work on a local set on the heap and then copy it to the ToC
             std::vector<U64> tmpSet(cacheEntry->tileIndices.size() + tilesToAlloc->size());
+            std::vector<U64> tmpLocalSet(tmpSet.size());
             {
                 int i = 0;
+                ExternalSegmentTypeULongLongList::const_iterator localIt = cacheEntry->tileLocalIndices.begin();
                 for (ExternalSegmentTypeULongLongList::const_iterator it = cacheEntry->tileIndices.begin(); it != cacheEntry->tileIndices.end(); ++it, ++i) {
                     tmpSet[i] = *it;
+                    if (localIt != cacheEntry->tileLocalIndices.end()) {
+                        tmpLocalSet[i] = *localIt;
+                        ++localIt;
+                    }
                 }
                 for (std::size_t c = 0; c < tilesToAlloc->size(); ++c, ++i) {
                     tmpSet[i] = (*allocatedTilesData)[c].first;
+                    tmpLocalSet[i] = (*tilesToAlloc)[c];
                 }
             }
 
@@ -3400,12 +4596,14 @@ Cache<persistent>::retrieveAndLockTiles(const CacheEntryBasePtr& entry,
 
                 try {
                     cacheEntry->tileIndices.clear();
+                    cacheEntry->tileLocalIndices.clear();
                     cacheEntry->tileIndices.insert(cacheEntry->tileIndices.end(), tmpSet.begin(), tmpSet.end());
+                    cacheEntry->tileLocalIndices.insert(cacheEntry->tileLocalIndices.end(), tmpLocalSet.begin(), tmpLocalSet.end());
                     break;
                 } catch (const bip::bad_alloc&) {
 
                     // We may not have enough memory to store all indices, so grow the ToC mapping
-                    std::size_t tocMemNeeded = tmpSet.size() * sizeof(U64) * 2;
+                    std::size_t tocMemNeeded = tmpSet.size() * sizeof(U64) * 4;
 
                     // Release the bucket mutex because it will become invalid while we grow the ToC file
                     bucketWriteLock.reset();
@@ -3479,6 +4677,9 @@ Cache<persistent>::retrieveAndLockTiles(const CacheEntryBasePtr& entry,
                 assert((tileDataPtr >= data) && (tileDataPtr < (data + NATRON_NUM_TILES_PER_FILE * NATRON_TILE_SIZE_BYTES)));
                 (*existingTilesData)[i] = tileDataPtr;
             } // for each tile indices
+
+            boost::unique_lock<boost::mutex> k(_imp->compressedTier.lock);
+            _imp->compressedTier.stats.nHotTierHits += tileIndices->size();
         }
     } catch (...) {
 
@@ -3597,6 +4798,12 @@ Cache<persistent>::releaseTiles(const CacheEntryBasePtr& entry, const std::vecto
                 for (std::size_t i = 0; i < cacheIndices.size(); ++i) {
                     ExternalSegmentTypeULongLongList::iterator foundTile = std::find(cacheEntry->tileIndices.begin(), cacheEntry->tileIndices.end(), cacheIndices[i]);
                     if (foundTile != cacheEntry->tileIndices.end()) {
+                        // Also remove the local index at the same position
+                        ExternalSegmentTypeULongLongList::iterator foundLocalTile = cacheEntry->tileLocalIndices.begin();
+                        std::advance(foundLocalTile, std::distance(cacheEntry->tileIndices.begin(), foundTile));
+                        if (foundLocalTile != cacheEntry->tileLocalIndices.end()) {
+                            cacheEntry->tileLocalIndices.erase(foundLocalTile);
+                        }
                         cacheEntry->tileIndices.erase(foundTile);
                     }
                 }
@@ -3605,10 +4812,13 @@ Cache<persistent>::releaseTiles(const CacheEntryBasePtr& entry, const std::vecto
             // Relase the bucket write lock
             entryBucketWriteLock.reset();
 
-            // If somehow the cache entry is no longer in the cache, we must make free again all tile indices
-            for (std::size_t i = 0; i < cacheIndices.size(); ++i) {
+            // Make the tiles free again: group them by bucket so each bucket is locked once
+            TilesPerBucketMap tilesPerBucket;
+            groupTilesPerBucket(entryHash, localIndices, &tilesPerBucket);
 
-                int bucketIndex = getBucketIndexForTile(entryHash, localIndices[i]);
+            for (TilesPerBucketMap::const_iterator bucketIt = tilesPerBucket.begin(); bucketIt != tilesPerBucket.end(); ++bucketIt) {
+
+                int bucketIndex = bucketIt->first;
                 CacheBucket<persistent>& tileBucket = _imp->buckets[bucketIndex];
 
                 boost::scoped_ptr<Sharable_WriteLock> bucketWriteLock;
@@ -3626,7 +4836,9 @@ Cache<persistent>::releaseTiles(const CacheEntryBasePtr& entry, const std::vecto
                 createTimedLock<Sharable_WriteLock>(_imp.get(), bucketWriteLock, &_imp->ipc->bucketsData[bucketIndex].bucketMutex);
 #endif
 
-                tileBucket.ipc->freeTiles.insert(cacheIndices[i]);
+                for (std::vector<std::size_t>::const_iterator it = bucketIt->second.begin(); it != bucketIt->second.end(); ++it) {
+                    tileBucket.ipc->freeTiles.insert(cacheIndices[*it]);
+                }
             }
         }
 
@@ -3783,6 +4995,12 @@ Cache<persistent>::setMaximumCacheSize(std::size_t size)
         boost::unique_lock<boost::mutex> k(_imp->maximumSizeMutex);
         _imp->maximumSize = size;
     }
+    {
+        // The compressed tier takes a share of the cache memory
+        boost::unique_lock<boost::mutex> k(_imp->compressedTier.lock);
+        _imp->compressedTier.cacheMaximumSize = size;
+        _imp->compressedTier.shrinkToSize( _imp->compressedTier.getEffectiveMaximumSize() );
+    }
 
     // Clear exceeding entries if we are shrinking the cache.
     if (size < curSize) {
@@ -3965,6 +5183,80 @@ CacheBase::getTileSizePx(ImageBitDepthEnum bitdepth, int *tx, int *ty)
     }
 }
 
+CacheLatencyHistogram::CacheLatencyHistogram()
+: count(0)
+, totalSeconds(0)
+, maxSeconds(0)
+{
+    std::fill(bins, bins + NATRON_CACHE_LATENCY_HISTOGRAM_BINS, 0);
+}
+
+void
+CacheLatencyHistogram::record(double seconds)
+{
+    double microseconds = seconds * 1e6;
+    int bin = 0;
+    while (bin < NATRON_CACHE_LATENCY_HISTOGRAM_BINS - 1 && microseconds >= 1.) {
+        microseconds *= 0.5;
+        ++bin;
+    }
+    ++bins[bin];
+    ++count;
+    totalSeconds += seconds;
+    maxSeconds = std::max(maxSeconds, seconds);
+}
+
+void
+CacheLatencyHistogram::merge(const CacheLatencyHistogram& other)
+{
+    for (int i = 0; i < NATRON_CACHE_LATENCY_HISTOGRAM_BINS; ++i) {
+        bins[i] += other.bins[i];
+    }
+    count += other.count;
+    totalSeconds += other.totalSeconds;
+    maxSeconds = std::max(maxSeconds, other.maxSeconds);
+}
+
+double
+CacheLatencyHistogram::getPercentile(double percentile) const
+{
+    if (count == 0) {
+        return 0.;
+    }
+    U64 rank = (U64)std::ceil(count * std::max(0., std::min(100., percentile)) / 100.);
+    U64 n = 0;
+    for (int i = 0; i < NATRON_CACHE_LATENCY_HISTOGRAM_BINS - 1; ++i) {
+        n += bins[i];
+        if (n >= rank) {
+            return getBinUpperBound(i);
+        }
+    }
+    // The last bin has no upper bound
+    return maxSeconds;
+}
+
+double
+CacheLatencyHistogram::getBinUpperBound(int bin)
+{
+    return std::ldexp(1., bin) * 1e-6;
+}
+
+void
+CacheBucketStats::merge(const CacheBucketStats& other)
+{
+    nLookups += other.nLookups;
+    nHits += other.nHits;
+    nPendingHits += other.nPendingHits;
+    nMisses += other.nMisses;
+    lookupLatency.merge(other.lookupLatency);
+    pendingEntryWaitLatency.merge(other.pendingEntryWaitLatency);
+    nLockContentions += other.nLockContentions;
+    nTilesAllocated += other.nTilesAllocated;
+    tileAllocationLatency.merge(other.tileAllocationLatency);
+    nEvictions += other.nEvictions;
+    nEvictedBytes += other.nEvictedBytes;
+}
+
 template <bool persistent>
 QString
 CachePrivate<persistent>::getBucketAbsoluteDirPath(int bucketIndex) const
@@ -3994,6 +5286,8 @@ Cache<persistent>::hasCacheEntryForHash(U64 hash) const
     int bucketIndex = Cache::getBucketCacheBucketIndex(hash);
     CacheBucket<persistent>& bucket = _imp->buckets[bucketIndex];
 
+    _imp->ensureBucketVerified(bucketIndex);
+
 #ifdef NATRON_CACHE_INTERPROCESS_ROBUST
     SHMReadLockerPtr shmReader(new SharedMemoryProcessLocalReadLocker(_imp.get()));
 #endif
@@ -4043,6 +5337,11 @@ Cache<persistent>::removeEntry(const CacheEntryBasePtr& entry)
 
     CacheBucket<persistent>& bucket = _imp->buckets[bucketIndex];
 
+    // The entry was explicitly removed: do not let its tiles be restored from the compressed tier
+    if (_imp->useTileStorage) {
+        _imp->compressedTier.removeEntryTiles(hash);
+    }
+
 #ifdef NATRON_CACHE_INTERPROCESS_ROBUST
     SHMReadLockerPtr shmReader(new SharedMemoryProcessLocalReadLocker(_imp.get()));
 #endif
@@ -4108,6 +5407,15 @@ CachePrivate<persistent>::recoverFromInconsistentState(
 #endif
 
 
+    // If a single bucket was detected inconsistent, reset only this bucket
+    try {
+        throw;
+    } catch (const CorruptedCacheException& e) {
+        quarantineBucket(e.getBucketIndex());
+        return;
+    } catch (...) {
+    }
+
     // Clear the cache: it could be corrupted
     _publicInterface->clear();
 
@@ -4115,7 +5423,262 @@ CachePrivate<persistent>::recoverFromInconsistentState(
 
 template <bool persistent>
 void
-CachePrivate<persistent>::clearCacheBucket(int bucket_i)
+CachePrivate<persistent>::recordFirstHit()
+{
+    if ((int)firstHitRecorded) {
+        return;
+    }
+    if (firstHitRecorded.fetchAndStoreOrdered(1) != 0) {
+        return;
+    }
+    boost::unique_lock<boost::mutex> k(warmStartStatsMutex);
+    warmStartStats.firstHitLatency = startupTimer.getTimeSinceCreation();
+} // recordFirstHit
+
+template <bool persistent>
+void
+CachePrivate<persistent>::recordLookup(int bucket_i, CacheEntryLockerBase::CacheEntryStatusEnum status, double seconds)
+{
+    boost::unique_lock<boost::mutex> k(bucketStatsMutex[bucket_i]);
+    CacheBucketStats& stats = bucketStats[bucket_i];
+    ++stats.nLookups;
+    switch (status) {
+        case CacheEntryLockerBase::eCacheEntryStatusCached:
+            ++stats.nHits;
+            break;
+        case CacheEntryLockerBase::eCacheEntryStatusComputationPending:
+            ++stats.nPendingHits;
+            break;
+        case CacheEntryLockerBase::eCacheEntryStatusMustCompute:
+            ++stats.nMisses;
+            break;
+    }
+    stats.lookupLatency.record(seconds);
+} // recordLookup
+
+template <bool persistent>
+void
+CachePrivate<persistent>::recordPendingEntryWait(int bucket_i, double seconds)
+{
+    boost::unique_lock<boost::mutex> k(bucketStatsMutex[bucket_i]);
+    bucketStats[bucket_i].pendingEntryWaitLatency.record(seconds);
+} // recordPendingEntryWait
+
+template <bool persistent>
+void
+CachePrivate<persistent>::recordLockContention(int bucket_i)
+{
+    boost::unique_lock<boost::mutex> k(bucketStatsMutex[bucket_i]);
+    ++bucketStats[bucket_i].nLockContentions;
+} // recordLockContention
+
+template <bool persistent>
+void
+CachePrivate<persistent>::recordTilesAllocation(int bucket_i, std::size_t nTiles, double seconds)
+{
+    boost::unique_lock<boost::mutex> k(bucketStatsMutex[bucket_i]);
+    bucketStats[bucket_i].nTilesAllocated += nTiles;
+    bucketStats[bucket_i].tileAllocationLatency.record(seconds);
+} // recordTilesAllocation
+
+template <bool persistent>
+void
+CachePrivate<persistent>::recordEviction(int bucket_i, std::size_t nBytes)
+{
+    boost::unique_lock<boost::mutex> k(bucketStatsMutex[bucket_i]);
+    ++bucketStats[bucket_i].nEvictions;
+    bucketStats[bucket_i].nEvictedBytes += nBytes;
+} // recordEviction
+
+template <bool persistent>
+void
+CachePrivate<persistent>::ensureBucketVerified(int bucket_i)
+{
+    CacheBucket<persistent>& bucket = buckets[bucket_i];
+    if ((int)bucket.verified) {
+        return;
+    }
+
+#ifdef NATRON_CACHE_INTERPROCESS_ROBUST
+    SHMReadLockerPtr shmAccess(new SharedMemoryProcessLocalReadLocker(this));
+#endif
+
+    bool ok;
+    try {
+        int maxFileIndex;
+        {
+            boost::scoped_ptr<Sharable_ReadLock> tocReadLock;
+            boost::scoped_ptr<Sharable_WriteLock> tocWriteLock;
+            bucket.checkToCMemorySegmentStatus(&tocReadLock, &tocWriteLock);
+
+            boost::scoped_ptr<Sharable_ReadLock> bucketReadLock;
+#ifndef NATRON_CACHE_INTERPROCESS_ROBUST
+            bucketReadLock.reset(new Sharable_ReadLock(ipc->bucketsData[bucket_i].bucketMutex));
+#else
+            createTimedLock<Sharable_ReadLock>(this, bucketReadLock, &ipc->bucketsData[bucket_i].bucketMutex);
+#endif
+            ok = bucket.checkConsistency(&maxFileIndex);
+        }
+        if (ok && maxFileIndex >= 0) {
+            // The tilesStorageMutex must be taken before any bucket lock, check the file indices now that the bucket is unlocked.
+            // This is fine since the tiles storage only grows.
+            boost::scoped_ptr<Sharable_ReadLock> tileReadLock;
+#ifndef NATRON_CACHE_INTERPROCESS_ROBUST
+            tileReadLock.reset(new Sharable_ReadLock(ipc->tilesStorageMutex));
+#else
+            createTimedLock<Sharable_ReadLock>(this, tileReadLock, &ipc->tilesStorageMutex);
+#endif
+            ok = maxFileIndex < (int)tilesStorage.size();
+        }
+    } catch (...) {
+        ok = false;
+    }
+
+    if (!ok) {
+        quarantineBucket(bucket_i);
+        return;
+    }
+
+    if (bucket.verified.fetchAndStoreOrdered(1) == 0) {
+        boost::unique_lock<boost::mutex> k(warmStartStatsMutex);
+        ++warmStartStats.nBucketsVerified;
+    }
+} // ensureBucketVerified
+
+template <bool persistent>
+void
+CachePrivate<persistent>::quarantineBucket(int bucket_i)
+{
+    boost::unique_lock<boost::mutex> quarantineLocker(quarantineMutex);
+
+#ifdef NATRON_CACHE_INTERPROCESS_ROBUST
+    SHMReadLockerPtr shmAccess(new SharedMemoryProcessLocalReadLocker(this));
+#endif
+
+    try {
+        // Make room in the new ToC for all the tiles the bucket may own
+        std::size_t nTilesStorage;
+        {
+            boost::scoped_ptr<Sharable_ReadLock> tileReadLock;
+#ifndef NATRON_CACHE_INTERPROCESS_ROBUST
+            tileReadLock.reset(new Sharable_ReadLock(ipc->tilesStorageMutex));
+#else
+            createTimedLock<Sharable_ReadLock>(this, tileReadLock, &ipc->tilesStorageMutex);
+#endif
+            nTilesStorage = tilesStorage.size();
+        }
+        clearCacheBucket(bucket_i, nTilesStorage * NATRON_NUM_TILES_PER_BUCKET_FILE * sizeof(U64) * 2);
+
+        if (useTileStorage) {
+            // Other threads may keep a bucket locked for a little while, retry for about a second before giving up.
+            // In that case the tiles of the dropped entries are lost until the cache is cleared.
+            int nAttempts = 0;
+            while (!reclaimUnusedTiles() && nAttempts < 1000) {
+                boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+                ++nAttempts;
+            }
+        }
+    } catch (...) {
+        // The bucket could not be reset, wipe the cache
+        quarantineLocker.unlock();
+        _publicInterface->clear();
+        return;
+    }
+
+    bool wasVerified = buckets[bucket_i].verified.fetchAndStoreOrdered(1) != 0;
+    boost::unique_lock<boost::mutex> k(warmStartStatsMutex);
+    ++warmStartStats.nBucketsQuarantined;
+    if (!wasVerified) {
+        ++warmStartStats.nBucketsVerified;
+    }
+} // quarantineBucket
+
+template <bool persistent>
+bool
+CachePrivate<persistent>::reclaimUnusedTiles()
+{
+    // Prevent any tile from being allocated or freed. Tiles only move between the free tiles of a bucket and the tiles
+    // of an entry while the tilesStorageMutex is held in read mode (see retrieveAndLockTiles() and releaseTiles()),
+    // hence all tiles are either free or used by an entry
+    boost::scoped_ptr<Sharable_WriteLock> tileWriteLock;
+#ifndef NATRON_CACHE_INTERPROCESS_ROBUST
+    tileWriteLock.reset(new Sharable_WriteLock(ipc->tilesStorageMutex));
+#else
+    createTimedLock<Sharable_WriteLock>(this, tileWriteLock, &ipc->tilesStorageMutex);
+#endif
+
+    const std::size_t nFiles = tilesStorage.size();
+    std::vector<bool> usedTiles(nFiles * NATRON_NUM_TILES_PER_FILE, false);
+
+    for (int bucket_i = 0; bucket_i < NATRON_CACHE_BUCKETS_COUNT; ++bucket_i) {
+        boost::scoped_ptr<Sharable_ReadLock> tocReadLock;
+        boost::scoped_ptr<Sharable_ReadLock> bucketReadLock;
+        if (!tryCreateLock(this, tocReadLock, &ipc->bucketsData[bucket_i].tocData.segmentMutex) ||
+            !buckets[bucket_i].isToCFileMappingValid() ||
+            !tryCreateLock(this, bucketReadLock, &ipc->bucketsData[bucket_i].bucketMutex)) {
+            return false;
+        }
+
+        // The entries of an inconsistent bucket cannot be trusted: tiles will be reclaimed when this bucket gets quarantined as well
+        if (buckets[bucket_i].ipc->bucketState != eBucketStateOk) {
+            return true;
+        }
+
+        const typename CacheBucket<persistent>::EntriesMap& entries = buckets[bucket_i].ipc->entriesMap;
+        for (typename CacheBucket<persistent>::EntriesMap::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+            for (ExternalSegmentTypeULongLongList::const_iterator it2 = it->second->tileIndices.begin(); it2 != it->second->tileIndices.end(); ++it2) {
+                U32 fileIndex = (U32)*it2;
+                U32 tileIndex = (U32)(*it2 >> 32);
+                if (fileIndex >= nFiles || tileIndex >= NATRON_NUM_TILES_PER_FILE) {
+                    return true;
+                }
+                usedTiles[fileIndex * NATRON_NUM_TILES_PER_FILE + tileIndex] = true;
+            }
+        }
+    } // for each bucket
+
+    for (int bucket_i = 0; bucket_i < NATRON_CACHE_BUCKETS_COUNT; ++bucket_i) {
+        boost::scoped_ptr<Sharable_ReadLock> tocReadLock;
+        boost::scoped_ptr<Sharable_WriteLock> bucketWriteLock;
+        if (!tryCreateLock(this, tocReadLock, &ipc->bucketsData[bucket_i].tocData.segmentMutex) ||
+            !buckets[bucket_i].isToCFileMappingValid() ||
+            !tryCreateLock(this, bucketWriteLock, &ipc->bucketsData[bucket_i].bucketMutex)) {
+            return false;
+        }
+
+        U64_Set& freeTiles = buckets[bucket_i].ipc->freeTiles;
+        try {
+            for (U64 fileIndex = 0; fileIndex < nFiles; ++fileIndex) {
+                for (U64 i = bucket_i * NATRON_NUM_TILES_PER_BUCKET_FILE; i < (U64)(bucket_i + 1) * NATRON_NUM_TILES_PER_BUCKET_FILE; ++i) {
+                    if (!usedTiles[fileIndex * NATRON_NUM_TILES_PER_FILE + i]) {
+                        freeTiles.insert((i << 32) | fileIndex);
+                    }
+                }
+            }
+        } catch (const bip::bad_alloc&) {
+            // Not enough room in the ToC of this bucket: its unused tiles are lost until the cache is cleared
+        }
+    } // for each bucket
+    return true;
+} // reclaimUnusedTiles
+
+template <bool persistent>
+void
+CachePrivate<persistent>::runBucketsVerification(boost::weak_ptr<Cache<persistent> > cache)
+{
+    for (int i = 0; i < NATRON_CACHE_BUCKETS_COUNT; ++i) {
+        // Do not keep the cache alive
+        boost::shared_ptr<Cache<persistent> > c = cache.lock();
+        if (!c) {
+            return;
+        }
+        c->_imp->ensureBucketVerified(i);
+    }
+} // runBucketsVerification
+
+template <bool persistent>
+void
+CachePrivate<persistent>::clearCacheBucket(int bucket_i, std::size_t minFreeSize)
 {
 
     CacheBucket<persistent>& bucket = buckets[bucket_i];
@@ -4133,7 +5696,7 @@ CachePrivate<persistent>::clearCacheBucket(int bucket_i)
         std::string tocFilePath = getStoragePath(bucket.tocFile);
         clearStorage(bucket.tocFile);
         openStorage(bucket.tocFile, tocFilePath, (int)MemoryFile::eFileOpenModeOpenTruncateOrCreate);
-        bucket.remapToCMemoryFile(*tocWriteLock, 0);
+        bucket.remapToCMemoryFile(*tocWriteLock, minFreeSize);
 
     }
 
@@ -4175,6 +5738,8 @@ Cache<persistent>::clear()
     } catch (...) {
 
     }
+
+    _imp->compressedTier.clear();
     
     
     
@@ -4197,7 +5762,8 @@ Cache<persistent>::evictLRUEntries(std::size_t nBytesToFree)
         maxSize = maxSize - nBytesToFree;
     }
 
-    std::size_t curSize = getCurrentSize();
+    // The compressed tier counts against the maximum size of the cache
+    std::size_t curSize = getCurrentSize() + _imp->compressedTier.getMemorySize();
 
     bool mustEvictEntries = curSize > maxSize;
 
@@ -4231,20 +5797,8 @@ Cache<persistent>::evictLRUEntries(std::size_t nBytesToFree)
                 BucketStateHandler_RAII<persistent> bucketStateHandler(&bucket);
 
 
-                U64 hash = 0;
-                {
-                    // Lock the LRU list
-#ifndef NATRON_CACHE_INTERPROCESS_ROBUST
-                    boost::scoped_ptr<ExclusiveLock> writeLock (new ExclusiveLock(_imp->ipc->bucketsData[bucket_i].lruListMutex));
-#else
-                    boost::scoped_ptr<ExclusiveLock> lruWriteLock;
-                    createTimedLock<ExclusiveLock>(_imp.get(), lruWriteLock, &_imp->ipc->bucketsData[bucket_i].lruListMutex);
-#endif
-                    // The least recently used entry is the one at the front of the linked list
-                    if (bucket.ipc->lruListFront) {
-                        hash = bucket.ipc->lruListFront->hash;
-                    }
-                }
+                const CacheEvictionPolicyEnum policy = _imp->getEvictionPolicy();
+                U64 hash = bucket.selectEntryToEvict(policy);
                 if (hash == 0) {
                     continue;
                 }
@@ -4258,10 +5812,19 @@ Cache<persistent>::evictLRUEntries(std::size_t nBytesToFree)
 
 
                 // We evicted one, decrease the size
-                curSize -= cacheEntryIt->second->size;
-                curSize -= cacheEntryIt->second->tileIndices.size() * NATRON_TILE_SIZE_BYTES;
-                
+                std::size_t evictedSize = cacheEntryIt->second->size + cacheEntryIt->second->tileIndices.size() * NATRON_TILE_SIZE_BYTES;
+                curSize -= evictedSize;
+                if (_imp->isStatisticsEnabled()) {
+                    _imp->recordEviction(bucket_i, evictedSize);
+                }
+
+                // Keep the tiles in the compressed tier rather than dropping them
+                if (_imp->useTileStorage) {
+                    _imp->compressEntryTiles(hash, *cacheEntryIt->second);
+                }
+
                 bucket.deallocateCacheEntryImpl(cacheEntryIt, storage);
+                ++bucket.evictionStats[policy].nEvictions;
 
 
 
@@ -4291,6 +5854,267 @@ Cache<persistent>::evictLRUEntries(std::size_t nBytesToFree)
 
 } // evictLRUEntries
 
+template <bool persistent>
+void
+Cache<persistent>::setEvictionPolicy(CacheEvictionPolicyEnum policy)
+{
+    _imp->evictionPolicy.fetchAndStoreRelease((int)policy);
+}
+
+template <bool persistent>
+CacheEvictionPolicyEnum
+Cache<persistent>::getEvictionPolicy() const
+{
+    return _imp->getEvictionPolicy();
+}
+
+template <bool persistent>
+void
+Cache<persistent>::getEvictionStats(CacheEvictionPolicyEnum policy, CacheEvictionStats* stats) const
+{
+    assert(policy >= 0 && policy < NATRON_CACHE_EVICTION_POLICIES_COUNT);
+    *stats = CacheEvictionStats();
+
+#ifdef NATRON_CACHE_INTERPROCESS_ROBUST
+    boost::scoped_ptr<SharedMemoryProcessLocalReadLocker> shmReader(new SharedMemoryProcessLocalReadLocker(_imp.get()));
+#endif
+
+    for (int bucket_i = 0; bucket_i < NATRON_CACHE_BUCKETS_COUNT; ++bucket_i) {
+        const CacheBucket<persistent>& bucket = _imp->buckets[bucket_i];
+
+        try {
+            // The stats live in process memory, we just need the mutexes protecting them
+            boost::scoped_ptr<Sharable_ReadLock> bucketLock;
+            boost::scoped_ptr<ExclusiveLock> lruLock;
+#ifndef NATRON_CACHE_INTERPROCESS_ROBUST
+            bucketLock.reset(new Sharable_ReadLock(_imp->ipc->bucketsData[bucket_i].bucketMutex));
+            lruLock.reset(new ExclusiveLock(_imp->ipc->bucketsData[bucket_i].lruListMutex));
+#else
+            createTimedLock<Sharable_ReadLock>(_imp.get(), bucketLock, &_imp->ipc->bucketsData[bucket_i].bucketMutex);
+            createTimedLock<ExclusiveLock>(_imp.get(), lruLock, &_imp->ipc->bucketsData[bucket_i].lruListMutex);
+#endif
+            stats->nHits += bucket.evictionStats[policy].nHits;
+            stats->nMisses += bucket.evictionStats[policy].nMisses;
+            stats->nEvictions += bucket.evictionStats[policy].nEvictions;
+        } catch (...) {
+            // Any exception caught here means the cache is corrupted
+            _imp->recoverFromInconsistentState(
+#ifdef NATRON_CACHE_INTERPROCESS_ROBUST
+                                                shmReader
+#endif
+                                               );
+            return;
+        }
+    } // for each bucket
+} // getEvictionStats
+
+template <bool persistent>
+void
+Cache<persistent>::addEntryComputeCost(const CacheEntryBasePtr& entry, double costSeconds)
+{
+    U64 hash = entry->getHashKey();
+    int bucketIndex = Cache::getBucketCacheBucketIndex(hash);
+    CacheBucket<persistent>& bucket = _imp->buckets[bucketIndex];
+
+#ifdef NATRON_CACHE_INTERPROCESS_ROBUST
+    SHMReadLockerPtr shmReader(new SharedMemoryProcessLocalReadLocker(_imp.get()));
+#endif
+
+    try {
+
+        // Take the read lock on the toc file mapping
+        boost::scoped_ptr<Sharable_ReadLock> tocReadLock;
+        boost::scoped_ptr<Sharable_WriteLock> tocWriteLock;
+        bucket.checkToCMemorySegmentStatus(&tocReadLock, &tocWriteLock);
+
+        boost::scoped_ptr<Sharable_ReadLock> readLock;
+#ifndef NATRON_CACHE_INTERPROCESS_ROBUST
+        readLock.reset(new Sharable_ReadLock(_imp->ipc->bucketsData[bucketIndex].bucketMutex));
+#else
+        createTimedLock<Sharable_ReadLock>(_imp.get(), readLock, &_imp->ipc->bucketsData[bucketIndex].bucketMutex);
+#endif
+
+        typename CacheBucket<persistent>::EntriesMap::iterator cacheEntryIt;
+        typename CacheBucket<persistent>::EntriesMap* storage;
+        if (!bucket.tryCacheLookupImpl(hash, &cacheEntryIt, &storage)) {
+            return;
+        }
+
+        // The compute cost is protected by the LRU list mutex
+        boost::scoped_ptr<ExclusiveLock> lruWriteLock;
+#ifndef NATRON_CACHE_INTERPROCESS_ROBUST
+        lruWriteLock.reset(new ExclusiveLock(_imp->ipc->bucketsData[bucketIndex].lruListMutex));
+#else
+        createTimedLock<ExclusiveLock>(_imp.get(), lruWriteLock, &_imp->ipc->bucketsData[bucketIndex].lruListMutex);
+#endif
+        cacheEntryIt->second->computeCost += costSeconds;
+    } catch (...) {
+        // Any exception caught here means the cache is corrupted
+        _imp->recoverFromInconsistentState(
+#ifdef NATRON_CACHE_INTERPROCESS_ROBUST
+                                            shmReader
+#endif
+                                                        );
+    }
+} // addEntryComputeCost
+
+template <bool persistent>
+void
+Cache<persistent>::setCompressedTierParameters(CacheCompressionEnum compression, std::size_t maxSize)
+{
+    boost::unique_lock<boost::mutex> k(_imp->compressedTier.lock);
+    _imp->compressedTier.compression = compression;
+    _imp->compressedTier.maximumSize = maxSize;
+    _imp->compressedTier.cacheMaximumSize = getMaximumCacheSize();
+    _imp->compressedTier.shrinkToSize( _imp->compressedTier.getEffectiveMaximumSize() );
+} // setCompressedTierParameters
+
+template <bool persistent>
+bool
+Cache<persistent>::retrieveCompressedTiles(const CacheEntryBasePtr& entry,
+                                           const std::vector<U64>& localTileIndices,
+                                           std::vector<bool>* foundTiles,
+                                           std::vector<std::pair<U64, void*> >* allocatedTilesData,
+                                           void** cacheData)
+{
+    assert(_imp->useTileStorage);
+    assert(cacheData);
+    *cacheData = 0;
+    foundTiles->assign(localTileIndices.size(), false);
+
+    U64 entryHash = entry->getHashKey();
+
+    // Take the tiles out of the compressed tier: once uncompressed they live in the tiles storage again
+    std::vector<U64> tilesToAlloc;
+    std::vector<QByteArray> compressedTiles;
+    std::vector<bool> tilesCompressed;
+    for (std::size_t i = 0; i < localTileIndices.size(); ++i) {
+        QByteArray data;
+        bool isCompressed;
+        if (_imp->compressedTier.takeTile(entryHash, localTileIndices[i], &data, &isCompressed)) {
+            (*foundTiles)[i] = true;
+            tilesToAlloc.push_back(localTileIndices[i]);
+            compressedTiles.push_back(data);
+            tilesCompressed.push_back(isCompressed);
+        }
+    }
+
+    if (tilesToAlloc.empty()) {
+        return true;
+    }
+
+    if (!retrieveAndLockTiles(entry, 0, &tilesToAlloc, 0, allocatedTilesData, cacheData)) {
+        return false;
+    }
+
+    assert(allocatedTilesData->size() == compressedTiles.size());
+    for (std::size_t i = 0; i < compressedTiles.size(); ++i) {
+        // Tiles that were still waiting for the compression thread are not compressed
+        QByteArray uncompressed = tilesCompressed[i] ? qUncompress(compressedTiles[i]) : compressedTiles[i];
+        if (uncompressed.size() != NATRON_TILE_SIZE_BYTES) {
+            assert(false);
+            return false;
+        }
+        std::memcpy((*allocatedTilesData)[i].second, uncompressed.constData(), NATRON_TILE_SIZE_BYTES);
+    }
+    return true;
+} // retrieveCompressedTiles
+
+template <bool persistent>
+void
+Cache<persistent>::getTierStats(CacheTierStats* stats) const
+{
+    boost::unique_lock<boost::mutex> k(_imp->compressedTier.lock);
+    *stats = _imp->compressedTier.stats;
+    stats->nCompressedTiles = _imp->compressedTier.tiles.size();
+    stats->compressedSize = _imp->compressedTier.size;
+    stats->uncompressedSize = _imp->compressedTier.tiles.size() * NATRON_TILE_SIZE_BYTES;
+} // getTierStats
+
+template <bool persistent>
+void
+Cache<persistent>::getWarmStartStats(CacheWarmStartStats* stats) const
+{
+    boost::unique_lock<boost::mutex> k(_imp->warmStartStatsMutex);
+    *stats = _imp->warmStartStats;
+} // getWarmStartStats
+
+template <bool persistent>
+void
+Cache<persistent>::prefetch(const CachePrefetchTaskPtr& task)
+{
+    if (!task) {
+        return;
+    }
+    CachePrefetchTaskPtr droppedTask;
+    {
+        boost::unique_lock<boost::mutex> k(_imp->prefetchQueue->lock);
+        if (_imp->prefetchQueue->mustQuit) {
+            return;
+        }
+        if (_imp->prefetchQueue->pendingTasks.size() >= NATRON_CACHE_PREFETCH_MAX_PENDING_TASKS) {
+            droppedTask = _imp->prefetchQueue->pendingTasks.front();
+            _imp->prefetchQueue->pendingTasks.pop_front();
+        }
+        _imp->prefetchQueue->pendingTasks.push_back(task);
+
+        // Start a new thread if all existing ones are busy
+        int maxThreads = std::max(1, std::min( NATRON_CACHE_PREFETCH_MAX_THREADS, (int)boost::thread::hardware_concurrency() / 4 ));
+        if ( (int)_imp->prefetchQueue->threads.size() < maxThreads &&
+             _imp->prefetchQueue->runningTasks.size() >= _imp->prefetchQueue->threads.size() ) {
+            _imp->prefetchQueue->threads.push_back( boost::shared_ptr<boost::thread>( new boost::thread(&CachePrefetchQueue::runTasks, _imp->prefetchQueue) ) );
+        }
+    }
+    _imp->prefetchQueue->cond.notify_one();
+
+    if (droppedTask) {
+        droppedTask->cancel();
+    }
+} // prefetch
+
+template <bool persistent>
+void
+Cache<persistent>::cancelPrefetch()
+{
+    boost::unique_lock<boost::mutex> k(_imp->prefetchQueue->lock);
+    _imp->prefetchQueue->cancelAllTasks();
+} // cancelPrefetch
+
+template <bool persistent>
+void
+Cache<persistent>::setStatisticsEnabled(bool enabled)
+{
+    _imp->statisticsEnabled.fetchAndStoreOrdered(enabled ? 1 : 0);
+} // setStatisticsEnabled
+
+template <bool persistent>
+bool
+Cache<persistent>::isStatisticsEnabled() const
+{
+    return _imp->isStatisticsEnabled();
+} // isStatisticsEnabled
+
+template <bool persistent>
+void
+Cache<persistent>::getBucketStats(std::vector<CacheBucketStats>* stats) const
+{
+    stats->resize(NATRON_CACHE_BUCKETS_COUNT);
+    for (int i = 0; i < NATRON_CACHE_BUCKETS_COUNT; ++i) {
+        boost::unique_lock<boost::mutex> k(_imp->bucketStatsMutex[i]);
+        (*stats)[i] = _imp->bucketStats[i];
+    }
+} // getBucketStats
+
+template <bool persistent>
+void
+Cache<persistent>::resetBucketStats()
+{
+    for (int i = 0; i < NATRON_CACHE_BUCKETS_COUNT; ++i) {
+        boost::unique_lock<boost::mutex> k(_imp->bucketStatsMutex[i]);
+        _imp->bucketStats[i] = CacheBucketStats();
+    }
+} // resetBucketStats
+
 template <bool persistent>
 void
 Cache<persistent>::getMemoryStats(std::map<std::string, CacheReportInfo>* infos) const
@@ -4333,6 +6157,12 @@ Cache<persistent>::getMemoryStats(std::map<std::string, CacheReportInfo>* infos)
                     CacheReportInfo& entryData = (*infos)[pluginID];
                     ++entryData.nEntries;
                     entryData.nBytes += cacheEntryIt->second->size;
+                    if (cacheEntryIt->second->prefetchState != MemorySegmentEntryHeaderBase::eEntryPrefetchStateNone) {
+                        ++entryData.nPrefetchedEntries;
+                        if (cacheEntryIt->second->prefetchState == MemorySegmentEntryHeaderBase::eEntryPrefetchStateHit) {
+                            ++entryData.nPrefetchHits;
+                        }
+                    }
                 }
                 it = it->next;
             }
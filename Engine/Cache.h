@@ -39,6 +39,8 @@
 
 #include "Global/GlobalDefines.h"
 
+#include <QtCore/QAtomicInt>
+
 #if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
 #include <boost/shared_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
@@ -111,14 +113,259 @@ struct CacheReportInfo
     int nEntries;
     std::size_t nBytes;
 
+    // Number of entries that were computed by a prefetch render, see CacheBase::prefetch()
+    int nPrefetchedEntries;
+
+    // Among nPrefetchedEntries, the number of entries that were then found by a regular look-up.
+    // nPrefetchHits / nPrefetchedEntries is the prefetch hit rate.
+    int nPrefetchHits;
+
     CacheReportInfo()
     : nEntries(0)
     , nBytes(0)
+    , nPrefetchedEntries(0)
+    , nPrefetchHits(0)
+    {
+
+    }
+};
+
+/**
+ * @brief Statistics of the cache recorded while a given eviction policy was active
+ **/
+struct CacheEvictionStats
+{
+    // Number of look-ups that found a cached entry
+    U64 nHits;
+
+    // Number of look-ups that did not find the entry and had to compute it
+    U64 nMisses;
+
+    // Number of entries evicted from the cache
+    U64 nEvictions;
+
+    CacheEvictionStats()
+    : nHits(0)
+    , nMisses(0)
+    , nEvictions(0)
+    {
+
+    }
+};
+
+struct CacheTierStats
+{
+    // Number of tiles that were retrieved from the tiles storage
+    U64 nHotTierHits;
+
+    // Number of tiles that were restored from the compressed tier
+    U64 nCompressedTierHits;
+
+    // Number of tiles that were looked-up in the compressed tier but were not found
+    U64 nCompressedTierMisses;
+
+    // Number of tiles of evicted entries that were dropped because too many tiles were waiting to be compressed
+    U64 nDroppedTiles;
+
+    // Number of tiles currently held in the compressed tier
+    U64 nCompressedTiles;
+
+    // Size in bytes of the compressed tiles held in the compressed tier
+    std::size_t compressedSize;
+
+    // Size in bytes the compressed tiles would take once uncompressed
+    std::size_t uncompressedSize;
+
+    CacheTierStats()
+    : nHotTierHits(0)
+    , nCompressedTierHits(0)
+    , nCompressedTierMisses(0)
+    , nDroppedTiles(0)
+    , nCompressedTiles(0)
+    , compressedSize(0)
+    , uncompressedSize(0)
+    {
+
+    }
+};
+
+/**
+ * @brief Statistics about the start-up of the cache. The buckets of a persistent cache that were reopened from disk
+ * are verified in a background thread so that look-ups can be served as soon as the cache is created.
+ **/
+struct CacheWarmStartStats
+{
+    // Time in seconds spent to create the cache, before it could serve look-ups
+    double initializationDuration;
+
+    // Time in seconds between the creation of the cache and the first look-up that found a cached entry,
+    // or -1 if no look-up found an entry yet
+    double firstHitLatency;
+
+    // Number of buckets whose consistency was verified so far
+    int nBucketsVerified;
+
+    // Number of buckets that were found inconsistent and were reset
+    int nBucketsQuarantined;
+
+    CacheWarmStartStats()
+    : initializationDuration(0)
+    , firstHitLatency(-1)
+    , nBucketsVerified(0)
+    , nBucketsQuarantined(0)
+    {
+
+    }
+};
+
+// Number of bins of a CacheLatencyHistogram. The last bin counts durations of 2^22 microseconds (about 4 seconds) and above.
+#define NATRON_CACHE_LATENCY_HISTOGRAM_BINS 24
+
+/**
+ * @brief Distribution of the durations of an operation of the cache, with logarithmic bins:
+ * bin 0 counts durations under 1 microsecond and bin i > 0 counts durations d such that 2^(i-1) <= d < 2^i microseconds.
+ **/
+struct CacheLatencyHistogram
+{
+    U64 bins[NATRON_CACHE_LATENCY_HISTOGRAM_BINS];
+
+    // Number of durations recorded, i.e: the sum of all bins
+    U64 count;
+
+    // Sum and maximum of the durations recorded, in seconds
+    double totalSeconds;
+    double maxSeconds;
+
+    CacheLatencyHistogram();
+
+    void record(double seconds);
+
+    void merge(const CacheLatencyHistogram& other);
+
+    /**
+     * @brief Returns the upper bound in seconds of the bin containing the given percentile (in [0, 100]) of the durations,
+     * or 0 if nothing was recorded.
+     **/
+    double getPercentile(double percentile) const;
+
+    /**
+     * @brief Returns the upper bound in seconds of the given bin
+     **/
+    static double getBinUpperBound(int bin);
+};
+
+/**
+ * @brief Statistics recorded by this process for a bucket of the cache, if enabled with CacheBase::setStatisticsEnabled().
+ * Durations include the time spent waiting for the locks of the cache.
+ **/
+struct CacheBucketStats
+{
+    // Look-ups of entries that hash to this bucket
+    U64 nLookups;
+
+    // Among nLookups, those which found the entry cached
+    U64 nHits;
+
+    // Among nLookups, those which found the entry pending and had to wait for another thread to compute it
+    U64 nPendingHits;
+
+    // Among nLookups, those which did not find the entry and had to compute it
+    U64 nMisses;
+
+    CacheLatencyHistogram lookupLatency;
+
+    // Time spent waiting for a pending entry in CacheEntryLockerBase::waitForPendingEntry()
+    CacheLatencyHistogram pendingEntryWaitLatency;
+
+    // Number of times a lock of the bucket was already taken by another thread when trying to take it
+    U64 nLockContentions;
+
+    // Tiles allocated in this bucket and the time spent to allocate each batch of tiles
+    U64 nTilesAllocated;
+    CacheLatencyHistogram tileAllocationLatency;
+
+    // Entries of this bucket evicted by evictLRUEntries() and the memory they used, in bytes
+    U64 nEvictions;
+    U64 nEvictedBytes;
+
+    CacheBucketStats()
+    : nLookups(0)
+    , nHits(0)
+    , nPendingHits(0)
+    , nMisses(0)
+    , lookupLatency()
+    , pendingEntryWaitLatency()
+    , nLockContentions(0)
+    , nTilesAllocated(0)
+    , tileAllocationLatency()
+    , nEvictions(0)
+    , nEvictedBytes(0)
+    {
+
+    }
+
+    void merge(const CacheBucketStats& other);
+};
+
+/**
+ * @brief A unit of work scheduled with CacheBase::prefetch() to populate the cache ahead of time.
+ * Implementations typically launch a render whose results are not used directly: they are only
+ * there to be found in the cache by a later look-up.
+ **/
+class CachePrefetchTask
+{
+public:
+
+    CachePrefetchTask()
+    : _cancelled()
+    {
+
+    }
+
+    virtual ~CachePrefetchTask()
     {
 
     }
+
+    /**
+     * @brief Called from a prefetch thread of the cache. Implementations should return as soon as possible
+     * once isCancelled() returns true.
+     **/
+    virtual void run() = 0;
+
+    /**
+     * @brief Flags the task as cancelled. If it was not cancelled yet, onCancelled() is called.
+     * This is thread-safe and may be called while run() is executing in another thread.
+     **/
+    void cancel()
+    {
+        if (_cancelled.fetchAndStoreOrdered(1) == 0) {
+            onCancelled();
+        }
+    }
+
+    bool isCancelled() const
+    {
+        return (int)_cancelled != 0;
+    }
+
+protected:
+
+    /**
+     * @brief Called once when the task gets cancelled, e.g: to abort a render in progress in run().
+     **/
+    virtual void onCancelled()
+    {
+
+    }
+
+private:
+
+    QAtomicInt _cancelled;
 };
 
+typedef boost::shared_ptr<CachePrefetchTask> CachePrefetchTaskPtr;
+
 template <bool persistent>
 struct CacheBucket;
 
@@ -186,8 +433,13 @@ public:
      * @param timeout If set to 0, the process will wait forever until the entry becomes available.
      * Otherwise this process will wait up to "timeout" milliseconds for the pending entry. After that, if it still
      * is not available, it will takeover the entry and return a status of eCacheEntryStatusMustCompute.
+     *
+     * @param cancellationToken If set, the thread is woken up as soon as the token is cancelled and then polls the
+     * entry at a short interval: the thread computing the entry is most likely part of the same aborted render
+     * and is about to release it.
      **/
-    virtual CacheEntryStatusEnum waitForPendingEntry(std::size_t timeout = 0) = 0;
+    virtual CacheEntryStatusEnum waitForPendingEntry(std::size_t timeout = 0,
+                                                     const CancellationTokenPtr& cancellationToken = CancellationTokenPtr()) = 0;
 
 
     /**
@@ -243,8 +495,13 @@ public:
      * @param timeout If set to 0, the process will wait forever until the entry becomes available.
      * Otherwise this process will wait up to "timeout" milliseconds for the pending entry. After that, if it still
      * is not available, it will takeover the entry and return a status of eCacheEntryStatusMustCompute.
+     *
+     * @param cancellationToken If set, the thread is woken up as soon as the token is cancelled and then polls the
+     * entry at a short interval: the thread computing the entry is most likely part of the same aborted render
+     * and is about to release it.
      **/
-    virtual CacheEntryStatusEnum waitForPendingEntry(std::size_t timeout = 0) OVERRIDE FINAL WARN_UNUSED_RETURN;
+    virtual CacheEntryStatusEnum waitForPendingEntry(std::size_t timeout = 0,
+                                                     const CancellationTokenPtr& cancellationToken = CancellationTokenPtr()) OVERRIDE FINAL WARN_UNUSED_RETURN;
 
 
     /**
@@ -393,6 +650,97 @@ public:
      **/
     virtual bool hasCacheEntryForHash(U64 hash) const = 0;
 
+    /**
+     * @brief Set the policy used by evictLRUEntries() to select which entries to remove from the cache.
+     **/
+    virtual void setEvictionPolicy(CacheEvictionPolicyEnum policy) = 0;
+
+    /**
+     * @brief Returns the policy used to evict entries from the cache.
+     **/
+    virtual CacheEvictionPolicyEnum getEvictionPolicy() const = 0;
+
+    /**
+     * @brief Returns the hits/misses/evictions that were recorded by this process while the given policy was active.
+     **/
+    virtual void getEvictionStats(CacheEvictionPolicyEnum policy, CacheEvictionStats* stats) const = 0;
+
+    /**
+     * @brief Add to the compute cost of the given entry the given amount of time, in seconds.
+     * The time spent between the look-up that created the entry and insertInCache() is already accounted for:
+     * this is useful for entries that keep on being filled after their insertion, such as image tiles.
+     * The cost is used by the eCacheEvictionPolicyCostAware policy.
+     **/
+    virtual void addEntryComputeCost(const CacheEntryBasePtr& entry, double costSeconds) = 0;
+
+    /**
+     * @brief Set the compression used for the compressed tier of the tiles storage and the maximum size in bytes it may take.
+     * When enabled, instead of dropping the tiles of entries evicted from the cache, they are compressed and kept in memory
+     * until they either get restored with retrieveCompressedTiles() or the compressed tier exceeds maxSize.
+     * The compressed tier is local to the process and counts against the maximum size of the cache, of which it may
+     * not use more than a quarter. Tiles are compressed by a background thread.
+     **/
+    virtual void setCompressedTierParameters(CacheCompressionEnum compression, std::size_t maxSize) = 0;
+
+    /**
+     * @brief Look-up the compressed tier for tiles of the given entry that were evicted from the tiles storage.
+     * Tiles found are allocated again for the entry and uncompressed, as if retrieveAndLockTiles was called with tilesToAlloc
+     * containing only the tiles that were found.
+     * @param localTileIndices The indices that were passed in tilesToAlloc to retrieveAndLockTiles when the tiles were allocated.
+     * @param foundTiles[out] For each local tile index, whether it was restored from the compressed tier
+     * @param allocatedTilesData[out] For each tile found, in the same order as localTileIndices, the tile as a pair of <tileIndex, pointer>.
+     * Same as retrieveAndLockTiles, you must call unLockTiles with the cacheData pointer returned from this function.
+     * @returns True upon success, false otherwise.
+     **/
+    virtual bool retrieveCompressedTiles(const CacheEntryBasePtr& entry,
+                                         const std::vector<U64>& localTileIndices,
+                                         std::vector<bool>* foundTiles,
+                                         std::vector<std::pair<U64, void*> >* allocatedTilesData,
+                                         void** cacheData) = 0;
+
+    /**
+     * @brief Returns the hits recorded by this process on each tier of the tiles storage.
+     **/
+    virtual void getTierStats(CacheTierStats* stats) const = 0;
+
+    /**
+     * @brief Returns the start-up statistics of the cache: how long it took to open and how long it took
+     * before a look-up could be served from it.
+     * For a persistent cache, nBucketsVerified reaches the number of buckets once the background verification is done.
+     **/
+    virtual void getWarmStartStats(CacheWarmStartStats* stats) const = 0;
+
+    /**
+     * @brief Schedules the given task to run in one of the prefetch threads of the cache.
+     * There are only a few prefetch threads so that prefetching does not compete with the renders
+     * requested by the user, and they do not start a task while an interactive render is running
+     * (see WorkStealingExecutor::isHighPriorityExecutorRunning()). The queue of pending tasks is bounded: when it is full the oldest pending task
+     * is cancelled to make room for the new one.
+     * Entries created by a render flagged with TreeRender::CtorArgs::prefetch are accounted for in the
+     * nPrefetchedEntries and nPrefetchHits fields of the CacheReportInfo.
+     **/
+    virtual void prefetch(const CachePrefetchTaskPtr& task) = 0;
+
+    /**
+     * @brief Cancels all pending and running prefetch tasks. This does not wait for running tasks to return.
+     * Typically called when the time of interest changes, e.g: when the timeline playhead jumps.
+     **/
+    virtual void cancelPrefetch() = 0;
+
+    /**
+     * @brief Enables the recording of the per-bucket statistics returned by getBucketStats().
+     * This is disabled by default: when disabled, the cache does not pay for measuring durations.
+     * Statistics recorded so far are kept when disabling, use resetBucketStats() to clear them.
+     **/
+    virtual void setStatisticsEnabled(bool enabled) = 0;
+    virtual bool isStatisticsEnabled() const = 0;
+
+    /**
+     * @brief Returns the statistics recorded by this process for each bucket. The vector is resized to the number of buckets.
+     **/
+    virtual void getBucketStats(std::vector<CacheBucketStats>* stats) const = 0;
+    virtual void resetBucketStats() = 0;
+
     /**
      * @brief Clears the cache of its last recently used entries so at least nBytesToFree are available for the given storage.
      * This should be called before allocating any buffer in the application to ensure we do not hit the swap.
@@ -466,6 +814,7 @@ class Cache
     friend struct CacheEntryLockerPrivate<persistent>;
     friend class CacheEntryLocker<persistent>;
     friend struct CacheBucket<persistent>;
+    friend struct CachePrivate<persistent>;
 
     void initialize(const boost::shared_ptr<Cache<persistent> >& thisShared);
 
@@ -503,6 +852,24 @@ public:
     virtual void unLockTiles(void* cacheData) OVERRIDE FINAL;
     virtual void releaseTiles(const CacheEntryBasePtr& entry, const std::vector<U64>& localIndices, const std::vector<U64>& cacheIndices) OVERRIDE FINAL;
     virtual bool hasCacheEntryForHash(U64 hash) const OVERRIDE FINAL;
+    virtual void setEvictionPolicy(CacheEvictionPolicyEnum policy) OVERRIDE FINAL;
+    virtual CacheEvictionPolicyEnum getEvictionPolicy() const OVERRIDE FINAL;
+    virtual void getEvictionStats(CacheEvictionPolicyEnum policy, CacheEvictionStats* stats) const OVERRIDE FINAL;
+    virtual void addEntryComputeCost(const CacheEntryBasePtr& entry, double costSeconds) OVERRIDE FINAL;
+    virtual void setCompressedTierParameters(CacheCompressionEnum compression, std::size_t maxSize) OVERRIDE FINAL;
+    virtual bool retrieveCompressedTiles(const CacheEntryBasePtr& entry,
+                                         const std::vector<U64>& localTileIndices,
+                                         std::vector<bool>* foundTiles,
+                                         std::vector<std::pair<U64, void*> >* allocatedTilesData,
+                                         void** cacheData) OVERRIDE FINAL;
+    virtual void getTierStats(CacheTierStats* stats) const OVERRIDE FINAL;
+    virtual void getWarmStartStats(CacheWarmStartStats* stats) const OVERRIDE FINAL;
+    virtual void prefetch(const CachePrefetchTaskPtr& task) OVERRIDE FINAL;
+    virtual void cancelPrefetch() OVERRIDE FINAL;
+    virtual void setStatisticsEnabled(bool enabled) OVERRIDE FINAL;
+    virtual bool isStatisticsEnabled() const OVERRIDE FINAL;
+    virtual void getBucketStats(std::vector<CacheBucketStats>* stats) const OVERRIDE FINAL;
+    virtual void resetBucketStats() OVERRIDE FINAL;
     virtual void evictLRUEntries(std::size_t nBytesToFree) OVERRIDE FINAL;
     virtual void clear() OVERRIDE FINAL;
     virtual void removeEntry(const CacheEntryBasePtr& entry) OVERRIDE FINAL;
@@ -36,10 +36,12 @@ struct CacheEntryBasePrivate
 
     CacheBaseWPtr cache;
     CacheEntryKeyBasePtr key;
+    bool prefetched;
 
     CacheEntryBasePrivate(const CacheBasePtr& cache)
     : cache(cache)
     , key()
+    , prefetched(false)
     {
         
     }
@@ -97,6 +99,18 @@ CacheEntryBase::getHashKey(bool forceComputation) const
     return _imp->key->getHash(forceComputation);
 }
 
+void
+CacheEntryBase::setPrefetched(bool prefetched)
+{
+    _imp->prefetched = prefetched;
+}
+
+bool
+CacheEntryBase::isPrefetched() const
+{
+    return _imp->prefetched;
+}
+
 std::size_t
 CacheEntryBase::getMetadataSize() const
 {
@@ -111,6 +111,15 @@ public:
      **/
     U64 getHashKey(bool forceComputation = false) const;
 
+    /**
+     * @brief Flag that this entry is looked-up by a prefetch render (see CacheBase::prefetch()).
+     * When inserted in the cache, the entry is accounted as prefetched. When a regular look-up
+     * finds a prefetched entry, it is accounted as a prefetch hit.
+     * This is process-local and is not written to the memory segment.
+     **/
+    void setPrefetched(bool prefetched);
+    bool isPrefetched() const;
+
     /**
      * @brief This should return exactly the size in bytes of memory taken in the 
      * memory segment of the cache used to store the table of content.
@@ -0,0 +1,159 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "CancellationToken.h"
+
+#include <list>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/weak_ptr.hpp>
+#endif
+
+NATRON_NAMESPACE_ENTER;
+
+struct CancellationTokenPrivate
+{
+    // Set once when the token is cancelled. Read without locking.
+    QAtomicInt cancelled;
+
+    // Protects children and is the mutex of cancelledCond
+    mutable QMutex lock;
+
+    // Woken up when the token is cancelled
+    mutable QWaitCondition cancelledCond;
+
+    // The children do not hold a reference on their parent: they are cancelled by their parent
+    // while it is alive and are simply never cancelled otherwise
+    std::list<CancellationTokenWPtr> children;
+
+    CancellationTokenPrivate()
+        : cancelled()
+        , lock()
+        , cancelledCond()
+        , children()
+    {
+        cancelled.fetchAndStoreOrdered(0);
+    }
+};
+
+CancellationToken::CancellationToken()
+    : _imp( new CancellationTokenPrivate() )
+{
+}
+
+CancellationToken::~CancellationToken()
+{
+}
+
+CancellationTokenPtr
+CancellationToken::create(const CancellationTokenPtr& parent)
+{
+    CancellationTokenPtr ret( new CancellationToken() );
+
+    if (parent) {
+        parent->addChild(ret);
+    }
+
+    return ret;
+}
+
+void
+CancellationToken::addChild(const CancellationTokenPtr& child)
+{
+    bool cancelled;
+    {
+        QMutexLocker k(&_imp->lock);
+
+        // Forget the children that are gone so that the list does not grow for the lifetime of a long render
+        std::list<CancellationTokenWPtr>::iterator it = _imp->children.begin();
+        while ( it != _imp->children.end() ) {
+            if ( it->expired() ) {
+                it = _imp->children.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        _imp->children.push_back(child);
+
+        // cancel() sets the flag before taking the lock: either it sees the child in the list or we see the flag here
+        cancelled = isCancelled();
+    }
+    if (cancelled) {
+        child->cancel();
+    }
+}
+
+bool
+CancellationToken::isCancelled() const
+{
+    return (int)_imp->cancelled != 0;
+}
+
+void
+CancellationToken::cancel()
+{
+    if ( _imp->cancelled.fetchAndStoreOrdered(1) != 0 ) {
+        // Already cancelled
+        return;
+    }
+
+    std::list<CancellationTokenPtr> children;
+    {
+        QMutexLocker k(&_imp->lock);
+        _imp->cancelledCond.wakeAll();
+
+        for (std::list<CancellationTokenWPtr>::const_iterator it = _imp->children.begin(); it != _imp->children.end(); ++it) {
+            CancellationTokenPtr child = it->lock();
+            if (child) {
+                children.push_back(child);
+            }
+        }
+        _imp->children.clear();
+    }
+
+    // Do not hold the lock while cancelling the children: they may be creating their own children
+    for (std::list<CancellationTokenPtr>::const_iterator it = children.begin(); it != children.end(); ++it) {
+        (*it)->cancel();
+    }
+} // cancel
+
+bool
+CancellationToken::waitForCancellation(std::size_t timeoutMS) const
+{
+    QMutexLocker k(&_imp->lock);
+
+    // The flag is set before cancel() takes the lock: if it is not set here, the wakeAll() is not missed
+    if ( isCancelled() ) {
+        return true;
+    }
+    _imp->cancelledCond.wait(&_imp->lock, (unsigned long)timeoutMS);
+
+    return isCancelled();
+}
+
+NATRON_NAMESPACE_EXIT;
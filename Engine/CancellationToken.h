@@ -0,0 +1,95 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef Engine_CancellationToken_h
+#define Engine_CancellationToken_h
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#endif
+
+#include "Global/GlobalDefines.h"
+
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER;
+
+/**
+ * @brief A flag shared by everything working on behalf of a render so that aborting the render is noticed
+ * everywhere: by the tasks of the tree render, the threads of the multi-thread suite, the OpenFX abort() function
+ * and the threads waiting for a pending cache entry.
+ *
+ * Tokens form a hierarchy: cancelling a token cancels all the tokens that were created with it as parent,
+ * and a token created with a cancelled parent is cancelled right away. isCancelled() does not take any lock so
+ * that it can be called for each scanline.
+ *
+ * Threads that must wait for a result computed by another thread should wait with waitForCancellation() instead of
+ * sleeping: they are woken up as soon as the token is cancelled.
+ **/
+struct CancellationTokenPrivate;
+class CancellationToken
+{
+    CancellationToken();
+
+public:
+
+    /**
+     * @brief Creates a token which gets cancelled when parent is cancelled, if any.
+     **/
+    static CancellationTokenPtr create(const CancellationTokenPtr& parent = CancellationTokenPtr());
+
+    ~CancellationToken();
+
+    /**
+     * @brief Returns true once cancel() was called on this token or on one of its ancestors.
+     **/
+    bool isCancelled() const;
+
+    /**
+     * @brief Cancels this token and all its descendants and wakes up the threads waiting on them.
+     * Cancelling a token more than once has no effect.
+     **/
+    void cancel();
+
+    /**
+     * @brief Blocks the calling thread for at most timeoutMS milliseconds or until the token gets cancelled.
+     * Returns true if the token is cancelled.
+     **/
+    bool waitForCancellation(std::size_t timeoutMS) const;
+
+private:
+
+    void addChild(const CancellationTokenPtr& child);
+
+    boost::scoped_ptr<CancellationTokenPrivate> _imp;
+};
+
+NATRON_NAMESPACE_EXIT;
+
+#endif // Engine_CancellationToken_h
@@ -0,0 +1,227 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "ConcurrentFramesController.h"
+
+#include <algorithm> // min, max
+#include <cassert>
+#include <sstream> // stringstream
+
+#include <QtCore/QMutex>
+#include <QtCore/QThreadPool>
+
+#include "Engine/MemoryInfo.h"
+#include "Engine/ThreadPool.h"
+#include "Engine/Timer.h"
+
+// Minimum number of frames over which the throughput is measured. The window is longer when more frames are rendered
+// concurrently so that the frames started with the previous setting do not bias the measure too much.
+#define NATRON_CONCURRENT_FRAMES_MIN_WINDOW 4
+
+// Do not render more frames concurrently when the threads are already busy
+#define NATRON_CONCURRENT_FRAMES_MAX_CPU_USAGE_TO_GROW 0.75
+
+// An additional frame must improve the throughput by this ratio, otherwise it is removed
+#define NATRON_CONCURRENT_FRAMES_MIN_THROUGHPUT_GAIN 0.05
+
+// Below this ratio of free RAM, remove a frame immediately
+#define NATRON_CONCURRENT_FRAMES_MIN_FREE_RAM 0.05
+
+// Below this ratio of free RAM, do not add frames
+#define NATRON_CONCURRENT_FRAMES_MIN_FREE_RAM_TO_GROW 0.10
+
+// Number of windows during which no frame is added after a change that did not pay off
+#define NATRON_CONCURRENT_FRAMES_COOLDOWN_WINDOWS 4
+
+NATRON_NAMESPACE_ENTER;
+
+struct ConcurrentFramesControllerPrivate
+{
+    int minFrames, maxFrames;
+
+    // Used to timestamp samples
+    TimeLapse clock;
+
+    // Protects all fields below
+    mutable QMutex lock;
+
+    int nFrames;
+
+    // The current measure window
+    bool windowStarted;
+    double windowStart;
+    int windowFrames;
+    double windowCPUUsage;
+    double windowMinFreeRAMRatio;
+
+    // If the number of frames was increased at the end of the last window, the previous number and its throughput
+    int previousFrames;
+    double previousFramesPerSecond;
+
+    // Number of windows left before trying to increase again
+    int cooldown;
+
+    ConcurrentFramesControllerPrivate(int initialFrames,
+                                      int minFrames,
+                                      int maxFrames)
+        : minFrames( std::max(1, minFrames) )
+        , maxFrames( std::max(std::max(1, minFrames), maxFrames) )
+        , clock()
+        , lock()
+        , nFrames(0)
+        , windowStarted(false)
+        , windowStart(0)
+        , windowFrames(0)
+        , windowCPUUsage(0)
+        , windowMinFreeRAMRatio(1)
+        , previousFrames(-1)
+        , previousFramesPerSecond(0)
+        , cooldown(0)
+    {
+        nFrames = std::max( this->minFrames, std::min(this->maxFrames, initialFrames) );
+    }
+
+    void startWindow(double timestamp)
+    {
+        windowStarted = true;
+        windowStart = timestamp;
+        windowFrames = 0;
+        windowCPUUsage = 0;
+        windowMinFreeRAMRatio = 1;
+    }
+};
+
+ConcurrentFramesController::ConcurrentFramesController(int initialFrames,
+                                                       int minFrames,
+                                                       int maxFrames)
+    : _imp( new ConcurrentFramesControllerPrivate(initialFrames, minFrames, maxFrames) )
+{
+}
+
+ConcurrentFramesController::~ConcurrentFramesController()
+{
+}
+
+int
+ConcurrentFramesController::getConcurrentFrames() const
+{
+    QMutexLocker k(&_imp->lock);
+
+    return _imp->nFrames;
+}
+
+ConcurrentFramesControllerSample
+ConcurrentFramesController::measure() const
+{
+    ConcurrentFramesControllerSample ret;
+
+    ret.timestamp = _imp->clock.getTimeSinceCreation();
+
+    // Same as MultiThread::getNCPUsAvailable() without the limit of threads per effect, which is irrelevant here
+    QThreadPool* pool = QThreadPool::globalInstance();
+    int maxThreads = std::max(1, pool->maxThreadCount());
+    int activeThreads = pool->activeThreadCount();
+    if ( isRunningInThreadPoolThread() ) {
+        --activeThreads;
+    }
+    activeThreads = std::max(0, std::min(maxThreads, activeThreads));
+    ret.cpuUsage = (double)activeThreads / maxThreads;
+
+    U64 totalRAM = getSystemTotalRAM();
+    if (totalRAM > 0) {
+        ret.freeRAMRatio = std::min(1., (double)getAmountFreePhysicalRAM() / totalRAM);
+    }
+
+    return ret;
+}
+
+bool
+ConcurrentFramesController::addSample(const ConcurrentFramesControllerSample& sample,
+                                      int* concurrentFrames,
+                                      std::string* decision)
+{
+    QMutexLocker k(&_imp->lock);
+
+    if (!_imp->windowStarted) {
+        // The first frame includes the time to start the render
+        _imp->startWindow(sample.timestamp);
+
+        return false;
+    }
+
+    ++_imp->windowFrames;
+    _imp->windowCPUUsage += sample.cpuUsage;
+    _imp->windowMinFreeRAMRatio = std::min(_imp->windowMinFreeRAMRatio, sample.freeRAMRatio);
+
+    std::stringstream ss;
+    ss.setf(std::ios::fixed);
+    ss.precision(1);
+    const int oldFrames = _imp->nFrames;
+
+    if (sample.freeRAMRatio < NATRON_CONCURRENT_FRAMES_MIN_FREE_RAM) {
+        // Memory is low: do not wait for the end of the window
+        if (_imp->nFrames > _imp->minFrames) {
+            --_imp->nFrames;
+            ss << "Free RAM is " << (int)(sample.freeRAMRatio * 100) << "%: rendering " << _imp->nFrames << " frame(s) concurrently instead of " << oldFrames;
+            _imp->previousFrames = -1;
+            _imp->cooldown = NATRON_CONCURRENT_FRAMES_COOLDOWN_WINDOWS;
+            _imp->startWindow(sample.timestamp);
+        }
+    } else if ( _imp->windowFrames >= std::max(NATRON_CONCURRENT_FRAMES_MIN_WINDOW, 2 * _imp->nFrames) ) {
+        double elapsed = sample.timestamp - _imp->windowStart;
+        double fps = elapsed > 0 ? _imp->windowFrames / elapsed : 0.;
+        double cpuUsage = _imp->windowCPUUsage / _imp->windowFrames;
+
+        if (_imp->previousFrames != -1) {
+            // The number of frames was increased at the end of the previous window: keep it only if it paid off
+            if ( fps < _imp->previousFramesPerSecond * (1. + NATRON_CONCURRENT_FRAMES_MIN_THROUGHPUT_GAIN) ) {
+                _imp->nFrames = _imp->previousFrames;
+                _imp->cooldown = NATRON_CONCURRENT_FRAMES_COOLDOWN_WINDOWS;
+                ss << fps << " fps with " << oldFrames << " frames is not better than " << _imp->previousFramesPerSecond
+                   << " fps: rendering " << _imp->nFrames << " frame(s) concurrently";
+            }
+            _imp->previousFrames = -1;
+        } else if (_imp->cooldown > 0) {
+            --_imp->cooldown;
+        } else if ( (cpuUsage < NATRON_CONCURRENT_FRAMES_MAX_CPU_USAGE_TO_GROW) &&
+                    (_imp->windowMinFreeRAMRatio >= NATRON_CONCURRENT_FRAMES_MIN_FREE_RAM_TO_GROW) &&
+                    (_imp->nFrames < _imp->maxFrames) ) {
+            _imp->previousFrames = _imp->nFrames;
+            _imp->previousFramesPerSecond = fps;
+            ++_imp->nFrames;
+            ss << "Threads are " << (int)(cpuUsage * 100) << "% busy at " << fps << " fps: rendering " << _imp->nFrames << " frame(s) concurrently instead of " << oldFrames;
+        }
+        _imp->startWindow(sample.timestamp);
+    }
+
+    if (_imp->nFrames == oldFrames) {
+        return false;
+    }
+    *concurrentFrames = _imp->nFrames;
+    *decision = ss.str();
+
+    return true;
+} // addSample
+
+NATRON_NAMESPACE_EXIT;
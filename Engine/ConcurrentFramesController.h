@@ -0,0 +1,108 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef Engine_ConcurrentFramesController_h
+#define Engine_ConcurrentFramesController_h
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <string>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/scoped_ptr.hpp>
+#endif
+
+#include "Global/GlobalDefines.h"
+
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER;
+
+/**
+ * @brief Measures of the system taken when a frame has been rendered
+ **/
+struct ConcurrentFramesControllerSample
+{
+    // Time at which the frame was rendered, in seconds
+    double timestamp;
+
+    // Fraction of the threads of the thread pool that are busy, in [0, 1]
+    double cpuUsage;
+
+    // Fraction of the physical RAM that is free, in [0, 1]
+    double freeRAMRatio;
+
+    ConcurrentFramesControllerSample()
+        : timestamp(0)
+        , cpuUsage(0)
+        , freeRAMRatio(1)
+    {
+    }
+};
+
+/**
+ * @brief Tunes the number of frames rendered concurrently during a render from the frames/sec measured
+ * over windows of rendered frames, the usage of the thread pool and the free memory.
+ *
+ * The number of frames is increased by one when the threads are not all busy and memory is available. If the
+ * throughput measured over the next window is not better by a margin, the previous number is restored and no
+ * increase is attempted for a few windows. When free memory gets too low, the number is decreased immediately.
+ * The thresholds to increase and to decrease are apart so that the number does not oscillate.
+ *
+ * This class is thread-safe.
+ **/
+struct ConcurrentFramesControllerPrivate;
+class ConcurrentFramesController
+{
+public:
+
+    ConcurrentFramesController(int initialFrames,
+                               int minFrames,
+                               int maxFrames);
+
+    ~ConcurrentFramesController();
+
+    int getConcurrentFrames() const;
+
+    /**
+     * @brief Measures the system now, to be passed to addSample()
+     **/
+    ConcurrentFramesControllerSample measure() const;
+
+    /**
+     * @brief Must be called each time a frame has been rendered. Returns true if the number of concurrent frames changed,
+     * in which case concurrentFrames is set to the new number and decision describes the reason of the change.
+     **/
+    bool addSample(const ConcurrentFramesControllerSample& sample,
+                   int* concurrentFrames,
+                   std::string* decision);
+
+private:
+
+    boost::scoped_ptr<ConcurrentFramesControllerPrivate> _imp;
+};
+
+NATRON_NAMESPACE_EXIT;
+
+#endif // Engine_ConcurrentFramesController_h
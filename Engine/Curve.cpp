@@ -26,6 +26,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <stdexcept>
 
 #if !defined(SBK_RUN) && !defined(Q_MOC_RUN)
@@ -36,12 +37,17 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/AppManager.h"
 
 #include "Engine/CurvePrivate.h"
+#include "Engine/Hash64.h"
+#include "Engine/ImageConvertSIMD.h"
 #include "Engine/Interpolation.h"
 #include "Engine/KnobTypes.h"
 #include "Engine/KnobFile.h"
 #include "Serialization/CurveSerialization.h"
 #include "Engine/Smooth1D.h"
 
+// Number of times Curve::getValuesAt() evaluates at once with the vectorized kernel
+#define NATRON_CURVE_EVALUATION_BLOCK_SIZE 256
+
 NATRON_NAMESPACE_ENTER;
 
 
@@ -233,6 +239,7 @@ Curve::setPeriodic(bool periodic)
     QMutexLocker k(&_imp->_lock);
     _imp->isPeriodic = periodic;
     _imp->keyFrames.clear();
+    onCurveChanged();
 }
 
 bool
@@ -253,6 +260,7 @@ Curve::clearKeyFrames()
     QMutexLocker l(&_imp->_lock);
 
     _imp->keyFrames.clear();
+    onCurveChanged();
 }
 
 bool
@@ -281,6 +289,8 @@ Curve::cloneIndexRange(const Curve& other, int firstKeyIdx, int nKeys)
     QMutexLocker l(&_imp->_lock);
     _imp->keyFrames.clear();
     if (firstKeyIdx >= (int)otherKeys.size()) {
+        onCurveChanged();
+
         return;
     }
     KeyFrameSet::iterator start = otherKeys.begin();
@@ -335,6 +345,8 @@ Curve::cloneAndCheckIfChanged(const Curve& other, double offset, const RangeD* r
             ++oit;
         }
     }
+    onCurveChanged();
+
     return hasChanged;
 }
 
@@ -914,76 +926,170 @@ interParams(const KeyFrameSet &keyFrames,
     }
 }
 
-double
-Curve::getValueAt(TimeValue t,
-                  bool doClamp) const
+/// set the segment i of the flattened curve from the parameters interParams() computes for a time in this segment
+static void
+setEvaluatorSegment(CurveEvaluator* evaluator,
+                    int i,
+                    double tcur,
+                    double vcur,
+                    double vcurDerivRight,
+                    KeyframeTypeEnum interp,
+                    double tnext,
+                    double vnext,
+                    double vnextDerivLeft,
+                    KeyframeTypeEnum interpNext)
+{
+    Interpolation::cubicCoefficients(tcur, vcur,
+                                     vcurDerivRight,
+                                     vnextDerivLeft,
+                                     tnext, vnext,
+                                     interp,
+                                     interpNext,
+                                     &evaluator->segmentStart[i],
+                                     &evaluator->segmentEnd[i],
+                                     &evaluator->c0[i],
+                                     &evaluator->c1[i],
+                                     &evaluator->c2[i],
+                                     &evaluator->c3[i]);
+}
+
+CurveEvaluatorPtr
+CurvePrivate::createEvaluator() const
+{
+    // PRIVATE - the lock must be held
+    boost::shared_ptr<CurveEvaluator> ret(new CurveEvaluator);
+
+    ret->type = type;
+    ret->isPeriodic = isPeriodic;
+    ret->yMin = yMin;
+    ret->yMax = yMax;
+    if ( keyFrames.empty() ) {
+        return ret;
+    }
+
+    const double period = xMax - xMin;
+    ret->periodStart = keyFrames.begin()->getTime() + xMin;
+    ret->period = period;
+
+    const int nKeys = (int)keyFrames.size();
+    ret->keyTimes.reserve(nKeys);
+    ret->segmentStart.resize(nKeys + 1);
+    ret->segmentEnd.resize(nKeys + 1);
+    ret->c0.resize(nKeys + 1);
+    ret->c1.resize(nKeys + 1);
+    ret->c2.resize(nKeys + 1);
+    ret->c3.resize(nKeys + 1);
+
+    const KeyFrame& first = *keyFrames.begin();
+    const KeyFrame& last = *keyFrames.rbegin();
+    KeyFrameSet::const_iterator prev = keyFrames.end();
+    int i = 0;
+    for (KeyFrameSet::const_iterator it = keyFrames.begin(); it != keyFrames.end(); ++it, ++i) {
+        ret->keyTimes.push_back( it->getTime() );
+
+        // Segment i ends at keyframe i
+        if ( prev != keyFrames.end() ) {
+            setEvaluatorSegment(ret.get(), i,
+                                prev->getTime(), prev->getValue(), prev->getRightDerivative(), prev->getInterpolation(),
+                                it->getTime(), it->getValue(), it->getLeftDerivative(), it->getInterpolation());
+        } else if (isPeriodic) {
+            // In-between xMin and the first keyframe
+            setEvaluatorSegment(ret.get(), 0,
+                                last.getTime() - period, last.getValue(), last.getRightDerivative(), last.getInterpolation(),
+                                it->getTime(), it->getValue(), it->getLeftDerivative(), it->getInterpolation());
+        } else {
+            setEvaluatorSegment(ret.get(), 0,
+                                it->getTime() - 1., it->getValue(), 0., eKeyframeTypeNone,
+                                it->getTime(), it->getValue(), it->getLeftDerivative(), it->getInterpolation());
+        }
+        prev = it;
+    }
+
+    // After the last keyframe
+    if (isPeriodic) {
+        // In-between the last keyframe and xMax
+        setEvaluatorSegment(ret.get(), nKeys,
+                            last.getTime(), last.getValue(), last.getRightDerivative(), last.getInterpolation(),
+                            first.getTime() + period, first.getValue(), first.getLeftDerivative(), first.getInterpolation());
+    } else {
+        setEvaluatorSegment(ret.get(), nKeys,
+                            last.getTime(), last.getValue(), last.getRightDerivative(), last.getInterpolation(),
+                            last.getTime() + 1., last.getValue(), 0., eKeyframeTypeNone);
+    }
+
+    return ret;
+} // createEvaluator
+
+CurveEvaluatorPtr
+CurvePrivate::getEvaluator() const
 {
-    QMutexLocker l(&_imp->_lock);
+    CurveEvaluatorPtr ret = boost::atomic_load(&evaluator);
 
-    if ( _imp->keyFrames.empty() ) {
-        //throw std::runtime_error("Curve has no control points!");
+    if (ret) {
+        return ret;
+    }
 
-        // A curve with no control points is considered to be 0
-        // this is to avoid returning StatFailed when KnobParametric::getValue() is called on a parametric curve without control point.
-        return 0.;
+    QMutexLocker l(&_lock);
 
-        // There is no special case for a curve with one (1) keyframe: the result is a linear curve before and after the keyframe.
-    //} else if (_imp->keyFrames.size() == 1) {
-    //    return _imp->keyFrames.begin()->getValue();
+    // Another thread may have built it while this one was waiting for the lock
+    ret = boost::atomic_load(&evaluator);
+    if (!ret) {
+        ret = createEvaluator();
+        boost::atomic_store(&evaluator, ret);
     }
 
-    double v;
-#ifdef NATRON_CURVE_USE_CACHE
-    std::map<double, double>::const_iterator foundCached = _imp->resultCache.find(t);
-    if ( foundCached != _imp->resultCache.end() ) {
-        v = foundCached->second;
-    } else
-#endif
-    {
-        // even when there is only one keyframe, there may be tangents!
-        //if (_imp->keyFrames.size() == 1) {
-        //    //if there's only 1 keyframe, don't bother interpolating
-        //    return (*_imp->keyFrames.begin()).getValue();
-        //}
-        TimeValue tcur, tnext;
-        double vcurDerivRight, vnextDerivLeft, vcur, vnext;
-        KeyframeTypeEnum interp, interpNext;
-        KeyFrame k(t, 0.);
-        // find the first keyframe with time greater than t
-        KeyFrameSet::const_iterator itup;
-        itup = _imp->keyFrames.upper_bound(k);
-        interParams(_imp->keyFrames,
-                    _imp->isPeriodic,
-                    _imp->xMin,
-                    _imp->xMax,
-                    &t,
-                    itup,
-                    &tcur,
-                    &vcur,
-                    &vcurDerivRight,
-                    &interp,
-                    &tnext,
-                    &vnext,
-                    &vnextDerivLeft,
-                    &interpNext);
+    return ret;
+}
 
-        v = Interpolation::interpolate(tcur, vcur,
-                                       vcurDerivRight,
-                                       vnextDerivLeft,
-                                       tnext, vnext,
-                                       t,
-                                       interp,
-                                       interpNext);
-#ifdef NATRON_CURVE_USE_CACHE
-        _imp->resultCache[t] = v;
-#endif
+int
+CurveEvaluator::findSegment(double t,
+                            int hint) const
+{
+    // Segment i holds the times in [keyTimes[i-1], keyTimes[i]), as upper_bound() finds it
+    const int nKeys = (int)keyTimes.size();
+
+    if ( (hint >= 0) && (hint <= nKeys) && ( (hint == 0) || (keyTimes[hint - 1] <= t) ) ) {
+        if ( (hint == nKeys) || (t < keyTimes[hint]) ) {
+            return hint;
+        }
+        if ( (hint + 1 == nKeys) || (t < keyTimes[hint + 1]) ) {
+            return hint + 1;
+        }
     }
 
-    if ( doClamp ) {
-        v = clampValueToCurveYRange(v);
+    return (int)( std::upper_bound(keyTimes.begin(), keyTimes.end(), t) - keyTimes.begin() );
+}
+
+double
+CurveEvaluator::getTimeInPeriod(double t) const
+{
+    if (isPeriodic) {
+        // if the curve is periodic, bring back t in the curve keyframes range
+        assert(period > 0);
+        if ( (t < periodStart) || (t > periodStart + period) ) {
+            t = std::fmod(t - periodStart, period) + periodStart;
+            if (t < periodStart) {
+                t = t + period;
+            }
+        }
+    }
+
+    return t;
+}
+
+double
+CurveEvaluator::getFinalValue(double v,
+                              bool clamp) const
+{
+    if (clamp) {
+        if (v > yMax) {
+            v = yMax;
+        } else if (v < yMin) {
+            v = yMin;
+        }
     }
 
-    switch (_imp->type) {
+    switch (type) {
     case Curve::eCurveTypeString:
     case Curve::eCurveTypeInt:
 
@@ -995,7 +1101,80 @@ Curve::getValueAt(TimeValue t,
 
         return v;
     }
-} // getValueAt
+} // CurveEvaluator::getFinalValue
+
+double
+CurveEvaluator::getValueAt(double t,
+                           bool clamp,
+                           int* hint) const
+{
+    if ( keyTimes.empty() ) {
+        // A curve with no control points is considered to be 0
+        // this is to avoid returning StatFailed when KnobParametric::getValue() is called on a parametric curve without control point.
+        return 0.;
+    }
+
+    t = getTimeInPeriod(t);
+
+    const int i = findSegment(t, *hint);
+    *hint = i;
+
+    return getFinalValue(Interpolation::cubicEval(c0[i], c1[i], c2[i], c3[i], (t - segmentStart[i]) / (segmentEnd[i] - segmentStart[i])), clamp);
+} // CurveEvaluator::getValueAt
+
+void
+CurveEvaluator::getValuesAt(const double* times,
+                            double* values,
+                            int count,
+                            bool clamp) const
+{
+    if ( keyTimes.empty() ) {
+        std::fill(values, values + count, 0.);
+
+        return;
+    }
+
+    // The times are processed by blocks so that the segments and times in the period stay in the L1 cache
+    int segments[NATRON_CURVE_EVALUATION_BLOCK_SIZE];
+    double blockTimes[NATRON_CURVE_EVALUATION_BLOCK_SIZE];
+    int hint = -1;
+    for (int first = 0; first < count; first += NATRON_CURVE_EVALUATION_BLOCK_SIZE) {
+        const int n = std::min(NATRON_CURVE_EVALUATION_BLOCK_SIZE, count - first);
+        for (int i = 0; i < n; ++i) {
+            blockTimes[i] = getTimeInPeriod(times[first + i]);
+            hint = findSegment(blockTimes[i], hint);
+            segments[i] = hint;
+        }
+        ImageConvertSIMD::evaluateCubicSegments(&segmentStart[0], &segmentEnd[0], &c0[0], &c1[0], &c2[0], &c3[0],
+                                                segments, blockTimes, values + first, n);
+        for (int i = 0; i < n; ++i) {
+            values[first + i] = getFinalValue(values[first + i], clamp);
+        }
+    }
+} // CurveEvaluator::getValuesAt
+
+double
+Curve::getValueAt(TimeValue t,
+                  bool doClamp) const
+{
+    // There is no special case for a curve with one (1) keyframe: the result is a linear curve before and after the keyframe.
+    CurveEvaluatorPtr evaluator = _imp->getEvaluator();
+    int segment = -1;
+
+    return evaluator->getValueAt(t, doClamp, &segment);
+}
+
+void
+Curve::getValuesAt(const double* times,
+                   double* values,
+                   int count,
+                   bool doClamp) const
+{
+    // All times are evaluated on the same version of the curve
+    CurveEvaluatorPtr evaluator = _imp->getEvaluator();
+
+    evaluator->getValuesAt(times, values, count, doClamp);
+}
 
 double
 Curve::getDerivativeAt(TimeValue t) const
@@ -1213,6 +1392,7 @@ Curve::setXRange(double a,
 
     _imp->xMin = a;
     _imp->xMax = b;
+    onCurveChanged();
 }
 
 std::pair<double, double> Curve::getXRange() const
@@ -1238,6 +1418,19 @@ Curve::getKeyFrames_mt_safe() const
     return _imp->keyFrames;
 }
 
+void
+Curve::appendToHash(Hash64* hash) const
+{
+    QMutexLocker l(&_imp->_lock);
+
+    for (KeyFrameSet::const_iterator it = _imp->keyFrames.begin(); it != _imp->keyFrames.end(); ++it) {
+        hash->append( (double)it->getTime() );
+        hash->append( it->getValue() );
+        hash->append( it->getLeftDerivative() );
+        hash->append( it->getRightDerivative() );
+    }
+}
+
 KeyFrameSet::iterator
 Curve::setKeyFrameValueAndTimeNoUpdate(double value,
                                        TimeValue time,
@@ -1464,6 +1657,8 @@ Curve::transformKeyframesValueAndTime(const std::list<double>& times,
         ret.first = evaluateCurveChanged(eCurveChangedReasonKeyframeChanged, ret.first);
         
     }
+    onCurveChanged();
+
     return true;
 } // transformKeyframesValueAndTime
 
@@ -1935,14 +2130,14 @@ Curve::setYRange(double yMin,
 
     _imp->yMin = yMin;
     _imp->yMax = yMax;
+    onCurveChanged();
 }
 
 void
 Curve::onCurveChanged()
 {
-#ifdef NATRON_CURVE_USE_CACHE
-    _imp->resultCache.clear();
-#endif
+    // The next evaluation rebuilds the flattened curve
+    boost::atomic_store( &_imp->evaluator, CurveEvaluatorPtr() );
 }
 
 void
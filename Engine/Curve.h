@@ -289,12 +289,24 @@ public:
      */
     double getValueAt(TimeValue t, bool clamp = true) const WARN_UNUSED_RETURN;
 
+    /**
+     * @brief Same as getValueAt() for count times at once: values[i] is the value at times[i].
+     * This does not lock the curve and is fastest when the times are sorted by increasing order.
+     **/
+    void getValuesAt(const double* times, double* values, int count, bool clamp = true) const;
+
     double getDerivativeAt(TimeValue t) const WARN_UNUSED_RETURN;
 
     double getIntegrateFromTo(TimeValue t1, TimeValue t2) const WARN_UNUSED_RETURN;
 
     KeyFrameSet getKeyFrames_mt_safe() const WARN_UNUSED_RETURN;
 
+    /**
+     * @brief Appends the time, value and derivatives of each keyframe to the given hash,
+     * without copying the keyframes.
+     **/
+    void appendToHash(Hash64* hash) const;
+
     void clearKeyFrames();
 
     /**
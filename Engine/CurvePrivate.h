@@ -27,6 +27,9 @@
 
 #include "Global/Macros.h"
 
+#include <limits>
+#include <vector>
+
 #if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
 #include <boost/shared_ptr.hpp>
 #endif
@@ -43,16 +46,86 @@
 
 NATRON_NAMESPACE_ENTER;
 
-//#define NATRON_CURVE_USE_CACHE
+/**
+ * @brief Immutable flattened form of a curve, evaluated by Curve::getValueAt() and Curve::getValuesAt() without taking
+ * the curve lock.
+ * For n keyframes there are n+1 segments: segment 0 is before the first keyframe, segment i (0 < i < n) is in-between
+ * keyframes i-1 and i and segment n is after the last keyframe. The value at t in segment i is
+ * Interpolation::cubicEval(c0[i], c1[i], c2[i], c3[i], (t - segmentStart[i]) / (segmentEnd[i] - segmentStart[i])),
+ * which is exactly what Interpolation::interpolate() would compute from the keyframes.
+ **/
+struct CurveEvaluator
+{
+    // The time of each keyframe, sorted
+    std::vector<double> keyTimes;
+
+    // Per segment
+    std::vector<double> segmentStart, segmentEnd;
+    std::vector<double> c0, c1, c2, c3;
 
+    Curve::CurveTypeEnum type;
+    bool isPeriodic;
+
+    // For periodic curves, times are brought back in [periodStart, periodStart + period]
+    double periodStart, period;
+    double yMin, yMax;
+
+    CurveEvaluator()
+    : keyTimes()
+    , segmentStart()
+    , segmentEnd()
+    , c0()
+    , c1()
+    , c2()
+    , c3()
+    , type(Curve::eCurveTypeDouble)
+    , isPeriodic(false)
+    , periodStart(0.)
+    , period(0.)
+    , yMin(-std::numeric_limits<double>::infinity())
+    , yMax(std::numeric_limits<double>::infinity())
+    {
+    }
+
+    /**
+     * @brief Returns the segment containing t, which must have been brought back in the period for periodic curves.
+     * hint is the segment of a previous evaluation: consecutive evaluations at increasing times are found in
+     * constant time.
+     **/
+    int findSegment(double t, int hint) const;
+
+    /**
+     * @brief For periodic curves, brings back t in [periodStart, periodStart + period]
+     **/
+    double getTimeInPeriod(double t) const;
+
+    /**
+     * @brief Clamps the value of the cubic to the Y range if clamp is true and rounds it for int and bool curves
+     **/
+    double getFinalValue(double v, bool clamp) const;
+
+    /**
+     * @brief Returns the value of the curve at t
+     **/
+    double getValueAt(double t, bool clamp, int* hint) const;
+
+    /**
+     * @brief Same as getValueAt() for count times: the segments are found in scalar code then the cubics are
+     * evaluated with the vectorized kernel of ImageConvertSIMD
+     **/
+    void getValuesAt(const double* times, double* values, int count, bool clamp) const;
+};
+
+typedef boost::shared_ptr<const CurveEvaluator> CurveEvaluatorPtr;
 
 struct CurvePrivate
 {
     KeyFrameSet keyFrames;
 
-#ifdef NATRON_CURVE_USE_CACHE
-    std::map<double, double> resultCache; //< a cache for interpolations
-#endif
+    // The flattened form of the curve. Built lazily under _lock and published with boost::atomic_store() so that
+    // readers fetch it with boost::atomic_load() without locking. It is reset by Curve::onCurveChanged() whenever the
+    // curve is modified.
+    mutable CurveEvaluatorPtr evaluator;
 
     Curve::CurveTypeEnum type;
     double xMin, xMax;
@@ -64,9 +137,7 @@ struct CurvePrivate
 
     CurvePrivate()
     : keyFrames()
-#ifdef NATRON_CURVE_USE_CACHE
-    , resultCache()
-#endif
+    , evaluator()
     , type(Curve::eCurveTypeDouble)
     , xMin(-std::numeric_limits<double>::infinity())
     , xMax(std::numeric_limits<double>::infinity())
@@ -98,9 +169,17 @@ struct CurvePrivate
         displayMax = other.displayMax;
         isPeriodic = other.isPeriodic;
         canMoveY = other.canMoveY;
+        boost::atomic_store( &evaluator, CurveEvaluatorPtr() );
     }
 
-    
+    /**
+     * @brief Returns the flattened form of the curve, building it if the curve changed since it was last built.
+     **/
+    CurveEvaluatorPtr getEvaluator() const;
+
+private:
+
+    CurveEvaluatorPtr createEvaluator() const;
 };
 
 NATRON_NAMESPACE_EXIT;
@@ -43,6 +43,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
 GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #endif
 
+#include <QtCore/QAtomicInt>
 #include <QtCore/QReadWriteLock>
 #include <QtCore/QCoreApplication>
 #include <QtConcurrentMap> // QtCore on Qt4, QtConcurrent on Qt5
@@ -54,6 +55,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/AppManager.h"
 #include "Engine/EffectOpenGLContextData.h"
 #include "Engine/Cache.h"
+#include "Engine/Distortion2D.h"
 #include "Engine/EffectInstanceActionResults.h"
 #include "Engine/EffectInstanceTLSData.h"
 #include "Engine/Image.h"
@@ -63,6 +65,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/Log.h"
 #include "Engine/MemoryInfo.h" // printAsRAM
 #include "Engine/Node.h"
+#include "Engine/NodeGroup.h"
 #include "Engine/OfxEffectInstance.h"
 #include "Engine/OfxOverlayInteract.h"
 #include "Engine/OfxImageEffectInstance.h"
@@ -257,6 +260,54 @@ EffectInstance::appendToHash(const ComputeHashArgs& args, Hash64* hash)
 
 } // appendToHash
 
+void
+EffectInstance::addExpressionHashListener(const KnobIPtr& knob)
+{
+    if ( addHashListener(knob) ) {
+        _imp->common->nExpressionHashListeners.fetchAndAddOrdered(1);
+    }
+}
+
+void
+EffectInstance::removeExpressionHashListener(const KnobIPtr& knob)
+{
+    if ( removeListener(knob) ) {
+        _imp->common->nExpressionHashListeners.fetchAndAddOrdered(-1);
+    }
+}
+
+bool
+EffectInstance::hasExpressionHashListeners() const
+{
+    return (int)_imp->common->nExpressionHashListeners > 0;
+}
+
+// The results of an ExprTk expression referencing an effect (its region of definition...) must be refreshed
+// when anything upstream of the effect changes: invalidate such effects downstream.
+// The hash cache of the other effects downstream knows it was computed from ours and is discarded lazily.
+static void
+invalidateExpressionHashListenersDownstream(const EffectInstance* effect,
+                                            std::set<const EffectInstance*>* visitedEffects,
+                                            std::set<HashableObject*>* invalidatedObjects)
+{
+    NodesList outputs;
+    effect->getNode()->getOutputsWithGroupRedirection(outputs);
+    for (NodesList::const_iterator it = outputs.begin(); it != outputs.end(); ++it) {
+        const NodePtr& outputNode = *it;
+        if (!outputNode) {
+            continue;
+        }
+        EffectInstancePtr outputEffect = outputNode->getEffectInstance();
+        if ( !outputEffect || !visitedEffects->insert( outputEffect.get() ).second ) {
+            continue;
+        }
+        if ( outputEffect->hasExpressionHashListeners() ) {
+            outputEffect->invalidateHashCacheRecursive(false /*recurse*/, invalidatedObjects);
+        }
+        invalidateExpressionHashListenersDownstream(outputEffect.get(), visitedEffects, invalidatedObjects);
+    }
+} // invalidateExpressionHashListenersDownstream
+
 bool
 EffectInstance::invalidateHashCacheRecursive(const bool recurse, std::set<HashableObject*>* invalidatedObjects)
 {
@@ -283,15 +334,9 @@ EffectInstance::invalidateHashCacheRecursive(const bool recurse, std::set<Hashab
     }
 
     if (recurse) {
-        NodesList outputs;
-        getNode()->getOutputsWithGroupRedirection(outputs);
-        for (NodesList::const_iterator it = outputs.begin(); it != outputs.end(); ++it) {
-            const NodePtr& outputNode = *it;
-            if (!outputNode) {
-                continue;
-            }
-            outputNode->getEffectInstance()->invalidateHashCacheRecursive(recurse, invalidatedObjects);
-        }
+        std::set<const EffectInstance*> visitedEffects;
+        visitedEffects.insert(this);
+        invalidateExpressionHashListenersDownstream(this, &visitedEffects, invalidatedObjects);
     }
     return true;
 } // invalidateHashCacheImplementation
@@ -998,6 +1043,16 @@ EffectInstance::isRenderAborted() const
 
 }
 
+CancellationTokenPtr
+EffectInstance::getCancellationToken() const
+{
+    TreeRenderPtr render = getCurrentRender();
+    if (!render) {
+        return CancellationTokenPtr();
+    }
+    return render->getCancellationToken();
+}
+
 EffectInstanceTLSDataPtr
 EffectInstance::getTLSObject() const
 {
@@ -1115,8 +1170,18 @@ EffectInstance::evaluate(bool isSignificant,
 
 
     // Get the connected viewers downstream and re-render or redraw them.
+    // If the change was reported to only affect a region of the output, the viewers only re-render what depends on it.
+    bool hasChangedRegion = _imp->common->changedRegionSet && _imp->common->changedRegionValid;
+    RectD changedRegion = _imp->common->changedRegion;
+    TimeValue changedRegionTime = _imp->common->changedRegionTime;
+    _imp->common->changedRegionSet = false;
     if (isSignificant) {
-        getApp()->renderAllViewers();
+        if (hasChangedRegion) {
+            getApp()->renderAllViewersInRegion(shared_from_this(), changedRegion, changedRegionTime);
+        } else {
+            ++_imp->common->fullEvaluationsCount;
+            getApp()->renderAllViewers();
+        }
     } else {
         getApp()->redrawAllViewers();
     }
@@ -1127,6 +1192,193 @@ EffectInstance::evaluate(bool isSignificant,
     }
 } // evaluate
 
+void
+EffectInstance::addChangedRegionForNextEvaluation(const RectD& region,
+                                                  TimeValue time)
+{
+    assert( QThread::currentThread() == qApp->thread() );
+    if (!_imp->common->changedRegionSet) {
+        _imp->common->changedRegion = region;
+        _imp->common->changedRegionTime = time;
+        _imp->common->changedRegionSet = true;
+        _imp->common->changedRegionValid = true;
+    } else if (_imp->common->changedRegionTime != time) {
+        // Regions computed at different times cannot be merged: the whole output is considered to change
+        _imp->common->changedRegionValid = false;
+    } else if ( _imp->common->changedRegion.isNull() ) {
+        _imp->common->changedRegion = region;
+    } else if ( !region.isNull() ) {
+        _imp->common->changedRegion.merge(region);
+    }
+}
+
+U64
+EffectInstance::getFullEvaluationsCount() const
+{
+    assert( QThread::currentThread() == qApp->thread() );
+
+    return _imp->common->fullEvaluationsCount;
+}
+
+bool
+EffectInstance::getOutputRegionChangedByInput(int inputNb,
+                                              TimeValue time,
+                                              ViewIdx view,
+                                              const RectD& inputRegion,
+                                              RectD* outputRegion)
+{
+    // If the effect is identity on the format, that means its bound to be identity anywhere and does not depend on the render window.
+    {
+        IsIdentityResultsPtr identityResults;
+        ActionRetCodeEnum stat = isIdentity_public(true, time, RenderScale(1.), getOutputFormat(), view, ImagePlaneDesc::getRGBAComponents() /*insignificant*/, &identityResults);
+        if ( isFailureRetCode(stat) ) {
+            return false;
+        }
+        int identityInputNb = -1;
+        TimeValue identityTime(0.);
+        ViewIdx identityView;
+        ImagePlaneDesc identityPlane;
+        if (identityResults) {
+            identityResults->getIdentityData(&identityInputNb, &identityTime, &identityView, &identityPlane);
+        }
+        if (identityInputNb >= 0) {
+            if (identityInputNb != inputNb) {
+                // The output is another input
+                outputRegion->clear();
+
+                return true;
+            }
+            if ( (identityTime == time) && (identityView == view) ) {
+                *outputRegion = inputRegion;
+
+                return true;
+            }
+
+            return false;
+        } else if (identityInputNb == -2) {
+            return false;
+        }
+    }
+
+    // The effect distorts its input with a matrix: map the region through it
+    if ( !getCurrentCanDistort() && !getCurrentCanTransform() ) {
+        return false;
+    }
+    GetDistortionResultsPtr results;
+    ActionRetCodeEnum stat = getDistortion_public(time, RenderScale(1.), false /*draftRender*/, view, &results);
+    if ( isFailureRetCode(stat) || !results ) {
+        return false;
+    }
+    DistortionFunction2DPtr disto = results->getResults();
+    if ( !disto || !disto->transformMatrix || (disto->inputNbToDistort != inputNb) ) {
+        return false;
+    }
+
+    Transform::Matrix3x3 mat(*disto->transformMatrix);
+
+    // The mat is in pixel coordinates if the plug-in is only "canTransform", convert it to canonical
+    if ( getCurrentCanTransform() ) {
+        EffectInstancePtr input = getInputMainInstance(inputNb);
+        double par = input ? input->getAspectRatio(-1) : 1.;
+        mat = Transform::matMul(Transform::matPixelToCanonical(par, 1, 1, false), mat);
+        mat = Transform::matMul( mat, Transform::matCanonicalToPixel(par, 1, 1, false) );
+    }
+
+    // The matrix maps output positions to input positions, the input region is thus mapped with its inverse
+    return Transform::inverseTransformRegion(inputRegion, mat, outputRegion);
+} // getOutputRegionChangedByInput
+
+/**
+ * @brief Returns true if effect is a node inside the group groupEffect, at any depth
+ **/
+static bool
+isEffectInsideGroup(const EffectInstancePtr& effect,
+                    const EffectInstancePtr& groupEffect)
+{
+    NodePtr groupNode = groupEffect->getNode();
+    NodePtr node = effect->getNode();
+
+    while (node) {
+        NodeGroupPtr container = toNodeGroup( node->getGroup() );
+        if (!container) {
+            return false;
+        }
+        node = container->getNode();
+        if (node == groupNode) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+typedef std::map<EffectInstance*, std::pair<bool, RectD> > ChangedRegionsMap;
+
+static bool
+getOutputRegionChangedByUpstreamEffectInternal(const EffectInstancePtr& effect,
+                                               const EffectInstancePtr& changedEffect,
+                                               const RectD& changedRegion,
+                                               TimeValue time,
+                                               ViewIdx view,
+                                               ChangedRegionsMap* visitedEffects,
+                                               RectD* outputRegion)
+{
+    // Effects may be reached through different branches of the tree, only visit them once
+    ChangedRegionsMap::const_iterator found = visitedEffects->find( effect.get() );
+    if ( found != visitedEffects->end() ) {
+        *outputRegion = found->second.second;
+
+        return found->second.first;
+    }
+
+    bool ok = true;
+    RectD region;
+    if ( (effect == changedEffect) || isEffectInsideGroup(effect, changedEffect) ) {
+        region = changedRegion;
+    } else {
+        int nInputs = effect->getMaxInputCount();
+        for (int i = 0; i < nInputs && ok; ++i) {
+            EffectInstancePtr input = effect->getInputMainInstance(i);
+            if (!input) {
+                continue;
+            }
+            RectD inputRegion;
+            ok = getOutputRegionChangedByUpstreamEffectInternal(input, changedEffect, changedRegion, time, view, visitedEffects, &inputRegion);
+            if ( !ok || inputRegion.isNull() ) {
+                continue;
+            }
+            RectD regionForInput;
+            ok = effect->getOutputRegionChangedByInput(i, time, view, inputRegion, &regionForInput);
+            if ( !ok || regionForInput.isNull() ) {
+                continue;
+            }
+            if ( region.isNull() ) {
+                region = regionForInput;
+            } else {
+                region.merge(regionForInput);
+            }
+        }
+    }
+
+    (*visitedEffects)[effect.get()] = std::make_pair(ok, region);
+    *outputRegion = region;
+
+    return ok;
+} // getOutputRegionChangedByUpstreamEffectInternal
+
+bool
+EffectInstance::getOutputRegionChangedByUpstreamEffect(const EffectInstancePtr& changedEffect,
+                                                       const RectD& changedRegion,
+                                                       TimeValue time,
+                                                       ViewIdx view,
+                                                       RectD* outputRegion)
+{
+    assert( QThread::currentThread() == qApp->thread() );
+    ChangedRegionsMap visitedEffects;
+
+    return getOutputRegionChangedByUpstreamEffectInternal(shared_from_this(), changedEffect, changedRegion, time, view, &visitedEffects, outputRegion);
+}
+
 bool
 EffectInstance::message(MessageTypeEnum type,
                         const std::string & content) const
@@ -123,6 +123,7 @@ NATRON_NAMESPACE_ENTER;
 #define PLUGINID_NATRON_WRITE               (NATRON_ORGANIZATION_DOMAIN_TOPLEVEL "." NATRON_ORGANIZATION_DOMAIN_SUB ".built-in.Write")
 #define PLUGINID_NATRON_ONEVIEW             (NATRON_ORGANIZATION_DOMAIN_TOPLEVEL "." NATRON_ORGANIZATION_DOMAIN_SUB ".built-in.OneView")
 #define PLUGINID_NATRON_STUB                (NATRON_ORGANIZATION_DOMAIN_TOPLEVEL "." NATRON_ORGANIZATION_DOMAIN_SUB ".built-in.Stub")
+#define PLUGINID_NATRON_PIXELEXPRESSION     (NATRON_ORGANIZATION_DOMAIN_TOPLEVEL "." NATRON_ORGANIZATION_DOMAIN_SUB ".built-in.PixelExpression")
 
 #define kReaderParamNameOriginalFrameRange "originalFrameRange"
 #define kReaderParamNameFirstFrame "firstFrame"
@@ -930,12 +931,21 @@ public:
 public:
 
     /**
-     * @brief Recursively invalidates the hash of this node and the nodes downstream.
+     * @brief Invalidates the hash of this node. The hash cache of the nodes downstream is discarded
+     * the next time they look it up. Only the effects downstream that are referenced by an expression
+     * are invalidated, so that its results are refreshed.
      **/
     virtual bool invalidateHashCacheInternal(std::set<HashableObject*>* invalidatedObjects) OVERRIDE ;
 
     bool invalidateHashCacheRecursive(const bool recurse, std::set<HashableObject*>* invalidatedObjects);
 
+    /**
+     * @brief Add/remove an expression knob which must be invalidated along with the hash of this effect.
+     **/
+    void addExpressionHashListener(const KnobIPtr& knob);
+    void removeExpressionHashListener(const KnobIPtr& knob);
+    bool hasExpressionHashListeners() const;
+
 
 public:
 
@@ -1184,6 +1194,11 @@ public:
      **/
     bool isRenderAborted() const;
 
+    /**
+     * @brief Convenience function for getCurrentRender()->getCancellationToken(). Returns NULL when not rendering.
+     **/
+    CancellationTokenPtr getCancellationToken() const;
+
     /**
      * @brief Effects are always copied throughout a render
      **/
@@ -1682,6 +1697,47 @@ public:
      **/
     virtual void evaluate(bool isSignificant, bool refreshMetadata) OVERRIDE;
 
+    /**
+     * @brief Reports that the next significant evaluate() call only changes the output of this effect at the given time
+     * within the given region, in canonical coordinates. The viewers displaying this time then only re-render the portion
+     * of their image that depends on this region, the others are fully re-rendered.
+     * Multiple calls before evaluate() are merged, unless they were made for different times in which case the whole
+     * output is considered to change. This must be called on the main thread, on the main instance.
+     **/
+    void addChangedRegionForNextEvaluation(const RectD& region, TimeValue time);
+
+    /**
+     * @brief Returns the number of significant evaluate() calls that changed the whole output of this effect,
+     * i.e: that were not preceded by a call to addChangedRegionForNextEvaluation().
+     * This is used to know whether a region reported previously is still valid. Only call on the main thread.
+     **/
+    U64 getFullEvaluationsCount() const;
+
+    /**
+     * @brief Returns in outputRegion the region of the output of this effect, in canonical coordinates, that changes when
+     * the image of the given input changes over inputRegion. An empty outputRegion means that the output does not depend on this input.
+     * Returns false if it cannot be determined, in which case the whole output should be considered to change.
+     * By default this handles identity effects and effects that distort their input with a matrix.
+     * This is called on the main thread, on the main instance.
+     **/
+    virtual bool getOutputRegionChangedByInput(int inputNb,
+                                               TimeValue time,
+                                               ViewIdx view,
+                                               const RectD& inputRegion,
+                                               RectD* outputRegion);
+
+    /**
+     * @brief Same as getOutputRegionChangedByInput() but for a change of the output of changedEffect anywhere upstream of this effect
+     * over changedRegion. If this effect is changedEffect or is part of its implementation (i.e: it is inside the group changedEffect)
+     * changedRegion is returned as is.
+     * This is called on the main thread, on the main instance.
+     **/
+    bool getOutputRegionChangedByUpstreamEffect(const EffectInstancePtr& changedEffect,
+                                                const RectD& changedRegion,
+                                                TimeValue time,
+                                                ViewIdx view,
+                                                RectD* outputRegion);
+
     PluginMemoryPtr createMemoryChunk(std::size_t nBytes);
 
 protected:
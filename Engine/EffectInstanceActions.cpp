@@ -472,7 +472,7 @@ EffectInstance::getLayersProducedAndNeeded_public(TimeValue inArgsTime, ViewIdx
 
     CacheEntryLockerBase::CacheEntryStatusEnum cacheStatus = cacheAccess->getStatus();
     while (cacheStatus == CacheEntryLockerBase::eCacheEntryStatusComputationPending) {
-        cacheStatus = cacheAccess->waitForPendingEntry();
+        cacheStatus = cacheAccess->waitForPendingEntry(0, getCancellationToken());
     }
 
     if (cacheStatus == CacheEntryLockerBase::eCacheEntryStatusCached) {
@@ -810,7 +810,7 @@ EffectInstance::getDistortion_public(TimeValue inArgsTime,
 
             CacheEntryLockerBase::CacheEntryStatusEnum cacheStatus = cacheAccess->getStatus();
             while (cacheStatus == CacheEntryLockerBase::eCacheEntryStatusComputationPending) {
-                cacheStatus = cacheAccess->waitForPendingEntry();
+                cacheStatus = cacheAccess->waitForPendingEntry(0, getCancellationToken());
             }
 
             if (cacheStatus == CacheEntryLockerBase::eCacheEntryStatusCached) {
@@ -923,7 +923,7 @@ EffectInstance::isIdentity_public(bool useIdentityCache, // only set to true whe
 
         CacheEntryLockerBase::CacheEntryStatusEnum cacheStatus = cacheAccess->getStatus();
         while (cacheStatus == CacheEntryLockerBase::eCacheEntryStatusComputationPending) {
-            cacheStatus = cacheAccess->waitForPendingEntry();
+            cacheStatus = cacheAccess->waitForPendingEntry(0, getCancellationToken());
         }
 
         if (cacheStatus == CacheEntryLockerBase::eCacheEntryStatusCached) {
@@ -1035,7 +1035,7 @@ EffectInstance::getRegionOfDefinition_public(TimeValue inArgsTime,
 
         CacheEntryLockerBase::CacheEntryStatusEnum cacheStatus = cacheAccess->getStatus();
         while (cacheStatus == CacheEntryLockerBase::eCacheEntryStatusComputationPending) {
-            cacheStatus = cacheAccess->waitForPendingEntry();
+            cacheStatus = cacheAccess->waitForPendingEntry(0, getCancellationToken());
         }
 
         if (cacheStatus == CacheEntryLockerBase::eCacheEntryStatusCached) {
@@ -1400,7 +1400,7 @@ EffectInstance::getFramesNeeded_public(TimeValue inArgsTime,
 
         CacheEntryLockerBase::CacheEntryStatusEnum cacheStatus = cacheAccess->getStatus();
         while (cacheStatus == CacheEntryLockerBase::eCacheEntryStatusComputationPending) {
-            cacheStatus = cacheAccess->waitForPendingEntry();
+            cacheStatus = cacheAccess->waitForPendingEntry(0, getCancellationToken());
         }
 
         if (cacheStatus == CacheEntryLockerBase::eCacheEntryStatusCached) {
@@ -1559,7 +1559,7 @@ EffectInstance::getFrameRange_public(GetFrameRangeResultsPtr* results)
 
     CacheEntryLockerBase::CacheEntryStatusEnum cacheStatus = cacheAccess->getStatus();
     while (cacheStatus == CacheEntryLockerBase::eCacheEntryStatusComputationPending) {
-        cacheStatus = cacheAccess->waitForPendingEntry();
+        cacheStatus = cacheAccess->waitForPendingEntry(0, getCancellationToken());
     }
 
     if (cacheStatus == CacheEntryLockerBase::eCacheEntryStatusCached) {
@@ -1837,7 +1837,7 @@ EffectInstance::getTimeInvariantMetadata_public(GetTimeInvariantMetadataResultsP
 
     CacheEntryLockerBase::CacheEntryStatusEnum cacheStatus = cacheAccess->getStatus();
     while (cacheStatus == CacheEntryLockerBase::eCacheEntryStatusComputationPending) {
-        cacheStatus = cacheAccess->waitForPendingEntry();
+        cacheStatus = cacheAccess->waitForPendingEntry(0, getCancellationToken());
     }
 
     if (cacheStatus == CacheEntryLockerBase::eCacheEntryStatusCached) {
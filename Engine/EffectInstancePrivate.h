@@ -36,6 +36,7 @@
 #include <QtCore/QCoreApplication>
 #include <QtCore/QWaitCondition>
 #include <QtCore/QMutex>
+#include <QtCore/QAtomicInt>
 
 #include "Global/GlobalDefines.h"
 
@@ -255,6 +256,20 @@ struct EffectInstanceCommonData
     // Active interacts, only accessed on the main thread
     std::list<OverlayInteractBasePtr> interacts;
 
+    // The region of the output, in canonical coordinates, reported with addChangedRegionForNextEvaluation()
+    // and consumed by the next call to evaluate(), along with the time at which it was computed.
+    // changedRegionValid is false if regions were reported at different times. Only accessed on the main thread
+    RectD changedRegion;
+    TimeValue changedRegionTime;
+    bool changedRegionSet;
+    bool changedRegionValid;
+
+    // Number of significant evaluations that did not report a changed region, only accessed on the main thread
+    U64 fullEvaluationsCount;
+
+    // The number of ExprTk expressions referencing this effect, see addExpressionHashListener()
+    QAtomicInt nExpressionHashListeners;
+
 
     EffectInstanceCommonData()
     : attachedContextsMutex(QMutex::Recursive)
@@ -271,6 +286,12 @@ struct EffectInstanceCommonData
     , accumBufferMutex()
     , accumBuffer()
     , interacts()
+    , changedRegion()
+    , changedRegionTime(0)
+    , changedRegionSet(false)
+    , changedRegionValid(false)
+    , fullEvaluationsCount(0)
+    , nExpressionHashListeners(0)
     {
 
     }
@@ -484,6 +505,18 @@ public:
      **/
     CacheAccessModeEnum shouldRenderUseCache(const RequestPassSharedDataPtr& requestPassSharedData, const FrameViewRequestPtr& requestPassData);
 
+    /**
+     * @brief Helper function in the implementation of renderRoI to register the request in the InFlightRequestTable
+     * so that concurrent renders requesting the same frame/view of this node share a single computation.
+     **/
+    void registerInFlightRequest(const FrameViewRequestPtr& requestPassData);
+
+    /**
+     * @brief If the request is attached to the in-flight request of an older render, waits for its results and re-uses them.
+     * Returns true if the results of the other render were re-used, false if this request must be rendered.
+     **/
+    bool fetchInFlightRequestResults(const FrameViewRequestPtr& requestPassData);
+
     ActionRetCodeEnum handleUpstreamFramesNeeded(const RequestPassSharedDataPtr& requestPassSharedData,
                                                  const FrameViewRequestPtr& requestPassData,
                                                  const RenderScale& proxyScale,
@@ -495,6 +528,13 @@ public:
     bool canSplitRenderWindowWithIdentityRectangles(const RenderScale& renderMappedScale,
                                                     RectD* inputRoDIntersection);
 
+    /**
+     * @brief Returns true if the user enabled host tiling for this plug-in and it applies to this render:
+     * the render window is then split in strips aligned to the cache tiles that are rendered concurrently
+     * even though the plug-in is eRenderSafetyInstanceSafe. An eRenderSafetyUnsafe plug-in is never tiled.
+     **/
+    bool isHostTilingActive(RenderBackendTypeEnum backendType) const;
+
     static RenderBackendTypeEnum storageModeToBackendType(StorageModeEnum storage);
 
     static StorageModeEnum storageModeFromBackendType(RenderBackendTypeEnum backend);
@@ -61,8 +61,10 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/Cache.h"
 #include "Engine/CacheEntryBase.h"
 #include "Engine/CacheEntryKeyBase.h"
+#include "Engine/Hash64.h"
 #include "Engine/Image.h"
 #include "Engine/ImageCacheEntry.h"
+#include "Engine/InFlightRequestTable.h"
 #include "Engine/KnobFile.h"
 #include "Engine/KnobTypes.h"
 #include "Engine/KnobItemsTable.h"
@@ -645,6 +647,13 @@ EffectInstance::Implementation::checkRestToRender(bool updateTilesStateFromCache
 
         const unsigned int nThreads = MultiThread::getNCPUsAvailable();
         reducedRects = mainRenderRect.splitIntoSmallerRects(nThreads);
+    } else if (reducedRects.size() == 1 && isHostTilingActive(requestData->getRenderDevice())) {
+        RectI mainRenderRect = reducedRects.front();
+
+        // The plug-in is not thread-safe but the user indicated that it can render disjoint windows concurrently:
+        // split the render window in strips so that each tile is rendered by a single thread.
+        const unsigned int nThreads = MultiThread::getNCPUsAvailable();
+        reducedRects = mainRenderRect.splitIntoTileAlignedStrips(tilesState.tileSizeY, nThreads);
     }
     for (std::list<RectI>::const_iterator it = reducedRects.begin(); it != reducedRects.end(); ++it) {
         if (!it->isNull()) {
@@ -656,6 +665,29 @@ EffectInstance::Implementation::checkRestToRender(bool updateTilesStateFromCache
     return eActionStatusOK;
 } // checkRestToRender
 
+bool
+EffectInstance::Implementation::isHostTilingActive(RenderBackendTypeEnum backendType) const
+{
+#ifdef NATRON_HOSTFRAMETHREADING_SEQUENTIAL
+    Q_UNUSED(backendType);
+    return false;
+#else
+    // An eRenderSafetyUnsafe plug-in is serialized with a lock shared by all its instances: concurrent strips
+    // would either have to bypass that lock or dead-lock on it, so host tiling is only offered to
+    // eRenderSafetyInstanceSafe plug-ins. Fully safe plug-ins are already rendered concurrently.
+    if (_publicInterface->getCurrentRenderThreadSafety() != eRenderSafetyInstanceSafe) {
+        return false;
+    }
+
+    // Strips are only rendered concurrently on CPU and the plug-in must accept a render window smaller than its RoD
+    if (backendType != eRenderBackendTypeCPU || !_publicInterface->getCurrentSupportTiles()) {
+        return false;
+    }
+    NodePtr node = _publicInterface->getNode();
+    return node->isMultiThreadingSupportEnabledForPlugin() && node->isHostTilingEnabledForPlugin();
+#endif
+} // isHostTilingActive
+
 RenderBackendTypeEnum
 EffectInstance::Implementation::storageModeToBackendType(StorageModeEnum storage)
 {
@@ -1451,6 +1483,12 @@ EffectInstance::requestRenderInternal(const RectD & roiCanonical,
     // If there's nothing to render, do not even add the inputs as needed dependencies.
     if (requestStatus == FrameViewRequest::eFrameViewRequestStatusNotRendered) {
 
+        // Images that are cached are already shared with other renders by the cache. Other images are shared through the
+        // in-flight requests table.
+        if (cachePolicy == eCacheAccessModeNone && backendType == eRenderBackendTypeCPU && !isAccumulating) {
+            _imp->registerInFlightRequest(requestData);
+        }
+
         ActionRetCodeEnum upstreamRetCode = _imp->handleUpstreamFramesNeeded(requestPassSharedData, requestData, proxyScale, mappedMipMapLevel, roundedCanonicalRoI, inputLayersNeeded);
         
         if (isFailureRetCode(upstreamRetCode)) {
@@ -1460,6 +1498,93 @@ EffectInstance::requestRenderInternal(const RectD & roiCanonical,
     return eActionStatusOK;
 } // requestRenderInternal
 
+void
+EffectInstance::Implementation::registerInFlightRequest(const FrameViewRequestPtr& requestData)
+{
+    bool isOwner;
+    InFlightRequestPtr inFlightRequest = requestData->getInFlightRequest(&isOwner);
+    if (inFlightRequest) {
+        // The RoI was merged with the RoI requested by another branch of the tree
+        if (isOwner) {
+            inFlightRequest->setRoI( requestData->getCurrentRoI() );
+        }
+        return;
+    }
+
+    TreeRenderPtr render = _publicInterface->getCurrentRender();
+
+    // Identify the request with the same data as the key of the image in the cache, plus the mipmap level
+    // which is not part of the image key.
+    U64 key;
+    {
+        Hash64 hash;
+        HashableObject::ComputeHashArgs args;
+        args.time = _publicInterface->getCurrentRenderTime();
+        args.view = _publicInterface->getCurrentRenderView();
+        args.hashType = HashableObject::eComputeHashTypeTimeViewVariant;
+        hash.append( _publicInterface->computeHash(args) );
+        Hash64::appendQString(QString::fromUtf8( requestData->getPlaneDesc().getPlaneID().c_str() ), &hash);
+        Hash64::appendQString(QString::fromUtf8( requestData->getPlaneDesc().getChannelsLabel().c_str() ), &hash);
+        hash.append( requestData->getMipMapLevel() );
+        hash.append( requestData->getProxyScale().x );
+        hash.append( requestData->getProxyScale().y );
+        hash.append( _publicInterface->isDraftRenderSupported() && render->isDraftRender() );
+        hash.computeHash();
+        key = hash.value();
+    }
+
+    inFlightRequest = appPTR->getInFlightRequestTable()->registerRequest(key, render->getRenderIndex(), requestData->getCurrentRoI(), &isOwner);
+    if (inFlightRequest) {
+        requestData->setInFlightRequest(inFlightRequest, isOwner);
+    }
+} // registerInFlightRequest
+
+bool
+EffectInstance::Implementation::fetchInFlightRequestResults(const FrameViewRequestPtr& requestData)
+{
+    bool isOwner;
+    InFlightRequestPtr inFlightRequest = requestData->getInFlightRequest(&isOwner);
+    if (!inFlightRequest || isOwner) {
+        return false;
+    }
+
+    // Only wait for an owner that started rendering: an owner that did not start may still be waiting on its own inputs
+    // which may in turn be waiting on this render.
+    if (inFlightRequest->getState() == InFlightRequest::eStateNotStarted) {
+        return false;
+    }
+
+    // The owner was created before this render (see InFlightRequestTable::registerRequest) hence it never waits on this render
+    // through the table: there is no need for a timeout. The wait stops when this render is aborted.
+    ActionRetCodeEnum ownerStat;
+    RectD ownerRoI;
+    ImagePtr ownerRequestedScaleImage, ownerFullScaleImage;
+    if ( !inFlightRequest->waitForResults(_publicInterface->getCancellationToken(), 0 /*timeoutMS*/, &ownerStat, &ownerRoI, &ownerRequestedScaleImage, &ownerFullScaleImage) ) {
+        return false;
+    }
+
+    // The owner may have rendered a smaller region than what this request needs
+    if ( isFailureRetCode(ownerStat) || !ownerRequestedScaleImage || !ownerRoI.contains( requestData->getCurrentRoI() ) ) {
+        return false;
+    }
+
+    // The tiles of the images of this request were marked pending in requestRender(), release them
+    FrameViewRequestLocker requestLocker(requestData);
+    ImagePtr requestedScaleImage = requestData->getRequestedScaleImagePlane();
+    ImagePtr fullScaleImage = requestData->getFullscaleImagePlane();
+    if (requestedScaleImage) {
+        requestedScaleImage->getCacheEntry()->markCacheTilesAsAborted();
+    }
+    if (fullScaleImage && fullScaleImage != requestedScaleImage) {
+        fullScaleImage->getCacheEntry()->markCacheTilesAsAborted();
+    }
+
+    requestData->setRequestedScaleImagePlane(ownerRequestedScaleImage);
+    requestData->setFullscaleImagePlane(ownerFullScaleImage ? ownerFullScaleImage : ownerRequestedScaleImage);
+
+    return true;
+} // fetchInFlightRequestResults
+
 
 
 ActionRetCodeEnum
@@ -1483,8 +1608,29 @@ EffectInstance::launchRender(const RequestPassSharedDataPtr& requestPassSharedDa
                 break;
         }
     }
+
+    // Re-use the results of the same request rendered by another render, if any
+    if ( _imp->fetchInFlightRequestResults(requestData) ) {
+        requestData->notifyRenderFinished(eActionStatusOK);
+        return eActionStatusOK;
+    }
+
+    bool isInFlightRequestOwner;
+    InFlightRequestPtr inFlightRequest = requestData->getInFlightRequest(&isInFlightRequestOwner);
+    if (!isInFlightRequestOwner) {
+        inFlightRequest.reset();
+    }
+    if (inFlightRequest) {
+        inFlightRequest->notifyRenderStarted();
+    }
+
     ActionRetCodeEnum stat = launchRenderInternal(requestPassSharedData, requestData);
 
+    // Publish the results to the requests of other renders attached to this one
+    if (inFlightRequest) {
+        inFlightRequest->notifyRenderFinished(stat, requestData->getCurrentRoI(), requestData->getRequestedScaleImagePlane(), requestData->getFullscaleImagePlane());
+    }
+
     // Notify that we are done rendering
     requestData->notifyRenderFinished(stat);
     return stat;
@@ -1841,7 +1987,7 @@ EffectInstance::Implementation::launchPluginRenderAndHostFrameThreading(const Fr
 #ifdef NATRON_HOSTFRAMETHREADING_SEQUENTIAL
     const bool attemptHostFrameThreading = false;
 #else
-    const bool attemptHostFrameThreading = _publicInterface->getCurrentRenderThreadSafety() == eRenderSafetyFullySafeFrame &&
+    const bool attemptHostFrameThreading = (_publicInterface->getCurrentRenderThreadSafety() == eRenderSafetyFullySafeFrame || isHostTilingActive(backendType)) &&
                                            renderRects.size() > 1 &&
                                            backendType == eRenderBackendTypeCPU;
 #endif
@@ -87,9 +87,11 @@ SOURCES += \
     Cache.cpp \
     CacheEntryBase.cpp \
     CacheEntryKeyBase.cpp \
+    CancellationToken.cpp \
     CLArgs.cpp \
     CoonsRegularization.cpp \
     ColorParser.cpp \
+    ConcurrentFramesController.cpp \
     CornerPinOverlayInteract.cpp \
     CreateNodeArgs.cpp \
     Curve.cpp \
@@ -110,7 +112,9 @@ SOURCES += \
     FileDownloader.cpp \
     FileSystemModel.cpp \
     FitCurve.cpp \
+    ForkJoinPool.cpp \
     Format.cpp \
+    FramePipeline.cpp \
     FrameViewRequest.cpp \
     GenericSchedulerThread.cpp \
     GenericSchedulerThreadWatcher.cpp \
@@ -124,6 +128,7 @@ SOURCES += \
     ImageCacheEntry.cpp \
     ImageCacheKey.cpp \
     ImageConvert.cpp \
+    ImageConvertSIMD.cpp \
     ImagePlaneDesc.cpp  \
     ImageCopyChannels.cpp \
     ImageFill.cpp \
@@ -131,6 +136,7 @@ SOURCES += \
     ImageMaskMix.cpp \
     ImageStorage.cpp \
     ImageTilesState.cpp \
+    InFlightRequestTable.cpp \
     IPCCommon.cpp \
     Interpolation.cpp \
     JoinViewsNode.cpp \
@@ -180,6 +186,7 @@ SOURCES += \
     OneViewNode.cpp \
     OutputSchedulerThread.cpp \
     OverlayInteractBase.cpp \
+    PixelExpressionNode.cpp \
     PointOverlayInteract.cpp \
     Plugin.cpp \
     PluginMemory.cpp \
@@ -229,6 +236,7 @@ SOURCES += \
     StubNode.cpp \
     TabWidgetI.cpp \
     Texture.cpp \
+    ThreadAffinity.cpp \
     ThreadPool.cpp \
     TimeLine.cpp \
     Timer.cpp \
@@ -252,6 +260,7 @@ SOURCES += \
     ViewerNodeKnobs.cpp \
     ViewerNodeOverlays.cpp \
     ViewIdx.cpp \
+    WorkStealingExecutor.cpp \
     WriteNode.cpp \
     ../Global/glad_source.c \
     ../Global/FStreamsSupport.cpp \
@@ -336,11 +345,13 @@ HEADERS += \
     Cache.h \
     CacheEntryBase.h \
     CacheEntryKeyBase.h \
+    CancellationToken.h \
     CoonsRegularization.h \
     CornerPinOverlayInteract.h \
     ChoiceOption.h \
     Color.h \
     ColorParser.h \
+    ConcurrentFramesController.h \
     CreateNodeArgs.h \
     Curve.h \
     CurvePrivate.h \
@@ -360,7 +371,9 @@ HEADERS += \
     FileDownloader.h \
     FileSystemModel.h \
     FitCurve.h \
+    ForkJoinPool.h \
     Format.h \
+    FramePipeline.h \
     FrameViewRequest.h \
     GenericSchedulerThread.h \
     GenericSchedulerThreadWatcher.h \
@@ -375,12 +388,14 @@ HEADERS += \
     ImageCacheEntry.h \
     ImageCacheEntryProcessing.h \
     ImageCacheKey.h \
+    ImageConvertSIMD.h \
     ImagePrivate.h \
     ImagePlaneDesc.h \
     Interpolation.h \
     IPCCommon.h \
     ImageStorage.h \
     ImageTilesState.h \
+    InFlightRequestTable.h \
     JoinViewsNode.h \
     KeybindShortcut.h \
     Knob.h \
@@ -433,6 +448,8 @@ HEADERS += \
     OutputSchedulerThread.h \
     OverlaySupport.h \
     OverlayInteractBase.h \
+    PixelExpression.h \
+    PixelExpressionNode.h \
     PointOverlayInteract.h \
     Plugin.h \
     PluginActionShortcut.h \
@@ -487,6 +504,7 @@ HEADERS += \
     StubNode.h \
     TabWidgetI.h \
     Texture.h \
+    ThreadAffinity.h \
     ThreadStorage.h \
     ThreadPool.h \
     TimeLine.h \
@@ -514,6 +532,7 @@ HEADERS += \
     ViewerNode.h \
     ViewerNodePrivate.h \
     ViewIdx.h \
+    WorkStealingExecutor.h \
     WriteNode.h \
     ../Global/Enums.h \
     ../Global/FStreamsSupport.h \
@@ -140,6 +140,7 @@ class CacheSignalEmitter;
 class CacheEntryKeyBase;
 class CacheEntryBase;
 class CacheEntryLockerBase;
+class CancellationToken;
 template<bool persistent> class CacheEntryLocker;
 class CompNodeItem;
 class CreateNodeArgs;
@@ -156,7 +157,10 @@ class EffectOpenGLContextData;
 class ExistenceCheckerThread;
 class FileSystemItem;
 class FileSystemModel;
+class ForkJoin;
+class ForkJoinPool;
 class Format;
+class FramePipeline;
 class FramebufferConfig;
 struct FrameViewRenderKey;
 class FrameViewRequest;
@@ -190,6 +194,8 @@ class ImageCacheEntry;
 class ImageCacheKey;
 class ImagePlaneDesc;
 class ImageTilesState;
+class InFlightRequest;
+class InFlightRequestTable;
 class IsIdentityKey;
 class IsIdentityResults;
 class JoinViewsNode;
@@ -251,6 +257,8 @@ class OpenGLRendererInfo;
 class OpenGLViewerI;
 class OverlayInteractBase;
 class OverlaySupport;
+class PixelExpression;
+class PixelExpressionNode;
 class Plugin;
 class PluginGroupNode;
 class PluginMemory;
@@ -305,6 +313,7 @@ class ViewIdx;
 class ViewerCurrentFrameRequestSchedulerStartArgs;
 class ViewerInstance;
 class ViewerNode;
+class WorkStealingExecutor;
 class WriteNode;
 
 namespace Color {
@@ -331,6 +340,7 @@ typedef boost::shared_ptr<BezierCP> BezierCPPtr;
 typedef boost::shared_ptr<BufferedFrame> BufferedFramePtr;
 typedef boost::shared_ptr<BufferedFrameContainer> BufferedFrameContainerPtr;
 typedef boost::shared_ptr<CacheEntryLockerBase> CacheEntryLockerBasePtr;
+typedef boost::shared_ptr<CancellationToken> CancellationTokenPtr;
 typedef boost::shared_ptr<CompNodeItem> CompNodeItemPtr;
 typedef boost::shared_ptr<CacheBase> CacheBasePtr;
 typedef boost::shared_ptr<Curve> CurvePtr;
@@ -349,6 +359,8 @@ typedef boost::shared_ptr<FrameViewRequest> FrameViewRequestPtr;
 typedef boost::shared_ptr<const FrameViewRequest> FrameViewRequestConstPtr;
 typedef boost::shared_ptr<FileSystemItem> FileSystemItemPtr;
 typedef boost::shared_ptr<FileSystemModel> FileSystemModelPtr;
+typedef boost::shared_ptr<ForkJoin> ForkJoinPtr;
+typedef boost::shared_ptr<FramePipeline> FramePipelinePtr;
 typedef boost::shared_ptr<GenericWatcherCallerArgs> WatcherCallerArgsPtr;
 typedef boost::shared_ptr<GenericActionTLSArgs> GenericActionTLSArgsPtr;
 typedef boost::shared_ptr<GetRegionOfDefinitionResults> GetRegionOfDefinitionResultsPtr;
@@ -375,6 +387,7 @@ typedef boost::shared_ptr<const Image> ImageConstPtr;
 typedef boost::shared_ptr<ImageCacheEntry> ImageCacheEntryPtr;
 typedef boost::shared_ptr<ImageCacheKey> ImageCacheKeyPtr;
 typedef boost::shared_ptr<ImageTilesState> ImageTilesStatePtr;
+typedef boost::shared_ptr<InFlightRequest> InFlightRequestPtr;
 typedef boost::shared_ptr<JoinViewsNode> JoinViewsNodePtr;
 typedef boost::shared_ptr<KnobBool> KnobBoolPtr;
 typedef boost::shared_ptr<KnobButton> KnobButtonPtr;
@@ -422,6 +435,8 @@ typedef boost::shared_ptr<OSGLContext> OSGLContextPtr;
 typedef boost::shared_ptr<OSGLContextAttacher> OSGLContextAttacherPtr;
 typedef boost::shared_ptr<OverlayInteractBase> OverlayInteractBasePtr;
 typedef boost::shared_ptr<OfxOverlayInteract> OfxOverlayInteractPtr;
+typedef boost::shared_ptr<PixelExpression> PixelExpressionPtr;
+typedef boost::shared_ptr<PixelExpressionNode> PixelExpressionNodePtr;
 typedef boost::shared_ptr<PrecompNode> PrecompNodePtr;
 typedef boost::shared_ptr<ProcessHandler> ProcessHandlerPtr;
 typedef boost::shared_ptr<Project> ProjectPtr;
@@ -463,6 +478,7 @@ typedef boost::shared_ptr<TreeRender> TreeRenderPtr;
 typedef boost::shared_ptr<UndoCommand> UndoCommandPtr;
 typedef boost::shared_ptr<ViewerInstance> ViewerInstancePtr;
 typedef boost::shared_ptr<ViewerNode> ViewerNodePtr;
+typedef boost::shared_ptr<WorkStealingExecutor> WorkStealingExecutorPtr;
 typedef boost::shared_ptr<WriteNode> WriteNodePtr;
 typedef boost::weak_ptr<AbortableRenderInfo> AbortableRenderInfoWPtr;
 typedef boost::weak_ptr<AnimatingObjectI> AnimatingObjectIWPtr;
@@ -470,12 +486,14 @@ typedef boost::weak_ptr<AppInstance> AppInstanceWPtr;
 typedef boost::weak_ptr<Bezier> BezierWPtr;
 typedef boost::weak_ptr<CompNodeItem> CompNodeItemWPtr;
 typedef boost::weak_ptr<CacheBase> CacheBaseWPtr;
+typedef boost::weak_ptr<CancellationToken> CancellationTokenWPtr;
 typedef boost::weak_ptr<Curve> CurveWPtr;
 typedef boost::weak_ptr<EffectInstance> EffectInstanceWPtr;
 typedef boost::weak_ptr<FrameViewRequest> FrameViewRequestWPtr;
 typedef boost::weak_ptr<HashableObject> HashableObjectWPtr;
 typedef boost::weak_ptr<OSGLContext> OSGLContextWPtr;
 typedef boost::weak_ptr<Image> ImageWPtr;
+typedef boost::weak_ptr<InFlightRequest> InFlightRequestWPtr;
 typedef boost::weak_ptr<KnobBool> KnobBoolWPtr;
 typedef boost::weak_ptr<KnobButton> KnobButtonWPtr;
 typedef boost::weak_ptr<KnobChoice> KnobChoiceWPtr;
@@ -28,11 +28,16 @@
 #include <sstream> // stringstream
 #include <string>
 
+#include "Engine/Hash64.h"
 #include "Engine/KnobItemsTable.h"
 #include "Engine/Noise.h"
+#include "Engine/PixelExpression.h"
 #include "Engine/PyExprUtils.h"
 #include "Global/StrUtils.h"
 
+// Number of evaluations of an expression after which a compiled expression that was not used is deleted
+#define NATRON_EXPRTK_POOL_MAX_IDLE_RELEASES 256
+
 // reduce object size:
 // we only include exprtk.hpp here, no need have visible template instanciations since it's not used elsewhere
 
@@ -119,8 +124,8 @@ NATRON_NAMESPACE_ANONYMOUS_EXIT
 
 /**
  * @brief All data that must be kept around for the expression to work.
- * Since the expression is not thread safe, we compile 1 expression for each thread to enable
- * concurrent evaluation of the same expression.
+ * Since the expression is not thread safe, each concurrent evaluation of the same expression uses its own
+ * compiled expression, see KnobExprExprTk::pool.
  **/
 struct NATRON_NAMESPACE::KnobExprExprTk::ExpressionData
 {
@@ -142,6 +147,38 @@ NATRON_NAMESPACE::KnobExprExprTk::createData()
     return KnobExprExprTk::ExpressionDataPtr(new ExpressionData);
 }
 
+KnobExprExprTk::ExpressionDataPtr
+NATRON_NAMESPACE::KnobExprExprTk::takeData()
+{
+    QMutexLocker k(&lock);
+
+    if ( pool.empty() ) {
+        return ExpressionDataPtr();
+    }
+    ExpressionDataPtr ret = pool.front().data;
+    pool.pop_front();
+
+    return ret;
+}
+
+void
+NATRON_NAMESPACE::KnobExprExprTk::releaseData(const ExpressionDataPtr& data)
+{
+    QMutexLocker k(&lock);
+
+    ++nReleases;
+    PooledExpressionData pooled;
+    pooled.data = data;
+    pooled.releaseIndex = nReleases;
+    pool.push_front(pooled);
+
+    // The least recently used expressions are at the back: forget those that were not used for a while, they were
+    // only needed by a burst of concurrent evaluations
+    while ( (pool.size() > 1) && (pool.back().releaseIndex + NATRON_EXPRTK_POOL_MAX_IDLE_RELEASES < nReleases) ) {
+        pool.pop_back();
+    }
+}
+
 NATRON_NAMESPACE_ANONYMOUS_ENTER
 
 template <typename T, typename FuncType>
@@ -448,6 +485,31 @@ struct pnoise
     }
 };
 
+// The initial hash of the random functions at the given time
+static U32
+getRandomHashAtTime(TimeValue time)
+{
+    // Make the hash vary from time
+    alias_cast_float ac;
+
+    ac.data = (float)time;
+
+    return ac.raw;
+}
+
+// Mixes all the bits of value into the hash of a random function. Adding the value to the hash converted to float
+// would lose the values that are small compared to the hash, e.g. random(1) and random(2) would often be equal.
+static U32
+mixRandomHash(U32 hash,
+              double value)
+{
+    U64 raw = Hash64::toU64(value);
+
+    hash = hashFunction( hash ^ (U32)(raw & 0xffffffff) );
+
+    return hashFunction( hash ^ (U32)(raw >> 32) );
+}
+
 struct random
     : public exprtk_igeneric_function_t
 {
@@ -458,12 +520,17 @@ struct random
         , lastRandomHash(0)
     {
         exprtk::enable_zero_parameters(*this);
-        // Make the hash vary from time
-        {
-            alias_cast_float ac;
-            ac.data = (float)time;
-            lastRandomHash = ac.raw;
-        }
+        reset(time);
+    }
+
+    void reset(TimeValue time)
+    {
+        lastRandomHash = getRandomHashAtTime(time);
+    }
+
+    void reset(U32 hash)
+    {
+        lastRandomHash = hash;
     }
     
     virtual exprtk_scalar_t operator()(const std::size_t& overloadIdx,
@@ -486,9 +553,7 @@ struct random
         }
         
         if (seed) {
-            alias_cast_float ac;
-            ac.data = lastRandomHash + (float)seed;
-            lastRandomHash = ac.raw;
+            lastRandomHash = mixRandomHash(lastRandomHash, seed);
         }
         lastRandomHash = hashFunction(lastRandomHash);
 
@@ -505,13 +570,19 @@ struct randomInt
         : exprtk_igeneric_function_t("Z|T|TTT")
         , lastRandomHash(0)
     {
-        // Make the hash vary from time
-        {
-            alias_cast_float ac;
-            ac.data = (float)time;
-            lastRandomHash += ac.raw;
-        }
+        reset(time);
     }
+
+    void reset(TimeValue time)
+    {
+        lastRandomHash = getRandomHashAtTime(time);
+    }
+
+    void reset(U32 hash)
+    {
+        lastRandomHash = hash;
+    }
+
     virtual exprtk_scalar_t operator()(const std::size_t& overloadIdx,
                                        parameter_list_t parameters) OVERRIDE FINAL
     {
@@ -532,9 +603,7 @@ struct randomInt
         }
         
         if (seed) {
-            alias_cast_float ac;
-            ac.data = lastRandomHash + (float)seed;
-            lastRandomHash = ac.raw;
+            lastRandomHash = mixRandomHash(lastRandomHash, seed);
         }
         lastRandomHash = hashFunction(lastRandomHash);
         
@@ -635,24 +704,55 @@ addGenericFunctions(TimeValue time,
     }
 }
 
-// Some functions (random) hold an internal state. Instead of using the same state for all threads,
-// We create a copy of the function update in this symbol table
+// Some functions (random) hold an internal state. A compiled expression is only ever evaluated by one thread at a time
+// (see KnobExprExprTk::pool) and holds its own copy of these functions: reset their state so that the evaluation
+// only depends on the time, and not on the previous evaluations of the same compiled expression.
 void
-makeLocalCopyOfStateFunctions(TimeValue time,
-                              exprtk_symbol_table_t& symbol_table,
-                              exprtk_igeneric_function_table_t* functions)
+resetStateFunctions(TimeValue time,
+                    const exprtk_igeneric_function_table_t& functions)
 {
-    symbol_table.remove_function("random");
-    symbol_table.remove_function("randomInt");
+    for (std::size_t i = 0; i < functions.size(); ++i) {
+        exprtk_igeneric_function_t* func = functions[i].second.get();
+        random* isRandom = dynamic_cast<random*>(func);
+        if (isRandom) {
+            isRandom->reset(time);
+            continue;
+        }
+        randomInt* isRandomInt = dynamic_cast<randomInt*>(func);
+        if (isRandomInt) {
+            isRandomInt->reset(time);
+        }
+    }
+}
+
+// Returns a compiled expression to the pool of its expression when going out of scope, unless it was discarded
+// because it could not be compiled.
+class ExprTkDataPool_RAII
+{
+    KnobExprExprTk* _expr;
+    KnobExprExprTk::ExpressionDataPtr _data;
+
+public:
+
+    ExprTkDataPool_RAII(KnobExprExprTk* expr,
+                        const KnobExprExprTk::ExpressionDataPtr& data)
+        : _expr(expr)
+        , _data(data)
     {
-        shared_ptr<exprtk_igeneric_function_t> ptr( new random(time) );
-        functions->push_back( make_pair("random", ptr) );
     }
+
+    ~ExprTkDataPool_RAII()
     {
-        shared_ptr<exprtk_igeneric_function_t> ptr( new randomInt(time) );
-        functions->push_back( make_pair("randomInt", ptr) );
+        if (_data) {
+            _expr->releaseData(_data);
+        }
     }
-}
+
+    void discard()
+    {
+        _data.reset();
+    }
+};
 
 bool
 isDimensionIndex(const string& str,
@@ -1515,12 +1615,9 @@ KnobHelperPrivate::validateExprTkExpression(const string& expression,
 
     // Symbol table containing all pre-declared variables (frame, view etc...)
     exprtk_symbol_table_t symbol_table;
-    QThread* curThread = QThread::currentThread();
 
-    KnobExprExprTk::ExpressionDataPtr& data = ret->data[curThread];
-    if (!data) {
-        data = KnobExprExprTk::createData();
-    }
+    // The expression compiled here is the first one of the pool: it is handed to the first evaluation
+    KnobExprExprTk::ExpressionDataPtr data = KnobExprExprTk::createData();
     data->expressionObject.reset(new exprtk_expression_t);
     data->expressionObject->register_symbol_table(unknown_var_symbol_table);
     data->expressionObject->register_symbol_table(symbol_table);
@@ -1572,6 +1669,8 @@ KnobHelperPrivate::validateExprTkExpression(const string& expression,
     case KnobHelper::eExpressionReturnValueTypeString:
         break;
     }
+
+    ret->releaseData(data);
 } // validateExprTkExpression
 
 KnobHelper::ExpressionReturnValueTypeEnum
@@ -1587,9 +1686,10 @@ KnobHelper::executeExprTkExpression(TimeValue time,
     // Take the expression mutex. Copying the exprtk expression does not actually copy all variables and functions, it just
     // increments a shared reference count.
     // To be thread safe we have 2 solutions:
-    // 1) Compile the expression for each thread and then run it without a mutex
+    // 1) Compile the expression for each concurrent evaluation and then run it without a mutex
     // 2) Compile only once and run the expression under a lock
-    // We picked solution 1)
+    // We picked solution 1): compiled expressions are taken from a pool shared by all threads, so that the
+    // expression is compiled at most once per concurrent evaluation rather than once per thread.
     {
         QMutexLocker k(&_imp->common->expressionMutex);
         ExprPerViewMap::const_iterator foundView = _imp->common->expressions[dimension].find(view);
@@ -1603,22 +1703,12 @@ KnobHelper::executeExprTkExpression(TimeValue time,
         assert(obj);
     }
 
-    QThread* curThread = QThread::currentThread();
-
-    KnobExprExprTk::ExpressionDataPtr data;
-    {
-        QMutexLocker k(&obj->lock);
-        KnobExprExprTk::PerThreadDataMap::iterator foundThreadData = obj->data.find(curThread);
-        if ( foundThreadData == obj->data.end() ) {
-            data = KnobExprExprTk::createData();
-            pair<KnobExprExprTk::PerThreadDataMap::iterator, bool> ret = obj->data.insert( make_pair(curThread, data) );
-            assert(ret.second);
-            foundThreadData = ret.first;
-        } else {
-            data = foundThreadData->second;
-            assert(data);
-        }
+    // Nobody else may use this compiled expression until it is returned to the pool
+    KnobExprExprTk::ExpressionDataPtr data = obj->takeData();
+    if (!data) {
+        data = KnobExprExprTk::createData();
     }
+    ExprTkDataPool_RAII dataReleaser(obj.get(), data);
 
     // If we are a render clone, we must also reference clones that are local to this render
     bool isRenderClone = getHolder()->isRenderClone();
@@ -1655,9 +1745,8 @@ KnobHelper::executeExprTkExpression(TimeValue time,
         // Update the frame & view in the know table
         symbol_table->variable_ref("frame") = (double)time;
 
-        // Remove from the symbol table functions that hold a state, and re-add a new fresh local copy of them so that the state
-        // is local to this thread.
-        makeLocalCopyOfStateFunctions(time, *symbol_table, &data->genericFunctions);
+        // Reset the functions that hold a state
+        resetStateFunctions(time, data->genericFunctions);
     } else {
         double time_f = (double)time;
         symbol_table->create_variable("frame", time_f);
@@ -1676,7 +1765,7 @@ KnobHelper::executeExprTkExpression(TimeValue time,
 
 
 
-    // If the expression did not exist already on this thread, create a USR which will create the variables.
+    // If the expression was not compiled already, create a USR which will create the variables.
     // Otherwise, update existing ones to their current value
     if (!existingExpression) {
         exprtk_parser_t parser;
@@ -1688,6 +1777,8 @@ KnobHelper::executeExprTkExpression(TimeValue time,
 
         string error;
         if ( !parseExprtkExpression(obj->expressionString, obj->modifiedExpression, parser, *data->expressionObject, &error) ) {
+            dataReleaser.discard();
+
             return KnobHelper::eExpressionReturnValueTypeError;
         }
     } else {
@@ -1788,4 +1879,286 @@ KnobHelper::executeExprTkExpression(const string& expr,
     return handleExprTkReturn(expressionObj, retValueIsScalar, retValueIsString, error);
 } // executeExprTkExpression
 
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+/**
+ * @brief The expressions of the 4 channels compiled against their own variables: a PixelExpressionInstance
+ * may only be evaluated by one thread at a time.
+ **/
+struct PixelExpressionInstance
+{
+    // The per-pixel variables, the compiled expressions reference them by address
+    exprtk_scalar_t x, y, r, g, b, a;
+
+    // Holds the functions and vector variables referenced by the expressions
+    KnobExprExprTk::ExpressionDataPtr data;
+
+    exprtk_expression_t expressions[4];
+
+    // If an expression does not depend on the pixel, this is its value
+    bool isConstant[4];
+    exprtk_scalar_t constantValue[4];
+
+    // The functions holding a state, they are reset for each pixel so that the result does not depend on the order
+    // in which the pixels are evaluated
+    std::vector<random*> randomFunctions;
+    std::vector<randomInt*> randomIntFunctions;
+
+    PixelExpressionInstance()
+    : x(0)
+    , y(0)
+    , r(0)
+    , g(0)
+    , b(0)
+    , a(0)
+    , data()
+    , expressions()
+    , randomFunctions()
+    , randomIntFunctions()
+    {
+        for (int i = 0; i < 4; ++i) {
+            isConstant[i] = false;
+            constantValue[i] = 0.;
+        }
+    }
+};
+
+typedef shared_ptr<PixelExpressionInstance> PixelExpressionInstancePtr;
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+struct PixelExpressionPrivate
+{
+    std::string expressions[4];
+
+    // The knob from which symbols are resolved
+    KnobHelperPtr knob;
+    TimeValue time;
+    ViewIdx view;
+    bool isRenderClone;
+    FrameViewRenderKey renderKey;
+
+    // The random functions of each pixel are seeded from this hash, the pixel coordinates and their seed
+    U32 randomHash;
+
+    // The knobs and effects referenced by the expression of each channel
+    std::list<KnobDimViewKey> knobDependencies[4];
+    std::list<EffectInstanceWPtr> effectDependencies[4];
+
+    // Protects pool
+    QMutex poolLock;
+
+    // The compiled instances that are not being evaluated
+    std::list<PixelExpressionInstancePtr> pool;
+
+    PixelExpressionPrivate()
+    : knob()
+    , time(0)
+    , view(0)
+    , isRenderClone(false)
+    , renderKey()
+    , randomHash(0)
+    , knobDependencies()
+    , effectDependencies()
+    , poolLock()
+    , pool()
+    {
+    }
+
+    /**
+     * @brief Compiles the expressions against a new set of variables. If dependencies is not NULL, it must point to
+     * 4 objects in which the symbols referencing knobs and effects are registered for each channel.
+     **/
+    PixelExpressionInstancePtr createInstance(std::string* error, KnobExprExprTk* dependencies) const;
+};
+
+PixelExpressionInstancePtr
+PixelExpressionPrivate::createInstance(std::string* error,
+                                       KnobExprExprTk* dependencies) const
+{
+    PixelExpressionInstancePtr ret(new PixelExpressionInstance);
+    ret->data = KnobExprExprTk::createData();
+
+    // Symbol table containing the knob values etc... resolved by the UnknownSymbolResolver
+    exprtk_symbol_table_t unknown_var_symbol_table;
+
+    // Symbol table containing the pixel variables and the functions
+    exprtk_symbol_table_t symbol_table;
+    symbol_table.add_variable("x", ret->x);
+    symbol_table.add_variable("y", ret->y);
+    symbol_table.add_variable("r", ret->r);
+    symbol_table.add_variable("g", ret->g);
+    symbol_table.add_variable("b", ret->b);
+    symbol_table.add_variable("a", ret->a);
+    {
+        double time_f = (double)time;
+        symbol_table.create_variable("frame", time_f);
+    }
+    symbol_table.add_constants();
+
+    addStandardFunctions(std::string(), time, symbol_table, ret->data->functions, ret->data->varargFunctions, ret->data->genericFunctions, 0);
+
+    for (std::size_t i = 0; i < ret->data->genericFunctions.size(); ++i) {
+        exprtk_igeneric_function_t* func = ret->data->genericFunctions[i].second.get();
+        random* isRandom = dynamic_cast<random*>(func);
+        if (isRandom) {
+            ret->randomFunctions.push_back(isRandom);
+        }
+        randomInt* isRandomInt = dynamic_cast<randomInt*>(func);
+        if (isRandomInt) {
+            ret->randomIntFunctions.push_back(isRandomInt);
+        }
+    }
+
+    // Pixel expressions are always scalar: they are not wrapped in a return statement like knob expressions
+    // to keep the evaluation as cheap as possible
+    for (int i = 0; i < 4; ++i) {
+        ret->expressions[i].register_symbol_table(unknown_var_symbol_table);
+        ret->expressions[i].register_symbol_table(symbol_table);
+
+        UnknownSymbolResolver musr(knob.get(), time, DimIdx(0), view, isRenderClone, renderKey, dependencies ? &dependencies[i] : 0, ret->data);
+        exprtk_parser_t parser;
+        parser.enable_unknown_symbol_resolver(&musr);
+
+        if ( !parseExprtkExpression(expressions[i], expressions[i], parser, ret->expressions[i], error) ) {
+            return PixelExpressionInstancePtr();
+        }
+
+        ret->isConstant[i] = exprtk::expression_helper<exprtk_scalar_t>::is_constant(ret->expressions[i]);
+        if (ret->isConstant[i]) {
+            ret->constantValue[i] = ret->expressions[i].value();
+        }
+    }
+
+    return ret;
+} // createInstance
+
+PixelExpression::PixelExpression()
+    : _imp( new PixelExpressionPrivate() )
+{
+}
+
+PixelExpression::~PixelExpression()
+{
+}
+
+bool
+PixelExpression::compile(const std::string expressions[4],
+                         const KnobIPtr& knob,
+                         TimeValue time,
+                         ViewIdx view,
+                         std::string* error)
+{
+    for (int i = 0; i < 4; ++i) {
+        _imp->expressions[i] = expressions[i];
+    }
+    _imp->knob = boost::dynamic_pointer_cast<KnobHelper>(knob);
+    assert(_imp->knob);
+    _imp->time = time;
+    _imp->view = view;
+
+    // If we are a render clone, we must also reference clones that are local to this render
+    KnobHolderPtr holder = knob->getHolder();
+    _imp->isRenderClone = holder && holder->isRenderClone();
+    if (_imp->isRenderClone) {
+        _imp->renderKey.render = holder->getCurrentRender();
+        _imp->renderKey.time = time;
+        _imp->renderKey.view = view;
+    }
+
+    _imp->randomHash = getRandomHashAtTime(time);
+
+    // Compile a first instance now to report errors and collect the dependencies, the following batches will use it
+    KnobExprExprTk dependencies[4];
+    PixelExpressionInstancePtr instance = _imp->createInstance(error, dependencies);
+    if (!instance) {
+        return false;
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        _imp->knobDependencies[i].clear();
+        for (std::map<string, KnobDimViewKey>::const_iterator it = dependencies[i].knobDependencies.begin(); it != dependencies[i].knobDependencies.end(); ++it) {
+            _imp->knobDependencies[i].push_back(it->second);
+        }
+        _imp->effectDependencies[i].clear();
+        for (std::map<string, EffectFunctionDependency>::const_iterator it = dependencies[i].effectDependencies.begin(); it != dependencies[i].effectDependencies.end(); ++it) {
+            _imp->effectDependencies[i].push_back(it->second.effect);
+        }
+    }
+
+    QMutexLocker k(&_imp->poolLock);
+    _imp->pool.clear();
+    _imp->pool.push_back(instance);
+
+    return true;
+} // compile
+
+void
+PixelExpression::evaluate(PixelExpressionBatch* batch) const
+{
+    PixelExpressionInstancePtr instance;
+    {
+        QMutexLocker k(&_imp->poolLock);
+        if ( !_imp->pool.empty() ) {
+            instance = _imp->pool.front();
+            _imp->pool.pop_front();
+        }
+    }
+    if (!instance) {
+        // Another thread is evaluating the expressions: compile them for this thread.
+        // This cannot fail since the same expressions already compiled in compile()
+        std::string error;
+        instance = _imp->createInstance(&error, 0);
+        if (!instance) {
+            for (int c = 0; c < 4; ++c) {
+                std::fill(batch->out[c], batch->out[c] + batch->count, 0.);
+            }
+
+            return;
+        }
+    }
+
+    const bool hasStateFunctions = !instance->randomFunctions.empty() || !instance->randomIntFunctions.empty();
+    for (int i = 0; i < batch->count; ++i) {
+        instance->x = batch->x[i];
+        instance->y = batch->y[i];
+        instance->r = batch->in[0][i];
+        instance->g = batch->in[1][i];
+        instance->b = batch->in[2][i];
+        instance->a = batch->in[3][i];
+        if (hasStateFunctions) {
+            // Seed the random functions from the pixel so that each pixel gets its own random values
+            const U32 pixelHash = mixRandomHash(mixRandomHash(_imp->randomHash, batch->x[i]), batch->y[i]);
+            for (std::size_t f = 0; f < instance->randomFunctions.size(); ++f) {
+                instance->randomFunctions[f]->reset(pixelHash);
+            }
+            for (std::size_t f = 0; f < instance->randomIntFunctions.size(); ++f) {
+                instance->randomIntFunctions[f]->reset(pixelHash);
+            }
+        }
+        for (int c = 0; c < 4; ++c) {
+            batch->out[c][i] = instance->isConstant[c] ? instance->constantValue[c] : instance->expressions[c].value();
+        }
+    }
+
+    QMutexLocker k(&_imp->poolLock);
+    _imp->pool.push_front(instance);
+} // evaluate
+
+void
+PixelExpression::getKnobDependencies(int channel,
+                                     std::list<KnobDimViewKey>* dependencies) const
+{
+    assert(channel >= 0 && channel < 4);
+    dependencies->insert(dependencies->end(), _imp->knobDependencies[channel].begin(), _imp->knobDependencies[channel].end());
+}
+
+void
+PixelExpression::getEffectDependencies(int channel,
+                                       std::list<EffectInstanceWPtr>* dependencies) const
+{
+    assert(channel >= 0 && channel < 4);
+    dependencies->insert(dependencies->end(), _imp->effectDependencies[channel].begin(), _imp->effectDependencies[channel].end());
+}
+
 NATRON_NAMESPACE_EXIT
@@ -0,0 +1,264 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "ForkJoinPool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <new> // bad_alloc
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+#include <QtCore/QWaitCondition>
+
+#include "Engine/ThreadPool.h"
+
+NATRON_NAMESPACE_ENTER;
+
+struct ForkJoinPoolPrivate
+{
+    QThreadPool* threadPool;
+
+    // Number of forks not joined yet
+    QAtomicInt nActiveForks;
+
+    ForkJoinPoolPrivate(QThreadPool* threadPool)
+    : threadPool(threadPool)
+    , nActiveForks()
+    {
+    }
+};
+
+struct ForkJoinPrivate
+{
+    ForkJoinTaskPtr task;
+    unsigned int count;
+    ForkJoinPoolPrivate* pool;
+
+    // The next index that was not started by any thread
+    QAtomicInt nextIndex;
+
+    // Number of indices finished
+    QAtomicInt nFinished;
+
+    // The first failure returned by the task, or eActionStatusOK
+    QAtomicInt status;
+
+    // Protects joined and is used with finishedCond to wait for the last index
+    QMutex lock;
+    QWaitCondition finishedCond;
+    bool joined;
+
+    ForkJoinPrivate(const ForkJoinTaskPtr& task,
+                    unsigned int count,
+                    ForkJoinPoolPrivate* pool)
+    : task(task)
+    , count(count)
+    , pool(pool)
+    , nextIndex()
+    , nFinished()
+    , status( (int)eActionStatusOK )
+    , lock()
+    , finishedCond()
+    , joined(false)
+    {
+    }
+
+    void executeAvailableIndices();
+};
+
+void
+ForkJoinPrivate::executeAvailableIndices()
+{
+    for (;;) {
+        int index = nextIndex.fetchAndAddOrdered(1);
+        if ( index >= (int)count ) {
+            return;
+        }
+
+        ActionRetCodeEnum stat;
+        try {
+            stat = task->run(index, count);
+        } catch (const std::bad_alloc &) {
+            stat = eActionStatusOutOfMemory;
+        } catch (...) {
+            stat = eActionStatusFailed;
+        }
+        if ( isFailureRetCode(stat) ) {
+            status.testAndSetOrdered( (int)eActionStatusOK, (int)stat );
+        }
+
+        if ( nFinished.fetchAndAddOrdered(1) + 1 == (int)count ) {
+            QMutexLocker k(&lock);
+            finishedCond.wakeAll();
+        }
+    }
+} // executeAvailableIndices
+
+/**
+ * @brief Helps the thread that forked until all indices are started, then goes back to the thread pool.
+ **/
+class ForkJoinRunnable
+    : public QRunnable
+{
+    boost::shared_ptr<ForkJoinPrivate> _fork;
+
+public:
+
+    ForkJoinRunnable(const boost::shared_ptr<ForkJoinPrivate>& fork)
+    : QRunnable()
+    , _fork(fork)
+    {
+    }
+
+    virtual ~ForkJoinRunnable()
+    {
+    }
+
+private:
+
+    virtual void run() OVERRIDE FINAL
+    {
+        _fork->executeAvailableIndices();
+    }
+};
+
+ForkJoin::ForkJoin(const ForkJoinTaskPtr& task,
+                   unsigned int count,
+                   ForkJoinPoolPrivate* pool)
+: _imp( new ForkJoinPrivate(task, count, pool) )
+{
+}
+
+ForkJoin::~ForkJoin()
+{
+    // The task may refer to data owned by the caller: never let it run after the handle is gone
+    join();
+}
+
+ActionRetCodeEnum
+ForkJoin::join()
+{
+    _imp->executeAvailableIndices();
+
+    if ( (int)_imp->nFinished < (int)_imp->count ) {
+        // The indices left are running in other threads
+        bool isThreadPoolThread = isRunningInThreadPoolThread();
+        if (isThreadPoolThread) {
+            _imp->pool->threadPool->releaseThread();
+        }
+        {
+            QMutexLocker k(&_imp->lock);
+            while ( (int)_imp->nFinished < (int)_imp->count ) {
+                _imp->finishedCond.wait(&_imp->lock);
+            }
+        }
+        if (isThreadPoolThread) {
+            _imp->pool->threadPool->reserveThread();
+        }
+    }
+
+    {
+        QMutexLocker k(&_imp->lock);
+        if (!_imp->joined) {
+            _imp->joined = true;
+            _imp->pool->nActiveForks.fetchAndAddOrdered(-1);
+        }
+    }
+
+    return (ActionRetCodeEnum)(int)_imp->status;
+} // join
+
+ForkJoinPool::ForkJoinPool(QThreadPool* threadPool)
+: _imp( new ForkJoinPoolPrivate(threadPool) )
+{
+}
+
+ForkJoinPool::~ForkJoinPool()
+{
+    assert( (int)_imp->nActiveForks == 0 );
+}
+
+ForkJoinPtr
+ForkJoinPool::fork(const ForkJoinTaskPtr& task,
+                   unsigned int count,
+                   unsigned int maxThreads)
+{
+    ForkJoinPtr ret( new ForkJoin(task, count, _imp.get()) );
+    _imp->nActiveForks.fetchAndAddOrdered(1);
+    if (count == 0) {
+        // Nothing to execute: join() returns eActionStatusOK right away
+        return ret;
+    }
+
+    // The thread calling join() executes indices as well. Only start helpers on threads that are
+    // immediately available: a helper queued in the thread pool would start when the fork is most likely already done.
+    unsigned int nHelpers = std::min( count, std::max(1u, maxThreads) ) - 1;
+    for (unsigned int i = 0; i < nHelpers; ++i) {
+        ForkJoinRunnable* helper = new ForkJoinRunnable(ret->_imp);
+        if ( !_imp->threadPool->tryStart(helper) ) {
+            delete helper;
+            break;
+        }
+    }
+
+    return ret;
+} // fork
+
+ActionRetCodeEnum
+ForkJoinPool::run(const ForkJoinTaskPtr& task,
+                  unsigned int count,
+                  unsigned int maxThreads)
+{
+    ForkJoinPtr f = fork(task, count, maxThreads);
+
+    return f->join();
+}
+
+int
+ForkJoinPool::getNumActiveForks() const
+{
+    return (int)_imp->nActiveForks;
+}
+
+unsigned int
+ForkJoinPool::getMaxThreadsPerFork(unsigned int maxThreads,
+                                   int userMaxThreads) const
+{
+    unsigned int poolSize = (unsigned int)std::max(1, _imp->threadPool->maxThreadCount());
+    unsigned int ret;
+    if (userMaxThreads > 0) {
+        ret = std::min( (unsigned int)userMaxThreads, poolSize );
+    } else {
+        // Share the pool with the forks already running
+        unsigned int nForks = (unsigned int)std::max(0, (int)_imp->nActiveForks) + 1;
+        ret = std::min( maxThreads, (poolSize + nForks - 1) / nForks );
+    }
+
+    return std::max(1u, ret);
+} // getMaxThreadsPerFork
+
+NATRON_NAMESPACE_EXIT;
@@ -0,0 +1,141 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef Engine_ForkJoinPool_h
+#define Engine_ForkJoinPool_h
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#endif
+
+#include "Global/Enums.h"
+
+#include "Engine/EngineFwd.h"
+
+class QThreadPool;
+
+NATRON_NAMESPACE_ENTER;
+
+/**
+ * @brief The work executed by a ForkJoinPool: run() is called exactly once for each index in [0, count[,
+ * possibly concurrently from different threads.
+ **/
+class ForkJoinTask
+{
+public:
+
+    ForkJoinTask()
+    {
+    }
+
+    virtual ~ForkJoinTask()
+    {
+    }
+
+    virtual ActionRetCodeEnum run(unsigned int index, unsigned int count) = 0;
+};
+
+typedef boost::shared_ptr<ForkJoinTask> ForkJoinTaskPtr;
+
+struct ForkJoinPoolPrivate;
+
+/**
+ * @brief A handle on a fork returned by ForkJoinPool::fork().
+ **/
+struct ForkJoinPrivate;
+class ForkJoin
+{
+    ForkJoin(const ForkJoinTaskPtr& task,
+             unsigned int count,
+             ForkJoinPoolPrivate* pool);
+
+public:
+
+    ~ForkJoin();
+
+    /**
+     * @brief Executes the indices that no thread started yet, then waits for the other threads to finish theirs.
+     * Returns the first failure status returned by ForkJoinTask::run(), or eActionStatusOK.
+     **/
+    ActionRetCodeEnum join();
+
+private:
+
+    friend class ForkJoinRunnable;
+    friend class ForkJoinPool;
+    boost::shared_ptr<ForkJoinPrivate> _imp;
+};
+
+/**
+ * @brief A fork-join executor with a much lower launch latency than QtConcurrent: there is no result
+ * sequence and no future, indices are claimed with a single atomic counter by the threads of the pool that are
+ * immediately available and by the thread calling join(). Threads that are not available when forking
+ * are not waited for, hence a fork made from within a fork (nested parallelism) never dead-locks: it is
+ * executed by the calling thread if the pool is busy.
+ *
+ * The pool keeps track of the number of forks currently running so that callers can share the threads
+ * between the effects rendering concurrently, see getMaxThreadsPerFork().
+ **/
+class ForkJoinPool
+{
+public:
+
+    ForkJoinPool(QThreadPool* threadPool);
+
+    ~ForkJoinPool();
+
+    /**
+     * @brief Starts executing task for all indices in [0, count[ with at most maxThreads threads, including the thread
+     * that will call join() on the returned object.
+     **/
+    ForkJoinPtr fork(const ForkJoinTaskPtr& task, unsigned int count, unsigned int maxThreads);
+
+    /**
+     * @brief Same as fork() followed by join(): the calling thread executes indices as well.
+     **/
+    ActionRetCodeEnum run(const ForkJoinTaskPtr& task, unsigned int count, unsigned int maxThreads);
+
+    /**
+     * @brief Returns the number of forks which are not joined yet.
+     **/
+    int getNumActiveForks() const;
+
+    /**
+     * @brief Returns the number of threads a new fork should use so that all forks running concurrently share the
+     * threads of the pool, but never less than 1 nor more than maxThreads. If userMaxThreads is strictly positive,
+     * it is returned instead (clamped to the thread pool size).
+     **/
+    unsigned int getMaxThreadsPerFork(unsigned int maxThreads, int userMaxThreads) const;
+
+private:
+
+    boost::scoped_ptr<ForkJoinPoolPrivate> _imp;
+};
+
+NATRON_NAMESPACE_EXIT;
+
+#endif // Engine_ForkJoinPool_h
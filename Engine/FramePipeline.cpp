@@ -0,0 +1,555 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "FramePipeline.h"
+
+#include <algorithm> // max
+#include <cassert>
+#include <list>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+#include <QtCore/QDebug>
+#include <QtCore/QMutex>
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+#include <QtCore/QWaitCondition>
+
+//#define FRAME_PIPELINE_TRACE_FAILURES
+
+NATRON_NAMESPACE_ENTER;
+
+struct FramePipelineEntry
+{
+    // The index of the item in the order it was pulled
+    U64 sequenceIndex;
+    FramePipelineItemPtr item;
+
+    // A failed item goes through the following stages without being processed so that
+    // they can keep the order of the items.
+    bool failed;
+
+    // True if the entry was processed by the stage holding it and uses one of its slots
+    bool ownsSlot;
+
+    FramePipelineEntry()
+        : sequenceIndex(0)
+        , item()
+        , failed(false)
+        , ownsSlot(false)
+    {
+    }
+};
+
+struct FramePipelineStageData
+{
+    FramePipelineStagePtr stage;
+    int maxConcurrentItems;
+    int maxQueuedItems;
+
+    // Items waiting to be processed
+    std::list<FramePipelineEntry> queue;
+
+    // Items being processed or processed but not handed over yet
+    int nRunning;
+
+    // Items processed, waiting for room in the next stage or for their turn if the order is preserved
+    std::map<U64, FramePipelineEntry> processed;
+
+    // The next item to hand over when the order is preserved
+    U64 nextSequenceIndex;
+
+    FramePipelineStageData()
+        : stage()
+        , maxConcurrentItems(1)
+        , maxQueuedItems(1)
+        , queue()
+        , nRunning(0)
+        , processed()
+        , nextSequenceIndex(0)
+    {
+    }
+};
+
+struct FramePipelinePrivate
+{
+    FramePipeline* _publicInterface;
+    QThreadPool* threadPool;
+    bool preserveOrder;
+
+    // Protects all fields below
+    mutable QMutex lock;
+    QWaitCondition finishedCond;
+
+    std::vector<FramePipelineStageData> stages;
+
+    bool started;
+    bool aborted;
+
+    // True once pullNextItem() returned NULL
+    bool sourceExhausted;
+
+    // True while a thread is in pullNextItem()
+    bool pulling;
+
+    U64 nPulled;
+
+    // Number of items pulled that did not leave the pipeline yet
+    int nItemsInFlight;
+
+    FramePipelinePrivate(FramePipeline* publicInterface,
+                         QThreadPool* threadPool,
+                         bool preserveOrder)
+        : _publicInterface(publicInterface)
+        , threadPool(threadPool)
+        , preserveOrder(preserveOrder)
+        , lock()
+        , finishedCond()
+        , stages()
+        , started(false)
+        , aborted(false)
+        , sourceExhausted(false)
+        , pulling(false)
+        , nPulled(0)
+        , nItemsInFlight(0)
+    {
+    }
+
+    bool isFinishedInternal() const
+    {
+        assert( !lock.tryLock() );
+
+        return started && !pulling && (sourceExhausted || aborted) && (nItemsInFlight == 0);
+    }
+
+    bool handOverProcessedItems(int stageIndex);
+
+    void startQueuedItems(int stageIndex, std::list<FramePipelineJobPtr>* jobs);
+
+    void dropAllItems();
+
+    void pump();
+
+    void onJobFinished(int stageIndex, U64 sequenceIndex, const FramePipelineItemPtr& item, bool failed);
+};
+
+struct FramePipelineJobPrivate
+{
+    FramePipelinePtr pipeline;
+    int stageIndex;
+    U64 sequenceIndex;
+    FramePipelineItemPtr item;
+
+    FramePipelineJobPrivate(const FramePipelinePtr& pipeline,
+                            int stageIndex,
+                            U64 sequenceIndex,
+                            const FramePipelineItemPtr& item)
+        : pipeline(pipeline)
+        , stageIndex(stageIndex)
+        , sequenceIndex(sequenceIndex)
+        , item(item)
+    {
+    }
+};
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+class FramePipelineJobRunnable
+    : public QRunnable
+{
+    FramePipelineJobPtr _job;
+
+public:
+
+    FramePipelineJobRunnable(const FramePipelineJobPtr& job)
+        : QRunnable()
+        , _job(job)
+    {
+        setAutoDelete(true);
+    }
+
+    virtual ~FramePipelineJobRunnable()
+    {
+    }
+
+    virtual void run() OVERRIDE FINAL
+    {
+        _job->run();
+    }
+};
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+FramePipelineJob::FramePipelineJob(const FramePipelinePtr& pipeline,
+                                   int stageIndex,
+                                   U64 sequenceIndex,
+                                   const FramePipelineItemPtr& item)
+    : _imp( new FramePipelineJobPrivate(pipeline, stageIndex, sequenceIndex, item) )
+{
+}
+
+FramePipelineJob::~FramePipelineJob()
+{
+}
+
+const FramePipelineItemPtr&
+FramePipelineJob::getItem() const
+{
+    return _imp->item;
+}
+
+int
+FramePipelineJob::getStageIndex() const
+{
+    return _imp->stageIndex;
+}
+
+void
+FramePipelineJob::run()
+{
+    FramePipelineStagePtr stage;
+    bool aborted;
+    {
+        QMutexLocker k(&_imp->pipeline->_imp->lock);
+        stage = _imp->pipeline->_imp->stages[_imp->stageIndex].stage;
+        aborted = _imp->pipeline->_imp->aborted;
+    }
+
+    // The job may have been launched right before the pipeline was aborted: do not process the item
+    if (aborted) {
+        _imp->pipeline->_imp->onJobFinished(_imp->stageIndex, _imp->sequenceIndex, _imp->item, false);
+
+        return;
+    }
+
+    ActionRetCodeEnum stat;
+    try {
+        stat = stage->process(_imp->item);
+    } catch (const std::exception& e) {
+#ifdef FRAME_PIPELINE_TRACE_FAILURES
+        qDebug() << "Frame pipeline stage" << _imp->stageIndex << "failed:" << e.what();
+#else
+        Q_UNUSED(e);
+#endif
+        stat = eActionStatusFailed;
+    }
+
+    bool failed = isFailureRetCode(stat);
+    if (failed) {
+        _imp->pipeline->onItemFailed(_imp->item, _imp->stageIndex, stat);
+    }
+    _imp->pipeline->_imp->onJobFinished(_imp->stageIndex, _imp->sequenceIndex, _imp->item, failed);
+}
+
+FramePipeline::FramePipeline(QThreadPool* threadPool,
+                             bool preserveOrder)
+    : _imp( new FramePipelinePrivate(this, threadPool, preserveOrder) )
+{
+}
+
+FramePipeline::~FramePipeline()
+{
+}
+
+void
+FramePipeline::addStage(const FramePipelineStagePtr& stage,
+                        int maxConcurrentItems,
+                        int maxQueuedItems)
+{
+    assert(stage);
+    QMutexLocker k(&_imp->lock);
+    assert(!_imp->started);
+
+    FramePipelineStageData data;
+    data.stage = stage;
+    data.maxConcurrentItems = std::max(1, maxConcurrentItems);
+    data.maxQueuedItems = std::max(1, maxQueuedItems);
+    _imp->stages.push_back(data);
+}
+
+int
+FramePipeline::getNumStages() const
+{
+    QMutexLocker k(&_imp->lock);
+
+    return (int)_imp->stages.size();
+}
+
+void
+FramePipeline::setStageMaxConcurrentItems(int stageIndex,
+                                          int maxConcurrentItems)
+{
+    {
+        QMutexLocker k(&_imp->lock);
+        assert( stageIndex >= 0 && stageIndex < (int)_imp->stages.size() );
+        _imp->stages[stageIndex].maxConcurrentItems = std::max(1, maxConcurrentItems);
+        if (!_imp->started) {
+            return;
+        }
+    }
+
+    // Start queued items if the stage has more room
+    _imp->pump();
+}
+
+int
+FramePipeline::getStageMaxConcurrentItems(int stageIndex) const
+{
+    QMutexLocker k(&_imp->lock);
+
+    assert( stageIndex >= 0 && stageIndex < (int)_imp->stages.size() );
+
+    return _imp->stages[stageIndex].maxConcurrentItems;
+}
+
+void
+FramePipeline::start()
+{
+    {
+        QMutexLocker k(&_imp->lock);
+        assert( !_imp->stages.empty() );
+        _imp->started = true;
+    }
+    _imp->pump();
+}
+
+void
+FramePipeline::abort()
+{
+    QMutexLocker k(&_imp->lock);
+
+    _imp->aborted = true;
+    _imp->dropAllItems();
+    if ( _imp->isFinishedInternal() ) {
+        _imp->finishedCond.wakeAll();
+    }
+}
+
+bool
+FramePipeline::isAborted() const
+{
+    QMutexLocker k(&_imp->lock);
+
+    return _imp->aborted;
+}
+
+bool
+FramePipeline::isFinished() const
+{
+    QMutexLocker k(&_imp->lock);
+
+    return _imp->isFinishedInternal();
+}
+
+void
+FramePipeline::waitForFinished()
+{
+    QMutexLocker k(&_imp->lock);
+
+    while ( !_imp->isFinishedInternal() ) {
+        _imp->finishedCond.wait(&_imp->lock);
+    }
+}
+
+int
+FramePipeline::getNumItemsInStage(int stageIndex) const
+{
+    QMutexLocker k(&_imp->lock);
+
+    assert( stageIndex >= 0 && stageIndex < (int)_imp->stages.size() );
+    const FramePipelineStageData& data = _imp->stages[stageIndex];
+    int ret = (int)data.queue.size() + data.nRunning;
+    for (std::map<U64, FramePipelineEntry>::const_iterator it = data.processed.begin(); it != data.processed.end(); ++it) {
+        if (!it->second.ownsSlot) {
+            ++ret;
+        }
+    }
+
+    return ret;
+}
+
+void
+FramePipeline::launchJob(const FramePipelineJobPtr& job)
+{
+    _imp->threadPool->start( new FramePipelineJobRunnable(job) );
+}
+
+void
+FramePipelinePrivate::dropAllItems()
+{
+    assert( !lock.tryLock() );
+    for (std::size_t i = 0; i < stages.size(); ++i) {
+        FramePipelineStageData& data = stages[i];
+        nItemsInFlight -= (int)data.queue.size();
+        data.queue.clear();
+        for (std::map<U64, FramePipelineEntry>::const_iterator it = data.processed.begin(); it != data.processed.end(); ++it) {
+            if (it->second.ownsSlot) {
+                --data.nRunning;
+            }
+            --nItemsInFlight;
+        }
+        data.processed.clear();
+    }
+    assert(nItemsInFlight >= 0);
+}
+
+bool
+FramePipelinePrivate::handOverProcessedItems(int stageIndex)
+{
+    assert( !lock.tryLock() );
+    FramePipelineStageData& data = stages[stageIndex];
+    const bool isLastStage = stageIndex == (int)stages.size() - 1;
+    bool ret = false;
+
+    while ( !data.processed.empty() ) {
+        std::map<U64, FramePipelineEntry>::iterator it = data.processed.begin();
+        if ( preserveOrder && (it->first != data.nextSequenceIndex) ) {
+            // Wait for the previous items
+            break;
+        }
+        if ( aborted || isLastStage ) {
+            // The item leaves the pipeline
+            --nItemsInFlight;
+        } else if (it->second.failed) {
+            FramePipelineEntry entry = it->second;
+            entry.ownsSlot = false;
+            stages[stageIndex + 1].processed.insert( std::make_pair(entry.sequenceIndex, entry) );
+        } else {
+            FramePipelineStageData& nextData = stages[stageIndex + 1];
+            if ( (int)nextData.queue.size() >= nextData.maxQueuedItems ) {
+                // Keep the slot until the next stage has room
+                break;
+            }
+            FramePipelineEntry entry = it->second;
+            entry.ownsSlot = false;
+            nextData.queue.push_back(entry);
+        }
+        if (it->second.ownsSlot) {
+            --data.nRunning;
+        }
+        data.processed.erase(it);
+        ++data.nextSequenceIndex;
+        ret = true;
+    }
+
+    return ret;
+} // handOverProcessedItems
+
+void
+FramePipelinePrivate::startQueuedItems(int stageIndex,
+                                       std::list<FramePipelineJobPtr>* jobs)
+{
+    assert( !lock.tryLock() );
+    FramePipelineStageData& data = stages[stageIndex];
+    while ( !aborted && !data.queue.empty() && (data.nRunning < data.maxConcurrentItems) ) {
+        const FramePipelineEntry& entry = data.queue.front();
+        FramePipelinePtr pipeline = _publicInterface->shared_from_this();
+        jobs->push_back( FramePipelineJobPtr( new FramePipelineJob(pipeline, stageIndex, entry.sequenceIndex, entry.item) ) );
+        data.queue.pop_front();
+        ++data.nRunning;
+    }
+}
+
+void
+FramePipelinePrivate::pump()
+{
+    std::list<FramePipelineJobPtr> jobs;
+
+    for (;;) {
+        bool mustPull;
+        {
+            QMutexLocker k(&lock);
+
+            // Start from the last stage so that items flow as far as possible
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                for (int i = (int)stages.size() - 1; i >= 0; --i) {
+                    startQueuedItems(i, &jobs);
+                    if ( handOverProcessedItems(i) ) {
+                        changed = true;
+                    }
+                }
+            }
+
+            if ( isFinishedInternal() ) {
+                finishedCond.wakeAll();
+            }
+
+            mustPull = started && !aborted && !sourceExhausted && !pulling && ( (int)stages[0].queue.size() < stages[0].maxQueuedItems );
+            if (mustPull) {
+                pulling = true;
+            }
+        }
+        if (!mustPull) {
+            break;
+        }
+
+        FramePipelineItemPtr item = _publicInterface->pullNextItem();
+        {
+            QMutexLocker k(&lock);
+            pulling = false;
+            if (!item) {
+                sourceExhausted = true;
+            } else if (!aborted) {
+                FramePipelineEntry entry;
+                entry.sequenceIndex = nPulled++;
+                entry.item = item;
+                stages[0].queue.push_back(entry);
+                ++nItemsInFlight;
+            }
+        }
+    }
+
+    for (std::list<FramePipelineJobPtr>::const_iterator it = jobs.begin(); it != jobs.end(); ++it) {
+        _publicInterface->launchJob(*it);
+    }
+} // pump
+
+void
+FramePipelinePrivate::onJobFinished(int stageIndex,
+                                    U64 sequenceIndex,
+                                    const FramePipelineItemPtr& item,
+                                    bool failed)
+{
+    {
+        QMutexLocker k(&lock);
+        if (aborted) {
+            // The item was not dropped by abort() since it was being processed
+            --stages[stageIndex].nRunning;
+            --nItemsInFlight;
+        } else {
+            FramePipelineEntry entry;
+            entry.sequenceIndex = sequenceIndex;
+            entry.item = item;
+            entry.failed = failed;
+            entry.ownsSlot = true;
+            stages[stageIndex].processed.insert( std::make_pair(sequenceIndex, entry) );
+        }
+    }
+    pump();
+}
+
+NATRON_NAMESPACE_EXIT;
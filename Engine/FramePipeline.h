@@ -0,0 +1,222 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef Engine_FramePipeline_h
+#define Engine_FramePipeline_h
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/scoped_ptr.hpp>
+#endif
+
+#include "Global/GlobalDefines.h"
+
+#include "Engine/EngineFwd.h"
+
+class QThreadPool;
+
+NATRON_NAMESPACE_ENTER;
+
+/**
+ * @brief A unit of work flowing through the stages of a FramePipeline, typically a frame.
+ * Derived classes hold the data that stages pass to each other.
+ **/
+class FramePipelineItem
+{
+public:
+
+    FramePipelineItem()
+    {
+    }
+
+    virtual ~FramePipelineItem()
+    {
+    }
+};
+
+typedef boost::shared_ptr<FramePipelineItem> FramePipelineItemPtr;
+
+/**
+ * @brief One stage of a FramePipeline. process() may be called concurrently for different items
+ * up to the concurrency given to FramePipeline::addStage().
+ **/
+class FramePipelineStage
+{
+public:
+
+    FramePipelineStage()
+    {
+    }
+
+    virtual ~FramePipelineStage()
+    {
+    }
+
+    /**
+     * @brief Process the item. If this returns a failure, the item is removed from the pipeline
+     * and FramePipeline::onItemFailed() is called.
+     **/
+    virtual ActionRetCodeEnum process(const FramePipelineItemPtr& item) = 0;
+};
+
+typedef boost::shared_ptr<FramePipelineStage> FramePipelineStagePtr;
+
+/**
+ * @brief The processing of an item by a stage, launched by FramePipeline::launchJob()
+ **/
+struct FramePipelineJobPrivate;
+class FramePipelineJob
+{
+    friend struct FramePipelinePrivate;
+
+    FramePipelineJob(const FramePipelinePtr& pipeline,
+                     int stageIndex,
+                     U64 sequenceIndex,
+                     const FramePipelineItemPtr& item);
+
+public:
+
+    ~FramePipelineJob();
+
+    const FramePipelineItemPtr& getItem() const;
+
+    int getStageIndex() const;
+
+    /**
+     * @brief Process the item with the stage and hands it over to the next stage.
+     * Must be called exactly once.
+     **/
+    void run();
+
+private:
+
+    boost::scoped_ptr<FramePipelineJobPrivate> _imp;
+};
+
+typedef boost::shared_ptr<FramePipelineJob> FramePipelineJobPtr;
+
+/**
+ * @brief Processes a stream of items through a sequence of stages, e.g: decoding, compute and encoding of frames.
+ * Each stage processes up to a given number of items concurrently, so that slow stages such as writing to disk
+ * overlap with the other stages instead of leaving the CPU idle.
+ *
+ * Items are pulled from pullNextItem() whenever the first stage has room in its queue. Each stage has a
+ * bounded queue: a stage whose next stage is full keeps its processed items, and thus its slots, until the
+ * next stage has room, hence the number of items in flight is bounded and slow stages throttle the faster ones.
+ * If the pipeline preserves the order, items are handed over to the next stage in the order they were pulled.
+ **/
+struct FramePipelinePrivate;
+class FramePipeline
+    : public boost::enable_shared_from_this<FramePipeline>
+{
+protected:
+
+    FramePipeline(QThreadPool* threadPool,
+                  bool preserveOrder);
+
+public:
+
+    virtual ~FramePipeline();
+
+    /**
+     * @brief Add a stage after the stages already added. At most maxConcurrentItems items are processed by this stage
+     * at once and at most maxQueuedItems wait to be processed. Must be called before start().
+     **/
+    void addStage(const FramePipelineStagePtr& stage,
+                  int maxConcurrentItems,
+                  int maxQueuedItems);
+
+    int getNumStages() const;
+
+    /**
+     * @brief Changes the number of items the given stage processes at once. This may be called while the pipeline runs:
+     * when decreased, items already being processed are let to finish.
+     **/
+    void setStageMaxConcurrentItems(int stageIndex,
+                                    int maxConcurrentItems);
+
+    int getStageMaxConcurrentItems(int stageIndex) const;
+
+    /**
+     * @brief Starts pulling items and processing them.
+     **/
+    void start();
+
+    /**
+     * @brief No item is pulled or started anymore, items waiting in queues are dropped.
+     * Items being processed are let to finish.
+     **/
+    void abort();
+
+    bool isAborted() const;
+
+    /**
+     * @brief Returns true when pullNextItem() returned NULL or the pipeline was aborted, and all items left the pipeline.
+     **/
+    bool isFinished() const;
+
+    /**
+     * @brief Blocks until isFinished() returns true.
+     **/
+    void waitForFinished();
+
+    /**
+     * @brief Returns the number of items waiting, being processed or processed but not yet handed over by the given stage.
+     **/
+    int getNumItemsInStage(int stageIndex) const;
+
+protected:
+
+    /**
+     * @brief Returns the next item to process or NULL if there is none left. Called by one thread at a time.
+     **/
+    virtual FramePipelineItemPtr pullNextItem() = 0;
+
+    /**
+     * @brief Called when the given stage failed to process the item.
+     **/
+    virtual void onItemFailed(const FramePipelineItemPtr& /*item*/,
+                              int /*stageIndex*/,
+                              ActionRetCodeEnum /*stat*/)
+    {
+    }
+
+    /**
+     * @brief Must call job->run() asynchronously. The default implementation runs it in the thread pool.
+     **/
+    virtual void launchJob(const FramePipelineJobPtr& job);
+
+private:
+
+    friend class FramePipelineJob;
+    friend struct FramePipelinePrivate;
+    boost::scoped_ptr<FramePipelinePrivate> _imp;
+};
+
+NATRON_NAMESPACE_EXIT;
+
+#endif // Engine_FramePipeline_h
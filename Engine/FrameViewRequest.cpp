@@ -45,6 +45,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/EffectInstance.h"
 #include "Engine/Image.h"
 #include "Engine/ImageCacheEntry.h"
+#include "Engine/InFlightRequestTable.h"
 #include "Engine/Node.h"
 #include "Engine/NodeGroup.h"
 #include "Engine/NodeMetadata.h"
@@ -128,8 +129,14 @@ struct PerLaunchRequestData
     // This frame/view is in the dependencies list each of the listeners.
     std::set<FrameViewRequestWPtr> listeners;
 
+    // See FrameViewRequest::getCriticalPathPriority()
+    double criticalPathPriority;
 
     PerLaunchRequestData()
+    : dependencies()
+    , renderedDependencies()
+    , listeners()
+    , criticalPathPriority(0)
     {
 
     }
@@ -152,6 +159,9 @@ struct FrameViewRequestPrivate
     // The tree render associated to this request
     TreeRenderWPtr parentRender;
 
+    // The cancellation token of parentRender, kept so that it can be checked even if the render is gone
+    CancellationTokenPtr cancellationToken;
+
     // The plane to render
     ImagePlaneDesc plane;
 
@@ -190,6 +200,9 @@ struct FrameViewRequestPrivate
     // For each launch request a list of dependencies and listeners.
     LaunchRequestDataMap requestData;
 
+    // See FrameViewRequest::getEstimatedRenderCost()
+    double estimatedRenderCost;
+
     // The required frame/views in input, set on first request
     GetFramesNeededResultsPtr frameViewsNeeded;
 
@@ -210,6 +223,10 @@ struct FrameViewRequestPrivate
     // True if cache write is allowed but not cache read
     bool byPassCache;
 
+    // See FrameViewRequest::getInFlightRequest()
+    InFlightRequestPtr inFlightRequest;
+    bool isInFlightRequestOwner;
+
     FrameViewRequestPrivate(const ImagePlaneDesc& plane,
                             unsigned int mipMapLevel,
                             const RenderScale& proxyScale,
@@ -219,6 +236,7 @@ struct FrameViewRequestPrivate
     , status(FrameViewRequest::eFrameViewRequestStatusNotRendered)
     , renderClone(effect)
     , parentRender(render)
+    , cancellationToken(render ? render->getCancellationToken() : CancellationTokenPtr())
     , plane(plane)
     , proxyScale(proxyScale)
     , mipMapLevel(mipMapLevel)
@@ -233,11 +251,14 @@ struct FrameViewRequestPrivate
     , requestedScaleImage()
     , finalRoi()
     , requestData()
+    , estimatedRenderCost(0)
     , frameViewsNeeded()
     , neededComps()
     , distortion()
     , distortionStack()
     , byPassCache(false)
+    , inFlightRequest()
+    , isInFlightRequestOwner(false)
     {
 #ifdef TRACE_REQUEST_LIFETIME
         nodeName = effect->getNode()->getScriptName_mt_safe();
@@ -269,6 +290,10 @@ FrameViewRequest::~FrameViewRequest()
 #ifdef TRACE_REQUEST_LIFETIME
     qDebug() << "Delete request" << _imp->nodeName.c_str();
 #endif
+    // Do not let the attached requests wait for a render that will never happen
+    if (_imp->inFlightRequest && _imp->isInFlightRequestOwner) {
+        _imp->inFlightRequest->notifyRenderFinished(eActionStatusAborted, _imp->finalRoi, ImagePtr(), ImagePtr());
+    }
 }
 
 TreeRenderPtr
@@ -277,6 +302,12 @@ FrameViewRequest::getParentRender() const
     return _imp->parentRender.lock();
 }
 
+CancellationTokenPtr
+FrameViewRequest::getCancellationToken() const
+{
+    return _imp->cancellationToken;
+}
+
 EffectInstancePtr
 FrameViewRequest::getEffect() const
 {
@@ -508,6 +539,36 @@ FrameViewRequest::getNumListeners(const RequestPassSharedDataPtr& request) const
     return data.listeners.size();
 }
 
+double
+FrameViewRequest::getEstimatedRenderCost() const
+{
+    QMutexLocker k(&_imp->lock);
+    return _imp->estimatedRenderCost;
+}
+
+void
+FrameViewRequest::setEstimatedRenderCost(double cost)
+{
+    QMutexLocker k(&_imp->lock);
+    _imp->estimatedRenderCost = cost;
+}
+
+double
+FrameViewRequest::getCriticalPathPriority(const RequestPassSharedDataPtr& request) const
+{
+    QMutexLocker k(&_imp->lock);
+    PerLaunchRequestData& data = _imp->requestData[request];
+    return data.criticalPathPriority;
+}
+
+void
+FrameViewRequest::setCriticalPathPriority(const RequestPassSharedDataPtr& request, double priority)
+{
+    QMutexLocker k(&_imp->lock);
+    PerLaunchRequestData& data = _imp->requestData[request];
+    data.criticalPathPriority = priority;
+}
+
 bool
 FrameViewRequest::checkIfByPassCacheEnabledAndTurnoff() const
 {
@@ -633,6 +694,22 @@ FrameViewRequest::setDistorsionStack(const Distortion2DStackPtr& stack)
     _imp->distortionStack = stack;
 }
 
+InFlightRequestPtr
+FrameViewRequest::getInFlightRequest(bool* isOwner) const
+{
+    QMutexLocker k(&_imp->lock);
+    *isOwner = _imp->isInFlightRequestOwner;
+    return _imp->inFlightRequest;
+}
+
+void
+FrameViewRequest::setInFlightRequest(const InFlightRequestPtr& request, bool isOwner)
+{
+    QMutexLocker k(&_imp->lock);
+    _imp->inFlightRequest = request;
+    _imp->isInFlightRequestOwner = isOwner;
+}
+
 
 
 NATRON_NAMESPACE_EXIT;
@@ -152,6 +152,11 @@ public:
      **/
     TreeRenderPtr getParentRender() const;
 
+    /**
+     * @brief Get the token cancelled when the tree render is aborted, or NULL if the request has no render
+     **/
+    CancellationTokenPtr getCancellationToken() const;
+
     /**
      * @brief Get the mipmap level at which to render
      **/
@@ -279,6 +284,21 @@ public:
      **/
     std::size_t getNumListeners(const RequestPassSharedDataPtr& requestData) const;
 
+    /**
+     * @brief The estimated time in seconds to render this frame/view, computed by the TreeRender
+     * from the area of the RoI and the cost per pixel of the plug-in, see Plugin::getEstimatedRenderCostPerPixel().
+     **/
+    double getEstimatedRenderCost() const;
+    void setEstimatedRenderCost(double cost);
+
+    /**
+     * @brief The estimated time in seconds to render this frame/view and the most expensive chain of listeners
+     * downstream up to the root of the tree. Among the frame/views that can be rendered, the one with the highest priority
+     * is on the critical path of the render and is launched first.
+     **/
+    double getCriticalPathPriority(const RequestPassSharedDataPtr& requestData) const;
+    void setCriticalPathPriority(const RequestPassSharedDataPtr& requestData, double priority);
+
     /**
      * @brief  When true, a subsequent render of this frame/view will not be allowed to read the cache
      * but will still be able to write to the cache. That render should then set this flag to false.
@@ -354,6 +374,14 @@ public:
     Distortion2DStackPtr getDistorsionStack() const;
     void setDistorsionStack(const Distortion2DStackPtr& stack);
 
+    /**
+     * @brief The entry of this request in the InFlightRequestTable, if any. If isOwner is true, this request
+     * computes the results for the attached requests of other renders, otherwise it may re-use the results of the owner.
+     * If the owner is destroyed without having published its results, the attached requests are notified that it was aborted.
+     **/
+    InFlightRequestPtr getInFlightRequest(bool* isOwner) const;
+    void setInFlightRequest(const InFlightRequestPtr& request, bool isOwner);
+
 private:
 
     friend class FrameViewRequestLocker;
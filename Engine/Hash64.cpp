@@ -24,13 +24,9 @@
 
 #include "Hash64.h"
 
-#include <algorithm>  // for std::for_each
 #include <cassert>
-#include <stdexcept>
+#include <cstring>
 
-#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
-#include <boost/crc.hpp>
-#endif
 #include <QtCore/QString>
 
 #include "Engine/Node.h"
@@ -38,27 +34,112 @@
 
 NATRON_NAMESPACE_ENTER;
 
+// Polynomial of the CRC-64 (ECMA-182), not reflected, zero initial value and no final xor.
+// This is what boost::crc_optimal<64, 0x42F0E1EBA9EA3693ULL, 0, 0, false, false> computes.
+#define NATRON_HASH64_CRC64_POLY 0x42F0E1EBA9EA3693ULL
+
+// Seeds of the fast algorithm
+#define NATRON_HASH64_FAST_SEED 0xa0761d6478bd642fULL
+#define NATRON_HASH64_FAST_FINAL 0x8ebc6af09c88c6e3ULL
+
+Hash64AlgorithmEnum Hash64::defaultAlgorithm = eHash64AlgorithmFast;
+
+namespace {
+
+// Tables to update the CRC-64 8 bytes at a time ("slicing-by-8"):
+// table[k][b] is the CRC register obtained from the byte b followed by k zero bytes.
+struct CRC64Tables
+{
+    U64 table[8][256];
+
+    CRC64Tables()
+    {
+        for (int b = 0; b < 256; ++b) {
+            U64 crc = (U64)b << 56;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & 0x8000000000000000ULL) ? ( (crc << 1) ^ NATRON_HASH64_CRC64_POLY ) : (crc << 1);
+            }
+            table[0][b] = crc;
+        }
+        for (int k = 1; k < 8; ++k) {
+            for (int b = 0; b < 256; ++b) {
+                U64 prev = table[k - 1][b];
+                table[k][b] = (prev << 8) ^ table[0][prev >> 56];
+            }
+        }
+    }
+};
+
+// Initialized before main(), hence before any thread may compute a hash
+static const CRC64Tables crc64Tables;
+
+} // anon namespace
+
+void
+Hash64::setDefaultAlgorithm(Hash64AlgorithmEnum algo)
+{
+    defaultAlgorithm = algo;
+}
+
+Hash64AlgorithmEnum
+Hash64::getDefaultAlgorithm()
+{
+    return defaultAlgorithm;
+}
+
+U64
+Hash64::getInitialState(Hash64AlgorithmEnum algo)
+{
+    return algo == eHash64AlgorithmCRC64 ? 0 : NATRON_HASH64_FAST_SEED;
+}
+
+U64
+Hash64::updateCRC64(U64 crc, U64 value)
+{
+    // The CRC was historically computed on the raw bytes of the vector of values: keep the memory order
+    // so that the keys are the same on every platform they were produced on.
+    unsigned char bytes[8];
+    std::memcpy(bytes, &value, sizeof(value));
+    U64 data = 0;
+    for (int i = 0; i < 8; ++i) {
+        data = (data << 8) | bytes[i];
+    }
+    crc ^= data;
+
+    return crc64Tables.table[7][crc >> 56] ^
+           crc64Tables.table[6][(crc >> 48) & 0xff] ^
+           crc64Tables.table[5][(crc >> 40) & 0xff] ^
+           crc64Tables.table[4][(crc >> 32) & 0xff] ^
+           crc64Tables.table[3][(crc >> 24) & 0xff] ^
+           crc64Tables.table[2][(crc >> 16) & 0xff] ^
+           crc64Tables.table[1][(crc >> 8) & 0xff] ^
+           crc64Tables.table[0][crc & 0xff];
+}
+
 void
 Hash64::computeHash()
 {
     if (hashValid) {
         return;
     }
-    if ( node_values.empty() ) {
+    if (nElements == 0) {
         return;
     }
 
-    const unsigned char* data = reinterpret_cast<const unsigned char*>( &node_values.front() );
-    boost::crc_optimal<64, 0x42F0E1EBA9EA3693ULL, 0, 0, false, false> crc_64;
-    crc_64.process_bytes(data, node_values.size() * sizeof(node_values[0]));
-    hash = crc_64.checksum();
+    if (algorithm == eHash64AlgorithmCRC64) {
+        hash = state;
+    } else {
+        // Mix in the number of values so that trailing zeroes are not ignored
+        hash = multiplyFold(state ^ nElements, NATRON_HASH64_FAST_FINAL);
+    }
     hashValid = true;
 }
 
 void
 Hash64::reset()
 {
-    node_values.clear();
+    state = getInitialState(algorithm);
+    nElements = 0;
     hash = 0;
     hashValid = false;
 }
@@ -66,31 +147,16 @@ Hash64::reset()
 void
 Hash64::appendQString(const QString & str, Hash64* hash)
 {
-    std::size_t curSize = hash->node_values.size();
-    hash->node_values.resize(curSize + str.size());
-
-    int c = (int)curSize;
-    for (QString::const_iterator it = str.begin(); it != str.end(); ++it, ++c) {
-        hash->node_values[c] = toU64<unsigned short>(it->unicode());
+    const QChar* data = str.constData();
+    for (int i = 0; i < str.size(); ++i) {
+        hash->append<unsigned short>(data[i].unicode());
     }
 }
 
 void
 Hash64::appendCurve(const CurvePtr& curve, Hash64* hash)
 {
-    KeyFrameSet keys = curve->getKeyFrames_mt_safe();
-
-    std::size_t curSize = hash->node_values.size();
-    hash->node_values.resize(curSize + 4 * keys.size());
-
-
-    int c = curSize;
-    for (KeyFrameSet::const_iterator it = keys.begin(); it!=keys.end(); ++it, c += 4) {
-        hash->node_values[c] = toU64((double)it->getTime());
-        hash->node_values[c + 1] = toU64(it->getValue());
-        hash->node_values[c + 2] = toU64(it->getLeftDerivative());
-        hash->node_values[c + 3] = toU64(it->getRightDerivative());
-    }
+    curve->appendToHash(hash);
 }
 
 
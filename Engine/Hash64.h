@@ -39,9 +39,13 @@
 
 NATRON_NAMESPACE_ENTER;
 
-/*The hash of a Node is the checksum of the vector of data containing:
+/*The hash of a Node is the checksum of the stream of data containing:
     - the values of the current knob for this node + the name of the node
     - the hash values for the  tree upstream
+
+   Values are consumed as they are appended: the hash never stores them and does not allocate,
+   appending a value only updates a 64-bit state. computeHash() finalizes the state
+   and may be called again after appending more values.
  */
 
 class Hash64
@@ -49,15 +53,42 @@ class Hash64
 public:
     Hash64()
     : hash(0)
-    , node_values()
+    , state(0)
+    , nElements(0)
+    , algorithm(defaultAlgorithm)
+    , hashValid(false)
+    {
+        state = getInitialState(algorithm);
+    }
+
+    explicit Hash64(Hash64AlgorithmEnum algo)
+    : hash(0)
+    , state(0)
+    , nElements(0)
+    , algorithm(algo)
     , hashValid(false)
     {
+        state = getInitialState(algorithm);
     }
 
     ~Hash64()
     {
     }
 
+    /**
+     * @brief Set the algorithm used by hashes created with the default constructor.
+     * This should be set once at startup, before any hash is computed: hashes computed with
+     * different algorithms are not comparable.
+     **/
+    static void setDefaultAlgorithm(Hash64AlgorithmEnum algo);
+
+    static Hash64AlgorithmEnum getDefaultAlgorithm();
+
+    Hash64AlgorithmEnum getAlgorithm() const
+    {
+        return algorithm;
+    }
+
     U64 value() const
     {
         return hash;
@@ -65,7 +96,7 @@ public:
 
     bool isEmpty() const
     {
-        return node_values.empty();
+        return nElements == 0;
     }
 
     void computeHash();
@@ -106,22 +137,15 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 
     void insert(const std::vector<U64>& elements)
     {
-        std::size_t curSize = node_values.size();
-        node_values.resize(curSize + elements.size());
-
-        int c = curSize;
-        for (std::vector<U64>::const_iterator it = elements.begin(); it != elements.end(); ++it, ++c) {
-            node_values[c] = *it;
+        for (std::vector<U64>::const_iterator it = elements.begin(); it != elements.end(); ++it) {
+            appendU64(*it);
         }
-        hashValid = false;
-
     }
 
     template<typename T>
     void append(T value)
     {
-        node_values.push_back( toU64(value) );
-        hashValid = false;
+        appendU64( toU64(value) );
     }
 
     static void appendQString(const QString & str, Hash64* hash);
@@ -154,8 +178,53 @@ private:
         };
     };
 
+    static U64 getInitialState(Hash64AlgorithmEnum algo);
+
+    // Feeds the 8 bytes of value, in memory order, to the CRC-64 register
+    static U64 updateCRC64(U64 crc, U64 value);
+
+    // Multiplies a and b to a 128-bit value and folds it to 64 bits
+    static U64 multiplyFold(U64 a, U64 b)
+    {
+#if defined(__SIZEOF_INT128__)
+        __uint128_t r = a;
+        r *= b;
+
+        return (U64)r ^ (U64)(r >> 64);
+#else
+        U64 aLo = a & 0xFFFFFFFFULL, aHi = a >> 32;
+        U64 bLo = b & 0xFFFFFFFFULL, bHi = b >> 32;
+        U64 loLo = aLo * bLo, hiLo = aHi * bLo, loHi = aLo * bHi, hiHi = aHi * bHi;
+        U64 cross = (loLo >> 32) + (hiLo & 0xFFFFFFFFULL) + loHi;
+        U64 lo = (cross << 32) | (loLo & 0xFFFFFFFFULL);
+        U64 hi = hiHi + (hiLo >> 32) + (cross >> 32);
+
+        return lo ^ hi;
+#endif
+    }
+
+    void appendU64(U64 value)
+    {
+        if (algorithm == eHash64AlgorithmCRC64) {
+            state = updateCRC64(state, value);
+        } else {
+            // wyhash-like mixing step: one 64x64->128 bit multiplication per value
+            state = multiplyFold(state ^ value, 0xe7037ed1a0b428dbULL);
+        }
+        ++nElements;
+        hashValid = false;
+    }
+
+    static Hash64AlgorithmEnum defaultAlgorithm;
+
     U64 hash;
-    std::vector<U64> node_values;
+
+    // The running state of the algorithm, updated by each appended value
+    U64 state;
+
+    // The number of values appended since the last reset
+    U64 nElements;
+    Hash64AlgorithmEnum algorithm;
     bool hashValid;
 };
 
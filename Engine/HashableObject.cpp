@@ -24,13 +24,88 @@
 
 #include "HashableObject.h"
 #include <list>
+#include <set>
+#include <vector>
 #include <QMutex>
+#include <QtCore/QAtomicInt>
 
 #include "Engine/Hash64.h"
 #include "Engine/FrameViewRequest.h"
+#include "Engine/ThreadStorage.h"
 
 NATRON_NAMESPACE_ENTER
 
+struct HashCacheStamp;
+typedef boost::shared_ptr<HashCacheStamp> HashCacheStampPtr;
+
+/**
+ * @brief The validity stamp of the hash cache of an object.
+ * Each change is given an epoch from a global counter. A hash cache remembers the epoch at which it was filled
+ * and the stamps of the objects whose hash it was computed from: it is outdated as soon as one of them
+ * was modified at a later epoch. The stamp is shared with the objects that used this hash so that they can
+ * check it without holding a reference to the object itself.
+ **/
+struct HashCacheStamp
+{
+    // Protects all members. Never held while locking the stamp of another object.
+    QMutex lock;
+
+    // The epoch at which the hash cache was last cleared
+    int modifiedEpoch;
+
+    // The epoch at which the computation of the oldest hash in the cache started
+    int cacheEpoch;
+
+    // The epoch at which the inputs were last checked
+    int verifiedEpoch;
+
+    // True if the cache is not empty
+    bool hasCache;
+
+    // Set when a check found that an input changed: the owner must clear its cache
+    bool cacheOutdated;
+
+    // The stamps of the objects whose hash was used to compute the hashes in the cache
+    std::set<HashCacheStampPtr> inputs;
+
+    HashCacheStamp()
+    : lock()
+    , modifiedEpoch(0)
+    , cacheEpoch(0)
+    , verifiedEpoch(0)
+    , hasCache(false)
+    , cacheOutdated(false)
+    , inputs()
+    {
+
+    }
+};
+
+// The global epoch, incremented by each invalidation
+static QAtomicInt hashCacheEpoch(1);
+
+// Epochs wrap around: compare them with their difference
+static bool
+isEpochAfter(int a,
+             int b)
+{
+    return (int)( (unsigned int)a - (unsigned int)b ) > 0;
+}
+
+// The object for which a hash is being computed on this thread: objects whose hash is computed
+// while computing the hash of another object are added to its inputs.
+struct HashComputationTLS
+{
+    HashableObjectPrivate* object;
+
+    HashComputationTLS()
+    : object(0)
+    {
+    }
+};
+
+static ThreadStorage<HashComputationTLS> currentHashComputation;
+
 struct HashableObjectPrivate
 {
     // The list of other objects that need this hash as part of their result
@@ -54,6 +129,9 @@ struct HashableObjectPrivate
     // Do we allow caching of the hash ?
     bool hashCacheEnabled;
 
+    // Validity of the hash cache
+    HashCacheStampPtr stamp;
+
     HashableObjectPrivate()
     : listeners()
     , dependencies()
@@ -64,6 +142,7 @@ struct HashableObjectPrivate
     , metadataSlaveCacheValid(false)
     , hashCacheMutex(QMutex::Recursive) // It might recurse when calling getValue on a knob with an expression because of randomSeed
     , hashCacheEnabled(true)
+    , stamp(new HashCacheStamp)
     {
 
     }
@@ -78,14 +157,26 @@ struct HashableObjectPrivate
     , metadataSlaveCacheValid(false)
     , hashCacheMutex(QMutex::Recursive)
     , hashCacheEnabled(true)
+    , stamp(new HashCacheStamp)
     {
+        int epoch = (int)hashCacheEpoch;
         QMutexLocker k(&other.hashCacheMutex);
+
+        // Make sure we do not copy an outdated cache
+        const_cast<HashableObjectPrivate&>(other).refreshHashCache(epoch);
         timeViewVariantHashCache = other.timeViewVariantHashCache;
         timeViewInvariantCache = other.timeViewInvariantCache;
         timeViewInvariantCacheValid = other.timeViewInvariantCacheValid;
         metadataSlaveCache = other.metadataSlaveCache;
         metadataSlaveCacheValid = other.metadataSlaveCacheValid;
         hashCacheEnabled = other.hashCacheEnabled;
+
+        // The copy is not linked to the inputs of the other object: like before it is only
+        // cleared by an explicit invalidation.
+        stamp->modifiedEpoch = epoch;
+        stamp->cacheEpoch = epoch;
+        stamp->verifiedEpoch = epoch;
+        stamp->hasCache = !timeViewVariantHashCache.empty() || timeViewInvariantCacheValid || metadataSlaveCacheValid;
     }
 
     bool findCachedHashInternal(const HashableObject::FindHashArgs& args, U64 *hash) const;
@@ -93,8 +184,96 @@ struct HashableObjectPrivate
     bool computeCachingEnabled() const;
 
     void computeCachingEnabledRecursive(std::set<HashableObjectPrivate*>* markedObjects);
+
+    void clearHashCache();
+
+    void refreshHashCache(int epoch);
 };
 
+// Checks whether an input of the cache owning the stamp was modified since the cache was filled.
+// The lock of a stamp is never held while locking another stamp, so that threads walking a cycle
+// of inputs from different objects cannot deadlock. visitedStamps stops the walk on such a cycle.
+static void
+verifyHashCacheStampRecursive(const HashCacheStampPtr& stamp,
+                              int epoch,
+                              std::set<HashCacheStamp*>* visitedStamps)
+{
+    if ( !visitedStamps->insert( stamp.get() ).second ) {
+        return;
+    }
+
+    std::vector<HashCacheStampPtr> inputs;
+    int cacheEpoch;
+    {
+        QMutexLocker k(&stamp->lock);
+        if (stamp->verifiedEpoch == epoch) {
+            return;
+        }
+        if (!stamp->hasCache) {
+            stamp->verifiedEpoch = epoch;
+            return;
+        }
+        inputs.assign( stamp->inputs.begin(), stamp->inputs.end() );
+        cacheEpoch = stamp->cacheEpoch;
+    }
+
+    bool outdated = false;
+    for (std::vector<HashCacheStampPtr>::const_iterator it = inputs.begin(); it != inputs.end(); ++it) {
+        verifyHashCacheStampRecursive(*it, epoch, visitedStamps);
+
+        QMutexLocker l(&(*it)->lock);
+        if ( isEpochAfter( (*it)->modifiedEpoch, cacheEpoch ) ) {
+            outdated = true;
+            break;
+        }
+    }
+
+    QMutexLocker k(&stamp->lock);
+    if (!stamp->hasCache || stamp->cacheEpoch != cacheEpoch) {
+        // The cache was cleared and maybe filled again while its inputs were checked: the inputs that were checked
+        // are not those of the new cache.
+        return;
+    }
+    if (outdated) {
+        stamp->cacheOutdated = true;
+        stamp->hasCache = false;
+        stamp->modifiedEpoch = epoch;
+        stamp->inputs.clear();
+    }
+    // Mark it only once checked, so that another thread checking it concurrently does not consider the cache valid meanwhile
+    stamp->verifiedEpoch = epoch;
+} // verifyHashCacheStampRecursive
+
+static void
+verifyHashCacheStamp(const HashCacheStampPtr& stamp,
+                     int epoch)
+{
+    std::set<HashCacheStamp*> visitedStamps;
+    verifyHashCacheStampRecursive(stamp, epoch, &visitedStamps);
+} // verifyHashCacheStamp
+
+void
+HashableObjectPrivate::clearHashCache()
+{
+    // Must be called under hashCacheMutex
+    timeViewVariantHashCache.clear();
+    timeViewInvariantCacheValid = false;
+    metadataSlaveCacheValid = false;
+}
+
+void
+HashableObjectPrivate::refreshHashCache(int epoch)
+{
+    // Must be called under hashCacheMutex
+    verifyHashCacheStamp(stamp, epoch);
+
+    QMutexLocker k(&stamp->lock);
+    if (stamp->cacheOutdated) {
+        stamp->cacheOutdated = false;
+        clearHashCache();
+    }
+}
+
 HashableObject::HashableObject()
 : _imp(new HashableObjectPrivate())
 {
@@ -103,7 +282,9 @@ HashableObject::HashableObject()
 
 HashableObject::~HashableObject()
 {
-
+    // Release the stamps of the inputs: the cache of this object will never change anymore
+    QMutexLocker k(&_imp->stamp->lock);
+    _imp->stamp->inputs.clear();
 }
 
 HashableObject::HashableObject(const HashableObject& other)
@@ -112,21 +293,22 @@ HashableObject::HashableObject(const HashableObject& other)
 
 }
 
-void
+bool
 HashableObject::addHashListener(const HashableObjectPtr& parent)
 {
-    _imp->listeners.insert(parent);
+    return _imp->listeners.insert(parent).second;
 }
 
-void
+bool
 HashableObject::removeListener(const HashableObjectPtr& parent)
 {
     for (std::set<HashableObjectWPtr>::iterator it = _imp->listeners.begin(); it != _imp->listeners.end(); ++it) {
         if (it->lock() == parent) {
             _imp->listeners.erase(it);
-            return;
+            return true;
         }
     }
+    return false;
 }
 
 void
@@ -165,7 +347,9 @@ HashableObjectPrivate::findCachedHashInternal(const HashableObject::FindHashArgs
 bool
 HashableObject::findCachedHash(const FindHashArgs& args, U64 *hash) const
 {
+    int epoch = (int)hashCacheEpoch;
     QMutexLocker k(&_imp->hashCacheMutex);
+    _imp->refreshHashCache(epoch);
     return _imp->findCachedHashInternal(args, hash);
 }
 
@@ -179,12 +363,48 @@ HashableObject::computeHash_noCache(const ComputeHashArgs& args, Hash64* hash)
 }
 
 
+namespace {
+
+// Makes the given object the one being computed on this thread for the lifetime of this object
+class HashComputationScope
+{
+    HashableObjectPrivate* _prevObject;
+
+public:
+
+    HashComputationScope(HashableObjectPrivate* object)
+    : _prevObject(0)
+    {
+        HashComputationTLS& tls = currentHashComputation.localData();
+        _prevObject = tls.object;
+        tls.object = object;
+    }
+
+    ~HashComputationScope()
+    {
+        currentHashComputation.localData().object = _prevObject;
+    }
+};
+
+} // anon namespace
+
 U64
 HashableObject::computeHash(const ComputeHashArgs& args)
 {
+    // Read the epoch before anything: if something changes while we compute, the cache will be outdated
+    int epoch = (int)hashCacheEpoch;
+
+    // If this hash is used to compute the hash of another object, its cache now depends on ours
+    HashableObjectPrivate* computingObject = currentHashComputation.localData().object;
+    if ( computingObject && (computingObject != _imp.get()) ) {
+        QMutexLocker k(&computingObject->stamp->lock);
+        computingObject->stamp->inputs.insert(_imp->stamp);
+    }
+
     {
         // Find a hash in the cache.
         QMutexLocker k(&_imp->hashCacheMutex);
+        _imp->refreshHashCache(epoch);
         U64 hashValue;
         if (_imp->hashCacheEnabled) {
             FindHashArgs findArgs;
@@ -202,10 +422,21 @@ HashableObject::computeHash(const ComputeHashArgs& args)
 
         // Identity the hash by the hash type in case for some coincendence 2 hash types are equal
         hash.append(args.hashType);
-        computeHash_noCache(args, &hash);
+        {
+            HashComputationScope scope( _imp.get() );
+            computeHash_noCache(args, &hash);
+        }
         hash.computeHash();
         hashValue = hash.value();
 
+        {
+            QMutexLocker l(&_imp->stamp->lock);
+            if (!_imp->stamp->hasCache) {
+                _imp->stamp->hasCache = true;
+                _imp->stamp->cacheEpoch = epoch;
+            }
+        }
+
         switch (args.hashType) {
             case eComputeHashTypeTimeViewInvariant:
                 _imp->timeViewInvariantCache = hashValue;
@@ -250,9 +481,17 @@ HashableObject::invalidateHashCacheInternal(std::set<HashableObject*>* invalidat
             return false;
         }
 #endif
-        _imp->timeViewVariantHashCache.clear();
-        _imp->timeViewInvariantCacheValid = false;
-        _imp->metadataSlaveCacheValid = false;
+        _imp->clearHashCache();
+
+        // Objects whose hash was computed from this one will find out that their cache is outdated
+        // the next time they look it up.
+        int epoch = hashCacheEpoch.fetchAndAddOrdered(1) + 1;
+        QMutexLocker l(&_imp->stamp->lock);
+        _imp->stamp->modifiedEpoch = epoch;
+        _imp->stamp->verifiedEpoch = epoch;
+        _imp->stamp->hasCache = false;
+        _imp->stamp->cacheOutdated = false;
+        _imp->stamp->inputs.clear();
     }
     for (std::set<HashableObjectWPtr>::const_iterator it = _imp->listeners.begin(); it != _imp->listeners.end(); ++it) {
         HashableObjectPtr listener = it->lock();
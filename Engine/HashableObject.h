@@ -46,7 +46,10 @@ NATRON_NAMESPACE_ENTER
  * @brief A HashableObject is an object that's used in the computation of the frame/view hash of a node.
  * This hash is used to identify specific images in the cache. 
  * Each time a hash is computed, the hash is cached against the frame/view as a key. 
- * The invalidate function removes all hashes from the hash cache and invalidates the parent as well recursively.
+ * The invalidate function removes all hashes from the hash cache and invalidates the listeners as well recursively.
+ * Objects whose hash was computed from this hash (e.g: the outputs of a node) do not need to be invalidated explicitly:
+ * the cache remembers which hashes it was computed from and the epoch at which it was filled, and it is discarded
+ * the next time it is looked up if any of them was invalidated since.
  **/
 struct HashableObjectPrivate;
 class HashableObject 
@@ -65,10 +68,10 @@ public:
      * This is useful to have sub-hash values that may not change a lot be cached.
      * For instance, a Curve in a Knob might not change a lot hence we cache it's hash
      **/
-    void addHashListener(const HashableObjectPtr& parent);
+    bool addHashListener(const HashableObjectPtr& parent);
     void addHashDependency(const HashableObjectPtr& parent);
 
-    void removeListener(const HashableObjectPtr& parent);
+    bool removeListener(const HashableObjectPtr& parent);
 
 
     enum ComputeHashTypeEnum
@@ -711,6 +711,58 @@ Image::isBitDepthConversionLossy(ImageBitDepthEnum from,
 }
 
 
+class DownscaleMipMapProcessor : public ImageMultiThreadProcessorBase
+{
+    Image::CPUData _srcTileData, _dstTileData;
+    RectI _srcRoI;
+    unsigned int _downscaleLevels;
+
+public:
+
+    DownscaleMipMapProcessor(const EffectInstancePtr& renderClone)
+    : ImageMultiThreadProcessorBase(renderClone)
+    , _srcTileData()
+    , _dstTileData()
+    , _srcRoI()
+    , _downscaleLevels(0)
+    {
+
+    }
+
+    virtual ~DownscaleMipMapProcessor()
+    {
+    }
+
+    void setValues(const Image::CPUData& srcTileData,
+                   const Image::CPUData& dstTileData,
+                   const RectI& srcRoI,
+                   unsigned int downscaleLevels)
+    {
+        _srcTileData = srcTileData;
+        _dstTileData = dstTileData;
+        _srcRoI = srcRoI;
+        _downscaleLevels = downscaleLevels;
+    }
+
+    virtual ActionRetCodeEnum process() OVERRIDE FINAL
+    {
+        // The render window is the downscaled image but each of its pixels costs 4^downscaleLevels source pixels:
+        // compute the number of threads from the size of the source, with at least 4096 source pixels per CPU
+        unsigned int nCPUs = ( std::min(_srcRoI.width(), 4096) * _srcRoI.height() ) / 4096;
+
+        nCPUs = std::max( 1u, std::min( nCPUs, MultiThread::getNCPUsAvailable() ) );
+
+        return launchThreadsBlocking(nCPUs);
+    }
+
+private:
+
+    virtual ActionRetCodeEnum multiThreadProcessImages(const RectI& renderWindow) OVERRIDE FINAL
+    {
+        return ImagePrivate::downscaleMipMapCPU((const void**)_srcTileData.ptrs, _srcTileData.nComps, _srcTileData.bitDepth, _srcTileData.bounds, _srcRoI, _downscaleLevels, _dstTileData.ptrs, _dstTileData.bounds, renderWindow, _effect);
+    }
+};
+
 ImagePtr
 Image::downscaleMipMap(const RectI & roi, unsigned int downscaleLevels) const
 {
@@ -725,48 +777,38 @@ Image::downscaleMipMap(const RectI & roi, unsigned int downscaleLevels) const
         return ImagePtr();
     }
 
+    // Downscaling the smallest enclosing po2 rect once per level is the same as downscaling it directly to the last level
     RectI dstRoI  = roi.downscalePowerOfTwoSmallestEnclosing(downscaleLevels);
     ImagePtr mipmapImage;
 
-    RectI previousLevelRoI = roi;
-    ImageConstPtr previousLevelImage = shared_from_this();
-
-    // Build all the mipmap levels until we reach the one we are interested in
-    for (unsigned int i = 0; i < downscaleLevels; ++i) {
-
-        // Halve the smallest enclosing po2 rect as we need to render a minimum of the renderWindow
-        RectI halvedRoI = previousLevelRoI.downscalePowerOfTwoSmallestEnclosing(1);
-
-        // Allocate an image with half the size of the source image
-        {
-            InitStorageArgs args;
-            args.bounds = halvedRoI;
-            args.renderClone = _imp->renderClone.lock();
-            args.plane = previousLevelImage->_imp->plane;
-            args.bitdepth = previousLevelImage->getBitDepth();
-            args.proxyScale = previousLevelImage->getProxyScale();
-            args.mipMapLevel = previousLevelImage->getMipMapLevel() + 1;
-            mipmapImage = Image::create(args);
-            if (!mipmapImage) {
-                return mipmapImage;
-            }
+    // Only the last level is allocated: intermediate levels are computed on small tiles by the processor
+    {
+        InitStorageArgs args;
+        args.bounds = dstRoI;
+        args.renderClone = _imp->renderClone.lock();
+        args.plane = _imp->plane;
+        args.bitdepth = getBitDepth();
+        args.proxyScale = getProxyScale();
+        args.mipMapLevel = getMipMapLevel() + downscaleLevels;
+        mipmapImage = Image::create(args);
+        if (!mipmapImage) {
+            return mipmapImage;
         }
+    }
 
-        Image::CPUData srcTileData;
-        previousLevelImage->getCPUData(&srcTileData);
-
-        Image::CPUData dstTileData;
-        mipmapImage->getCPUData(&dstTileData);
+    Image::CPUData srcTileData;
+    getCPUData(&srcTileData);
 
-        ActionRetCodeEnum stat = ImagePrivate::halveImage((const void**)srcTileData.ptrs, srcTileData.nComps, srcTileData.bitDepth, srcTileData.bounds, dstTileData.ptrs, dstTileData.bounds, _imp->renderClone.lock());
-        if (isFailureRetCode(stat)) {
-            return ImagePtr();
-        }
+    Image::CPUData dstTileData;
+    mipmapImage->getCPUData(&dstTileData);
 
-        // Switch for next pass
-        previousLevelRoI = halvedRoI;
-        previousLevelImage = mipmapImage;
-    } // for all downscale levels
+    DownscaleMipMapProcessor processor(_imp->renderClone.lock());
+    processor.setValues(srcTileData, dstTileData, roi, downscaleLevels);
+    processor.setRenderWindow(dstRoI);
+    ActionRetCodeEnum stat = processor.process();
+    if (isFailureRetCode(stat)) {
+        return ImagePtr();
+    }
     return mipmapImage;
 
 } // downscaleMipMap
@@ -36,6 +36,7 @@
 #include <boost/thread/locks.hpp>
 
 #include "Engine/AppManager.h"
+#include "Engine/CancellationToken.h"
 #include "Engine/Cache.h"
 #include "Engine/CacheEntryBase.h"
 #include "Engine/Hash64.h"
@@ -47,6 +48,7 @@
 #include "Engine/MultiThread.h"
 #include "Engine/ThreadPool.h"
 #include "Engine/Timer.h"
+#include "Engine/TreeRender.h"
 
 // Define to log tiles status in the console
 //#define TRACE_TILES_STATUS
@@ -255,13 +257,15 @@ struct TileData
 /**
  * @brief Since all tiles in the cache share the same cache entry (same image) we want the allocation of the tiles from the cache to 
  * come from different buckets so that we distribute uniformly the tile file storage.
+ * This index also identifies the tile in the compressed tier of the cache once evicted, hence it depends on the quality of the tile.
  **/
-static U64 makeTileCacheIndex(int tx, int ty, unsigned int mipMapLevel, int channelIndex) {
+static U64 makeTileCacheIndex(int tx, int ty, unsigned int mipMapLevel, int channelIndex, bool isDraft) {
     Hash64 hash;
     hash.append(channelIndex);
     hash.append(mipMapLevel);
     hash.append(tx);
     hash.append(ty);
+    hash.append(isDraft);
     hash.computeHash();
     return hash.value();
 }
@@ -342,6 +346,11 @@ struct ImageCacheEntryPrivate
     // Pointer to the image holding this ImageCacheEntry
     ImageWPtr image;
 
+    // Started when tiles get marked pending for this object to render them.
+    // The time elapsed until they are marked rendered is added to the compute cost of the cache entry.
+    // Protected by lock
+    boost::scoped_ptr<TimeLapse> renderTimer;
+
 #if defined(TRACE_TILES_STATUS) || defined(TRACE_TILES_STATUS_SHORT)
     QString debugId;
 #endif
@@ -378,6 +387,7 @@ struct ImageCacheEntryPrivate
     , tilesToFetch()
     , cachePolicy(cachePolicy)
     , image(image)
+    , renderTimer()
     {
         assert(perMipMapPixelRod.size() >= mipMapLevel + 1);
         for (int i = 0; i < 4; ++i) {
@@ -429,6 +439,19 @@ struct ImageCacheEntryPrivate
 
     }
 
+    /**
+     * @brief Returns the cancellation token of the render of the effect, if any, so that waits for tiles
+     * or cache entries computed by other threads return when the render is aborted.
+     **/
+    CancellationTokenPtr getCancellationToken() const
+    {
+        EffectInstancePtr e = effect.lock();
+        if (!e) {
+            return CancellationTokenPtr();
+        }
+        return e->getCancellationToken();
+    }
+
 
     enum UpdateStateMapRetCodeEnum
     {
@@ -459,11 +482,24 @@ struct ImageCacheEntryPrivate
      **/
     ActionRetCodeEnum fetchAndCopyCachedTiles() WARN_UNUSED_RETURN;
 
+    /**
+     * @brief Restore from the compressed tier of the cache the tiles we marked pending at the mipmap level of interest
+     * so that they do not have to be rendered. This must be called after a call to readAndUpdateStateMap
+     * Note that this function does the pixels transfer
+     **/
+    ActionRetCodeEnum fetchCompressedTiles() WARN_UNUSED_RETURN;
+
     /**
      * @brief Only relevant if the cache entry is persistent: update the cache from our local cache entry
      **/
     void updateCachedTilesStateMap(const std::vector<TilesSet>& tilesToUpdate, bool updateAllTilesRegardless);
 
+    /**
+     * @brief Creates internalCacheEntry to interact with the cache. The entry is flagged as prefetched
+     * if the effect is rendered by a prefetch render.
+     **/
+    void createInternalCacheEntry();
+
     enum LookupTileStateRetCodeEnum
     {
         eLookupTileStateRetCodeUpToDate,
@@ -1183,20 +1219,21 @@ static void fetchTileIndicesInPyramid(unsigned int lookupLevel,
                                       int tileSizeY,
                                       const TileCacheIndex& tile,
                                       int nComps,
+                                      bool isDraft,
                                       std::vector<U64> *tileIndicesToFetch,
                                       std::vector<U64>* tilesAllocNeeded)
 {
     if (tile.upscaleTiles[0]) {
         // We must downscale the upscaled tiles
         for (int c = 0; c < nComps; ++c) {
-            U64 tileBucketHash = makeTileCacheIndex(tile.tx, tile.ty, lookupLevel, c);
+            U64 tileBucketHash = makeTileCacheIndex(tile.tx, tile.ty, lookupLevel, c, isDraft);
             tilesAllocNeeded->push_back(tileBucketHash);
         }
         for (int i = 0; i < 4; ++i) {
             assert(tile.upscaleTiles[i]);
             // Check that the upscaled tile exists
             if (tile.upscaleTiles[i]->tx != -1) {
-                fetchTileIndicesInPyramid(lookupLevel - 1, tileSizeX, tileSizeY, *tile.upscaleTiles[i], nComps, tileIndicesToFetch, tilesAllocNeeded);
+                fetchTileIndicesInPyramid(lookupLevel - 1, tileSizeX, tileSizeY, *tile.upscaleTiles[i], nComps, isDraft, tileIndicesToFetch, tilesAllocNeeded);
             }
         }
     } else {
@@ -1313,7 +1350,7 @@ ImageCacheEntryPrivate::fetchAndCopyCachedTiles()
     // Number of tiles to allocate to downscale
     std::vector<U64> tilesAllocNeeded;
     for (std::size_t i = 0; i < tilesToFetch.size(); ++i) {
-        fetchTileIndicesInPyramid(mipMapLevel, localTilesState.tileSizeX, localTilesState.tileSizeY, tilesToFetch[i], nComps, &tileIndicesToFetch, &tilesAllocNeeded);
+        fetchTileIndicesInPyramid(mipMapLevel, localTilesState.tileSizeX, localTilesState.tileSizeY, tilesToFetch[i], nComps, isDraftModeEnabled, &tileIndicesToFetch, &tilesAllocNeeded);
     }
 
     if (tileIndicesToFetch.empty() && tilesAllocNeeded.empty()) {
@@ -1482,6 +1519,153 @@ ImageCacheEntryPrivate::fetchAndCopyCachedTiles()
 
 } // fetchAndCopyCachedTiles
 
+ActionRetCodeEnum
+ImageCacheEntryPrivate::fetchCompressedTiles()
+{
+    if (markedTiles.size() != mipMapLevel + 1 || markedTiles[mipMapLevel].empty()) {
+        return eActionStatusOK;
+    }
+
+    // Tiles marked to be downscaled from higher scale tiles are handled in fetchAndCopyCachedTiles()
+    TilesSet downscaledTiles;
+    for (std::vector<TileCacheIndex>::const_iterator it = tilesToFetch.begin(); it != tilesToFetch.end(); ++it) {
+        if (it->upscaleTiles[0]) {
+            TileCoord coord = {it->tx, it->ty};
+            downscaledTiles.insert(coord);
+        }
+    }
+
+    std::vector<TileCoord> tilesToLookup;
+    std::vector<U64> localTileIndices;
+    for (TilesSet::const_iterator it = markedTiles[mipMapLevel].begin(); it != markedTiles[mipMapLevel].end(); ++it) {
+        if (downscaledTiles.find(*it) != downscaledTiles.end()) {
+            continue;
+        }
+        tilesToLookup.push_back(*it);
+        for (int c = 0; c < nComps; ++c) {
+            localTileIndices.push_back(makeTileCacheIndex(it->tx, it->ty, mipMapLevel, c, isDraftModeEnabled));
+        }
+    }
+
+    if (localTileIndices.empty()) {
+        return eActionStatusOK;
+    }
+
+    CacheBasePtr tileCache = internalCacheEntry->getCache();
+
+    // Tiles of which only some channels were restored: they are rendered again
+    std::vector<U64> localTileIndicesToRelease, cacheTileIndicesToRelease;
+
+    std::vector<TilesSet> tilesToUpdate(mipMapLevel + 1);
+
+    ActionRetCodeEnum stat = eActionStatusOK;
+    {
+        std::vector<bool> foundTiles;
+        std::vector<std::pair<U64, void*> > allocatedTiles;
+        void* cacheData;
+        bool gotTiles = tileCache->retrieveCompressedTiles(internalCacheEntry, localTileIndices, &foundTiles, &allocatedTiles, &cacheData);
+        CacheDataLock_RAII cacheDataDeleter(tileCache, cacheData);
+        if (!gotTiles || allocatedTiles.empty()) {
+            // Tiles not found will be rendered
+            return eActionStatusOK;
+        }
+
+        // We are going to copy data from the cache, ensure our local buffers are allocated
+        image.lock()->ensureBuffersAllocated();
+
+        TileStateHeader cacheStateMap(localTilesState.tileSizeX, localTilesState.tileSizeY, &internalCacheEntry->perMipMapTilesState[mipMapLevel]);
+        assert(!cacheStateMap.state->tiles.empty());
+
+        std::vector<boost::shared_ptr<TileData> > tilesToCopy;
+
+        int allocatedTiles_i = 0;
+        for (std::size_t i = 0; i < tilesToLookup.size(); ++i) {
+
+            bool allChannelsFound = true;
+            for (int c = 0; c < nComps; ++c) {
+                if (!foundTiles[i * nComps + c]) {
+                    allChannelsFound = false;
+                }
+            }
+
+            TileState* cacheTileState = cacheStateMap.getTileAt(tilesToLookup[i].tx, tilesToLookup[i].ty);
+            TileState* localTileState = localTilesState.getTileAt(tilesToLookup[i].tx, tilesToLookup[i].ty);
+            assert(cacheTileState && localTileState);
+
+            for (int c = 0; c < nComps; ++c) {
+                if (!foundTiles[i * nComps + c]) {
+                    continue;
+                }
+                const std::pair<U64, void*>& allocatedTile = allocatedTiles[allocatedTiles_i];
+                ++allocatedTiles_i;
+
+                if (!allChannelsFound) {
+                    localTileIndicesToRelease.push_back(localTileIndices[i * nComps + c]);
+                    cacheTileIndicesToRelease.push_back(allocatedTile.first);
+                    continue;
+                }
+
+                cacheTileState->channelsTileStorageIndex[c] = allocatedTile.first;
+                localTileState->channelsTileStorageIndex[c] = allocatedTile.first;
+
+                boost::shared_ptr<TileData> copy(new TileData);
+                copy->ptr = allocatedTile.second;
+                copy->tileCache_i = allocatedTile.first;
+                copy->bounds = localTileState->bounds;
+                copy->channel_i = c;
+                tilesToCopy.push_back(copy);
+            }
+
+            if (!allChannelsFound) {
+                continue;
+            }
+
+            // The tile is no longer ours to render
+            assert(cacheTileState->status == eTileStatusPending);
+            cacheTileState->status = isDraftModeEnabled ? eTileStatusRenderedLowQuality : eTileStatusRenderedHighestQuality;
+            assert(localTileState->status == eTileStatusNotRendered);
+            localTileState->status = cacheTileState->status;
+
+            markedTiles[mipMapLevel].erase(tilesToLookup[i]);
+            tilesToUpdate[mipMapLevel].insert(tilesToLookup[i]);
+#ifdef TRACE_TILES_STATUS
+            qDebug() << QThread::currentThread() << debugId << "marking " << tilesToLookup[i].tx << tilesToLookup[i].ty << "rendered from the compressed cache at level" << mipMapLevel;
+#endif
+        }
+
+        if (!tilesToCopy.empty()) {
+            EffectInstancePtr renderClone = effect.lock();
+            boost::scoped_ptr<CachePixelsTransferProcessorBase> processor;
+            switch (bitdepth) {
+                case eImageBitDepthByte:
+                    processor.reset(new CachePixelsTransferProcessor<false /*copyToCache*/, unsigned char>(renderClone));
+                    break;
+                case eImageBitDepthShort:
+                    processor.reset(new CachePixelsTransferProcessor<false /*copyToCache*/, unsigned short>(renderClone));
+                    break;
+                case eImageBitDepthFloat:
+                    processor.reset(new CachePixelsTransferProcessor<false /*copyToCache*/, float>(renderClone));
+                    break;
+                default:
+                    break;
+            }
+            processor->setValues(this, tilesToCopy);
+            stat = processor->launchThreadsBlocking();
+        }
+    } // cacheDataDeleter
+
+    // unLockTiles must be called before releaseTiles
+    if (!cacheTileIndicesToRelease.empty()) {
+        tileCache->releaseTiles(internalCacheEntry, localTileIndicesToRelease, cacheTileIndicesToRelease);
+    }
+
+    // In persistent mode we have to actually copy the states map from the cache entry to the cache
+    if (internalCacheEntry->isPersistent() && !tilesToUpdate[mipMapLevel].empty()) {
+        updateCachedTilesStateMap(tilesToUpdate, false);
+    }
+    return stat;
+} // fetchCompressedTiles
+
 ActionRetCodeEnum
 ImageCacheEntry::fetchCachedTilesAndUpdateStatus(TileStateHeader* tileStatus, bool* hasUnRenderedTile, bool *hasPendingResults)
 {
@@ -1512,19 +1696,13 @@ ImageCacheEntry::fetchCachedTilesAndUpdateStatus(TileStateHeader* tileStatus, bo
         } else {
             // If we want interaction with the cache, we need to fetch the actual tiles state map from the cache
 
-            if (!appPTR->getTileCache()->isPersistent()) {
-                _imp->internalCacheEntry = ImageCacheEntryInternal<false>::create(_imp->key);
-            } else {
-                _imp->internalCacheEntry = ImageCacheEntryInternal<true>::create(_imp.get(), _imp->key);
-            }
-            _imp->internalCacheEntry->tileSizeX = _imp->localTilesState.tileSizeX;
-            _imp->internalCacheEntry->tileSizeY = _imp->localTilesState.tileSizeY;
+            _imp->createInternalCacheEntry();
 
             CacheEntryLockerBasePtr cacheAccess = _imp->internalCacheEntry->getFromCache();
 
             CacheEntryLockerBase::CacheEntryStatusEnum cacheStatus = cacheAccess->getStatus();
             while (cacheStatus == CacheEntryLockerBase::eCacheEntryStatusComputationPending) {
-                cacheStatus = cacheAccess->waitForPendingEntry();
+                cacheStatus = cacheAccess->waitForPendingEntry(0, _imp->getCancellationToken());
             }
             assert(cacheStatus == CacheEntryLockerBase::eCacheEntryStatusCached ||
                    cacheStatus == CacheEntryLockerBase::eCacheEntryStatusMustCompute);
@@ -1532,20 +1710,14 @@ ImageCacheEntry::fetchCachedTilesAndUpdateStatus(TileStateHeader* tileStatus, bo
             if (_imp->cachePolicy == eCacheAccessModeWriteOnly && cacheStatus == CacheEntryLockerBase::eCacheEntryStatusCached) {
                 _imp->internalCacheEntry->getCache()->removeEntry(_imp->internalCacheEntry);
 
-                if (!appPTR->getTileCache()->isPersistent()) {
-                    _imp->internalCacheEntry = ImageCacheEntryInternal<false>::create(_imp->key);
-                } else {
-                    _imp->internalCacheEntry = ImageCacheEntryInternal<true>::create(_imp.get(), _imp->key);
-                }
-                _imp->internalCacheEntry->tileSizeX = _imp->localTilesState.tileSizeX;
-                _imp->internalCacheEntry->tileSizeY = _imp->localTilesState.tileSizeY;
+                _imp->createInternalCacheEntry();
                 _imp->markedTiles.clear();
                 _imp->tilesToFetch.clear();
                 
                 cacheAccess = _imp->internalCacheEntry->getFromCache();
                 cacheStatus = cacheAccess->getStatus();
                 while (cacheStatus == CacheEntryLockerBase::eCacheEntryStatusComputationPending) {
-                    cacheStatus = cacheAccess->waitForPendingEntry();
+                    cacheStatus = cacheAccess->waitForPendingEntry(0, _imp->getCancellationToken());
                 }
                 assert(cacheStatus == CacheEntryLockerBase::eCacheEntryStatusCached ||
                        cacheStatus == CacheEntryLockerBase::eCacheEntryStatusMustCompute);
@@ -1649,6 +1821,14 @@ ImageCacheEntry::fetchCachedTilesAndUpdateStatus(TileStateHeader* tileStatus, bo
                     writeLock.reset(new boost::unique_lock<boost::shared_mutex>(nonPersistentLocalEntry->perMipMapTilesStateMutex));
                 }
 
+                // The tiles we marked to render may have been evicted to the compressed tier of the cache
+                if (markedTilesModified) {
+                    ActionRetCodeEnum stat = _imp->fetchCompressedTiles();
+                    if (isFailureRetCode(stat)) {
+                        return stat;
+                    }
+                }
+
                 // If we found any new cached tile, fetch and copy them to our local storage
                 ActionRetCodeEnum stat = _imp->fetchAndCopyCachedTiles();
                 if (isFailureRetCode(stat)) {
@@ -1656,6 +1836,10 @@ ImageCacheEntry::fetchCachedTilesAndUpdateStatus(TileStateHeader* tileStatus, bo
                 }
                 
             }
+
+            if (markedTilesModified && !_imp->renderTimer && !_imp->markedTiles[_imp->mipMapLevel].empty()) {
+                _imp->renderTimer.reset(new TimeLapse);
+            }
         } // _imp->cachePolicy = eCacheAccessModeNone
 
     } // locker
@@ -1688,6 +1872,25 @@ ImageCacheEntry::getStatus(TileStateHeader* tileStatus, bool* hasUnRenderedTile,
     }
 } // getStatus
 
+void
+ImageCacheEntryPrivate::createInternalCacheEntry()
+{
+    if (!appPTR->getTileCache()->isPersistent()) {
+        internalCacheEntry = ImageCacheEntryInternal<false>::create(key);
+    } else {
+        internalCacheEntry = ImageCacheEntryInternal<true>::create(this, key);
+    }
+    internalCacheEntry->tileSizeX = localTilesState.tileSizeX;
+    internalCacheEntry->tileSizeY = localTilesState.tileSizeY;
+
+    EffectInstancePtr renderClone = effect.lock();
+    TreeRenderPtr render;
+    if (renderClone) {
+        render = renderClone->getCurrentRender();
+    }
+    internalCacheEntry->setPrefetched(render && render->isPrefetchRender());
+} // createInternalCacheEntry
+
 void
 ImageCacheEntryPrivate::updateCachedTilesStateMap(const std::vector<TilesSet>& tilesToUpdate, bool updateAllTilesRegardless)
 {
@@ -1716,7 +1919,7 @@ ImageCacheEntryPrivate::updateCachedTilesStateMap(const std::vector<TilesSet>& t
     CacheEntryLockerBasePtr cacheAccess = internalCacheEntry->getFromCache();
     CacheEntryLockerBase::CacheEntryStatusEnum cacheStatus = cacheAccess->getStatus();
     while (cacheStatus == CacheEntryLockerBase::eCacheEntryStatusComputationPending) {
-        cacheStatus = cacheAccess->waitForPendingEntry();
+        cacheStatus = cacheAccess->waitForPendingEntry(0, getCancellationToken());
     }
     assert(cacheStatus == CacheEntryLockerBase::eCacheEntryStatusCached ||
            cacheStatus == CacheEntryLockerBase::eCacheEntryStatusMustCompute);
@@ -1738,6 +1941,9 @@ ImageCacheEntry::markCacheTilesAsAborted()
     // Protect all local structures against multiple threads using this object.
     boost::unique_lock<boost::mutex> locker(_imp->lock);
 
+    // Tiles were not rendered, do not account for the time spent
+    _imp->renderTimer.reset();
+
     if (_imp->markedTiles.empty()) {
         return;
     }
@@ -1880,6 +2086,9 @@ ImageCacheEntry::markCacheTilesInRegionAsNotRendered(const RectI& roi)
 
                 TileState* cacheTileState = cacheStateMap.getTileAt(tx, ty);
                 assert(cacheTileState);
+
+                // The local index of the tiles depends on the quality they were rendered with
+                bool wasDraft = cacheTileState->status == eTileStatusRenderedLowQuality;
                 cacheTileState->status = eTileStatusNotRendered;
                 hasModifiedTileMap = true;
 #ifdef TRACE_TILES_STATUS
@@ -1890,7 +2099,7 @@ ImageCacheEntry::markCacheTilesInRegionAsNotRendered(const RectI& roi)
                     if (cacheTileState->channelsTileStorageIndex[c] != (U64)-1) {
                         cacheTileIndicesToRelease.push_back(cacheTileState->channelsTileStorageIndex[c]);
 
-                        U64 tileIndex = makeTileCacheIndex(tx, ty, i, c);
+                        U64 tileIndex = makeTileCacheIndex(tx, ty, i, c, wasDraft);
                         localTileIndicesToRelease.push_back(tileIndex);
                     }
                 }
@@ -2022,7 +2231,7 @@ ImageCacheEntry::markCacheTilesAsRendered()
 
     std::vector<U64> tilesAllocNeeded(tilesToCopy.size());
     for (std::size_t i = 0; i < tilesToCopy.size(); ++i) {
-        tilesAllocNeeded[i] = makeTileCacheIndex(tilesToCopy[i]->bounds.x1, tilesToCopy[i]->bounds.y1, _imp->mipMapLevel, tilesToCopy[i]->channel_i);
+        tilesAllocNeeded[i] = makeTileCacheIndex(tilesToCopy[i]->bounds.x1, tilesToCopy[i]->bounds.y1, _imp->mipMapLevel, tilesToCopy[i]->channel_i, _imp->isDraftModeEnabled);
     }
 
     // Allocated buffers for tiles
@@ -2086,6 +2295,12 @@ ImageCacheEntry::markCacheTilesAsRendered()
     if (_imp->internalCacheEntry->isPersistent()) {
         _imp->updateCachedTilesStateMap(tilesToUpdate, false);
     }
+
+    // Record the time it took to render the tiles so that the cache can evict first cheap entries
+    if (_imp->renderTimer) {
+        cache->addEntryComputeCost(_imp->internalCacheEntry, _imp->renderTimer->getTimeSinceCreation());
+        _imp->renderTimer.reset();
+    }
 } // markCacheTilesAsRendered
 
 bool
@@ -2117,6 +2332,9 @@ ImageCacheEntry::waitForPendingTiles()
     std::size_t timeSpentWaitingForPendingEntryMS = 0;
     std::size_t timeToWaitMS = 40;
 
+    // Wake up as soon as the render is aborted rather than at the end of the sleep
+    CancellationTokenPtr cancellationToken = _imp->getCancellationToken();
+
 
     bool hasUnrenderedTile;
     bool hasPendingResults;
@@ -2132,7 +2350,13 @@ ImageCacheEntry::waitForPendingTiles()
         if (hasPendingResults) {
 
             timeSpentWaitingForPendingEntryMS += timeToWaitMS;
-            CacheEntryLockerBase::sleep_milliseconds(timeToWaitMS);
+            if (cancellationToken) {
+                if ( cancellationToken->waitForCancellation(timeToWaitMS) ) {
+                    break;
+                }
+            } else {
+                CacheEntryLockerBase::sleep_milliseconds(timeToWaitMS);
+            }
 
             // Increase the time to wait at the next iteration
             timeToWaitMS *= 1.2;
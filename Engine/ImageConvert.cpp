@@ -27,6 +27,7 @@
 #include <algorithm> // min, max
 #include <cassert>
 #include <stdexcept>
+#include <vector>
 
 #if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
 GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
@@ -37,6 +38,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include <QtCore/QDebug>
 
 #include "Engine/AppManager.h"
+#include "Engine/ImageConvertSIMD.h"
 #include "Engine/Texture.h"
 #include "Engine/Lut.h"
 
@@ -133,6 +135,194 @@ lutFromColorspace(ViewerColorSpaceEnum cs)
     return lut;
 }
 
+/**
+ * @brief Converts a packed scan-line of width pixels with the vectorized kernels of ImageConvertSIMD.
+ * Returns false if this conversion has no kernel, in which case the generic code must be used.
+ * The overloads below must produce exactly the same output as convertToFormatInternal_sameComps.
+ **/
+template <typename SRCPIX, typename DSTPIX>
+bool
+convertPackedScanLineSIMD(const Color::Lut* /*srcLut*/,
+                          const Color::Lut* /*dstLut*/,
+                          const SRCPIX* /*src*/,
+                          DSTPIX* /*dst*/,
+                          int /*width*/,
+                          int /*nComp*/,
+                          std::vector<unsigned short>* /*quantizedScanLine*/)
+{
+    return false;
+}
+
+static bool
+convertPackedScanLineSIMD(const Color::Lut* srcLut,
+                          const Color::Lut* dstLut,
+                          const unsigned char* src,
+                          float* dst,
+                          int width,
+                          int nComp,
+                          std::vector<unsigned short>* /*quantizedScanLine*/)
+{
+    if (dstLut) {
+        return false;
+    }
+    if (srcLut) {
+        ImageConvertSIMD::convertUint8ToFloatLut(srcLut, src, dst, width * nComp, nComp);
+    } else {
+        ImageConvertSIMD::convertUint8ToFloat(src, dst, width * nComp);
+    }
+
+    return true;
+}
+
+static bool
+convertPackedScanLineSIMD(const Color::Lut* srcLut,
+                          const Color::Lut* dstLut,
+                          const unsigned short* src,
+                          float* dst,
+                          int width,
+                          int nComp,
+                          std::vector<unsigned short>* /*quantizedScanLine*/)
+{
+    if (srcLut || dstLut) {
+        return false;
+    }
+    ImageConvertSIMD::convertUint16ToFloat(src, dst, width * nComp);
+
+    return true;
+}
+
+static bool
+convertPackedScanLineSIMD(const Color::Lut* srcLut,
+                          const Color::Lut* dstLut,
+                          const float* src,
+                          unsigned short* dst,
+                          int width,
+                          int nComp,
+                          std::vector<unsigned short>* /*quantizedScanLine*/)
+{
+    if (srcLut || dstLut) {
+        return false;
+    }
+    ImageConvertSIMD::convertFloatToUint16(src, dst, width * nComp);
+
+    return true;
+}
+
+static bool
+convertPackedScanLineSIMD(const Color::Lut* srcLut,
+                          const Color::Lut* dstLut,
+                          const float* src,
+                          unsigned char* dst,
+                          int width,
+                          int nComp,
+                          std::vector<unsigned short>* quantizedScanLine)
+{
+    if (srcLut) {
+        return false;
+    }
+    if (!dstLut) {
+        // No color-space conversion: there's no error diffusion either
+        ImageConvertSIMD::convertFloatToUint8(src, dst, width * nComp);
+
+        return true;
+    }
+
+    // Quantize the whole scan-line with the kernel, only the error diffusion remains sequential
+    quantizedScanLine->resize(width * nComp);
+    const unsigned short* quantized = &quantizedScanLine->front();
+    ImageConvertSIMD::convertFloatToUint8xxLut(dstLut, src, &quantizedScanLine->front(), width * nComp);
+
+    // Start of the line for error diffusion
+    // coverity[dont_call]
+    int start = rand() % width;
+
+    for (int backward = 0; backward < 2; ++backward) {
+        int x = backward ? start - 1 : start;
+        int end = backward ? -1 : width;
+        int increment = backward ? -1 : 1;
+        unsigned error[3] = {
+            0x80, 0x80, 0x80
+        };
+
+        for (; x != end; x += increment) {
+            for (int k = 0; k < nComp; ++k) {
+                int i = x * nComp + k;
+                if (k == 3) {
+                    dst[i] = Image::convertPixelDepth<float, unsigned char>(src[i]);
+                } else {
+                    error[k] = (error[k] & 0xff) + quantized[i];
+                    dst[i] = (unsigned char)(error[k] >> 8);
+                }
+            }
+        }
+    }
+
+    return true;
+} // convertPackedScanLineSIMD
+
+template <typename SRCPIX, typename DSTPIX>
+bool
+convertScanLineSIMD(const RectI & renderWindow,
+                    int y,
+                    const Color::Lut* srcLut,
+                    const Color::Lut* dstLut,
+                    const void* srcBufPtrs[4],
+                    int nComp,
+                    const RectI& srcBounds,
+                    void* dstBufPtrs[4],
+                    const RectI& dstBounds,
+                    std::vector<unsigned short>* quantizedScanLine)
+{
+    if (ImageConvertSIMD::getSupportedInstructionSet() == ImageConvertSIMD::eInstructionSetScalar) {
+        // The generic code is as fast as the scalar kernels
+        return false;
+    }
+
+    const SRCPIX* srcPixelPtrs[4];
+    int srcPixelStride;
+    Image::getChannelPointers<SRCPIX>((const SRCPIX**)srcBufPtrs, renderWindow.x1, y, srcBounds, nComp, (SRCPIX**)srcPixelPtrs, &srcPixelStride);
+
+    DSTPIX* dstPixelPtrs[4];
+    int dstPixelStride;
+    Image::getChannelPointers<DSTPIX>((const DSTPIX**)dstBufPtrs, renderWindow.x1, y, dstBounds, nComp, (DSTPIX**)dstPixelPtrs, &dstPixelStride);
+
+    // The kernels work on contiguous values: only packed (or single channel) buffers can be handled
+    if ( (srcPixelStride != nComp) || (dstPixelStride != nComp) || !srcPixelPtrs[0] || !dstPixelPtrs[0] ) {
+        return false;
+    }
+
+    return convertPackedScanLineSIMD(srcLut, dstLut, srcPixelPtrs[0], dstPixelPtrs[0], renderWindow.width(), nComp, quantizedScanLine);
+}
+
+/**
+ * @brief Expands a packed RGB scan-line to packed RGBA with the vectorized kernels of ImageConvertSIMD.
+ * Only handles buffers of the same bit depth, returns false otherwise.
+ **/
+template <typename SRCPIX, typename DSTPIX>
+bool
+convertRGBToRGBAScanLineSIMD(const SRCPIX* /*src*/,
+                             DSTPIX* /*dst*/,
+                             int /*width*/,
+                             DSTPIX /*alpha*/)
+{
+    return false;
+}
+
+template <typename PIX>
+bool
+convertRGBToRGBAScanLineSIMD(const PIX* src,
+                             PIX* dst,
+                             int width,
+                             PIX alpha)
+{
+    if (ImageConvertSIMD::getSupportedInstructionSet() == ImageConvertSIMD::eInstructionSetScalar) {
+        return false;
+    }
+    ImageConvertSIMD::convertRGBToRGBA(src, dst, width, alpha);
+
+    return true;
+}
+
 ///Fast version when components are the same
 template <typename SRCPIX, int srcMaxValue, typename DSTPIX, int dstMaxValue>
 ActionRetCodeEnum
@@ -157,6 +347,8 @@ convertToFormatInternal_sameComps(const RectI & renderWindow,
 
     int srcDataSizeOf = sizeof(SRCPIX);
 
+    // Holds the quantized scan-line before error diffusion when converting to 8-bit with the vectorized kernels
+    std::vector<unsigned short> quantizedScanLine;
 
     for (int y = renderWindow.y1; y < renderWindow.y2; ++y) {
 
@@ -209,6 +401,8 @@ convertToFormatInternal_sameComps(const RectI & renderWindow,
                 }
             }
 
+        } else if ( convertScanLineSIMD<SRCPIX, DSTPIX>(renderWindow, y, srcLut, dstLut, srcBufPtrs, nComp, srcBounds, dstBufPtrs, dstBounds, &quantizedScanLine) ) {
+            // The scan-line was converted by the vectorized kernels
         } else {
             // Start of the line for error diffusion
             // coverity[dont_call]
@@ -353,6 +547,24 @@ convertToFormatInternal(const RectI & renderWindow,
             return eActionStatusAborted;
         }
 
+        if ( (srcNComps == 3) && (dstNComps == 4) && !srcLut && !dstLut && (alphaHandling != Image::eAlphaChannelHandlingFillFromChannel) ) {
+            // Without color-space conversion, converting RGB to RGBA of the same bit depth is a copy filling the alpha channel.
+            // Note that the 8-bit error diffusion below does not change anything when the source is 8-bit.
+            const SRCPIX* srcPixelPtrs[4];
+            int srcPixelStride;
+            Image::getChannelPointers<SRCPIX, srcNComps>((const SRCPIX**)srcBufPtrs, renderWindow.x1, y, srcBounds, (SRCPIX**)srcPixelPtrs, &srcPixelStride);
+
+            DSTPIX* dstPixelPtrs[4];
+            int dstPixelStride;
+            Image::getChannelPointers<DSTPIX, dstNComps>((const DSTPIX**)dstBufPtrs, renderWindow.x1, y, dstBounds, (DSTPIX**)dstPixelPtrs, &dstPixelStride);
+
+            DSTPIX alpha = alphaHandling == Image::eAlphaChannelHandlingCreateFill1 ? (DSTPIX)dstMaxValue : (DSTPIX)0;
+            if ( (srcPixelStride == 3) && (dstPixelStride == 4) &&
+                 convertRGBToRGBAScanLineSIMD(srcPixelPtrs[0], dstPixelPtrs[0], renderWindow.width(), alpha) ) {
+                continue;
+            }
+        }
+
         int start = rand() % renderWindow.width() + renderWindow.x1;
 
         const SRCPIX* srcPixelPtrs[4];
@@ -0,0 +1,989 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2013-2017 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "ImageConvertSIMD.h"
+
+#include <algorithm> // min
+#include <cassert>
+#include <cstring> // memcpy
+
+#include "Engine/Interpolation.h"
+#include "Engine/Lut.h"
+
+// The vectorized kernels are compiled with a per-function target attribute so that the rest of the
+// Engine does not have to be compiled with -msse4.1 or -mavx2: the CPU is checked at run-time before
+// calling them. This requires GCC >= 4.9 or Clang on x86, other compilers only get the scalar kernels.
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) ) && \
+    ( defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9) )
+#define NATRON_IMAGECONVERT_SIMD
+#include <immintrin.h>
+#define NATRON_TARGET_SSE41 __attribute__( ( target("sse4.1") ) )
+#define NATRON_TARGET_AVX2 __attribute__( ( target("avx2") ) )
+#endif
+
+NATRON_NAMESPACE_ENTER;
+
+namespace ImageConvertSIMD {
+
+static InstructionSetEnum
+detectInstructionSet()
+{
+#ifdef NATRON_IMAGECONVERT_SIMD
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports("avx2") ) {
+        return eInstructionSetAVX2;
+    }
+    if ( __builtin_cpu_supports("sse4.1") ) {
+        return eInstructionSetSSE41;
+    }
+#endif
+
+    return eInstructionSetScalar;
+}
+
+// Set by setMaximumInstructionSet()
+static InstructionSetEnum maximumInstructionSet = eInstructionSetAVX2;
+
+InstructionSetEnum
+getSupportedInstructionSet()
+{
+    static const InstructionSetEnum instructionSet = detectInstructionSet();
+
+    return std::min(instructionSet, maximumInstructionSet);
+}
+
+void
+setMaximumInstructionSet(InstructionSetEnum instructionSet)
+{
+    maximumInstructionSet = instructionSet;
+}
+
+// Never run a kernel the CPU does not support, even if explicitly asked for
+static InstructionSetEnum
+clampInstructionSet(InstructionSetEnum instructionSet)
+{
+    return std::min( instructionSet, getSupportedInstructionSet() );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Scalar kernels: these are the reference for the vectorized ones.
+
+static void
+convertUint8ToFloat_scalar(const unsigned char* src,
+                           float* dst,
+                           int n)
+{
+    for (int i = 0; i < n; ++i) {
+        dst[i] = Color::intToFloat<256>(src[i]);
+    }
+}
+
+static void
+convertUint16ToFloat_scalar(const unsigned short* src,
+                            float* dst,
+                            int n)
+{
+    for (int i = 0; i < n; ++i) {
+        dst[i] = Color::intToFloat<65536>(src[i]);
+    }
+}
+
+template <typename DSTPIX, int numvals>
+static void
+convertFloatToInt_scalar(const float* src,
+                         DSTPIX* dst,
+                         int n)
+{
+    for (int i = 0; i < n; ++i) {
+        dst[i] = (DSTPIX)Color::floatToInt<numvals>(src[i]);
+    }
+}
+
+static void
+convertFloatToUint8xxLut_scalar(const Color::Lut* lut,
+                                const float* src,
+                                unsigned short* dst,
+                                int n)
+{
+    for (int i = 0; i < n; ++i) {
+        dst[i] = lut->toColorSpaceUint8xxFromLinearFloatFast(src[i]);
+    }
+}
+
+// i is the index of the first value in the packed buffer, to find out which one is the alpha channel
+static void
+convertUint8ToFloatLut_scalar(const Color::Lut* lut,
+                              const unsigned char* src,
+                              float* dst,
+                              int i,
+                              int n,
+                              int nComps)
+{
+    for (; i < n; ++i) {
+        if ( (nComps == 4) && ( (i & 3) == 3 ) ) {
+            dst[i] = Color::intToFloat<256>(src[i]);
+        } else {
+            dst[i] = lut->fromColorSpaceUint8ToLinearFloatFast(src[i]);
+        }
+    }
+}
+
+template <typename PIX>
+static void
+convertRGBToRGBA_scalar(const PIX* src,
+                        PIX* dst,
+                        int nPixels,
+                        PIX alpha)
+{
+    for (int p = 0; p < nPixels; ++p, src += 3, dst += 4) {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+        dst[3] = alpha;
+    }
+}
+
+template <typename PIX>
+static void
+halveScanLine_scalar(const PIX* src0,
+                     const PIX* src1,
+                     PIX* dst,
+                     int dstWidth,
+                     int nComps)
+{
+    for (int x = 0; x < dstWidth; ++x, src0 += 2 * nComps, src1 += 2 * nComps, dst += nComps) {
+        for (int k = 0; k < nComps; ++k) {
+            const PIX a = src0[k];
+            const PIX b = src0[nComps + k];
+            const PIX c = src1[k];
+            const PIX d = src1[nComps + k];
+            dst[k] = (a + b + c + d) / 4;
+        }
+    }
+}
+
+static void
+evaluateCubicSegments_scalar(const double* segmentStart,
+                             const double* segmentEnd,
+                             const double* c0,
+                             const double* c1,
+                             const double* c2,
+                             const double* c3,
+                             const int* segments,
+                             const double* times,
+                             double* dst,
+                             int n)
+{
+    for (int i = 0; i < n; ++i) {
+        const int s = segments[i];
+        dst[i] = Interpolation::cubicEval(c0[s], c1[s], c2[s], c3[s], (times[i] - segmentStart[s]) / (segmentEnd[s] - segmentStart[s]));
+    }
+}
+
+#ifdef NATRON_IMAGECONVERT_SIMD
+
+////////////////////////////////////////////////////////////////////////////////
+// SSE4.1 kernels
+
+// Color::floatToInt on 4 values, scale being numvals - 1.
+// Like the scalar version, the product is computed in single precision and the rounding in double precision.
+static inline NATRON_TARGET_SSE41 __m128i
+floatToInt_sse41(__m128 v,
+                 __m128 scale)
+{
+    v = _mm_min_ps( _mm_max_ps( v, _mm_setzero_ps() ), _mm_set1_ps(1.f) );
+    v = _mm_mul_ps(v, scale);
+    const __m128d half = _mm_set1_pd(0.5);
+    __m128i lo = _mm_cvttpd_epi32( _mm_add_pd(_mm_cvtps_pd(v), half) );
+    __m128i hi = _mm_cvttpd_epi32( _mm_add_pd(_mm_cvtps_pd( _mm_movehl_ps(v, v) ), half) );
+
+    return _mm_unpacklo_epi64(lo, hi);
+}
+
+static NATRON_TARGET_SSE41 void
+convertUint8ToFloat_sse41(const unsigned char* src,
+                          float* dst,
+                          int n)
+{
+    const __m128 scale = _mm_set1_ps(255.f);
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        int packed;
+        std::memcpy(&packed, src + i, sizeof(int));
+        __m128i v = _mm_cvtepu8_epi32( _mm_cvtsi32_si128(packed) );
+        _mm_storeu_ps( dst + i, _mm_div_ps(_mm_cvtepi32_ps(v), scale) );
+    }
+    convertUint8ToFloat_scalar(src + i, dst + i, n - i);
+}
+
+static NATRON_TARGET_SSE41 void
+convertUint16ToFloat_sse41(const unsigned short* src,
+                           float* dst,
+                           int n)
+{
+    const __m128 scale = _mm_set1_ps(65535.f);
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_cvtepu16_epi32( _mm_loadl_epi64( (const __m128i*)(src + i) ) );
+        _mm_storeu_ps( dst + i, _mm_div_ps(_mm_cvtepi32_ps(v), scale) );
+    }
+    convertUint16ToFloat_scalar(src + i, dst + i, n - i);
+}
+
+template <int numvals>
+static NATRON_TARGET_SSE41 void
+convertFloatToUint16_sse41(const float* src,
+                           unsigned short* dst,
+                           int n)
+{
+    const __m128 scale = _mm_set1_ps( (float)(numvals - 1) );
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i lo = floatToInt_sse41(_mm_loadu_ps(src + i), scale);
+        __m128i hi = floatToInt_sse41(_mm_loadu_ps(src + i + 4), scale);
+        _mm_storeu_si128( (__m128i*)(dst + i), _mm_packus_epi32(lo, hi) );
+    }
+    convertFloatToInt_scalar<unsigned short, numvals>(src + i, dst + i, n - i);
+}
+
+static NATRON_TARGET_SSE41 void
+convertFloatToUint8_sse41(const float* src,
+                          unsigned char* dst,
+                          int n)
+{
+    const __m128 scale = _mm_set1_ps(255.f);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i lo = floatToInt_sse41(_mm_loadu_ps(src + i), scale);
+        __m128i hi = floatToInt_sse41(_mm_loadu_ps(src + i + 4), scale);
+        __m128i v16 = _mm_packus_epi32(lo, hi);
+        _mm_storel_epi64( (__m128i*)(dst + i), _mm_packus_epi16(v16, v16) );
+    }
+    convertFloatToInt_scalar<unsigned char, 256>(src + i, dst + i, n - i);
+}
+
+static NATRON_TARGET_SSE41 void
+convertFloatToUint8xxLut_sse41(const Color::Lut* lut,
+                               const float* src,
+                               unsigned short* dst,
+                               int n)
+{
+    // There is no gather instruction in SSE, only the extraction of the 16 most significant bits is vectorized
+    const unsigned short* table = lut->getHipartToUint8xxTable();
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i hipart = _mm_srli_epi32(_mm_castps_si128( _mm_loadu_ps(src + i) ), 16);
+        dst[i] = table[_mm_extract_epi32(hipart, 0)];
+        dst[i + 1] = table[_mm_extract_epi32(hipart, 1)];
+        dst[i + 2] = table[_mm_extract_epi32(hipart, 2)];
+        dst[i + 3] = table[_mm_extract_epi32(hipart, 3)];
+    }
+    convertFloatToUint8xxLut_scalar(lut, src + i, dst + i, n - i);
+}
+
+static NATRON_TARGET_SSE41 void
+convertRGBToRGBA_sse41(const unsigned char* src,
+                       unsigned char* dst,
+                       int nPixels,
+                       unsigned char alpha)
+{
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11, -128);
+    const __m128i alphaMask = _mm_set1_epi32( (int)( (unsigned)alpha << 24 ) );
+    int p = 0;
+
+    // 4 pixels per iteration: 16 bytes are read but only 12 are used, stop early enough to never read past the end
+    for (; p + 6 <= nPixels; p += 4) {
+        __m128i v = _mm_loadu_si128( (const __m128i*)(src + p * 3) );
+        _mm_storeu_si128( (__m128i*)(dst + p * 4), _mm_or_si128(_mm_shuffle_epi8(v, shuffle), alphaMask) );
+    }
+    convertRGBToRGBA_scalar<unsigned char>(src + p * 3, dst + p * 4, nPixels - p, alpha);
+}
+
+static NATRON_TARGET_SSE41 void
+convertRGBToRGBA_sse41(const unsigned short* src,
+                       unsigned short* dst,
+                       int nPixels,
+                       unsigned short alpha)
+{
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 3, 4, 5, -128, -128, 6, 7, 8, 9, 10, 11, -128, -128);
+    const __m128i alphaMask = _mm_setr_epi16(0, 0, 0, (short)alpha, 0, 0, 0, (short)alpha);
+    int p = 0;
+
+    // 2 pixels per iteration: 8 values are read but only 6 are used, stop early enough to never read past the end
+    for (; p + 3 <= nPixels; p += 2) {
+        __m128i v = _mm_loadu_si128( (const __m128i*)(src + p * 3) );
+        _mm_storeu_si128( (__m128i*)(dst + p * 4), _mm_or_si128(_mm_shuffle_epi8(v, shuffle), alphaMask) );
+    }
+    convertRGBToRGBA_scalar<unsigned short>(src + p * 3, dst + p * 4, nPixels - p, alpha);
+}
+
+static NATRON_TARGET_SSE41 void
+convertRGBToRGBA_sse41(const float* src,
+                       float* dst,
+                       int nPixels,
+                       float alpha)
+{
+    const __m128 a = _mm_set1_ps(alpha);
+    int p = 0;
+
+    // 4 pixels per iteration
+    for (; p + 4 <= nPixels; p += 4) {
+        const float* s = src + p * 3;
+        float* d = dst + p * 4;
+        __m128 in0 = _mm_loadu_ps(s); // r0 g0 b0 r1
+        __m128 in1 = _mm_loadu_ps(s + 4); // g1 b1 r2 g2
+        __m128 in2 = _mm_loadu_ps(s + 8); // b2 r3 g3 b3
+        __m128 t1 = _mm_shuffle_ps( in0, in1, _MM_SHUFFLE(1, 0, 3, 3) ); // r1 r1 g1 b1
+        __m128 t2 = _mm_shuffle_ps( in1, in2, _MM_SHUFFLE(0, 0, 3, 2) ); // r2 g2 b2 b2
+        _mm_storeu_ps( d, _mm_blend_ps(in0, a, 0x8) );
+        _mm_storeu_ps( d + 4, _mm_blend_ps(_mm_shuffle_ps( t1, t1, _MM_SHUFFLE(3, 3, 2, 0) ), a, 0x8) );
+        _mm_storeu_ps( d + 8, _mm_blend_ps(t2, a, 0x8) );
+        _mm_storeu_ps( d + 12, _mm_blend_ps(_mm_shuffle_ps( in2, in2, _MM_SHUFFLE(3, 3, 2, 1) ), a, 0x8) );
+    }
+    convertRGBToRGBA_scalar<float>(src + p * 3, dst + p * 4, nPixels - p, alpha);
+}
+
+// Dividing by 4 or multiplying by 0.25 gives exactly the same result in floating point
+static NATRON_TARGET_SSE41 void
+halveScanLine_sse41(const float* src0,
+                    const float* src1,
+                    float* dst,
+                    int dstWidth,
+                    int nComps)
+{
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    int x = 0;
+
+    if (nComps == 4) {
+        for (; x < dstWidth; ++x) {
+            __m128 a = _mm_loadu_ps(src0 + x * 8);
+            __m128 b = _mm_loadu_ps(src0 + x * 8 + 4);
+            __m128 c = _mm_loadu_ps(src1 + x * 8);
+            __m128 d = _mm_loadu_ps(src1 + x * 8 + 4);
+            _mm_storeu_ps( dst + x * 4, _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(a, b), c), d), quarter) );
+        }
+    } else if (nComps == 1) {
+        // 4 pixels per iteration: split even and odd source pixels
+        for (; x + 4 <= dstWidth; x += 4) {
+            __m128 r00 = _mm_loadu_ps(src0 + x * 2);
+            __m128 r01 = _mm_loadu_ps(src0 + x * 2 + 4);
+            __m128 r10 = _mm_loadu_ps(src1 + x * 2);
+            __m128 r11 = _mm_loadu_ps(src1 + x * 2 + 4);
+            __m128 a = _mm_shuffle_ps( r00, r01, _MM_SHUFFLE(2, 0, 2, 0) );
+            __m128 b = _mm_shuffle_ps( r00, r01, _MM_SHUFFLE(3, 1, 3, 1) );
+            __m128 c = _mm_shuffle_ps( r10, r11, _MM_SHUFFLE(2, 0, 2, 0) );
+            __m128 d = _mm_shuffle_ps( r10, r11, _MM_SHUFFLE(3, 1, 3, 1) );
+            _mm_storeu_ps( dst + x, _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(a, b), c), d), quarter) );
+        }
+    }
+    halveScanLine_scalar<float>(src0 + x * 2 * nComps, src1 + x * 2 * nComps, dst + x * nComps, dstWidth - x, nComps);
+}
+
+// With integers the order of the additions does not matter, sums are computed on wider integers
+static NATRON_TARGET_SSE41 void
+halveScanLine_sse41(const unsigned char* src0,
+                    const unsigned char* src1,
+                    unsigned char* dst,
+                    int dstWidth,
+                    int nComps)
+{
+    int x = 0;
+
+    if (nComps == 4) {
+        // 2 pixels per iteration
+        for (; x + 2 <= dstWidth; x += 2) {
+            __m128i r0 = _mm_loadu_si128( (const __m128i*)(src0 + x * 8) );
+            __m128i r1 = _mm_loadu_si128( (const __m128i*)(src1 + x * 8) );
+            // vertical sums of the 4 source pixels
+            __m128i lo = _mm_add_epi16( _mm_cvtepu8_epi16(r0), _mm_cvtepu8_epi16(r1) );
+            __m128i hi = _mm_add_epi16( _mm_cvtepu8_epi16( _mm_srli_si128(r0, 8) ), _mm_cvtepu8_epi16( _mm_srli_si128(r1, 8) ) );
+            // horizontal sums of each pair of pixels
+            __m128i sum = _mm_add_epi16( _mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi) );
+            sum = _mm_srli_epi16(sum, 2);
+            _mm_storel_epi64( (__m128i*)(dst + x * 4), _mm_packus_epi16(sum, sum) );
+        }
+    } else if (nComps == 1) {
+        // 8 pixels per iteration, adjacent bytes are summed by maddubs
+        const __m128i ones = _mm_set1_epi8(1);
+        for (; x + 8 <= dstWidth; x += 8) {
+            __m128i r0 = _mm_maddubs_epi16( _mm_loadu_si128( (const __m128i*)(src0 + x * 2) ), ones );
+            __m128i r1 = _mm_maddubs_epi16( _mm_loadu_si128( (const __m128i*)(src1 + x * 2) ), ones );
+            __m128i sum = _mm_srli_epi16(_mm_add_epi16(r0, r1), 2);
+            _mm_storel_epi64( (__m128i*)(dst + x), _mm_packus_epi16(sum, sum) );
+        }
+    }
+    halveScanLine_scalar<unsigned char>(src0 + x * 2 * nComps, src1 + x * 2 * nComps, dst + x * nComps, dstWidth - x, nComps);
+}
+
+static NATRON_TARGET_SSE41 void
+halveScanLine_sse41(const unsigned short* src0,
+                    const unsigned short* src1,
+                    unsigned short* dst,
+                    int dstWidth,
+                    int nComps)
+{
+    int x = 0;
+
+    if (nComps == 4) {
+        for (; x < dstWidth; ++x) {
+            __m128i a = _mm_cvtepu16_epi32( _mm_loadl_epi64( (const __m128i*)(src0 + x * 8) ) );
+            __m128i b = _mm_cvtepu16_epi32( _mm_loadl_epi64( (const __m128i*)(src0 + x * 8 + 4) ) );
+            __m128i c = _mm_cvtepu16_epi32( _mm_loadl_epi64( (const __m128i*)(src1 + x * 8) ) );
+            __m128i d = _mm_cvtepu16_epi32( _mm_loadl_epi64( (const __m128i*)(src1 + x * 8 + 4) ) );
+            __m128i sum = _mm_srli_epi32(_mm_add_epi32( _mm_add_epi32(a, b), _mm_add_epi32(c, d) ), 2);
+            _mm_storel_epi64( (__m128i*)(dst + x * 4), _mm_packus_epi32(sum, sum) );
+        }
+    } else if (nComps == 1) {
+        // 4 pixels per iteration: split even and odd source pixels in 32-bit lanes
+        const __m128i lowMask = _mm_set1_epi32(0xffff);
+        for (; x + 4 <= dstWidth; x += 4) {
+            __m128i r0 = _mm_loadu_si128( (const __m128i*)(src0 + x * 2) );
+            __m128i r1 = _mm_loadu_si128( (const __m128i*)(src1 + x * 2) );
+            __m128i sum0 = _mm_add_epi32( _mm_and_si128(r0, lowMask), _mm_srli_epi32(r0, 16) );
+            __m128i sum1 = _mm_add_epi32( _mm_and_si128(r1, lowMask), _mm_srli_epi32(r1, 16) );
+            __m128i sum = _mm_srli_epi32(_mm_add_epi32(sum0, sum1), 2);
+            _mm_storel_epi64( (__m128i*)(dst + x), _mm_packus_epi32(sum, sum) );
+        }
+    }
+    halveScanLine_scalar<unsigned short>(src0 + x * 2 * nComps, src1 + x * 2 * nComps, dst + x * nComps, dstWidth - x, nComps);
+}
+
+// The term (c ? c * t : 0.) of Interpolation::cubicEval on 2 values: it is +0 when c is 0, even if t is infinite
+static inline NATRON_TARGET_SSE41 __m128d
+cubicTerm_sse41(__m128d c,
+                __m128d t)
+{
+    return _mm_and_pd( _mm_mul_pd(c, t), _mm_cmpneq_pd( c, _mm_setzero_pd() ) );
+}
+
+// 2 values per iteration, SSE4.1 has no gather instruction so the coefficients are loaded one by one
+static NATRON_TARGET_SSE41 void
+evaluateCubicSegments_sse41(const double* segmentStart,
+                            const double* segmentEnd,
+                            const double* c0,
+                            const double* c1,
+                            const double* c2,
+                            const double* c3,
+                            const int* segments,
+                            const double* times,
+                            double* dst,
+                            int n)
+{
+    int i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        const int s0 = segments[i];
+        const int s1 = segments[i + 1];
+        __m128d start = _mm_set_pd(segmentStart[s1], segmentStart[s0]);
+        __m128d end = _mm_set_pd(segmentEnd[s1], segmentEnd[s0]);
+        __m128d t = _mm_div_pd( _mm_sub_pd(_mm_loadu_pd(times + i), start), _mm_sub_pd(end, start) );
+        __m128d t2 = _mm_mul_pd(t, t);
+        __m128d t3 = _mm_mul_pd(t2, t);
+        __m128d v = _mm_add_pd( _mm_set_pd(c0[s1], c0[s0]), cubicTerm_sse41(_mm_set_pd(c1[s1], c1[s0]), t) );
+        v = _mm_add_pd( v, cubicTerm_sse41(_mm_set_pd(c2[s1], c2[s0]), t2) );
+        v = _mm_add_pd( v, cubicTerm_sse41(_mm_set_pd(c3[s1], c3[s0]), t3) );
+        _mm_storeu_pd(dst + i, v);
+    }
+    evaluateCubicSegments_scalar(segmentStart, segmentEnd, c0, c1, c2, c3, segments + i, times + i, dst + i, n - i);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// AVX2 kernels
+
+// Same as floatToInt_sse41 on 8 values, returned as 8 unsigned shorts
+static inline NATRON_TARGET_AVX2 __m128i
+floatToInt_avx2(__m256 v,
+                __m256 scale)
+{
+    v = _mm256_min_ps( _mm256_max_ps( v, _mm256_setzero_ps() ), _mm256_set1_ps(1.f) );
+    v = _mm256_mul_ps(v, scale);
+    const __m256d half = _mm256_set1_pd(0.5);
+    __m128i lo = _mm256_cvttpd_epi32( _mm256_add_pd(_mm256_cvtps_pd( _mm256_castps256_ps128(v) ), half) );
+    __m128i hi = _mm256_cvttpd_epi32( _mm256_add_pd(_mm256_cvtps_pd( _mm256_extractf128_ps(v, 1) ), half) );
+
+    return _mm_packus_epi32(lo, hi);
+}
+
+static NATRON_TARGET_AVX2 void
+convertUint8ToFloat_avx2(const unsigned char* src,
+                         float* dst,
+                         int n)
+{
+    const __m256 scale = _mm256_set1_ps(255.f);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*)(src + i) ) );
+        _mm256_storeu_ps( dst + i, _mm256_div_ps(_mm256_cvtepi32_ps(v), scale) );
+    }
+    convertUint8ToFloat_scalar(src + i, dst + i, n - i);
+}
+
+static NATRON_TARGET_AVX2 void
+convertUint16ToFloat_avx2(const unsigned short* src,
+                          float* dst,
+                          int n)
+{
+    const __m256 scale = _mm256_set1_ps(65535.f);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i*)(src + i) ) );
+        _mm256_storeu_ps( dst + i, _mm256_div_ps(_mm256_cvtepi32_ps(v), scale) );
+    }
+    convertUint16ToFloat_scalar(src + i, dst + i, n - i);
+}
+
+template <int numvals>
+static NATRON_TARGET_AVX2 void
+convertFloatToUint16_avx2(const float* src,
+                          unsigned short* dst,
+                          int n)
+{
+    const __m256 scale = _mm256_set1_ps( (float)(numvals - 1) );
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        _mm_storeu_si128( (__m128i*)(dst + i), floatToInt_avx2(_mm256_loadu_ps(src + i), scale) );
+    }
+    convertFloatToInt_scalar<unsigned short, numvals>(src + i, dst + i, n - i);
+}
+
+static NATRON_TARGET_AVX2 void
+convertFloatToUint8_avx2(const float* src,
+                         unsigned char* dst,
+                         int n)
+{
+    const __m256 scale = _mm256_set1_ps(255.f);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i v16 = floatToInt_avx2(_mm256_loadu_ps(src + i), scale);
+        _mm_storel_epi64( (__m128i*)(dst + i), _mm_packus_epi16(v16, v16) );
+    }
+    convertFloatToInt_scalar<unsigned char, 256>(src + i, dst + i, n - i);
+}
+
+static NATRON_TARGET_AVX2 void
+convertFloatToUint8xxLut_avx2(const Color::Lut* lut,
+                              const float* src,
+                              unsigned short* dst,
+                              int n)
+{
+    // The table holds unsigned shorts but the gather instruction loads 32-bit words: load the word
+    // containing the entry and shift it. The word index is hipart / 2 so we never read past the table.
+    const int* table = (const int*)lut->getHipartToUint8xxTable();
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i lowMask = _mm256_set1_epi32(0xffff);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i hipart = _mm256_srli_epi32(_mm256_castps_si256( _mm256_loadu_ps(src + i) ), 16);
+        __m256i words = _mm256_i32gather_epi32(table, _mm256_srli_epi32(hipart, 1), 4);
+        __m256i shift = _mm256_slli_epi32(_mm256_and_si256(hipart, one), 4);
+        __m256i v = _mm256_and_si256(_mm256_srlv_epi32(words, shift), lowMask);
+        _mm_storeu_si128( (__m128i*)(dst + i), _mm_packus_epi32( _mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1) ) );
+    }
+    convertFloatToUint8xxLut_scalar(lut, src + i, dst + i, n - i);
+}
+
+static NATRON_TARGET_AVX2 void
+convertUint8ToFloatLut_avx2(const Color::Lut* lut,
+                            const unsigned char* src,
+                            float* dst,
+                            int n,
+                            int nComps)
+{
+    const float* table = lut->getUint8ToLinearFloatTable();
+    const __m256 scale = _mm256_set1_ps(255.f);
+    int i = 0;
+
+    // i is a multiple of 8 so the alpha channel of a 4 components buffer is always in lanes 3 and 7
+    for (; i + 8 <= n; i += 8) {
+        __m256i idx = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*)(src + i) ) );
+        __m256 v = _mm256_i32gather_ps(table, idx, 4);
+        if (nComps == 4) {
+            v = _mm256_blend_ps(v, _mm256_div_ps(_mm256_cvtepi32_ps(idx), scale), 0x88);
+        }
+        _mm256_storeu_ps(dst + i, v);
+    }
+    convertUint8ToFloatLut_scalar(lut, src, dst, i, n, nComps);
+}
+
+static NATRON_TARGET_AVX2 void
+halveScanLine_avx2(const float* src0,
+                   const float* src1,
+                   float* dst,
+                   int dstWidth,
+                   int nComps)
+{
+    const __m256 quarter = _mm256_set1_ps(0.25f);
+    int x = 0;
+
+    if (nComps == 4) {
+        // 2 pixels per iteration: gather the left and right source pixels in separate registers
+        for (; x + 2 <= dstWidth; x += 2) {
+            __m256 r00 = _mm256_loadu_ps(src0 + x * 8);
+            __m256 r01 = _mm256_loadu_ps(src0 + x * 8 + 8);
+            __m256 r10 = _mm256_loadu_ps(src1 + x * 8);
+            __m256 r11 = _mm256_loadu_ps(src1 + x * 8 + 8);
+            __m256 a = _mm256_permute2f128_ps(r00, r01, 0x20);
+            __m256 b = _mm256_permute2f128_ps(r00, r01, 0x31);
+            __m256 c = _mm256_permute2f128_ps(r10, r11, 0x20);
+            __m256 d = _mm256_permute2f128_ps(r10, r11, 0x31);
+            _mm256_storeu_ps( dst + x * 4, _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_add_ps(a, b), c), d), quarter) );
+        }
+    } else if (nComps == 1) {
+        // 8 pixels per iteration: split even and odd source pixels, the shuffle works within 128-bit lanes so
+        // the 64-bit blocks have to be put back in order afterwards
+        for (; x + 8 <= dstWidth; x += 8) {
+            __m256 r00 = _mm256_loadu_ps(src0 + x * 2);
+            __m256 r01 = _mm256_loadu_ps(src0 + x * 2 + 8);
+            __m256 r10 = _mm256_loadu_ps(src1 + x * 2);
+            __m256 r11 = _mm256_loadu_ps(src1 + x * 2 + 8);
+            __m256 a = _mm256_shuffle_ps( r00, r01, _MM_SHUFFLE(2, 0, 2, 0) );
+            __m256 b = _mm256_shuffle_ps( r00, r01, _MM_SHUFFLE(3, 1, 3, 1) );
+            __m256 c = _mm256_shuffle_ps( r10, r11, _MM_SHUFFLE(2, 0, 2, 0) );
+            __m256 d = _mm256_shuffle_ps( r10, r11, _MM_SHUFFLE(3, 1, 3, 1) );
+            __m256 sum = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_add_ps(a, b), c), d), quarter);
+            sum = _mm256_castpd_ps( _mm256_permute4x64_pd( _mm256_castps_pd(sum), _MM_SHUFFLE(3, 1, 2, 0) ) );
+            _mm256_storeu_ps(dst + x, sum);
+        }
+    }
+    halveScanLine_scalar<float>(src0 + x * 2 * nComps, src1 + x * 2 * nComps, dst + x * nComps, dstWidth - x, nComps);
+}
+
+#endif // NATRON_IMAGECONVERT_SIMD
+
+////////////////////////////////////////////////////////////////////////////////
+// Dispatch
+
+void
+convertUint8ToFloat(const unsigned char* src,
+                    float* dst,
+                    int n,
+                    InstructionSetEnum instructionSet)
+{
+    switch ( clampInstructionSet(instructionSet) ) {
+#ifdef NATRON_IMAGECONVERT_SIMD
+    case eInstructionSetAVX2:
+        convertUint8ToFloat_avx2(src, dst, n);
+        break;
+    case eInstructionSetSSE41:
+        convertUint8ToFloat_sse41(src, dst, n);
+        break;
+#endif
+    default:
+        convertUint8ToFloat_scalar(src, dst, n);
+        break;
+    }
+}
+
+void
+convertUint16ToFloat(const unsigned short* src,
+                     float* dst,
+                     int n,
+                     InstructionSetEnum instructionSet)
+{
+    switch ( clampInstructionSet(instructionSet) ) {
+#ifdef NATRON_IMAGECONVERT_SIMD
+    case eInstructionSetAVX2:
+        convertUint16ToFloat_avx2(src, dst, n);
+        break;
+    case eInstructionSetSSE41:
+        convertUint16ToFloat_sse41(src, dst, n);
+        break;
+#endif
+    default:
+        convertUint16ToFloat_scalar(src, dst, n);
+        break;
+    }
+}
+
+void
+convertFloatToUint8(const float* src,
+                    unsigned char* dst,
+                    int n,
+                    InstructionSetEnum instructionSet)
+{
+    switch ( clampInstructionSet(instructionSet) ) {
+#ifdef NATRON_IMAGECONVERT_SIMD
+    case eInstructionSetAVX2:
+        convertFloatToUint8_avx2(src, dst, n);
+        break;
+    case eInstructionSetSSE41:
+        convertFloatToUint8_sse41(src, dst, n);
+        break;
+#endif
+    default:
+        convertFloatToInt_scalar<unsigned char, 256>(src, dst, n);
+        break;
+    }
+}
+
+void
+convertFloatToUint16(const float* src,
+                     unsigned short* dst,
+                     int n,
+                     InstructionSetEnum instructionSet)
+{
+    switch ( clampInstructionSet(instructionSet) ) {
+#ifdef NATRON_IMAGECONVERT_SIMD
+    case eInstructionSetAVX2:
+        convertFloatToUint16_avx2<65536>(src, dst, n);
+        break;
+    case eInstructionSetSSE41:
+        convertFloatToUint16_sse41<65536>(src, dst, n);
+        break;
+#endif
+    default:
+        convertFloatToInt_scalar<unsigned short, 65536>(src, dst, n);
+        break;
+    }
+}
+
+void
+convertFloatToUint8xx(const float* src,
+                      unsigned short* dst,
+                      int n,
+                      InstructionSetEnum instructionSet)
+{
+    switch ( clampInstructionSet(instructionSet) ) {
+#ifdef NATRON_IMAGECONVERT_SIMD
+    case eInstructionSetAVX2:
+        convertFloatToUint16_avx2<0xff01>(src, dst, n);
+        break;
+    case eInstructionSetSSE41:
+        convertFloatToUint16_sse41<0xff01>(src, dst, n);
+        break;
+#endif
+    default:
+        convertFloatToInt_scalar<unsigned short, 0xff01>(src, dst, n);
+        break;
+    }
+}
+
+void
+convertFloatToUint8xxLut(const Color::Lut* lut,
+                         const float* src,
+                         unsigned short* dst,
+                         int n,
+                         InstructionSetEnum instructionSet)
+{
+    assert(lut);
+    switch ( clampInstructionSet(instructionSet) ) {
+#ifdef NATRON_IMAGECONVERT_SIMD
+    case eInstructionSetAVX2:
+        convertFloatToUint8xxLut_avx2(lut, src, dst, n);
+        break;
+    case eInstructionSetSSE41:
+        convertFloatToUint8xxLut_sse41(lut, src, dst, n);
+        break;
+#endif
+    default:
+        convertFloatToUint8xxLut_scalar(lut, src, dst, n);
+        break;
+    }
+}
+
+void
+convertUint8ToFloatLut(const Color::Lut* lut,
+                       const unsigned char* src,
+                       float* dst,
+                       int n,
+                       int nComps,
+                       InstructionSetEnum instructionSet)
+{
+    assert(lut);
+    switch ( clampInstructionSet(instructionSet) ) {
+#ifdef NATRON_IMAGECONVERT_SIMD
+    case eInstructionSetAVX2:
+        convertUint8ToFloatLut_avx2(lut, src, dst, n, nComps);
+        break;
+#endif
+    default:
+        // Without a gather instruction, the look-up itself cannot be vectorized
+        convertUint8ToFloatLut_scalar(lut, src, dst, 0, n, nComps);
+        break;
+    }
+}
+
+void
+convertRGBToRGBA(const unsigned char* src,
+                 unsigned char* dst,
+                 int nPixels,
+                 unsigned char alpha,
+                 InstructionSetEnum instructionSet)
+{
+#ifdef NATRON_IMAGECONVERT_SIMD
+    // AVX2 does not bring anything over SSE4.1 shuffles here
+    if (clampInstructionSet(instructionSet) != eInstructionSetScalar) {
+        convertRGBToRGBA_sse41(src, dst, nPixels, alpha);
+
+        return;
+    }
+#else
+    Q_UNUSED(instructionSet);
+#endif
+    convertRGBToRGBA_scalar<unsigned char>(src, dst, nPixels, alpha);
+}
+
+void
+convertRGBToRGBA(const unsigned short* src,
+                 unsigned short* dst,
+                 int nPixels,
+                 unsigned short alpha,
+                 InstructionSetEnum instructionSet)
+{
+#ifdef NATRON_IMAGECONVERT_SIMD
+    if (clampInstructionSet(instructionSet) != eInstructionSetScalar) {
+        convertRGBToRGBA_sse41(src, dst, nPixels, alpha);
+
+        return;
+    }
+#else
+    Q_UNUSED(instructionSet);
+#endif
+    convertRGBToRGBA_scalar<unsigned short>(src, dst, nPixels, alpha);
+}
+
+void
+convertRGBToRGBA(const float* src,
+                 float* dst,
+                 int nPixels,
+                 float alpha,
+                 InstructionSetEnum instructionSet)
+{
+#ifdef NATRON_IMAGECONVERT_SIMD
+    if (clampInstructionSet(instructionSet) != eInstructionSetScalar) {
+        convertRGBToRGBA_sse41(src, dst, nPixels, alpha);
+
+        return;
+    }
+#else
+    Q_UNUSED(instructionSet);
+#endif
+    convertRGBToRGBA_scalar<float>(src, dst, nPixels, alpha);
+}
+
+void
+halveScanLine(const unsigned char* src0,
+              const unsigned char* src1,
+              unsigned char* dst,
+              int dstWidth,
+              int nComps,
+              InstructionSetEnum instructionSet)
+{
+#ifdef NATRON_IMAGECONVERT_SIMD
+    // Integer sums are not worth the 256-bit registers
+    if (clampInstructionSet(instructionSet) != eInstructionSetScalar) {
+        halveScanLine_sse41(src0, src1, dst, dstWidth, nComps);
+
+        return;
+    }
+#else
+    Q_UNUSED(instructionSet);
+#endif
+    halveScanLine_scalar<unsigned char>(src0, src1, dst, dstWidth, nComps);
+}
+
+void
+halveScanLine(const unsigned short* src0,
+              const unsigned short* src1,
+              unsigned short* dst,
+              int dstWidth,
+              int nComps,
+              InstructionSetEnum instructionSet)
+{
+#ifdef NATRON_IMAGECONVERT_SIMD
+    if (clampInstructionSet(instructionSet) != eInstructionSetScalar) {
+        halveScanLine_sse41(src0, src1, dst, dstWidth, nComps);
+
+        return;
+    }
+#else
+    Q_UNUSED(instructionSet);
+#endif
+    halveScanLine_scalar<unsigned short>(src0, src1, dst, dstWidth, nComps);
+}
+
+void
+halveScanLine(const float* src0,
+              const float* src1,
+              float* dst,
+              int dstWidth,
+              int nComps,
+              InstructionSetEnum instructionSet)
+{
+    switch ( clampInstructionSet(instructionSet) ) {
+#ifdef NATRON_IMAGECONVERT_SIMD
+    case eInstructionSetAVX2:
+        halveScanLine_avx2(src0, src1, dst, dstWidth, nComps);
+        break;
+    case eInstructionSetSSE41:
+        halveScanLine_sse41(src0, src1, dst, dstWidth, nComps);
+        break;
+#endif
+    default:
+        halveScanLine_scalar<float>(src0, src1, dst, dstWidth, nComps);
+        break;
+    }
+}
+
+void
+evaluateCubicSegments(const double* segmentStart,
+                      const double* segmentEnd,
+                      const double* c0,
+                      const double* c1,
+                      const double* c2,
+                      const double* c3,
+                      const int* segments,
+                      const double* times,
+                      double* dst,
+                      int n,
+                      InstructionSetEnum instructionSet)
+{
+    switch ( clampInstructionSet(instructionSet) ) {
+#ifdef NATRON_IMAGECONVERT_SIMD
+    case eInstructionSetAVX2:
+    // The coefficients of 4 values can only be loaded with gathers or one by one: both were measured slower
+    // than the SSE4.1 kernel, the division being the bottleneck anyway
+    case eInstructionSetSSE41:
+        evaluateCubicSegments_sse41(segmentStart, segmentEnd, c0, c1, c2, c3, segments, times, dst, n);
+        break;
+#endif
+    default:
+        evaluateCubicSegments_scalar(segmentStart, segmentEnd, c0, c1, c2, c3, segments, times, dst, n);
+        break;
+    }
+}
+
+} // namespace ImageConvertSIMD
+
+NATRON_NAMESPACE_EXIT;
@@ -0,0 +1,131 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2013-2017 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_IMAGECONVERTSIMD_H
+#define NATRON_ENGINE_IMAGECONVERTSIMD_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER;
+
+/**
+ * @brief Vectorized kernels used by the scan-line conversions of ImageConvert.cpp, by the mipmap
+ * downscaling of ImagePrivate.cpp and by the batch evaluation of curves in Curve.cpp. Each kernel processes a contiguous array of values. The instruction set
+ * is selected at run-time depending on what the CPU supports: AVX2, SSE4.1 or plain C++.
+ * Whatever the instruction set, the output is bit-identical to the one of the scalar conversion
+ * functions of Lut.h (Color::intToFloat, Color::floatToInt and the Lut "Fast" functions) and of Interpolation::cubicEval.
+ **/
+namespace ImageConvertSIMD {
+
+enum InstructionSetEnum
+{
+    eInstructionSetScalar = 0,
+    eInstructionSetSSE41,
+    eInstructionSetAVX2
+};
+
+/**
+ * @brief Returns the best instruction set supported by this CPU and compiler. It is detected only once.
+ * Vectorized kernels are only available when compiling with GCC or Clang for x86, otherwise this
+ * always returns eInstructionSetScalar.
+ **/
+InstructionSetEnum getSupportedInstructionSet();
+
+/**
+ * @brief Limits the instruction set returned by getSupportedInstructionSet(). With eInstructionSetScalar,
+ * ImageConvert.cpp does not use the kernels at all and falls back on its generic code: this is used by the tests
+ * to compare both. This is not thread-safe and should not be called while images are converted.
+ **/
+void setMaximumInstructionSet(InstructionSetEnum instructionSet);
+
+/**
+ * @brief dst[i] = Color::intToFloat<256>(src[i])
+ **/
+void convertUint8ToFloat(const unsigned char* src, float* dst, int n, InstructionSetEnum instructionSet = getSupportedInstructionSet());
+
+/**
+ * @brief dst[i] = Color::intToFloat<65536>(src[i])
+ **/
+void convertUint16ToFloat(const unsigned short* src, float* dst, int n, InstructionSetEnum instructionSet = getSupportedInstructionSet());
+
+/**
+ * @brief dst[i] = Color::floatToInt<256>(src[i])
+ **/
+void convertFloatToUint8(const float* src, unsigned char* dst, int n, InstructionSetEnum instructionSet = getSupportedInstructionSet());
+
+/**
+ * @brief dst[i] = Color::floatToInt<65536>(src[i])
+ **/
+void convertFloatToUint16(const float* src, unsigned short* dst, int n, InstructionSetEnum instructionSet = getSupportedInstructionSet());
+
+/**
+ * @brief dst[i] = Color::floatToInt<0xff01>(src[i]). This is the quantization step of the 8-bit
+ * error diffusion, the diffusion itself is sequential and must be done by the caller.
+ **/
+void convertFloatToUint8xx(const float* src, unsigned short* dst, int n, InstructionSetEnum instructionSet = getSupportedInstructionSet());
+
+/**
+ * @brief Same as convertFloatToUint8xx but through the given Lut, i.e:
+ * dst[i] = lut->toColorSpaceUint8xxFromLinearFloatFast(src[i])
+ **/
+void convertFloatToUint8xxLut(const Color::Lut* lut, const float* src, unsigned short* dst, int n, InstructionSetEnum instructionSet = getSupportedInstructionSet());
+
+/**
+ * @brief Converts n values of a packed buffer of nComps components through the given Lut:
+ * dst[i] = lut->fromColorSpaceUint8ToLinearFloatFast(src[i]), except for the alpha channel
+ * of a 4 components buffer which is converted linearly.
+ **/
+void convertUint8ToFloatLut(const Color::Lut* lut, const unsigned char* src, float* dst, int n, int nComps, InstructionSetEnum instructionSet = getSupportedInstructionSet());
+
+/**
+ * @brief Expands nPixels packed RGB pixels to packed RGBA pixels, filling the alpha channel with the given value.
+ **/
+void convertRGBToRGBA(const unsigned char* src, unsigned char* dst, int nPixels, unsigned char alpha, InstructionSetEnum instructionSet = getSupportedInstructionSet());
+void convertRGBToRGBA(const unsigned short* src, unsigned short* dst, int nPixels, unsigned short alpha, InstructionSetEnum instructionSet = getSupportedInstructionSet());
+void convertRGBToRGBA(const float* src, float* dst, int nPixels, float alpha, InstructionSetEnum instructionSet = getSupportedInstructionSet());
+
+/**
+ * @brief Box-filters two consecutive packed scan-lines of nComps components into a scan-line of dstWidth pixels,
+ * src0 and src1 holding 2 * dstWidth pixels each. Each destination pixel is (a + b + c + d) / 4 where a, b are
+ * 2 adjacent pixels of src0 and c, d the pixels below them in src1. The additions are made in this order
+ * and integer values are truncated, like the borders of the image which the caller handles in scalar code.
+ **/
+void halveScanLine(const unsigned char* src0, const unsigned char* src1, unsigned char* dst, int dstWidth, int nComps, InstructionSetEnum instructionSet = getSupportedInstructionSet());
+void halveScanLine(const unsigned short* src0, const unsigned short* src1, unsigned short* dst, int dstWidth, int nComps, InstructionSetEnum instructionSet = getSupportedInstructionSet());
+void halveScanLine(const float* src0, const float* src1, float* dst, int dstWidth, int nComps, InstructionSetEnum instructionSet = getSupportedInstructionSet());
+
+/**
+ * @brief Evaluates n cubics of a flattened curve (see CurveEvaluator): with s = segments[i],
+ * dst[i] = Interpolation::cubicEval(c0[s], c1[s], c2[s], c3[s], (times[i] - segmentStart[s]) / (segmentEnd[s] - segmentStart[s]))
+ **/
+void evaluateCubicSegments(const double* segmentStart, const double* segmentEnd, const double* c0, const double* c1, const double* c2, const double* c3,
+                           const int* segments, const double* times, double* dst, int n, InstructionSetEnum instructionSet = getSupportedInstructionSet());
+
+} // namespace ImageConvertSIMD
+
+NATRON_NAMESPACE_EXIT;
+
+#endif // NATRON_ENGINE_IMAGECONVERTSIMD_H
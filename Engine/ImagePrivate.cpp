@@ -26,7 +26,11 @@
 #include "ImagePrivate.h"
 
 #include "Engine/Hash64.h"
+#include "Engine/ImageConvertSIMD.h"
 #include "Engine/Node.h"
+#include <algorithm> // min, max
+#include <vector>
+
 #include <QDebug>
 #include <QThread>
 
@@ -336,135 +340,215 @@ ImagePrivate::checkIfCopyToTempImageIsNeeded(const Image& fromImage, const Image
     return eActionStatusOK;
 } // checkIfCopyToTempImageIsNeeded
 
-template <typename PIX, int maxValue, int nComps>
-static ActionRetCodeEnum
-halveImageForInternal(const void* srcPtrs[4],
-                      const RectI& srcBounds,
-                      void* dstPtrs[4],
-                      const RectI& dstBounds,
-                      const EffectInstancePtr& renderClone)
+// Side, in pixels of the source image, of the square region that downscaleMipMapCPU processes at once.
+// Intermediate levels of such a region remain in the CPU caches.
+#define NATRON_MIPMAP_DOWNSCALE_SOURCE_TILE_SIZE 128
+
+template <typename PIX>
+static inline PIX*
+getPixelAddress(PIX* ptr,
+                const RectI& bufferBounds,
+                int x,
+                int y,
+                int nComps)
 {
+    assert(bufferBounds.contains(x, y));
 
-    PIX* dstPixelPtrs[4];
-    int dstPixelStride;
-    Image::getChannelPointers<PIX, nComps>((const PIX**)dstPtrs, dstBounds.x1, dstBounds.y1, dstBounds, (PIX**)dstPixelPtrs, &dstPixelStride);
-
-    const PIX* srcPixelPtrs[4];
-    int srcPixelStride;
-    Image::getChannelPointers<PIX, nComps>((const PIX**)srcPtrs, srcBounds.x1, srcBounds.y1, srcBounds, (PIX**)srcPixelPtrs, &srcPixelStride);
+    return ptr + ( (std::size_t)(y - bufferBounds.y1) * bufferBounds.width() + (x - bufferBounds.x1) ) * nComps;
+}
 
-    const int dstRowElementsCount = dstBounds.width() * dstPixelStride;
-    const int srcRowElementsCount = srcBounds.width() * srcPixelStride;
+/**
+ * @brief Computes the pixel (x, y) of a level as the average of the 2x2 pixels of the previous level
+ * that are within inValidBounds.
+ **/
+template <typename PIX>
+static void
+halvePixel(const PIX* inPtr,
+           const RectI& inBufferBounds,
+           const RectI& inValidBounds,
+           PIX* outPtr,
+           const RectI& outBufferBounds,
+           int x,
+           int y,
+           int nComps)
+{
+    // The dst pixel covers the src rows y*2 (thisRow) and y*2+1 (nextRow) and the src cols x*2 (thisCol) and x*2+1 (nextCol).
+    const int srcx = x * 2;
+    const int srcy = y * 2;
 
+    // Check that we are within the bounds of the previous level.
+    const bool pickThisRow = inValidBounds.y1 <= (srcy + 0) && (srcy + 0) < inValidBounds.y2;
+    const bool pickNextRow = inValidBounds.y1 <= (srcy + 1) && (srcy + 1) < inValidBounds.y2;
+    const bool pickThisCol = inValidBounds.x1 <= (srcx + 0) && (srcx + 0) < inValidBounds.x2;
+    const bool pickNextCol = inValidBounds.x1 <= (srcx + 1) && (srcx + 1) < inValidBounds.x2;
 
-    for (int y = dstBounds.y1; y < dstBounds.y2; ++y) {
+    const int sum = ( (int)pickThisCol + (int)pickNextCol ) * ( (int)pickThisRow + (int)pickNextRow );
+    assert(0 < sum && sum <= 4);
 
-        if (renderClone && renderClone->isRenderAborted()) {
-            return eActionStatusAborted;
-        }
+    PIX* dstPixel = getPixelAddress(outPtr, outBufferBounds, x, y, nComps);
+    for (int k = 0; k < nComps; ++k) {
 
-        // The current dst row, at y, covers the src rows y*2 (thisRow) and y*2+1 (nextRow).
-        const int srcy = y * 2;
+        // Averaged pixels are as such:
+        // a b
+        // c d
 
-        // Check that we are within srcBounds.
-        const bool pickThisRow = srcBounds.y1 <= (srcy + 0) && (srcy + 0) < srcBounds.y2;
-        const bool pickNextRow = srcBounds.y1 <= (srcy + 1) && (srcy + 1) < srcBounds.y2;
+        const PIX a = (pickThisCol && pickThisRow) ? getPixelAddress(inPtr, inBufferBounds, srcx, srcy, nComps)[k] : 0;
+        const PIX b = (pickNextCol && pickThisRow) ? getPixelAddress(inPtr, inBufferBounds, srcx + 1, srcy, nComps)[k] : 0;
+        const PIX c = (pickThisCol && pickNextRow) ? getPixelAddress(inPtr, inBufferBounds, srcx, srcy + 1, nComps)[k] : 0;
+        const PIX d = (pickNextCol && pickNextRow) ? getPixelAddress(inPtr, inBufferBounds, srcx + 1, srcy + 1, nComps)[k] : 0;
 
-        const int sumH = (int)pickNextRow + (int)pickThisRow;
-        assert(sumH == 1 || sumH == 2);
+        dstPixel[k] = (a + b + c + d) / sum;
+    }
+} // halvePixel
 
-        for (int x = dstBounds.x1; x < dstBounds.x2; ++x) {
+/**
+ * @brief Halves the outRoI portion of a level from the previous level, whose pixels are defined in inValidBounds.
+ * Both buffers are packed with nComps components and start at the bottom-left corner of their buffer bounds.
+ **/
+template <typename PIX>
+static void
+halveRegion(const PIX* inPtr,
+            const RectI& inBufferBounds,
+            const RectI& inValidBounds,
+            PIX* outPtr,
+            const RectI& outBufferBounds,
+            const RectI& outRoI,
+            int nComps)
+{
+    // The pixels for which the 4 source pixels exist are processed by the vectorized kernel, others on the borders
+    // of the previous level are averaged over the existing pixels only.
+    const RectI interior = inValidBounds.downscalePowerOfTwoLargestEnclosed(1);
+    const int interiorX1 = std::max(outRoI.x1, interior.x1);
+    const int interiorX2 = std::min(outRoI.x2, interior.x2);
+
+    for (int y = outRoI.y1; y < outRoI.y2; ++y) {
+        int x = outRoI.x1;
+        if ( (interior.y1 <= y) && (y < interior.y2) && (interiorX1 < interiorX2) ) {
+            for (; x < interiorX1; ++x) {
+                halvePixel<PIX>(inPtr, inBufferBounds, inValidBounds, outPtr, outBufferBounds, x, y, nComps);
+            }
+            ImageConvertSIMD::halveScanLine(getPixelAddress(inPtr, inBufferBounds, interiorX1 * 2, y * 2, nComps),
+                                            getPixelAddress(inPtr, inBufferBounds, interiorX1 * 2, y * 2 + 1, nComps),
+                                            getPixelAddress(outPtr, outBufferBounds, interiorX1, y, nComps),
+                                            interiorX2 - interiorX1,
+                                            nComps);
+            x = interiorX2;
+        }
+        for (; x < outRoI.x2; ++x) {
+            halvePixel<PIX>(inPtr, inBufferBounds, inValidBounds, outPtr, outBufferBounds, x, y, nComps);
+        }
+    }
+} // halveRegion
 
-            // The current dst col, at y, covers the src cols x*2 (thisCol) and x*2+1 (nextCol).
-            const int srcx = x * 2;
+template <typename PIX>
+static ActionRetCodeEnum
+downscaleMipMapForDepth(const void* srcPtrs[4],
+                        int nComps,
+                        const RectI& srcBounds,
+                        const RectI& srcRoI,
+                        unsigned int downscaleLevels,
+                        void* dstPtrs[4],
+                        const RectI& dstBounds,
+                        const RectI& renderWindow,
+                        const EffectInstancePtr& renderClone)
+{
+    assert(downscaleLevels > 0);
 
-            // Check that we are within srcBounds.
-            const bool pickThisCol = srcBounds.x1 <= (srcx + 0) && (srcx + 0) < srcBounds.x2;
-            const bool pickNextCol = srcBounds.x1 <= (srcx + 1) && (srcx + 1) < srcBounds.x2;
+    // The bounds of each level, the first one being the source
+    std::vector<RectI> levelBounds(downscaleLevels + 1);
+    levelBounds[0] = srcRoI;
+    for (unsigned int l = 1; l <= downscaleLevels; ++l) {
+        levelBounds[l] = levelBounds[l - 1].downscalePowerOfTwoSmallestEnclosing(1);
+    }
+    assert( levelBounds[downscaleLevels].contains(renderWindow) && dstBounds.contains(renderWindow) );
 
-            const int sumW = (int)pickThisCol + (int)pickNextCol;
-            assert(sumW == 1 || sumW == 2);
+    const PIX* srcPixelPtrs[4];
+    int srcPixelStride;
+    Image::getChannelPointers<PIX>((const PIX**)srcPtrs, srcBounds.x1, srcBounds.y1, srcBounds, nComps, (PIX**)srcPixelPtrs, &srcPixelStride);
 
-            const int sum = sumW * sumH;
-            assert(0 < sum && sum <= 4);
+    PIX* dstPixelPtrs[4];
+    int dstPixelStride;
+    Image::getChannelPointers<PIX>((const PIX**)dstPtrs, dstBounds.x1, dstBounds.y1, dstBounds, nComps, (PIX**)dstPixelPtrs, &dstPixelStride);
+    assert(srcPixelStride == dstPixelStride);
+
+    // In coplanar mode each channel is downscaled separately as a single channel image
+    const int nPlanes = (srcPixelStride == 1) ? nComps : 1;
+    const int planeComps = (srcPixelStride == 1) ? 1 : nComps;
+
+    // Each tile of the destination covers a NATRON_MIPMAP_DOWNSCALE_SOURCE_TILE_SIZE square of the source:
+    // all levels of a tile are computed before moving to the next tile.
+    const int tileSize = std::max(1, NATRON_MIPMAP_DOWNSCALE_SOURCE_TILE_SIZE >> downscaleLevels);
+
+    // Intermediate levels of a tile, the last level is written directly to the destination
+    std::vector<std::vector<PIX> > levelsBuffers(downscaleLevels);
+    for (unsigned int l = 1; l < downscaleLevels; ++l) {
+        const std::size_t levelTileSize = (std::size_t)tileSize << (downscaleLevels - l);
+        levelsBuffers[l].resize(levelTileSize * levelTileSize * planeComps);
+    }
 
-            for (int k = 0; k < nComps; ++k) {
+    for (int ty = renderWindow.y1; ty < renderWindow.y2; ty += tileSize) {
 
-                // Averaged pixels are as such:
-                // a b
-                // c d
+        if (renderClone && renderClone->isRenderAborted()) {
+            return eActionStatusAborted;
+        }
 
-                const PIX a = (pickThisCol && pickThisRow) ? *(srcPixelPtrs[k]) : 0;
-                const PIX b = (pickNextCol && pickThisRow) ? *(srcPixelPtrs[k] + srcPixelStride) : 0;
-                const PIX c = (pickThisCol && pickNextRow) ? *(srcPixelPtrs[k] + srcRowElementsCount) : 0;
-                const PIX d = (pickNextCol && pickNextRow) ? *(srcPixelPtrs[k] + srcRowElementsCount + srcPixelStride)  : 0;
+        for (int tx = renderWindow.x1; tx < renderWindow.x2; tx += tileSize) {
 
-                assert( sumW == 2 || ( sumW == 1 && ( (a == 0 && c == 0) || (b == 0 && d == 0) ) ) );
-                assert( sumH == 2 || ( sumH == 1 && ( (a == 0 && b == 0) || (c == 0 && d == 0) ) ) );
+            const RectI dstTile( tx, ty, std::min(tx + tileSize, renderWindow.x2), std::min(ty + tileSize, renderWindow.y2) );
 
-                *dstPixelPtrs[k] = (a + b + c + d) / sum;
+            for (int p = 0; p < nPlanes; ++p) {
+                const PIX* inPtr = srcPixelPtrs[p];
+                RectI inBufferBounds = srcBounds;
 
-                srcPixelPtrs[k] += srcPixelStride * 2;
-                dstPixelPtrs[k] += dstPixelStride;
-            } // for each component
+                for (unsigned int l = 1; l <= downscaleLevels; ++l) {
+                    RectI outRoI;
+                    if ( !dstTile.upscalePowerOfTwo(downscaleLevels - l).intersect(levelBounds[l], &outRoI) ) {
+                        break;
+                    }
 
-        } // for each pixels on the line
+                    PIX* outPtr;
+                    RectI outBufferBounds;
+                    if (l == downscaleLevels) {
+                        outPtr = dstPixelPtrs[p];
+                        outBufferBounds = dstBounds;
+                    } else {
+                        outPtr = &levelsBuffers[l].front();
+                        outBufferBounds = outRoI;
+                    }
+                    halveRegion<PIX>(inPtr, inBufferBounds, levelBounds[l - 1], outPtr, outBufferBounds, outRoI, planeComps);
 
-        // Remove what was offset to the pointers during this scan-line and offset to the next
-        for (int k = 0; k < nComps; ++k) {
-            dstPixelPtrs[k] += (dstRowElementsCount - dstBounds.width() * dstPixelStride);
-            srcPixelPtrs[k] += ((srcRowElementsCount - dstBounds.width() * srcPixelStride) * 2);
-        }
-    }  // for each scan line
+                    inPtr = outPtr;
+                    inBufferBounds = outBufferBounds;
+                }
+            } // for each plane
+        } // for each tile on the row
+    } // for each row of tiles
     return eActionStatusOK;
-} // halveImageForInternal
-
-
-template <typename PIX, int maxValue>
-static ActionRetCodeEnum
-halveImageForDepth(const void* srcPtrs[4],
-                   int nComps,
-                   const RectI& srcBounds,
-                   void* dstPtrs[4],
-                   const RectI& dstBounds,
-                   const EffectInstancePtr& renderClone)
-{
-    switch (nComps) {
-        case 1:
-            return halveImageForInternal<PIX, maxValue, 1>(srcPtrs, srcBounds, dstPtrs, dstBounds, renderClone);
-        case 2:
-            return halveImageForInternal<PIX, maxValue, 2>(srcPtrs, srcBounds, dstPtrs, dstBounds, renderClone);
-        case 3:
-            return halveImageForInternal<PIX, maxValue, 3>(srcPtrs, srcBounds, dstPtrs, dstBounds, renderClone);
-        case 4:
-            return halveImageForInternal<PIX, maxValue, 4>(srcPtrs, srcBounds, dstPtrs, dstBounds, renderClone);
-        default:
-        return eActionStatusFailed;
-    }
-}
-
+} // downscaleMipMapForDepth
 
 ActionRetCodeEnum
-ImagePrivate::halveImage(const void* srcPtrs[4],
-                         int nComps,
-                         ImageBitDepthEnum bitDepth,
-                         const RectI& srcBounds,
-                         void* dstPtrs[4],
-                         const RectI& dstBounds,
-                         const EffectInstancePtr& renderClone)
+ImagePrivate::downscaleMipMapCPU(const void* srcPtrs[4],
+                                 int nComps,
+                                 ImageBitDepthEnum bitDepth,
+                                 const RectI& srcBounds,
+                                 const RectI& srcRoI,
+                                 unsigned int downscaleLevels,
+                                 void* dstPtrs[4],
+                                 const RectI& dstBounds,
+                                 const RectI& renderWindow,
+                                 const EffectInstancePtr& renderClone)
 {
     switch ( bitDepth ) {
         case eImageBitDepthByte:
-            return halveImageForDepth<unsigned char, 255>(srcPtrs, nComps, srcBounds, dstPtrs, dstBounds, renderClone);
+            return downscaleMipMapForDepth<unsigned char>(srcPtrs, nComps, srcBounds, srcRoI, downscaleLevels, dstPtrs, dstBounds, renderWindow, renderClone);
         case eImageBitDepthShort:
-            return halveImageForDepth<unsigned short, 65535>(srcPtrs, nComps, srcBounds, dstPtrs, dstBounds, renderClone);
+            return downscaleMipMapForDepth<unsigned short>(srcPtrs, nComps, srcBounds, srcRoI, downscaleLevels, dstPtrs, dstBounds, renderWindow, renderClone);
         case eImageBitDepthFloat:
-            return halveImageForDepth<float, 1>(srcPtrs, nComps, srcBounds, dstPtrs, dstBounds, renderClone);
-            break;
+            return downscaleMipMapForDepth<float>(srcPtrs, nComps, srcBounds, srcRoI, downscaleLevels, dstPtrs, dstBounds, renderWindow, renderClone);
         default:
         return eActionStatusFailed;
     }
-} // halveImage
+} // downscaleMipMapCPU
 
 
 template <typename PIX, int maxValue, int nComps>
@@ -203,13 +203,21 @@ struct ImagePrivate
                                      const RectI& roi,
                                      const EffectInstancePtr& renderClone);
 
-    static ActionRetCodeEnum halveImage(const void* srcPtrs[4],
-                                        int nComps,
-                                        ImageBitDepthEnum bitdepth,
-                           const RectI& srcBounds,
-                           void* dstPtrs[4],
-                           const RectI& dstBounds,
-                           const EffectInstancePtr& renderClone);
+    /**
+     * @brief Downscales the srcRoI portion of the source buffer by 2^downscaleLevels with a box filter, only
+     * computing the renderWindow portion of the destination. The result is the same as halving the image
+     * downscaleLevels times, but all levels are computed in a single pass over small tiles of the destination.
+     **/
+    static ActionRetCodeEnum downscaleMipMapCPU(const void* srcPtrs[4],
+                                                int nComps,
+                                                ImageBitDepthEnum bitdepth,
+                                                const RectI& srcBounds,
+                                                const RectI& srcRoI,
+                                                unsigned int downscaleLevels,
+                                                void* dstPtrs[4],
+                                                const RectI& dstBounds,
+                                                const RectI& renderWindow,
+                                                const EffectInstancePtr& renderClone);
 
     static bool checkForNaNs(void* ptrs[4],
                              int nComps,
@@ -0,0 +1,290 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "InFlightRequestTable.h"
+
+#include <map>
+
+#include <QtCore/QMutex>
+#include <QtCore/QThreadPool>
+#include <QtCore/QWaitCondition>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/weak_ptr.hpp>
+#endif
+
+#include "Engine/CancellationToken.h"
+#include "Engine/ThreadPool.h"
+
+// A thread waiting for an in-flight request checks the cancellation token of its render at this interval
+#define NATRON_IN_FLIGHT_REQUEST_WAIT_SLICE_MS 10
+
+// The table forgets the requests that are gone every this number of registrations
+#define NATRON_IN_FLIGHT_REQUEST_TABLE_SWEEP_INTERVAL 256
+
+NATRON_NAMESPACE_ENTER;
+
+struct InFlightRequestPrivate
+{
+    U64 key;
+    U64 ownerRenderIndex;
+
+    // Protects all data below and is the mutex of finishedCond
+    mutable QMutex lock;
+
+    // Woken up when the owner publishes its results
+    mutable QWaitCondition finishedCond;
+
+    InFlightRequest::StateEnum state;
+    RectD roi;
+    ActionRetCodeEnum stat;
+    ImagePtr requestedScaleImage, fullScaleImage;
+
+    InFlightRequestPrivate(U64 key,
+                           U64 ownerRenderIndex,
+                           const RectD& roi)
+        : key(key)
+        , ownerRenderIndex(ownerRenderIndex)
+        , lock()
+        , finishedCond()
+        , state(InFlightRequest::eStateNotStarted)
+        , roi(roi)
+        , stat(eActionStatusOK)
+        , requestedScaleImage()
+        , fullScaleImage()
+    {
+    }
+};
+
+InFlightRequest::InFlightRequest(U64 key,
+                                 U64 ownerRenderIndex,
+                                 const RectD& roi)
+    : _imp( new InFlightRequestPrivate(key, ownerRenderIndex, roi) )
+{
+}
+
+InFlightRequest::~InFlightRequest()
+{
+}
+
+U64
+InFlightRequest::getKey() const
+{
+    return _imp->key;
+}
+
+U64
+InFlightRequest::getOwnerRenderIndex() const
+{
+    return _imp->ownerRenderIndex;
+}
+
+InFlightRequest::StateEnum
+InFlightRequest::getState() const
+{
+    QMutexLocker k(&_imp->lock);
+
+    return _imp->state;
+}
+
+RectD
+InFlightRequest::getRoI() const
+{
+    QMutexLocker k(&_imp->lock);
+
+    return _imp->roi;
+}
+
+void
+InFlightRequest::setRoI(const RectD& roi)
+{
+    QMutexLocker k(&_imp->lock);
+
+    _imp->roi = roi;
+}
+
+void
+InFlightRequest::notifyRenderStarted()
+{
+    QMutexLocker k(&_imp->lock);
+
+    assert(_imp->state == eStateNotStarted);
+    _imp->state = eStateRendering;
+}
+
+void
+InFlightRequest::notifyRenderFinished(ActionRetCodeEnum stat,
+                                      const RectD& roi,
+                                      const ImagePtr& requestedScaleImage,
+                                      const ImagePtr& fullScaleImage)
+{
+    QMutexLocker k(&_imp->lock);
+
+    if (_imp->state == eStateFinished) {
+        return;
+    }
+    _imp->state = eStateFinished;
+    _imp->stat = stat;
+    _imp->roi = roi;
+    _imp->requestedScaleImage = requestedScaleImage;
+    _imp->fullScaleImage = fullScaleImage;
+    _imp->finishedCond.wakeAll();
+}
+
+bool
+InFlightRequest::waitForResults(const CancellationTokenPtr& cancellationToken,
+                                std::size_t timeoutMS,
+                                ActionRetCodeEnum* stat,
+                                RectD* roi,
+                                ImagePtr* requestedScaleImage,
+                                ImagePtr* fullScaleImage) const
+{
+    // The owner may take a while: let the thread pool use this thread for other runnables meanwhile
+    bool hasReleasedThread = false;
+    if ( isRunningInThreadPoolThread() ) {
+        QThreadPool::globalInstance()->releaseThread();
+        hasReleasedThread = true;
+    }
+
+    bool finished;
+    {
+        QMutexLocker k(&_imp->lock);
+        std::size_t timeSpentWaitingMS = 0;
+        while ( _imp->state != eStateFinished && (timeoutMS == 0 || timeSpentWaitingMS < timeoutMS) &&
+                ( !cancellationToken || !cancellationToken->isCancelled() ) ) {
+            _imp->finishedCond.wait(&_imp->lock, NATRON_IN_FLIGHT_REQUEST_WAIT_SLICE_MS);
+            timeSpentWaitingMS += NATRON_IN_FLIGHT_REQUEST_WAIT_SLICE_MS;
+        }
+        finished = _imp->state == eStateFinished;
+        if (finished) {
+            *stat = _imp->stat;
+            *roi = _imp->roi;
+            *requestedScaleImage = _imp->requestedScaleImage;
+            *fullScaleImage = _imp->fullScaleImage;
+        }
+    }
+
+    if (hasReleasedThread) {
+        QThreadPool::globalInstance()->reserveThread();
+    }
+
+    return finished;
+} // waitForResults
+
+typedef std::map<U64, InFlightRequestWPtr> InFlightRequestMap;
+
+struct InFlightRequestTablePrivate
+{
+    // Protects requests and nRegistrations
+    mutable QMutex lock;
+
+    InFlightRequestMap requests;
+
+    // Number of registrations since the last sweep of the requests that are gone
+    int nRegistrations;
+
+    InFlightRequestTablePrivate()
+        : lock()
+        , requests()
+        , nRegistrations(0)
+    {
+    }
+
+    void sweepExpiredRequests()
+    {
+        InFlightRequestMap::iterator it = requests.begin();
+        while ( it != requests.end() ) {
+            if ( it->second.expired() ) {
+                requests.erase(it++);
+            } else {
+                ++it;
+            }
+        }
+    }
+};
+
+InFlightRequestTable::InFlightRequestTable()
+    : _imp( new InFlightRequestTablePrivate() )
+{
+}
+
+InFlightRequestTable::~InFlightRequestTable()
+{
+}
+
+InFlightRequestPtr
+InFlightRequestTable::registerRequest(U64 key,
+                                      U64 renderIndex,
+                                      const RectD& roi,
+                                      bool* isOwner)
+{
+    *isOwner = false;
+
+    QMutexLocker k(&_imp->lock);
+
+    InFlightRequestWPtr& slot = _imp->requests[key];
+    InFlightRequestPtr existing = slot.lock();
+    if (existing) {
+        // The request lock is never held while taking the table lock, hence it is safe to take it here
+        QMutexLocker requestLocker(&existing->_imp->lock);
+        bool usable = existing->_imp->state != InFlightRequest::eStateFinished || !isFailureRetCode(existing->_imp->stat);
+        if (usable) {
+            // Results that are available can be shared with any render, but only a render created after the owner
+            // may wait for it
+            if ( (existing->_imp->state == InFlightRequest::eStateFinished) || (existing->_imp->ownerRenderIndex < renderIndex) ) {
+                return existing;
+            }
+
+            return InFlightRequestPtr();
+        }
+    }
+
+    InFlightRequestPtr ret( new InFlightRequest(key, renderIndex, roi) );
+    slot = ret;
+    *isOwner = true;
+
+    if (++_imp->nRegistrations >= NATRON_IN_FLIGHT_REQUEST_TABLE_SWEEP_INTERVAL) {
+        _imp->nRegistrations = 0;
+        _imp->sweepExpiredRequests();
+    }
+
+    return ret;
+} // registerRequest
+
+std::size_t
+InFlightRequestTable::getNumRequests() const
+{
+    QMutexLocker k(&_imp->lock);
+    std::size_t ret = 0;
+
+    for (InFlightRequestMap::const_iterator it = _imp->requests.begin(); it != _imp->requests.end(); ++it) {
+        if ( !it->second.expired() ) {
+            ++ret;
+        }
+    }
+
+    return ret;
+}
+
+NATRON_NAMESPACE_EXIT;
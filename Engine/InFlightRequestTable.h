@@ -0,0 +1,162 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef Engine_InFlightRequestTable_h
+#define Engine_InFlightRequestTable_h
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#endif
+
+#include "Global/GlobalDefines.h"
+
+#include "Engine/RectD.h"
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER;
+
+/**
+ * @brief The computation of a frame/view of a node shared by the FrameViewRequests of concurrent renders.
+ * The first render requesting it owns it: it is the only one to compute it and publishes its results with
+ * notifyRenderFinished(). The requests of other renders attach to it and wait for the results instead of computing
+ * them again.
+ **/
+struct InFlightRequestPrivate;
+class InFlightRequest
+{
+    friend class InFlightRequestTable;
+
+    InFlightRequest(U64 key, U64 ownerRenderIndex, const RectD& roi);
+
+public:
+
+    enum StateEnum
+    {
+        // The owner did not start rendering yet: it may still be waiting on its own inputs
+        eStateNotStarted,
+
+        // The owner is rendering
+        eStateRendering,
+
+        // The results are available, see waitForResults()
+        eStateFinished
+    };
+
+    ~InFlightRequest();
+
+    U64 getKey() const;
+
+    /**
+     * @brief Returns the TreeRender::getRenderIndex() of the render computing this request
+     **/
+    U64 getOwnerRenderIndex() const;
+
+    StateEnum getState() const;
+
+    /**
+     * @brief The region of interest that the owner is going to render, in canonical coordinates.
+     * The owner updates it each time its RoI is merged with the RoI requested by another branch of its tree.
+     **/
+    RectD getRoI() const;
+    void setRoI(const RectD& roi);
+
+    /**
+     * @brief Called by the owner right before it renders.
+     **/
+    void notifyRenderStarted();
+
+    /**
+     * @brief Called by the owner once it is done rendering, even if the render failed or was aborted,
+     * this wakes up the attached requests. This has no effect if called more than once.
+     **/
+    void notifyRenderFinished(ActionRetCodeEnum stat,
+                              const RectD& roi,
+                              const ImagePtr& requestedScaleImage,
+                              const ImagePtr& fullScaleImage);
+
+    /**
+     * @brief Blocks the calling thread until the owner published its results, the given token is cancelled
+     * or timeoutMS milliseconds elapsed. If timeoutMS is 0, only the token stops the wait.
+     * If the calling thread is a thread pool thread, it is released while waiting.
+     * Returns true if the results are available, in which case they are returned in the other parameters.
+     **/
+    bool waitForResults(const CancellationTokenPtr& cancellationToken,
+                        std::size_t timeoutMS,
+                        ActionRetCodeEnum* stat,
+                        RectD* roi,
+                        ImagePtr* requestedScaleImage,
+                        ImagePtr* fullScaleImage) const;
+
+private:
+
+    boost::scoped_ptr<InFlightRequestPrivate> _imp;
+};
+
+/**
+ * @brief Process-wide table of the requests being computed by the renders, keyed by a hash of the node frame/view hash
+ * and of the parameters of the request (plane, scale, draft). It is owned by the AppManager.
+ *
+ * Renders share their results through the cache, but only once they reach the cache entry lock, that is after their
+ * own request pass is done, and not at all for images that are not cached. With this table the requests of a render
+ * find the identical request of an older render still in flight and re-use its results.
+ *
+ * The table only holds weak references: an entry lives as long as the FrameViewRequests referencing it.
+ **/
+struct InFlightRequestTablePrivate;
+class InFlightRequestTable
+{
+public:
+
+    InFlightRequestTable();
+
+    ~InFlightRequestTable();
+
+    /**
+     * @brief Returns the in-flight request for the given key, registering a new one owned by the render
+     * renderIndex if there was none. isOwner is set to true if the returned request was registered by this call.
+     *
+     * A request already in flight is only returned to renders created after its owner, so that two renders never wait on
+     * each other. A null pointer is returned otherwise: the caller should compute the request on its own.
+     * A request whose owner failed or was aborted is replaced.
+     **/
+    InFlightRequestPtr registerRequest(U64 key, U64 renderIndex, const RectD& roi, bool* isOwner);
+
+    /**
+     * @brief Returns the number of requests referenced by the table which are still alive
+     **/
+    std::size_t getNumRequests() const;
+
+private:
+
+    boost::scoped_ptr<InFlightRequestTablePrivate> _imp;
+};
+
+NATRON_NAMESPACE_EXIT;
+
+#endif // Engine_InFlightRequestTable_h
@@ -71,19 +71,7 @@ hermiteToCubicCoeffs(double P0,
 }
 
 // evaluate at t
-static double
-cubicEval(double c0,
-          double c1,
-          double c2,
-          double c3,
-          double t)
-{
-    const double t2 = t * t;
-    const double t3 = t2 * t;
-    assert(t == t && t2 == t2 && t3 == t3 && c0 == c0 && c1 == c1 && c2 == c2 && c3 == c3);
-
-    return c0 + (c1 ? c1 * t : 0.) + (c2 ? c2 * t2 : 0.) + (c3 ? c3 * t3 : 0.);
-}
+using Interpolation::cubicEval;
 
 // integrate from 0 to t
 static double
@@ -410,25 +398,21 @@ Interpolation::solveQuartic(double c0,
     return num;
 } // solveQuartic
 
-/**
- * @brief Interpolates using the control points P0(t0,v0) , P3(t3,v3)
- * and the derivatives P1(t1,v1) (being the derivative at P0 with respect to
- * t \in [t1,t2]) and P2(t2,v2) (being the derivative at P3 with respect to
- * t \in [t1,t2]) the value at 'currentTime' using the
- * interpolation method "interp".
- * Note that for CATMULL-ROM you must use the function interpolate_catmullRom
- * which will compute the derivatives for you.
- **/
-double
-Interpolation::interpolate(double tcur,
-                           const double vcur,              //start control point
-                           const double vcurDerivRight, //being the derivative dv/dt at tcur
-                           const double vnextDerivLeft, //being the derivative dv/dt at tnext
-                           double tnext,
-                           const double vnext,               //end control point
-                           double currentTime,
-                           KeyframeTypeEnum interp,
-                           KeyframeTypeEnum interpNext)
+void
+Interpolation::cubicCoefficients(double tcur,
+                                 const double vcur,              //start control point
+                                 const double vcurDerivRight, //being the derivative dv/dt at tcur
+                                 const double vnextDerivLeft, //being the derivative dv/dt at tnext
+                                 double tnext,
+                                 const double vnext,               //end control point
+                                 KeyframeTypeEnum interp,
+                                 KeyframeTypeEnum interpNext,
+                                 double *tStart,
+                                 double *tEnd,
+                                 double *c0,
+                                 double *c1,
+                                 double *c2,
+                                 double *c3)
 {
     double P0 = vcur;
     double P3 = vnext;
@@ -436,9 +420,6 @@ Interpolation::interpolate(double tcur,
     double P0pr = vcurDerivRight * (tnext - tcur); // normalize for x \in [0,1]
     double P3pl = vnextDerivLeft * (tnext - tcur); // normalize for x \in [0,1]
 
-    // if the following is true, this makes the special case for eKeyframeTypeConstant at tnext useless, and we can always use a cubic - the strict "currentTime < tnext" is the key
-    // commented-out: the following assert is not true for periodic curves and passing the flag to interpolate would only be required in NDEBUG
-    //assert( ( (interp == eKeyframeTypeNone) || (tcur <= currentTime) ) && ( (currentTime < tnext) || (interpNext == eKeyframeTypeNone) ) );
     // after the last / before the first keyframe, derivatives are wrt currentTime (i.e. non-normalized)
     if (interp == eKeyframeTypeNone) {
         // virtual previous frame at t-1
@@ -456,10 +437,39 @@ Interpolation::interpolate(double tcur,
         P3 = P0 + P0pr;
         tnext = tcur + 1;
     }
+    hermiteToCubicCoeffs(P0, P0pr, P3pl, P3, c0, c1, c2, c3);
+    *tStart = tcur;
+    *tEnd = tnext;
+}
+
+/**
+ * @brief Interpolates using the control points P0(t0,v0) , P3(t3,v3)
+ * and the derivatives P1(t1,v1) (being the derivative at P0 with respect to
+ * t \in [t1,t2]) and P2(t2,v2) (being the derivative at P3 with respect to
+ * t \in [t1,t2]) the value at 'currentTime' using the
+ * interpolation method "interp".
+ * Note that for CATMULL-ROM you must use the function interpolate_catmullRom
+ * which will compute the derivatives for you.
+ **/
+double
+Interpolation::interpolate(double tcur,
+                           const double vcur,              //start control point
+                           const double vcurDerivRight, //being the derivative dv/dt at tcur
+                           const double vnextDerivLeft, //being the derivative dv/dt at tnext
+                           double tnext,
+                           const double vnext,               //end control point
+                           double currentTime,
+                           KeyframeTypeEnum interp,
+                           KeyframeTypeEnum interpNext)
+{
+    // if the following is true, this makes the special case for eKeyframeTypeConstant at tnext useless, and we can always use a cubic - the strict "currentTime < tnext" is the key
+    // commented-out: the following assert is not true for periodic curves and passing the flag to interpolate would only be required in NDEBUG
+    //assert( ( (interp == eKeyframeTypeNone) || (tcur <= currentTime) ) && ( (currentTime < tnext) || (interpNext == eKeyframeTypeNone) ) );
+    double tStart, tEnd;
     double c0, c1, c2, c3;
-    hermiteToCubicCoeffs(P0, P0pr, P3pl, P3, &c0, &c1, &c2, &c3);
+    cubicCoefficients(tcur, vcur, vcurDerivRight, vnextDerivLeft, tnext, vnext, interp, interpNext, &tStart, &tEnd, &c0, &c1, &c2, &c3);
 
-    const double t = (currentTime - tcur) / (tnext - tcur);
+    const double t = (currentTime - tStart) / (tEnd - tStart);
     double ret = cubicEval(c0, c1, c2, c3, t);
 
     // cubicDerive: divide the result by (tnext-tcur)
@@ -27,6 +27,8 @@
 
 #include "Global/Macros.h"
 
+#include <cassert>
+
 #include "Global/Enums.h"
 #include "Engine/TimeValue.h"
 
@@ -50,6 +52,35 @@ double interpolate(double tcur, const double vcur, //start control point
                    KeyframeTypeEnum interp,
                    KeyframeTypeEnum interpNext) WARN_UNUSED_RETURN;
 
+/**
+ * @brief Computes the coefficients of the cubic that interpolate() evaluates with the same arguments: the value at
+ * currentTime is cubicEval(c0, c1, c2, c3, (currentTime - *tStart) / (*tEnd - *tStart)).
+ * This is meant for callers evaluating the same segment of a curve many times, such as the flattened form of a Curve.
+ **/
+void cubicCoefficients(double tcur, const double vcur, //start control point
+                       const double vcurDerivRight, //being the derivative dv/dt at tcur
+                       const double vnextDerivLeft, //being the derivative dv/dt at tnext
+                       double tnext, const double vnext, //end control point
+                       KeyframeTypeEnum interp,
+                       KeyframeTypeEnum interpNext,
+                       double *tStart, double *tEnd,
+                       double *c0, double *c1, double *c2, double *c3);
+
+/// evaluate the cubic c0 + c1*t + c2*t^2 + c3*t^3 at t
+inline double
+cubicEval(double c0,
+          double c1,
+          double c2,
+          double c3,
+          double t)
+{
+    const double t2 = t * t;
+    const double t3 = t2 * t;
+    assert(t == t && t2 == t2 && t3 == t3 && c0 == c0 && c1 == c1 && c2 == c2 && c3 == c3);
+
+    return c0 + (c1 ? c1 * t : 0.) + (c2 ? c2 * t2 : 0.) + (c3 ? c3 * t3 : 0.);
+}
+
 /// derive at currentTime. The derivative is with respect to currentTime
 double derive(double tcur, const double vcur, //start control point
               const double vcurDerivRight, //being the derivative dv/dt at tcur
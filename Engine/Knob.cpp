@@ -2397,6 +2397,31 @@ KnobHelper::addListener(const DimIdx listenerDimension,
     _signalSlotHandler->s_linkChanged();
 } // addListener
 
+void
+KnobHelper::removeKnobListener(const DimIdx listenerDimension,
+                               const DimIdx listenedToDimension,
+                               const ViewIdx listenerView,
+                               const ViewIdx listenedToView,
+                               const KnobIPtr& listener)
+{
+    if (!listener) {
+        return;
+    }
+
+    // Remove from the listeners list
+    {
+        QMutexLocker l(&_imp->common->expressionMutex);
+        KnobDimViewKeySet& listenersSet = _imp->common->listeners[listenedToDimension][listenedToView];
+        KnobDimViewKeySet::iterator foundListener = listenersSet.find( KnobDimViewKey(listener, listenerDimension, listenerView) );
+        if ( foundListener != listenersSet.end() ) {
+            listenersSet.erase(foundListener);
+        }
+    }
+
+    // Remove from the hash listeners
+    removeListener(listener);
+} // removeKnobListener
+
 
 void
 KnobHelper::getListeners(KnobDimViewKeySet& listeners, ListenersTypeFlags flags) const
@@ -1188,6 +1188,16 @@ public:
                              const KnobIPtr& listener,
                              ExpressionLanguageEnum language) = 0;
 
+    /**
+     * @brief Removes a listener added with addListener(): the given knob no longer listens to the values/keyframes
+     * of "this" at the given dimensions and views.
+     **/
+    virtual void removeKnobListener(const DimIdx listenerDimension,
+                                    const DimIdx listenedToDimension,
+                                    const ViewIdx listenerView,
+                                    const ViewIdx listenedToView,
+                                    const KnobIPtr& listener) = 0;
+
     /**
      * @brief Implement to save the content of the object to the serialization object
      **/
@@ -1839,6 +1849,12 @@ public:
                              const KnobIPtr& knob,
                              ExpressionLanguageEnum language) OVERRIDE FINAL;
 
+    virtual void removeKnobListener(const DimIdx listenerDimension,
+                                    const DimIdx listenedToDimension,
+                                    const ViewIdx listenerView,
+                                    const ViewIdx listenedToView,
+                                    const KnobIPtr& listener) OVERRIDE FINAL;
+
     virtual void getListeners(KnobDimViewKeySet& listeners, ListenersTypeFlags flags = ListenersTypeFlags(eListenersTypeExpression | eListenersTypeSharedValue)) const OVERRIDE FINAL;
 
 private:
@@ -2327,11 +2343,14 @@ public:
      **/
     virtual bool areDimensionsEqual(ViewIdx view) OVERRIDE FINAL;
 
+    /**
+     * @brief Clears the values of expressions and animated strings cached on a render clone.
+     * The snapshot of static and animated values taken in populate() is immutable and is not affected.
+     **/
     virtual void clearRenderValuesCache() OVERRIDE
     {
-        if (_valuesCache) {
-            _valuesCache->clear();
-        }
+        QMutexLocker k(&_evaluatedRenderValuesMutex);
+        _evaluatedRenderValues.clear();
     }
 
     virtual void clearExpressionsResults(DimSpec dimension, ViewSetSpec view) OVERRIDE FINAL;
@@ -2354,6 +2373,10 @@ private:
                        ViewIdx view,
                        bool clamp);
 
+    void captureRenderValues();
+
+    bool getRenderValue(TimeValue time, DimIdx dimension, ViewIdx view, bool clamp, T* ret) const;
+
     void setValueOnCurveInternal(TimeValue time, const T& v, DimIdx dimension, ViewIdx view, KeyFrame* newKey, ValueChangedReturnCodeEnum* ret);
 
     void addSetValueToUndoRedoStackIfNeeded(const T& oldValue, const T& value, ValueChangedReasonEnum reason, ValueChangedReturnCodeEnum setValueRetCode, ViewSetSpec view, DimSpec dimension, TimeValue time, bool setKeyFrame);
@@ -2434,6 +2457,25 @@ private:
 
     typedef std::map<DimTimeView, T, ValueDimTimeViewCompareLess> ValuesCacheMap;
 
+    enum RenderValueTypeEnum
+    {
+        // The dimension/view has no animation nor expression: value is the value at any time
+        eRenderValueTypeStatic,
+
+        // The dimension/view is animated: value is the value at the render time, other times are read from curve
+        eRenderValueTypeCurve,
+
+        // The dimension/view has an expression or cannot be evaluated without locking: go through getValueFromExpression/getValueFromCurve
+        eRenderValueTypeEvaluated
+    };
+
+    struct RenderValue
+    {
+        RenderValueTypeEnum type;
+        T value, unclampedValue;
+        CurvePtr curve;
+    };
+
 
     struct Data
     {
@@ -2468,9 +2510,16 @@ private:
 
 
 
-    // Used only on render clones to cache the result of getValue/getValueAtTime so it stays
-    // consistant throughout a render.
-    boost::scoped_ptr<ValuesCacheMap> _valuesCache;
+    // Used only on render clones: snapshot of the value of each dimension/view taken when the clone is created
+    // so that it stays consistant throughout a render. Indexed by view * nDims + dimension.
+    // It is never modified afterwards hence it can be read without locking.
+    std::vector<RenderValue> _renderValues;
+    TimeValue _renderValuesTime;
+
+    // Used only on render clones to cache the result of getValue/getValueAtTime for dimension/views
+    // that could not be captured in _renderValues (expressions, animated strings).
+    mutable QMutex _evaluatedRenderValuesMutex;
+    ValuesCacheMap _evaluatedRenderValues;
 
     // The Data pointer is shared accross the "main" instance and the render clones.
     boost::shared_ptr<Data> _data;
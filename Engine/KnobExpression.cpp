@@ -25,6 +25,8 @@
 #include "Knob.h"
 #include "KnobPrivate.h"
 
+#include <cmath>
+#include <climits>
 #include <sstream> // stringstream
 #include <string>
 
@@ -630,7 +632,8 @@ KnobHelperPrivate::validatePythonExpression(const string& expression,
     // Try to execute the expression and evaluate it, if it doesn't have a good syntax, throw an exception
     // with the error.
     string error;
-    string funcExecScript = "ret = " + exprFuncPrefix + exprFuncName;
+    string functionPath = exprFuncPrefix + exprFuncName;
+    string funcExecScript = "ret = " + functionPath;
 
     {
         ExprRecursionLevel_RAII __recursionLevelIncrementer__(publicInterface);
@@ -685,7 +688,7 @@ KnobHelperPrivate::validatePythonExpression(const string& expression,
         }
     }
 
-    return funcExecScript;
+    return functionPath;
 } // validatePythonExpression
 
 
@@ -913,6 +916,7 @@ KnobHelper::setExpressionInternal(DimIdx dimension,
             expressionObj = obj;
             obj->modifiedExpression = _imp->validatePythonExpression(expression, dimension, view, hasRetVariable, &exprResult);
             obj->hasRet = hasRetVariable;
+            obj->compile();
         }
         break;
         case eExpressionLanguageExprTk: {
@@ -967,7 +971,7 @@ KnobHelper::setExpressionInternal(DimIdx dimension,
                         continue;
                     }
 
-                    effect->addHashListener(thisShared);
+                    effect->addExpressionHashListener(thisShared);
                 }
             }
             break;
@@ -1200,7 +1204,7 @@ KnobHelper::clearExpressionInternal(DimIdx dimension,
                     if (!effect) {
                         continue;
                     }
-                    effect->removeListener(thisShared);
+                    effect->removeExpressionHashListener(thisShared);
                 }
             }
             foundView->second.reset();
@@ -1208,27 +1212,13 @@ KnobHelper::clearExpressionInternal(DimIdx dimension,
     }
     {
         // Notify all dependencies of the expression that they no longer listen to this knob
-        KnobDimViewKey listenerToRemoveKey(thisShared, dimension, view);
         for (KnobDimViewKeySet::iterator it = dependencies.begin();
              it != dependencies.end(); ++it) {
             KnobIPtr otherKnob = it->knob.lock();
-            KnobHelper* other = dynamic_cast<KnobHelper*>( otherKnob.get() );
-            if (!other) {
+            if (!otherKnob) {
                 continue;
             }
-
-            // Remove from the other knob's listeners list
-            {
-                QMutexLocker otherMastersLocker(&other->_imp->common->expressionMutex);
-                KnobDimViewKeySet& otherListeners = other->_imp->common->listeners[it->dimension][it->view];
-                KnobDimViewKeySet::iterator foundListener = otherListeners.find(listenerToRemoveKey);
-                if ( foundListener != otherListeners.end() ) {
-                    otherListeners.erase(foundListener);
-                }
-            }
-
-            // Remove from the hash listeners
-            other->removeListener(thisShared);
+            otherKnob->removeKnobListener(dimension, it->dimension, view, it->view, thisShared);
         }
     }
 
@@ -1377,6 +1367,82 @@ KnobHelper::evaluateExpression(const string& expr,
 }
 
 
+KnobExprPython::~KnobExprPython()
+{
+    if ( (functionCode || viewArg) && Py_IsInitialized() ) {
+        PythonGILLocker pgl;
+        Py_XDECREF(functionCode);
+        Py_XDECREF(viewArg);
+    }
+}
+
+void
+KnobExprPython::compile()
+{
+    Py_XDECREF(functionCode);
+    functionCode = Py_CompileString(modifiedExpression.c_str(), "<expression>", Py_eval_input);
+    if (!functionCode) {
+        string error;
+        catchErrors(NATRON_PYTHON_NAMESPACE::getMainModule(), &error);
+        if ( error.empty() ) {
+            error = "Failed to compile " + modifiedExpression;
+        }
+        throw std::runtime_error(error);
+    }
+}
+
+PyObject*
+KnobExprPython::call(TimeValue time,
+                     const string& viewName)
+{
+    assert(functionCode);
+    PyObject* globalDict = PyModule_GetDict( NATRON_PYTHON_NAMESPACE::getMainModule() ); // borrowed ref
+
+    // Look-up the function each time so that it is found even if its attribute was set again, this does not parse anything
+#if PY_MAJOR_VERSION >= 3
+    PyObject* function = PyEval_EvalCode(functionCode, globalDict, globalDict); // new ref
+#else
+    PyObject* function = PyEval_EvalCode( (PyCodeObject*)functionCode, globalDict, globalDict ); // new ref
+#endif
+    if (!function) {
+        return 0;
+    }
+
+    if ( !viewArg || (viewArgName != viewName) ) {
+        Py_XDECREF(viewArg);
+#if PY_MAJOR_VERSION >= 3
+        viewArg = PyUnicode_FromString( viewName.c_str() );
+#else
+        viewArg = PyString_FromString( viewName.c_str() );
+#endif
+        viewArgName = viewName;
+    }
+
+    // Integer frames are passed as int, as they were when the call was written in a script
+    PyObject* frameArg;
+    const double t = time;
+    if ( (t == std::floor(t)) && (std::fabs(t) < LONG_MAX) ) {
+#if PY_MAJOR_VERSION >= 3
+        frameArg = PyLong_FromLong( (long)t );
+#else
+        frameArg = PyInt_FromLong( (long)t );
+#endif
+    } else {
+        frameArg = PyFloat_FromDouble(t);
+    }
+
+    PyObject* ret = 0;
+    PyObject* args = (viewArg && frameArg) ? PyTuple_Pack(2, frameArg, viewArg) : 0; // new ref
+    if (args) {
+        ret = PyObject_CallObject(function, args); // new ref
+    }
+    Py_XDECREF(args);
+    Py_XDECREF(frameArg);
+    Py_DECREF(function);
+
+    return ret;
+} // KnobExprPython::call
+
 bool
 KnobHelper::executePythonExpression(TimeValue time,
                                     ViewIdx view,
@@ -1388,24 +1454,32 @@ KnobHelper::executePythonExpression(TimeValue time,
         throw std::invalid_argument("KnobHelper::executeExpression(): Dimension out of range");
     }
 
+    *ret = 0;
+
     EffectInstancePtr effect = toEffectInstance( getHolder() );
     if (effect) {
         appPTR->setLastPythonAPICaller_TLS(effect);
     }
 
 
-    string expr;
+    // Hold a reference to the expression so it does not get destroyed if it is changed while running
+    KnobExprPtr exprObj;
     {
         QMutexLocker k(&_imp->common->expressionMutex);
         ExprPerViewMap::const_iterator foundView = _imp->common->expressions[dimension].find(view);
         if ( ( foundView == _imp->common->expressions[dimension].end() ) || !foundView->second ) {
             return false;
         }
-        KnobExprPython* isPythonExpr = dynamic_cast<KnobExprPython*>( foundView->second.get() );
-        assert(isPythonExpr);
-        expr = isPythonExpr->modifiedExpression;
+        exprObj = foundView->second;
     }
-    stringstream ss;
+    KnobExprPython* isPythonExpr = dynamic_cast<KnobExprPython*>( exprObj.get() );
+    assert(isPythonExpr);
+    if (!isPythonExpr || !isPythonExpr->functionCode) {
+        *error = "Invalid expression";
+
+        return false;
+    }
+
     string viewName;
     if ( getHolder() && getHolder()->getApp() ) {
         viewName = getHolder()->getApp()->getProject()->getViewName(view);
@@ -1414,13 +1488,21 @@ KnobHelper::executePythonExpression(TimeValue time,
         viewName = "Main";
     }
 
-    ss << expr << '(' << time << ", \"" << viewName << "\")\n";
-    string script = ss.str();
-
     ///Reset the random state to reproduce the sequence
     randomSeed( time, hashFunction(dimension) );
 
-    return executePythonExpression(ss.str(), ret, error);
+    *ret = isPythonExpr->call(time, viewName);
+    if (!*ret) {
+        // Do not forget to empty the error stream using catchError, even if we know the error,
+        // for subsequent expression evaluations.
+        if ( catchErrors(NATRON_PYTHON_NAMESPACE::getMainModule(), error) ) {
+            *error = "The expression did not return a value";
+        }
+
+        return false;
+    }
+
+    return true;
 } // executeExpression
 
 
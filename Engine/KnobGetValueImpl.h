@@ -218,7 +218,7 @@ Knob<T>::getValueFromExpression_pod(TimeValue time,
 
 template <typename T>
 T
-Knob<T>::getValueInternal(TimeValue tlsCurrentTime,
+Knob<T>::getValueInternal(TimeValue /*currentTime*/,
                           DimIdx dimension,
                           ViewIdx view,
                           bool clamp)
@@ -230,29 +230,79 @@ Knob<T>::getValueInternal(TimeValue tlsCurrentTime,
     {
         QMutexLocker k(&dataForDimView->valueMutex);
         if (clamp) {
-            T ret = clampToMinMax(dataForDimView->value, dimension);
-            if (_valuesCache) {
-                DimTimeView key;
-                key.time = tlsCurrentTime;
-                key.view = view;
-                key.dimension = dimension;
-                (*_valuesCache)[key] = ret;
-            }
-            return ret;
+            return clampToMinMax(dataForDimView->value, dimension);
         } else {
-            const T& ret = dataForDimView->value;
-            if (_valuesCache) {
-                DimTimeView key;
-                key.time = tlsCurrentTime;
-                key.view = view;
-                key.dimension = dimension;
-                (*_valuesCache)[key] = ret;
-            }
-            return ret;
+            return dataForDimView->value;
         }
     }
 } // getValueInternal
 
+template <typename T>
+bool
+Knob<T>::getRenderValue(TimeValue time,
+                        DimIdx dimension,
+                        ViewIdx view,
+                        bool clamp,
+                        T* ret) const
+{
+    // Not a render clone
+    if ( _renderValues.empty() || (view < 0) ) {
+        return false;
+    }
+    int nDims = getNDimensions();
+    int index = view * nDims + dimension;
+    if ( index >= (int)_renderValues.size() ) {
+        // The view did not exist when the clone was created: it falls back on the main view
+        index = dimension;
+    }
+    const RenderValue& slot = _renderValues[index];
+    switch (slot.type) {
+    case eRenderValueTypeStatic:
+        *ret = clamp ? slot.value : slot.unclampedValue;
+
+        return true;
+    case eRenderValueTypeCurve:
+        if (time == _renderValuesTime) {
+            *ret = clamp ? slot.value : slot.unclampedValue;
+        } else {
+            // Curve::getValueAt does not lock
+            *ret = (T)slot.curve->getValueAt(time, clamp);
+        }
+
+        return true;
+    case eRenderValueTypeEvaluated:
+        break;
+    }
+
+    return false;
+} // getRenderValue
+
+template <>
+bool
+KnobStringBase::getRenderValue(TimeValue /*time*/,
+                               DimIdx dimension,
+                               ViewIdx view,
+                               bool /*clamp*/,
+                               std::string* ret) const
+{
+    // Animated strings are never captured, see captureRenderValues()
+    if ( _renderValues.empty() || (view < 0) ) {
+        return false;
+    }
+    int nDims = getNDimensions();
+    int index = view * nDims + dimension;
+    if ( index >= (int)_renderValues.size() ) {
+        index = dimension;
+    }
+    const RenderValue& slot = _renderValues[index];
+    if (slot.type != eRenderValueTypeStatic) {
+        return false;
+    }
+    *ret = slot.value;
+
+    return true;
+} // getRenderValue
+
 template <typename T>
 T
 Knob<T>::getValue(DimIdx dimension,
@@ -266,21 +316,26 @@ Knob<T>::getValue(DimIdx dimension,
 
 
 
-    // Figure out the view to read
-    ViewIdx view_i = checkIfViewExistsOrFallbackMainView(view);
+    TimeValue currentTime = getCurrentRenderTime();
 
-    boost::shared_ptr<Knob<T> > thisShared = boost::dynamic_pointer_cast<Knob<T> >(shared_from_this());
+    // On a render clone, read the value captured when the clone was created
+    T ret;
+    if ( getRenderValue(currentTime, dimension, view, clamp, &ret) ) {
+        return ret;
+    }
 
+    // Figure out the view to read
+    ViewIdx view_i = checkIfViewExistsOrFallbackMainView(view);
 
-    TimeValue currentTime = getCurrentRenderTime();
-    // Check if value is already in TLS when rendering
-    if (_valuesCache) {
-        DimTimeView key;
-        key.time = currentTime;
-        key.view = view_i;
-        key.dimension = dimension;
-        typename ValuesCacheMap::const_iterator foundCached = _valuesCache->find(key);
-        if (foundCached != _valuesCache->end()) {
+    bool isRenderClone = !_renderValues.empty();
+    DimTimeView key;
+    key.time = currentTime;
+    key.view = view_i;
+    key.dimension = dimension;
+    if (isRenderClone) {
+        QMutexLocker k(&_evaluatedRenderValuesMutex);
+        typename ValuesCacheMap::const_iterator foundCached = _evaluatedRenderValues.find(key);
+        if ( foundCached != _evaluatedRenderValues.end() ) {
             return foundCached->second;
         }
     }
@@ -289,14 +344,10 @@ Knob<T>::getValue(DimIdx dimension,
     // If an expression is set, read from expression
     std::string hasExpr = getExpression(dimension, view_i);
     if ( !hasExpr.empty() ) {
-        T ret;
         if ( getValueFromExpression(currentTime, view, dimension, clamp, &ret) ) {
-            if (_valuesCache) {
-                DimTimeView key;
-                key.time = currentTime;
-                key.view = view_i;
-                key.dimension = dimension;
-                (*_valuesCache)[key] = ret;
+            if (isRenderClone) {
+                QMutexLocker k(&_evaluatedRenderValuesMutex);
+                _evaluatedRenderValues[key] = ret;
             }
             return ret;
         }
@@ -442,48 +493,43 @@ Knob<T>::getValueAtTime(TimeValue time,
     }
 
 
+    // On a render clone, read the value captured when the clone was created
+    T ret;
+    if ( getRenderValue(time, dimension, view, clamp, &ret) ) {
+        return ret;
+    }
+
     // Figure out the view to read
     ViewIdx view_i = checkIfViewExistsOrFallbackMainView(view);
 
-    boost::shared_ptr<Knob<T> > thisShared = boost::dynamic_pointer_cast<Knob<T> >(shared_from_this());
-
-    // Check if value is already in TLS when rendering
-    if (_valuesCache) {
-        DimTimeView key;
-        key.time = time;
-        key.view = view_i;
-        key.dimension = dimension;
-        typename ValuesCacheMap::const_iterator foundCached = _valuesCache->find(key);
-        if (foundCached != _valuesCache->end()) {
+    bool isRenderClone = !_renderValues.empty();
+    DimTimeView key;
+    key.time = time;
+    key.view = view_i;
+    key.dimension = dimension;
+    if (isRenderClone) {
+        QMutexLocker k(&_evaluatedRenderValuesMutex);
+        typename ValuesCacheMap::const_iterator foundCached = _evaluatedRenderValues.find(key);
+        if ( foundCached != _evaluatedRenderValues.end() ) {
             return foundCached->second;
         }
     }
 
     std::string hasExpr = getExpression(dimension, view);
     if ( !hasExpr.empty() ) {
-        T ret;
         if ( getValueFromExpression(time, /*view*/ ViewIdx(0), dimension, clamp, &ret) ) {
-            if (_valuesCache) {
-                DimTimeView key;
-                key.time = time;
-                key.view = view_i;
-                key.dimension = dimension;
-                (*_valuesCache)[key] = ret;
+            if (isRenderClone) {
+                QMutexLocker k(&_evaluatedRenderValuesMutex);
+                _evaluatedRenderValues[key] = ret;
             }
             return ret;
         }
     }
 
-
-
-    T ret;
     if ( getValueFromCurve(time, view_i, dimension, clamp, &ret) ) {
-        if (_valuesCache) {
-            DimTimeView key;
-            key.time = time;
-            key.view = view_i;
-            key.dimension = dimension;
-            (*_valuesCache)[key] = ret;
+        if (isRenderClone) {
+            QMutexLocker k(&_evaluatedRenderValuesMutex);
+            _evaluatedRenderValues[key] = ret;
         }
         return ret;
     }
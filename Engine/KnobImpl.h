@@ -116,6 +116,10 @@ Knob<T>::Knob(const KnobHolderPtr& holder,
               const std::string & name,
               int dimension)
     : KnobHelper(holder, name, dimension)
+    , _renderValues()
+    , _renderValuesTime(0)
+    , _evaluatedRenderValuesMutex()
+    , _evaluatedRenderValues()
     , _data(new Data(dimension))
 {
 
@@ -125,6 +129,10 @@ Knob<T>::Knob(const KnobHolderPtr& holder,
 template <typename T>
 Knob<T>::Knob(const KnobHolderPtr& holder, const KnobIPtr& mainKnob)
 : KnobHelper(holder, mainKnob)
+, _renderValues()
+, _renderValuesTime(0)
+, _evaluatedRenderValuesMutex()
+, _evaluatedRenderValues()
 , _data(boost::dynamic_pointer_cast<Knob<T> >(mainKnob)->_data)
 {
 
@@ -574,6 +582,7 @@ Knob<T>::evaluateExpression_pod(TimeValue time,
                 //Strings should always fall here
                 *value = 0.;
             }
+            Py_DECREF(ret); //< new ref
             return true;
         }
         case eExpressionLanguageExprTk: {
@@ -957,9 +966,6 @@ Knob<T>::populate()
 {
     KnobHelper::populate();
 
-    if (getHolder() && getHolder()->isRenderClone()) {
-        _valuesCache.reset(new ValuesCacheMap);
-    }
     int nDims = getNDimensions();
     _data->expressionResults.resize(nDims);
     for (int i = 0; i < nDims; ++i) {
@@ -970,8 +976,56 @@ Knob<T>::populate()
     }
     refreshCurveMinMax(ViewSetSpec::all(), DimSpec::all());
 
+    if (getHolder() && getHolder()->isRenderClone()) {
+        captureRenderValues();
+    }
 }
 
+template<typename T>
+void
+Knob<T>::captureRenderValues()
+{
+    // Called once when the render clone is created, before it is visible to other threads.
+    _renderValuesTime = getCurrentRenderTime();
+
+    int nDims = getNDimensions();
+    std::list<ViewIdx> views = getViewsList();
+    int nViews = 1;
+    for (std::list<ViewIdx>::const_iterator it = views.begin(); it != views.end(); ++it) {
+        nViews = std::max(nViews, (int)*it + 1);
+    }
+
+    _renderValues.resize(nViews * nDims);
+    for (int v = 0; v < nViews; ++v) {
+        ViewIdx view_i = checkIfViewExistsOrFallbackMainView(ViewIdx(v));
+        for (int d = 0; d < nDims; ++d) {
+            DimIdx dim(d);
+            RenderValue& slot = _renderValues[v * nDims + d];
+            slot.type = eRenderValueTypeEvaluated;
+
+            if ( !getExpression(dim, view_i).empty() ) {
+                continue;
+            }
+
+            CurvePtr curve = getAnimationCurve(view_i, dim);
+            if ( curve && (curve->getKeyFramesCount() > 0) ) {
+                // Only POD values can be interpolated from the curve without going through the knob
+                if ( isTypePOD() &&
+                     getValueFromCurve(_renderValuesTime, view_i, dim, true, &slot.value) &&
+                     getValueFromCurve(_renderValuesTime, view_i, dim, false, &slot.unclampedValue) ) {
+                    slot.type = eRenderValueTypeCurve;
+                    slot.curve = curve;
+                }
+                continue;
+            }
+
+            slot.type = eRenderValueTypeStatic;
+            slot.value = getValueInternal(_renderValuesTime, dim, view_i, true);
+            slot.unclampedValue = getValueInternal(_renderValuesTime, dim, view_i, false);
+        }
+    }
+} // captureRenderValues
+
 template<typename T>
 bool
 Knob<T>::isTypePOD() const
@@ -31,6 +31,7 @@
 
 #include <algorithm> // min, max
 #include <cassert>
+#include <list>
 #include <stdexcept>
 
 #include <QtCore/QDataStream>
@@ -112,13 +113,37 @@ public:
     // The knobs/dimension/view we depend on in the expression
     KnobDimViewKeySet dependencies;
 
+    // modifiedExpression compiled by compile(): evaluating it returns the expression function.
+    // Only accessed while holding the Python GIL.
+    PyObject* functionCode;
+
+    // The view argument passed to the expression function and the view name it was made from
+    PyObject* viewArg;
+    std::string viewArgName;
+
     KnobExprPython()
     : hasRet(false)
+    , dependencies()
+    , functionCode(0)
+    , viewArg(0)
+    , viewArgName()
     {
 
     }
 
-    virtual ~KnobExprPython() {}
+    virtual ~KnobExprPython();
+
+    /**
+     * @brief Compiles modifiedExpression, which is the path of the expression function from the main module.
+     * Throws an exception if it cannot be compiled. The GIL must be held.
+     **/
+    void compile();
+
+    /**
+     * @brief Calls the expression function with the given frame and view name, without parsing any script.
+     * Returns a new reference to the result or NULL if the call raised an error. The GIL must be held.
+     **/
+    PyObject* call(TimeValue time, const std::string& viewName);
 };
 
 struct EffectFunctionDependency;
@@ -131,11 +156,25 @@ public:
 
     typedef boost::shared_ptr<ExpressionData> ExpressionDataPtr;
 
-    typedef std::map<QThread*, ExpressionDataPtr> PerThreadDataMap;
+    struct PooledExpressionData
+    {
+        ExpressionDataPtr data;
 
-    // Protects data
+        // The value of nReleases when it was last released to the pool
+        U64 releaseIndex;
+    };
+
+    typedef std::list<PooledExpressionData> ExpressionDataPool;
+
+    // Protects pool and nReleases
     mutable QMutex lock;
-    PerThreadDataMap data;
+
+    // The compiled expressions which are not being evaluated, most recently used first.
+    // A compiled exprtk expression cannot be evaluated concurrently: a thread takes one from the pool for the
+    // duration of an evaluation and only compiles a new one if the pool is empty, hence there are only as many
+    // compiled expressions as concurrent evaluations, whatever the number of threads evaluating the expression.
+    ExpressionDataPool pool;
+    U64 nReleases;
 
 
     // knob values dependencies mapped against their variable name in the expression
@@ -145,6 +184,11 @@ public:
     std::map<std::string, EffectFunctionDependency> effectDependencies;
 
     KnobExprExprTk()
+    : lock()
+    , pool()
+    , nReleases(0)
+    , knobDependencies()
+    , effectDependencies()
     {
 
     }
@@ -152,6 +196,17 @@ public:
     virtual ~KnobExprExprTk() {}
 
     static ExpressionDataPtr createData();
+
+    /**
+     * @brief Takes a compiled expression out of the pool, or returns NULL if there is none available
+     **/
+    ExpressionDataPtr takeData();
+
+    /**
+     * @brief Returns a compiled expression to the pool once the evaluation is done.
+     * Expressions that were not used for a while are evicted from the pool.
+     **/
+    void releaseData(const ExpressionDataPtr& data);
 };
 
 /**
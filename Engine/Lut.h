@@ -31,6 +31,7 @@
 ///// This namespace is kept is synch with what can be found in openfx-io repository. It is used here in Natron for the viewer essentially.
 ///
 
+#include <cassert>
 #include <cmath>
 #include <map>
 #include <string>
@@ -230,6 +231,27 @@ public:
      */
     float fromColorSpaceUint16ToLinearFloatFast(unsigned short v) const;
 
+    /* @brief Returns the 256 entries table used by fromColorSpaceUint8ToLinearFloatFast(unsigned char).
+     * This is used by the vectorized conversion kernels of ImageConvertSIMD.
+     */
+    const float* getUint8ToLinearFloatTable() const
+    {
+        assert(init_);
+
+        return fromFunc_uint8_to_float;
+    }
+
+    /* @brief Returns the 0x10000 entries table used by toColorSpaceUint8xxFromLinearFloatFast(float),
+     * indexed by the 16 most significant bits of the float.
+     * This is used by the vectorized conversion kernels of ImageConvertSIMD.
+     */
+    const unsigned short* getHipartToUint8xxTable() const
+    {
+        assert(init_);
+
+        return toFunc_hipart_to_uint8xx;
+    }
+
 
     /////@TODO the following functions expects a float input buffer, one could extend it to cover all bitdepths.
 
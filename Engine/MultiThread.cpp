@@ -25,7 +25,6 @@
 
 #include "MultiThread.h"
 
-#include <map>
 #include <list>
 
 CLANG_DIAG_OFF(deprecated)
@@ -37,90 +36,90 @@ CLANG_DIAG_OFF(uninitialized)
 #include <QtCore/QCoreApplication>
 #include <QtCore/QDebug>
 #include <QtCore/QThread>
-#include <QtCore/QReadWriteLock>
-#include <QtCore/QThreadStorage>
-#include <QtConcurrentMap> // QtCore on Qt4, QtConcurrent on Qt5
+#include <QtCore/QAtomicInt>
+#include <QtCore/QVector>
 CLANG_DIAG_ON(deprecated-register)
 CLANG_DIAG_ON(uninitialized)
 
-GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
-// /usr/local/include/boost/bind/arg.hpp:37:9: warning: unused typedef 'boost_static_assert_typedef_37' [-Wunused-local-typedef]
-#include <boost/bind.hpp>
 #include <boost/algorithm/string/predicate.hpp>
-GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 
 #include "Engine/AppManager.h"
+#include "Engine/CancellationToken.h"
 #include "Engine/EffectInstance.h"
+#include "Engine/ForkJoinPool.h"
 #include "Engine/Node.h"
 #include "Engine/Settings.h"
 #include "Engine/TLSHolder.h"
 #include "Engine/EffectInstanceTLSData.h"
 #include "Engine/ThreadPool.h"
+#include "Engine/ThreadStorage.h"
 
-// An effect may not use more than this amount of threads
-#define NATRON_MULTI_THREAD_SUITE_MAX_NUM_CPU 4
+// An effect may not use more than this amount of threads. When the maximum number of threads per effect
+// is not set in the preferences, the threads are shared between the effects running concurrently
+// (see ForkJoinPool::getMaxThreadsPerFork) up to this limit.
+#define NATRON_MULTI_THREAD_SUITE_MAX_NUM_CPU 256
 
 
 NATRON_NAMESPACE_ENTER;
 
 struct MultiThreadThreadData
 {
-    // Index of the thread. This is a list so that the launchThread functino
+    // Index of the thread. This is a list so that the launchThread function
     // may be used recursively.
     std::list<unsigned int> indices;
 };
 
-typedef std::map<QThread*, MultiThreadThreadData> PerThreadMultiThreadDataMap;
+// The indices are local to each thread: getCurrentThreadIndex() is called by plug-ins very often
+// and does not need to take any lock.
+static ThreadStorage<MultiThreadThreadData> threadsData;
+
+// The maximum number of threads per effect set in the preferences, or 0 to share the threads between effects
+static QAtomicInt userMaxThreadsPerEffect;
 
 struct MultiThreadPrivate
 {
-
-    PerThreadMultiThreadDataMap threadsData;
-    mutable QReadWriteLock threadsDataMutex;
+    // All forks of the multi-thread suite are executed on the global thread pool
+    boost::scoped_ptr<ForkJoinPool> forkJoinPool;
 
     MultiThreadPrivate()
-    : threadsData()
-    , threadsDataMutex()
+    : forkJoinPool( new ForkJoinPool( QThreadPool::globalInstance() ) )
     {
 
     }
+};
 
-    void pushThreadIndex(QThread* thread, unsigned int index)
-    {
-        QWriteLocker k(&threadsDataMutex);
-        MultiThreadThreadData& data = threadsData[thread];
-        data.indices.push_back(index);
-    }
-    void popThreadIndex(QThread* thread)
-    {
-        QWriteLocker k(&threadsDataMutex);
-        PerThreadMultiThreadDataMap::iterator foundThread = threadsData.find(thread);
-        assert(foundThread != threadsData.end());
-        if (foundThread != threadsData.end()) {
-            assert(!foundThread->second.indices.empty());
-            foundThread->second.indices.pop_back();
-            if (foundThread->second.indices.empty()) {
-                threadsData.erase(foundThread);
-            }
-        }
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+static void
+pushThreadIndex(unsigned int index)
+{
+    threadsData.localData().indices.push_back(index);
+}
+
+static void
+popThreadIndex()
+{
+    MultiThreadThreadData& data = threadsData.localData();
+    assert( !data.indices.empty() );
+    if ( !data.indices.empty() ) {
+        data.indices.pop_back();
     }
+}
 
-    bool getThreadIndex(QThread* thread, unsigned int* index) const
-    {
-        QReadLocker k(&threadsDataMutex);
-        PerThreadMultiThreadDataMap::const_iterator foundThread = threadsData.find(thread);
-        if (foundThread == threadsData.end()) {
-            return false;
-        }
-        if (foundThread->second.indices.empty()) {
-            return false;
-        }
-        *index = foundThread->second.indices.back();
-        return true;
+static bool
+getThreadIndex(unsigned int* index)
+{
+    if ( !threadsData.hasLocalData() ) {
+        return false;
     }
-};
+    const MultiThreadThreadData& data = threadsData.localData();
+    if ( data.indices.empty() ) {
+        return false;
+    }
+    *index = data.indices.back();
 
-NATRON_NAMESPACE_ANONYMOUS_ENTER
+    return true;
+}
 
 static void copyOFXRenderTLS(const EffectInstancePtr& effect,
                              QThread* spawnerThread,
@@ -153,8 +152,7 @@ static void copyOFXRenderTLS(const EffectInstancePtr& effect,
 // if we re-use the same thread.
 
 static ActionRetCodeEnum
-threadFunctionWrapper(MultiThreadPrivate* imp,
-                      MultiThread::ThreadFunctor func,
+threadFunctionWrapper(MultiThread::ThreadFunctor func,
                       unsigned int threadIndex,
                       unsigned int threadMax,
                       QThread* spawnerThread,
@@ -165,7 +163,7 @@ threadFunctionWrapper(MultiThreadPrivate* imp,
 
     QThread* spawnedThread = QThread::currentThread();
 
-    imp->pushThreadIndex(spawnedThread, threadIndex);
+    pushThreadIndex(threadIndex);
 
     // If we launched the functor in a new thread,
     // this thread doesn't have any TLS set.
@@ -185,7 +183,7 @@ threadFunctionWrapper(MultiThreadPrivate* imp,
     }
 
     // Reset back the index otherwise it could mess up the indices if the same thread is re-used
-    imp->popThreadIndex(spawnedThread);
+    popThreadIndex();
 
     return ret;
 } // threadFunctionWrapper
@@ -195,8 +193,7 @@ class NonThreadPoolThread
 , public AbortableThread
 {
 public:
-    NonThreadPoolThread(MultiThreadPrivate* imp,
-                        MultiThread::ThreadFunctor func,
+    NonThreadPoolThread(MultiThread::ThreadFunctor func,
                         unsigned int threadIndex,
                         unsigned int threadMax,
                         void *customArg,
@@ -205,7 +202,6 @@ public:
                         ActionRetCodeEnum *stat)
     : QThread()
     , AbortableThread(this)
-    , _imp(imp)
     , _func(func)
     , _threadIndex(threadIndex)
     , _threadMax(threadMax)
@@ -223,7 +219,7 @@ private:
     {
         assert(_threadIndex < _threadMax);
 
-        _imp->pushThreadIndex(this, _threadIndex);
+        pushThreadIndex(_threadIndex);
 
         // If we launched the functor in a new thread,
         // this thread doesn't have any TLS set.
@@ -244,11 +240,10 @@ private:
         }
 
         // Reset back the index otherwise it could mess up the indexes if the same thread is re-used
-        _imp->popThreadIndex(this);
+        popThreadIndex();
     }
 
 private:
-    MultiThreadPrivate* _imp;
     MultiThread::ThreadFunctor *_func;
     unsigned int _threadIndex;
     unsigned int _threadMax;
@@ -258,6 +253,48 @@ private:
     ActionRetCodeEnum *_stat;
 };
 
+// Executes each index of a launchThreads call in the fork-join pool
+class MultiThreadForkJoinTask
+    : public ForkJoinTask
+{
+public:
+
+    MultiThreadForkJoinTask(MultiThread::ThreadFunctor func,
+                            void *customArg,
+                            QThread* spawnerThread,
+                            const EffectInstancePtr& effect,
+                            const CancellationTokenPtr& cancellationToken)
+    : ForkJoinTask()
+    , _func(func)
+    , _customArg(customArg)
+    , _spawnerThread(spawnerThread)
+    , _effect(effect)
+    , _cancellationToken(cancellationToken)
+    {
+    }
+
+    virtual ~MultiThreadForkJoinTask()
+    {
+    }
+
+    virtual ActionRetCodeEnum run(unsigned int index,
+                                  unsigned int count) OVERRIDE FINAL
+    {
+        // Indices that were not started before the render got aborted are skipped
+        if ( _cancellationToken && _cancellationToken->isCancelled() ) {
+            return eActionStatusAborted;
+        }
+        return threadFunctionWrapper(_func, index, count, _spawnerThread, _effect, _customArg);
+    }
+
+private:
+    MultiThread::ThreadFunctor *_func;
+    void *_customArg;
+    QThread* _spawnerThread;
+    EffectInstancePtr _effect;
+    CancellationTokenPtr _cancellationToken;
+};
+
 NATRON_NAMESPACE_ANONYMOUS_EXIT
 
 
@@ -275,13 +312,11 @@ MultiThread::~MultiThread()
 
 struct MultiThreadFuturePrivate
 {
-    boost::scoped_ptr<QFuture<ActionRetCodeEnum> > future;
-    std::vector<unsigned int> threadIndices;
+    ForkJoinPtr fork;
     ActionRetCodeEnum status;
 
     MultiThreadFuturePrivate(ActionRetCodeEnum initialStatus)
-    : future()
-    , threadIndices()
+    : fork()
     , status(initialStatus)
     {
 
@@ -297,17 +332,12 @@ MultiThreadFuture::MultiThreadFuture(ActionRetCodeEnum initialStatus)
 ActionRetCodeEnum
 MultiThreadFuture::waitForFinished()
 {
-    if (_imp->future) {
-        _imp->future->waitForFinished();
-
-        if (isFailureRetCode(_imp->status)) {
-            return _imp->status;
-        }
-        for (QFuture<ActionRetCodeEnum>::const_iterator it = _imp->future->begin(); it != _imp->future->end(); ++it) {
-            ActionRetCodeEnum stat = *it;
-            if (isFailureRetCode(stat)) {
-                return stat;
-            }
+    if (_imp->fork) {
+        // The calling thread executes the indices that were not started yet
+        ActionRetCodeEnum stat = _imp->fork->join();
+        _imp->fork.reset();
+        if ( isFailureRetCode(stat) ) {
+            _imp->status = stat;
         }
     }
     return _imp->status;
@@ -327,6 +357,11 @@ MultiThread::launchThreadsInternal(MultiThread::ThreadFunctor func, unsigned int
         ret->_imp->status = eActionStatusFailed;
         return ret;
     }
+    if (nThreads == 0) {
+        // Nothing to do, e.g. an OpenFX plug-in called multiThread() with 0 threads
+        ret->_imp->status = eActionStatusOK;
+        return ret;
+    }
 
     unsigned int maxConcurrentThread = MultiThread::getNCPUsAvailable();
 
@@ -335,11 +370,21 @@ MultiThread::launchThreadsInternal(MultiThread::ThreadFunctor func, unsigned int
     // "nThreads can be more than the value returned by multiThreadNumCPUs, however
     // the threads will be limitted to the number of CPUs returned by multiThreadNumCPUs."
 
+    // The threads stop picking up indices as soon as the render of the effect is aborted
+    CancellationTokenPtr cancellationToken;
+    if (effect) {
+        cancellationToken = effect->getCancellationToken();
+    }
+
     if ( (nThreads == 1) || (maxConcurrentThread <= 1) ) {
         // If user wants multiple calls but we only have 1 thread, call the function sequentially
         // multiple times.
         try {
             for (unsigned int i = 0; i < nThreads; ++i) {
+                if ( cancellationToken && cancellationToken->isCancelled() ) {
+                    ret->_imp->status = eActionStatusAborted;
+                    return ret;
+                }
                 ActionRetCodeEnum stat = func(i, nThreads, customArg);
                 if (isFailureRetCode(stat)) {
                     ret->_imp->status = stat;
@@ -375,36 +420,13 @@ MultiThread::launchThreadsInternal(MultiThread::ThreadFunctor func, unsigned int
 
     if (useThreadPool) {
 
-        ret->_imp->threadIndices.resize(nThreads);
-        for (unsigned int i = 0; i < nThreads; ++i) {
-            ret->_imp->threadIndices[i] = i;
-        }
-
-        // If the current thread is a thread-pool thread, make it also do an iteration instead
-        // of waiting for other threads
-        bool isThreadPoolThread = isRunningInThreadPoolThread();
-        if (isThreadPoolThread) {
-            ret->_imp->threadIndices.pop_back();
-        }
-
         // DON'T set the maximum thread count: this is a global application setting, and see the documentation excerpt above
         // QThreadPool::globalInstance()->setMaxThreadCount(nThreads);
 
-        ret->_imp->future.reset(new QFuture<ActionRetCodeEnum>);
-        *ret->_imp->future = QtConcurrent::mapped( ret->_imp->threadIndices, boost::bind(threadFunctionWrapper, imp, func, _1, nThreads, spawnerThread, effect, customArg) );
-
-        // Do one iteration in this thread
-        if (isThreadPoolThread) {
-            ActionRetCodeEnum stat = threadFunctionWrapper(imp, func, nThreads - 1, nThreads, spawnerThread, effect, customArg);
-            if (isFailureRetCode(stat)) {
-                // This thread failed, wait for other threads and exit
-                ret->_imp->status = stat;
-                ret->_imp->future->waitForFinished();
-                ret->_imp->future.reset();
-                return ret;
-            }
-        }
-
+        // Threads of the pool that are available start executing indices right away, the calling thread
+        // executes the indices left when waiting on the future.
+        ForkJoinTaskPtr task( new MultiThreadForkJoinTask(func, customArg, spawnerThread, effect, cancellationToken) );
+        ret->_imp->fork = imp->forkJoinPool->fork(task, nThreads, maxConcurrentThread);
 
     } else { // !useThreadPool
 
@@ -414,7 +436,7 @@ MultiThread::launchThreadsInternal(MultiThread::ThreadFunctor func, unsigned int
             // at most maxConcurrentThread should be running at the same time
             QVector<NonThreadPoolThread*> threads(nThreads);
             for (unsigned int i = 0; i < nThreads; ++i) {
-                threads[i] = new NonThreadPoolThread(imp, func, i, nThreads, customArg, spawnerThread, effect, &status[i]);
+                threads[i] = new NonThreadPoolThread(func, i, nThreads, customArg, spawnerThread, effect, &status[i]);
             }
             unsigned int i = 0; // index of next thread to launch
             unsigned int running = 0; // number of running threads
@@ -486,20 +508,33 @@ MultiThread::getNCPUsAvailable()
     assert(maxThreadsCount >= 0);
 
     int ret = std::max(1, maxThreadsCount - activeThreadsCount);
+
+    // Do not let a single effect take all threads while other effects are rendering
+    ret = std::min( ret, (int)getMaxThreadsPerEffect() );
     return ret;
 } // getNCPUsAvailable
 
-ActionRetCodeEnum
-MultiThread::getCurrentThreadIndex(unsigned int *threadIndex)
+unsigned int
+MultiThread::getMaxThreadsPerEffect()
 {
-    QThread* thisThread = QThread::currentThread();
-    if (!thisThread) {
-        return eActionStatusFailed;
+    int userMaxThreads = (int)userMaxThreadsPerEffect;
+    const MultiThread* handler = appPTR ? appPTR->getMultiThreadHandler() : 0;
+    if (!handler) {
+        return userMaxThreads > 0 ? (unsigned int)userMaxThreads : NATRON_MULTI_THREAD_SUITE_MAX_NUM_CPU;
     }
+    return handler->_imp->forkJoinPool->getMaxThreadsPerFork(NATRON_MULTI_THREAD_SUITE_MAX_NUM_CPU, userMaxThreads);
+}
 
-    // Get the global multi-thread handler data
-    MultiThreadPrivate* imp = appPTR->getMultiThreadHandler()->_imp.get();
-    if (!imp->getThreadIndex(thisThread, threadIndex)) {
+void
+MultiThread::setMaxThreadsPerEffect(int maxThreads)
+{
+    userMaxThreadsPerEffect.fetchAndStoreOrdered( std::max(0, maxThreads) );
+}
+
+ActionRetCodeEnum
+MultiThread::getCurrentThreadIndex(unsigned int *threadIndex)
+{
+    if ( !getThreadIndex(threadIndex) ) {
         return eActionStatusFailed;
     }
     return eActionStatusOK;
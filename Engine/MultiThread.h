@@ -96,7 +96,8 @@ public:
      *
      * @param customArg The arguments to passed to the function
      *
-     * This function cannot be called recursively.
+     * This function may be called recursively: if all threads are busy, the calling thread executes
+     * the function for all indices.
      * Note that the thread indexes are from 0 to nThreads - 1.
      * http://openfx.sourceforge.net/Documentation/1.3/ofxProgrammingReference.html#OfxMultiThreadSuiteV1_multiThread
      */
@@ -104,6 +105,7 @@ public:
 
     /**
      * @brief Same as launchThreadsBlocking except that this functions returns a future object, on which
+     * waitForFinished() must be called. The calling thread executes the indices that were not started yet when waiting.
      **/
     static MultiThreadFuturePtr launchThreadsNonBlocking(ThreadFunctor func, unsigned int nThreads, void *customArg, const EffectInstancePtr& effect);
 
@@ -120,6 +122,18 @@ public:
      **/
     static unsigned int getNCPUsAvailable();
 
+    /**
+     * @brief Returns the maximum number of threads a single effect may use. If the maximum was not set with
+     * setMaxThreadsPerEffect(), the threads are shared between the effects currently launching threads.
+     **/
+    static unsigned int getMaxThreadsPerEffect();
+
+    /**
+     * @brief Set the maximum number of threads a single effect may use, or 0 to share the threads between
+     * the effects rendering concurrently.
+     **/
+    static void setMaxThreadsPerEffect(int maxThreads);
+
     /**
      * @brief Function which indicates the index of the current thread.
      * This function returns the thread index, which is the same as the threadIndex argument passed to the ThreadFunctor.
@@ -189,6 +189,13 @@ Node::isMultiThreadingSupportEnabledForPlugin() const
     return plugin ? plugin->isMultiThreadingEnabled() : true;
 }
 
+bool
+Node::isHostTilingEnabledForPlugin() const
+{
+    PluginPtr plugin = getPlugin();
+    return plugin ? plugin->isHostTilingEnabled() : false;
+}
+
 bool
 Node::isNodeCreated() const
 {
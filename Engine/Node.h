@@ -454,6 +454,8 @@ public:
 
     bool isMultiThreadingSupportEnabledForPlugin() const;
 
+    bool isHostTilingEnabledForPlugin() const;
+
 
     /**
      * @brief Used in the implementation of EffectInstance::onMetadataChanged_recursive so we know if the metadata changed or not.
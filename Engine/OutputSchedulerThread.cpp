@@ -59,7 +59,12 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 
 #include "Engine/AppManager.h"
 #include "Engine/AppInstance.h"
+#include "Engine/Cache.h"
+#include "Engine/CancellationToken.h"
+#include "Engine/ConcurrentFramesController.h"
 #include "Engine/EffectInstance.h"
+#include "Engine/EffectInstanceActionResults.h"
+#include "Engine/FramePipeline.h"
 #include "Engine/FrameViewRequest.h"
 #include "Engine/ImageCacheKey.h"
 #include "Engine/Image.h"
@@ -87,12 +92,23 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #ifdef DEBUG
 //#define TRACE_SCHEDULER
 //#define TRACE_CURRENT_FRAME_SCHEDULER
+//#define TRACE_CONCURRENT_FRAMES
 #endif
 
 #define NATRON_FPS_REFRESH_RATE_SECONDS 1.5
 
 #define NATRON_SCHEDULER_ABORT_AFTER_X_UNSUCCESSFUL_ITERATIONS 5000
 
+// Number of frames each stage of the pipeline of a Writer processes concurrently.
+// The render starts by computing a single frame at once since it is already rendered by all threads,
+// the number of frames computed concurrently is then adapted by a ConcurrentFramesController.
+#define NATRON_WRITER_PIPELINE_MAX_DECODING_FRAMES 2
+#define NATRON_WRITER_PIPELINE_INITIAL_COMPUTING_FRAMES 1
+#define NATRON_WRITER_PIPELINE_MAX_ENCODING_FRAMES 2
+
+// Number of frames waiting in front of each stage of the pipeline of a Writer
+#define NATRON_WRITER_PIPELINE_QUEUE_SIZE 2
+
 NATRON_NAMESPACE_ENTER;
 
 
@@ -195,7 +211,7 @@ struct OutputSchedulerThreadPrivate
     QWaitCondition allRenderThreadsInactiveCond; // wait condition to make sure all render threads are asleep
 
 
-    // Protects lastFrameRequested & expectedFrameToRender & schedulerRenderDirection
+    // Protects lastFrameRequested & expectedFrameToRender & schedulerRenderDirection & pipelinedRender
     QMutex lastFrameRequestedMutex;
 
     // The last frame requested to render
@@ -207,6 +223,9 @@ struct OutputSchedulerThreadPrivate
     // The direction of the scheduler
     RenderDirectionEnum schedulerRenderDirection;
 
+    // True if the frames of the current render are started by startPipelinedRender() rather than by startTasks()
+    bool pipelinedRender;
+
     NodeWPtr outputEffect; //< The effect used as output device
 
     RenderEngine* engine;
@@ -255,6 +274,7 @@ struct OutputSchedulerThreadPrivate
         , lastFrameRequested(0)
         , expectedFrameToRender(0)
         , schedulerRenderDirection(eRenderDirectionForward)
+        , pipelinedRender(false)
         , outputEffect(effect)
         , engine(engine)
         , bufferedOutputMutex()
@@ -501,42 +521,56 @@ OutputSchedulerThreadPrivate::getNearestInSequence(RenderDirectionEnum direction
 }
 
 
-void
-OutputSchedulerThread::startTasksFromLastStartedFrame()
+bool
+OutputSchedulerThread::pickNextFrameToRender(TimeValue* frame)
 {
+    OutputSchedulerThreadStartArgsPtr args = _imp->runArgs.lock();
 
-    TimeValue frame;
-    bool canContinue;
+    PlaybackModeEnum pMode = _imp->engine->getPlaybackMode();
 
-    {
-        OutputSchedulerThreadStartArgsPtr args = _imp->runArgs.lock();
+    QMutexLocker l(&_imp->lastFrameRequestedMutex);
+    *frame = _imp->lastFrameRequested;
 
-        PlaybackModeEnum pMode = _imp->engine->getPlaybackMode();
+    if ( (args->firstFrame == args->lastFrame) && (*frame == args->firstFrame) ) {
+        return false;
+    }
 
-        {
-            QMutexLocker l(&_imp->lastFrameRequestedMutex);
-            frame = _imp->lastFrameRequested;
+    RenderDirectionEnum newDirection = args->direction;
+    ///If startingTime is already taken into account in the framesToRender, push new frames from the last one in the stack instead
+    bool canContinue = OutputSchedulerThreadPrivate::getNextFrameInSequence(pMode, args->direction, *frame,
+                                                                            args->firstFrame, args->lastFrame, args->frameStep, frame, &newDirection);
+    if (newDirection != args->direction) {
+        args->direction = newDirection;
+    }
+    _imp->lastFrameRequested = *frame;
 
-            if ( (args->firstFrame == args->lastFrame) && (frame == args->firstFrame) ) {
-                return;
-            }
+    return canContinue;
+} // pickNextFrameToRender
 
-            RenderDirectionEnum newDirection = args->direction;
-            ///If startingTime is already taken into account in the framesToRender, push new frames from the last one in the stack instead
-            canContinue = OutputSchedulerThreadPrivate::getNextFrameInSequence(pMode, args->direction, frame,
-                                                                               args->firstFrame, args->lastFrame, args->frameStep, &frame, &newDirection);
-            if (newDirection != args->direction) {
-                args->direction = newDirection;
-            }
-            _imp->lastFrameRequested = frame;
+void
+OutputSchedulerThread::startTasksFromLastStartedFrame()
+{
+    {
+        // The pipeline picks the frames to render by itself
+        QMutexLocker l(&_imp->lastFrameRequestedMutex);
+        if (_imp->pipelinedRender) {
+            return;
         }
     }
 
-    if (canContinue) {
+    TimeValue frame;
+    if ( pickNextFrameToRender(&frame) ) {
         startTasks(frame);
     }
 } // startTasksFromLastStartedFrame
 
+void
+OutputSchedulerThread::startRenderThreadTask(const boost::shared_ptr<RenderThreadTask>& task)
+{
+    QMutexLocker k(&_imp->renderThreadsMutex);
+    _imp->startRunnable(task);
+}
+
 void
 OutputSchedulerThread::startTasks(TimeValue startingFrame)
 {
@@ -666,8 +700,20 @@ OutputSchedulerThread::startRender()
         QMutexLocker k(&_imp->lastFrameRequestedMutex);
         _imp->expectedFrameToRender = startingFrame;
         _imp->schedulerRenderDirection = direction;
+
+        // Set the flag before the pipeline starts, since a frame rendered by the pipeline must not start other tasks
+        _imp->lastFrameRequested = startingFrame;
+        _imp->pipelinedRender = firstFrame != lastFrame;
     }
 
+    if ( (firstFrame != lastFrame) && startPipelinedRender(startingFrame) ) {
+        return;
+    }
+
+    {
+        QMutexLocker k(&_imp->lastFrameRequestedMutex);
+        _imp->pipelinedRender = false;
+    }
     startTasks(startingFrame);
 
 
@@ -1635,6 +1681,106 @@ DefaultScheduler::~DefaultScheduler()
 {
 }
 
+static void
+runBeforeFrameRenderCallback(TimeValue frame,
+                             const NodePtr& outputNode,
+                             OutputSchedulerThread* scheduler)
+{
+    std::string cb = outputNode->getEffectInstance()->getBeforeFrameRenderCallback();
+    if ( cb.empty() ) {
+        return;
+    }
+    std::vector<std::string> args;
+    std::string error;
+    try {
+        NATRON_PYTHON_NAMESPACE::getFunctionArguments(cb, &error, &args);
+    } catch (const std::exception& e) {
+        outputNode->getApp()->appendToScriptEditor( std::string("Failed to run beforeFrameRendered callback: ")
+                                               + e.what() );
+
+        return;
+    }
+
+    if ( !error.empty() ) {
+        outputNode->getApp()->appendToScriptEditor("Failed to run before frame render callback: " + error);
+
+        return;
+    }
+
+    std::string signatureError;
+    signatureError.append("The before frame render callback supports the following signature(s):\n");
+    signatureError.append("- callback(frame, thisNode, app)");
+    if (args.size() != 3) {
+        outputNode->getApp()->appendToScriptEditor("Failed to run before frame render callback: " + signatureError);
+
+        return;
+    }
+
+    if ( (args[0] != "frame") || (args[1] != "thisNode") || (args[2] != "app") ) {
+        outputNode->getApp()->appendToScriptEditor("Failed to run before frame render callback: " + signatureError);
+
+        return;
+    }
+
+    std::stringstream ss;
+    std::string appStr = outputNode->getApp()->getAppIDString();
+    std::string outputNodeName = appStr + "." + outputNode->getFullyQualifiedName();
+    ss << cb << "(" << frame << ", " << outputNodeName << ", " << appStr << ")";
+    std::string script = ss.str();
+    try {
+        scheduler->runCallbackWithVariables( QString::fromUtf8( script.c_str() ) );
+    } catch (const std::exception &e) {
+        scheduler->notifyRenderFailure( eActionStatusFailed, e.what() );
+
+        return;
+    }
+} // runBeforeFrameRenderCallback
+
+static NodePtr
+getNodeToRenderOnDisk(const NodePtr& outputNode)
+{
+    // If the output is a Write node, actually write is the internal write node encoder
+    WriteNodePtr isWrite = toWriteNode(outputNode->getEffectInstance());
+    if (isWrite) {
+        NodePtr embeddedWriter = isWrite->getEmbeddedWriter();
+        if (embeddedWriter) {
+            return embeddedWriter;
+        }
+    }
+
+    return outputNode;
+}
+
+static TreeRender::CtorArgsPtr
+createRenderOnDiskArgs(const NodePtr& node,
+                       TimeValue time,
+                       ViewIdx view,
+                       const RenderStatsPtr& stats)
+{
+    TreeRender::CtorArgsPtr args(new TreeRender::CtorArgs);
+    args->treeRootEffect = node->getEffectInstance();
+    args->time = time;
+    args->view = view;
+
+    // Render default layer produced
+    args->plane = 0;
+
+    // Render by default on disk is always using a mipmap level of 0 but using the proxy scale of the project
+    args->mipMapLevel = 0;
+
+#pragma message WARN("Todo: set proxy scale here")
+    args->proxyScale = RenderScale(1.);
+
+    // Render the RoD
+    args->canonicalRoI = 0;
+    args->stats = stats;
+    args->draftMode = false;
+    args->playback = true;
+    args->byPassCache = false;
+
+    return args;
+} // createRenderOnDiskArgs
+
 class DefaultRenderFrameRunnable
     : public RenderThreadTask
 {
@@ -1673,62 +1819,6 @@ public:
         }
     }
 
-private:
-
-    void runBeforeFrameRenderCallback(TimeValue frame, const NodePtr& outputNode)
-    {
-        std::string cb = outputNode->getEffectInstance()->getBeforeFrameRenderCallback();
-        if ( cb.empty() ) {
-            return;
-        }
-        std::vector<std::string> args;
-        std::string error;
-        try {
-            NATRON_PYTHON_NAMESPACE::getFunctionArguments(cb, &error, &args);
-        } catch (const std::exception& e) {
-            outputNode->getApp()->appendToScriptEditor( std::string("Failed to run beforeFrameRendered callback: ")
-                                                   + e.what() );
-
-            return;
-        }
-
-        if ( !error.empty() ) {
-            outputNode->getApp()->appendToScriptEditor("Failed to run before frame render callback: " + error);
-
-            return;
-        }
-
-        std::string signatureError;
-        signatureError.append("The before frame render callback supports the following signature(s):\n");
-        signatureError.append("- callback(frame, thisNode, app)");
-        if (args.size() != 3) {
-            outputNode->getApp()->appendToScriptEditor("Failed to run before frame render callback: " + signatureError);
-
-            return;
-        }
-
-        if ( (args[0] != "frame") || (args[1] != "thisNode") || (args[2] != "app") ) {
-            outputNode->getApp()->appendToScriptEditor("Failed to run before frame render callback: " + signatureError);
-
-            return;
-        }
-
-        std::stringstream ss;
-        std::string appStr = outputNode->getApp()->getAppIDString();
-        std::string outputNodeName = appStr + "." + outputNode->getFullyQualifiedName();
-        ss << cb << "(" << frame << ", " << outputNodeName << ", " << appStr << ")";
-        std::string script = ss.str();
-        try {
-            _imp->scheduler->runCallbackWithVariables( QString::fromUtf8( script.c_str() ) );
-        } catch (const std::exception &e) {
-            _imp->scheduler->notifyRenderFailure( eActionStatusFailed, e.what() );
-
-            return;
-        }
-
-
-    }
-
 protected:
 
     ActionRetCodeEnum renderFrameInternal(NodePtr outputNode,
@@ -1741,39 +1831,10 @@ protected:
             return eActionStatusFailed;
         }
 
-        // If the output is a Write node, actually write is the internal write node encoder
-        {
-            WriteNodePtr isWrite = toWriteNode(outputNode->getEffectInstance());
-            if (isWrite) {
-                NodePtr embeddedWriter = isWrite->getEmbeddedWriter();
-                if (embeddedWriter) {
-                    outputNode = embeddedWriter;
-                }
-            }
-        }
+        outputNode = getNodeToRenderOnDisk(outputNode);
         assert(outputNode);
 
-
-        TreeRender::CtorArgsPtr args(new TreeRender::CtorArgs);
-        args->treeRootEffect = outputNode->getEffectInstance();
-        args->time = time;
-        args->view = view;
-
-        // Render default layer produced
-        args->plane = 0;
-
-        // Render by default on disk is always using a mipmap level of 0 but using the proxy scale of the project
-        args->mipMapLevel = 0;
-
-#pragma message WARN("Todo: set proxy scale here")
-        args->proxyScale = RenderScale(1.);
-
-        // Render the RoD
-        args->canonicalRoI = 0;
-        args->stats = stats;
-        args->draftMode = false;
-        args->playback = true;
-        args->byPassCache = false;
+        TreeRender::CtorArgsPtr args = createRenderOnDiskArgs(outputNode, time, view, stats);
 
         ActionRetCodeEnum retCode = eActionStatusFailed;
         TreeRenderPtr render = TreeRender::create(args);
@@ -1807,7 +1868,7 @@ private:
         assert(outputNode);
 
         // Notify we start rendering a frame to Python
-        runBeforeFrameRenderCallback(time, outputNode);
+        runBeforeFrameRenderCallback(time, outputNode, _imp->scheduler);
 
         // Even if enableRenderStats is false, we at least profile the time spent rendering the frame when rendering with a Write node.
         // Though we don't enable render stats for sequential renders (e.g: WriteFFMPEG) since this is 1 file.
@@ -1853,6 +1914,489 @@ DefaultScheduler::createRunnable(TimeValue frame,
     return new DefaultRenderFrameRunnable(getOutputNode(), this, frame, useRenderStarts, viewsToRender);
 }
 
+/**
+ * @brief A frame going through the DefaultSchedulerPipeline
+ **/
+class DefaultSchedulerFrame
+    : public FramePipelineItem
+{
+public:
+
+    TimeValue time;
+    RenderStatsPtr stats;
+
+    // Parent of the tokens of all the renders launched for this frame, so that they can be aborted at once
+    CancellationTokenPtr cancellationToken;
+
+    DefaultSchedulerFrame(TimeValue time,
+                          const CancellationTokenPtr& pipelineCancellationToken)
+        : FramePipelineItem()
+        , time(time)
+        , stats()
+        , cancellationToken( CancellationToken::create(pipelineCancellationToken) )
+    {
+    }
+
+    virtual ~DefaultSchedulerFrame()
+    {
+    }
+};
+
+typedef boost::shared_ptr<DefaultSchedulerFrame> DefaultSchedulerFramePtr;
+
+/**
+ * @brief Renders the frames of a Writer in 3 stages: the source frames are decoded, then the tree upstream of the
+ * Writer is computed and finally the Writer encodes the frame. Each stage only renders a node of the tree as root
+ * and the following stage reads its result from the cache, hence the reading of the sources of the next frame
+ * and the writing of the previous frame to disk overlap with the computation of the current frame.
+ **/
+class DefaultSchedulerPipeline
+    : public FramePipeline
+{
+public:
+
+    enum StageEnum
+    {
+        eStageDecode = 0,
+        eStageCompute,
+        eStageEncode
+    };
+
+private:
+
+    DefaultScheduler* _scheduler;
+    NodeWPtr _outputNode, _writer, _writerInput;
+    std::list<NodeWPtr> _readers;
+    std::vector<ViewIdx> _viewsToRender;
+    bool _enableRenderStats;
+
+    // Only accessed from pullNextItem()
+    TimeValue _startingFrame;
+    bool _startingFramePulled;
+
+    // Tunes the number of frames computed concurrently
+    ConcurrentFramesController _concurrentFrames;
+
+    // Parent of the tokens of all frames: cancelled when the whole render is aborted
+    CancellationTokenPtr _cancellationToken;
+
+    DefaultSchedulerPipeline(DefaultScheduler* scheduler,
+                             const NodePtr& outputNode,
+                             const NodePtr& writer,
+                             const NodePtr& writerInput,
+                             const std::list<NodePtr>& readers,
+                             TimeValue startingFrame,
+                             const std::vector<ViewIdx>& viewsToRender,
+                             bool enableRenderStats)
+        : FramePipeline(QThreadPool::globalInstance(), true /*preserveOrder*/)
+        , _scheduler(scheduler)
+        , _outputNode(outputNode)
+        , _writer(writer)
+        , _writerInput(writerInput)
+        , _readers()
+        , _viewsToRender(viewsToRender)
+        , _enableRenderStats(enableRenderStats)
+        , _startingFrame(startingFrame)
+        , _startingFramePulled(false)
+        , _concurrentFrames( NATRON_WRITER_PIPELINE_INITIAL_COMPUTING_FRAMES, 1, QThreadPool::globalInstance()->maxThreadCount() )
+        , _cancellationToken( CancellationToken::create() )
+    {
+        for (std::list<NodePtr>::const_iterator it = readers.begin(); it != readers.end(); ++it) {
+            _readers.push_back(*it);
+        }
+    }
+
+public:
+
+    static boost::shared_ptr<DefaultSchedulerPipeline> create(DefaultScheduler* scheduler,
+                                                              const NodePtr& outputNode,
+                                                              const NodePtr& writer,
+                                                              const NodePtr& writerInput,
+                                                              const std::list<NodePtr>& readers,
+                                                              TimeValue startingFrame,
+                                                              const std::vector<ViewIdx>& viewsToRender,
+                                                              bool enableRenderStats,
+                                                              int maxDecodingFrames,
+                                                              int maxEncodingFrames);
+
+    virtual ~DefaultSchedulerPipeline()
+    {
+    }
+
+    ActionRetCodeEnum processFrame(StageEnum stage, const DefaultSchedulerFramePtr& frame);
+
+    /**
+     * @brief Stops pulling frames and aborts the renders of all frames in the pipeline
+     **/
+    void abortAllFrames()
+    {
+        abort();
+        _cancellationToken->cancel();
+    }
+
+protected:
+
+    virtual FramePipelineItemPtr pullNextItem() OVERRIDE FINAL;
+
+    virtual void onItemFailed(const FramePipelineItemPtr& item, int stageIndex, ActionRetCodeEnum stat) OVERRIDE FINAL;
+
+    virtual void launchJob(const FramePipelineJobPtr& job) OVERRIDE FINAL;
+
+private:
+
+    ActionRetCodeEnum launchFrameRender(const DefaultSchedulerFramePtr& frame, const TreeRender::CtorArgsPtr& args);
+};
+
+/**
+ * @brief Returns in roi the region of the input of the Writer that the Writer reads to render its region of definition
+ **/
+static ActionRetCodeEnum
+getWriterInputRoI(const NodePtr& writer,
+                  TimeValue time,
+                  ViewIdx view,
+                  RectD* roi)
+{
+    EffectInstancePtr writerEffect = writer->getEffectInstance();
+    GetRegionOfDefinitionResultsPtr rodResults;
+    ActionRetCodeEnum stat = writerEffect->getRegionOfDefinition_public(time, RenderScale(1.), view, &rodResults);
+    if ( isFailureRetCode(stat) ) {
+        return stat;
+    }
+
+    RoIMap inputsRoI;
+    stat = writerEffect->getRegionsOfInterest_public(time, RenderScale(1.), rodResults->getRoD(), view, &inputsRoI);
+    if ( isFailureRetCode(stat) ) {
+        return stat;
+    }
+    RoIMap::const_iterator found = inputsRoI.find(0);
+    if ( found == inputsRoI.end() ) {
+        // The Writer does not read its input
+        return eActionStatusFailed;
+    }
+    *roi = found->second;
+
+    return eActionStatusOK;
+} // getWriterInputRoI
+
+class DefaultSchedulerStage
+    : public FramePipelineStage
+{
+    // The pipeline owns its stages
+    DefaultSchedulerPipeline* _pipeline;
+    DefaultSchedulerPipeline::StageEnum _stage;
+
+public:
+
+    DefaultSchedulerStage(DefaultSchedulerPipeline* pipeline,
+                          DefaultSchedulerPipeline::StageEnum stage)
+        : FramePipelineStage()
+        , _pipeline(pipeline)
+        , _stage(stage)
+    {
+    }
+
+    virtual ~DefaultSchedulerStage()
+    {
+    }
+
+    virtual ActionRetCodeEnum process(const FramePipelineItemPtr& item) OVERRIDE FINAL
+    {
+        DefaultSchedulerFramePtr frame = boost::dynamic_pointer_cast<DefaultSchedulerFrame>(item);
+        assert(frame);
+
+        return _pipeline->processFrame(_stage, frame);
+    }
+};
+
+/**
+ * @brief Runs a job of the pipeline as a render thread of the scheduler so that it gets aborted and waited for
+ * like any other render thread.
+ **/
+class DefaultSchedulerPipelineRunnable
+    : public RenderThreadTask
+{
+    boost::shared_ptr<DefaultSchedulerPipeline> _pipeline;
+    FramePipelineJobPtr _job;
+
+public:
+
+    DefaultSchedulerPipelineRunnable(const NodePtr& output,
+                                     OutputSchedulerThread* scheduler,
+                                     const boost::shared_ptr<DefaultSchedulerPipeline>& pipeline,
+                                     const FramePipelineJobPtr& job,
+                                     TimeValue time,
+                                     const std::vector<ViewIdx>& viewsToRender)
+        : RenderThreadTask(output, scheduler, time, false /*useRenderStats*/, viewsToRender)
+        , _pipeline(pipeline)
+        , _job(job)
+    {
+    }
+
+    virtual ~DefaultSchedulerPipelineRunnable()
+    {
+    }
+
+    virtual void abortRender() OVERRIDE FINAL
+    {
+        _pipeline->abortAllFrames();
+    }
+
+private:
+
+    virtual void renderFrame(TimeValue /*time*/,
+                             const std::vector<ViewIdx>& /*viewsToRender*/,
+                             bool /*enableRenderStats*/) OVERRIDE FINAL
+    {
+        // This launches the jobs of the next stages, if any, before this thread is removed from the render threads
+        _job->run();
+    }
+};
+
+boost::shared_ptr<DefaultSchedulerPipeline>
+DefaultSchedulerPipeline::create(DefaultScheduler* scheduler,
+                                 const NodePtr& outputNode,
+                                 const NodePtr& writer,
+                                 const NodePtr& writerInput,
+                                 const std::list<NodePtr>& readers,
+                                 TimeValue startingFrame,
+                                 const std::vector<ViewIdx>& viewsToRender,
+                                 bool enableRenderStats,
+                                 int maxDecodingFrames,
+                                 int maxEncodingFrames)
+{
+    boost::shared_ptr<DefaultSchedulerPipeline> ret( new DefaultSchedulerPipeline(scheduler, outputNode, writer, writerInput, readers, startingFrame, viewsToRender, enableRenderStats) );
+
+    ret->addStage(FramePipelineStagePtr( new DefaultSchedulerStage(ret.get(), eStageDecode) ), maxDecodingFrames, NATRON_WRITER_PIPELINE_QUEUE_SIZE);
+    ret->addStage(FramePipelineStagePtr( new DefaultSchedulerStage(ret.get(), eStageCompute) ), NATRON_WRITER_PIPELINE_INITIAL_COMPUTING_FRAMES, NATRON_WRITER_PIPELINE_QUEUE_SIZE);
+    ret->addStage(FramePipelineStagePtr( new DefaultSchedulerStage(ret.get(), eStageEncode) ), maxEncodingFrames, NATRON_WRITER_PIPELINE_QUEUE_SIZE);
+
+    return ret;
+}
+
+FramePipelineItemPtr
+DefaultSchedulerPipeline::pullNextItem()
+{
+    if ( isAborted() ) {
+        return FramePipelineItemPtr();
+    }
+
+    TimeValue time;
+    if (!_startingFramePulled) {
+        time = _startingFrame;
+        _startingFramePulled = true;
+    } else if ( !_scheduler->pickNextFrameToRender(&time) ) {
+        return FramePipelineItemPtr();
+    }
+
+    DefaultSchedulerFramePtr frame( new DefaultSchedulerFrame(time, _cancellationToken) );
+
+    // Even if enableRenderStats is false, we at least profile the time spent rendering the frame when rendering with a Write node.
+    NodePtr outputNode = _outputNode.lock();
+    if ( outputNode && outputNode->getEffectInstance()->isWriter() ) {
+        frame->stats.reset( new RenderStats(_enableRenderStats) );
+    }
+
+    return frame;
+}
+
+void
+DefaultSchedulerPipeline::onItemFailed(const FramePipelineItemPtr& /*item*/,
+                                       int /*stageIndex*/,
+                                       ActionRetCodeEnum stat)
+{
+    // When the render is aborted, all frames being rendered fail: only report once
+    if ( isAborted() ) {
+        return;
+    }
+    abortAllFrames();
+    _scheduler->notifyRenderFailure(stat, std::string());
+}
+
+void
+DefaultSchedulerPipeline::launchJob(const FramePipelineJobPtr& job)
+{
+    DefaultSchedulerFramePtr frame = boost::dynamic_pointer_cast<DefaultSchedulerFrame>( job->getItem() );
+    assert(frame);
+    boost::shared_ptr<DefaultSchedulerPipeline> thisShared = boost::dynamic_pointer_cast<DefaultSchedulerPipeline>( shared_from_this() );
+    boost::shared_ptr<RenderThreadTask> task( new DefaultSchedulerPipelineRunnable(_outputNode.lock(), _scheduler, thisShared, job, frame->time, _viewsToRender) );
+
+    _scheduler->startRenderThreadTask(task);
+}
+
+ActionRetCodeEnum
+DefaultSchedulerPipeline::launchFrameRender(const DefaultSchedulerFramePtr& frame,
+                                            const TreeRender::CtorArgsPtr& args)
+{
+    // The render is created aborted if the frame was aborted already
+    args->parentCancellationToken = frame->cancellationToken;
+    TreeRenderPtr render = TreeRender::create(args);
+    if (!render) {
+        return eActionStatusFailed;
+    }
+
+    FrameViewRequestPtr outputRequest;
+
+    return render->launchRender(&outputRequest);
+}
+
+ActionRetCodeEnum
+DefaultSchedulerPipeline::processFrame(StageEnum stage,
+                                       const DefaultSchedulerFramePtr& frame)
+{
+    NodePtr writer = _writer.lock();
+    NodePtr writerInput = _writerInput.lock();
+    if (!writer || !writerInput) {
+        return eActionStatusFailed;
+    }
+
+    switch (stage) {
+    case eStageDecode: {
+        // Render the readers alone so that their output is in the cache when the tree is computed.
+        // This is only a prefetch: a failure is reported by the compute stage if the image is actually needed.
+        for (std::list<NodeWPtr>::const_iterator it = _readers.begin(); it != _readers.end(); ++it) {
+            NodePtr reader = it->lock();
+            if (!reader) {
+                continue;
+            }
+            for (std::size_t i = 0; i < _viewsToRender.size(); ++i) {
+                TreeRender::CtorArgsPtr args = createRenderOnDiskArgs(reader, frame->time, _viewsToRender[i], frame->stats);
+                ActionRetCodeEnum stat = launchFrameRender(frame, args);
+                if (stat == eActionStatusAborted) {
+                    return stat;
+                }
+            }
+        }
+        break;
+    }
+    case eStageCompute: {
+        // Render the input of the Writer, reading the readers from the cache
+        for (std::size_t i = 0; i < _viewsToRender.size(); ++i) {
+            TreeRender::CtorArgsPtr args = createRenderOnDiskArgs(writerInput, frame->time, _viewsToRender[i], frame->stats);
+
+            // Only render the part of the input that the Writer reads, so that the encode stage finds it in the cache
+            RectD writerInputRoI;
+            ActionRetCodeEnum stat = getWriterInputRoI(writer, frame->time, _viewsToRender[i], &writerInputRoI);
+            if ( isFailureRetCode(stat) ) {
+                return stat;
+            }
+            args->canonicalRoI = writerInputRoI.isNull() ? 0 : &writerInputRoI;
+            stat = launchFrameRender(frame, args);
+            if ( isFailureRetCode(stat) ) {
+                return stat;
+            }
+        }
+        break;
+    }
+    case eStageEncode: {
+        // Write the frame, reading the input of the Writer from the cache
+        BufferedFrameContainerPtr frameContainer(new BufferedFrameContainer);
+        frameContainer->time = frame->time;
+
+        for (std::size_t i = 0; i < _viewsToRender.size(); ++i) {
+            BufferedFramePtr bufferedFrame(new BufferedFrame);
+            bufferedFrame->view = _viewsToRender[i];
+            bufferedFrame->stats = frame->stats;
+
+            TreeRender::CtorArgsPtr args = createRenderOnDiskArgs(writer, frame->time, _viewsToRender[i], frame->stats);
+            args->extraNodesToSample.push_back(writerInput);
+            ActionRetCodeEnum stat = launchFrameRender(frame, args);
+            if ( isFailureRetCode(stat) ) {
+                return stat;
+            }
+
+            frameContainer->frames.push_back(bufferedFrame);
+        }
+
+        _scheduler->notifyFrameRendered(frameContainer, eSchedulingPolicyFFA);
+        _scheduler->runAfterFrameRenderedCallback(frame->time);
+
+        // Adapt the number of frames computed concurrently to the throughput and the load of the system
+        int nConcurrentFrames;
+        std::string decision;
+        if ( _concurrentFrames.addSample(_concurrentFrames.measure(), &nConcurrentFrames, &decision) ) {
+            setStageMaxConcurrentItems(eStageCompute, nConcurrentFrames);
+#ifdef TRACE_CONCURRENT_FRAMES
+            qDebug() << writer->getScriptName_mt_safe().c_str() << ":" << decision.c_str();
+#endif
+        }
+        break;
+    }
+    } // switch (stage)
+
+    return eActionStatusOK;
+} // processFrame
+
+bool
+DefaultScheduler::startPipelinedRender(TimeValue startingFrame)
+{
+    NodePtr outputNode = getOutputNode();
+
+    // The before frame render callback may change parameters for the frame it is called for:
+    // frames must then be rendered one after another.
+    if ( !outputNode->getEffectInstance()->getBeforeFrameRenderCallback().empty() ) {
+        return false;
+    }
+
+    NodePtr writer = getNodeToRenderOnDisk(outputNode);
+    EffectInstancePtr writerEffect = writer->getEffectInstance();
+    if ( !writerEffect->isWriter() ) {
+        return false;
+    }
+    NodePtr writerInput = writer->getInput(0);
+    if (!writerInput) {
+        return false;
+    }
+
+    // Find the readers upstream of the Writer
+    std::list<NodePtr> readers;
+    bool hasSequentialReader = false;
+    {
+        std::list<NodePtr> nodesToVisit;
+        std::set<NodePtr> visitedNodes;
+        nodesToVisit.push_back(writerInput);
+        while ( !nodesToVisit.empty() ) {
+            NodePtr node = nodesToVisit.front();
+            nodesToVisit.pop_front();
+            if ( !visitedNodes.insert(node).second ) {
+                continue;
+            }
+            EffectInstancePtr effect = node->getEffectInstance();
+            if ( effect->isReader() ) {
+                readers.push_back(node);
+                if ( effect->isVideoReader() || (effect->getCurrentRenderThreadSafety() == eRenderSafetyUnsafe) ) {
+                    hasSequentialReader = true;
+                }
+                continue;
+            }
+            int nInputs = node->getMaxInputCount();
+            for (int i = 0; i < nInputs; ++i) {
+                NodePtr input = node->getInput(i);
+                if (input) {
+                    nodesToVisit.push_back(input);
+                }
+            }
+        }
+    }
+
+    // Videos are decoded and encoded in order, one frame at a time
+    int maxDecodingFrames = hasSequentialReader ? 1 : NATRON_WRITER_PIPELINE_MAX_DECODING_FRAMES;
+    SequentialPreferenceEnum pref = writerEffect->getSequentialPreference();
+    bool isSequentialWriter = (pref == eSequentialPreferenceOnlySequential) || (pref == eSequentialPreferencePreferSequential) ||
+                              (writerEffect->getCurrentRenderThreadSafety() == eRenderSafetyUnsafe);
+    int maxEncodingFrames = isSequentialWriter ? 1 : NATRON_WRITER_PIPELINE_MAX_ENCODING_FRAMES;
+
+    OutputSchedulerThreadStartArgsPtr args = getCurrentRunArgs();
+    boost::shared_ptr<DefaultSchedulerPipeline> pipeline = DefaultSchedulerPipeline::create(this, outputNode, writer, writerInput, readers, startingFrame,
+                                                                                            args->viewsToRender, args->enableRenderStats,
+                                                                                            maxDecodingFrames, maxEncodingFrames);
+
+    // The pipeline of the previous render is finished since all render threads quit when it stopped
+    _pipeline = pipeline;
+    pipeline->start();
+
+    return true;
+} // DefaultScheduler::startPipelinedRender
+
 
 void
 DefaultScheduler::processFrame(const BufferedFrameContainerPtr& /*frames*/)
@@ -2120,6 +2664,7 @@ public:
     : BufferedFrameContainer()
     , recenterViewer(0)
     , viewerCenter()
+    , isIncrementalRender(false)
     {
         
     }
@@ -2128,6 +2673,9 @@ public:
     
     bool recenterViewer;
     Point viewerCenter;
+
+    // True if the frames only contain the region of the image displayed that changed
+    bool isIncrementalRender;
 };
 
 typedef boost::shared_ptr<ViewerRenderBufferedFrame> ViewerRenderBufferedFramePtr;
@@ -2648,6 +3196,10 @@ struct RenderEnginePrivate
     {
         bool enableStats;
         bool enableAbort;
+
+        // If true, only viewerRegion, in canonical coordinates, changed in the viewer image
+        bool hasViewerRegion;
+        RectD viewerRegion;
     };
 
     /*
@@ -2709,6 +3261,7 @@ RenderEngine::renderFrameRange(bool isBlocking,
     // We are going to start playback, abort any current viewer refresh
     if (_imp->currentFrameScheduler) {
         _imp->currentFrameScheduler->onAbortRequested(true);
+        _imp->currentFrameScheduler->invalidateIncrementalRenderBase();
     }
     
     setPlaybackAutoRestartEnabled(true);
@@ -2730,6 +3283,7 @@ RenderEngine::renderFromCurrentFrame(bool enableRenderStats,
 {
     // We are going to start playback, abort any current viewer refresh
     _imp->currentFrameScheduler->onAbortRequested(true);
+    _imp->currentFrameScheduler->invalidateIncrementalRenderBase();
     
     setPlaybackAutoRestartEnabled(true);
 
@@ -2748,45 +3302,108 @@ RenderEngine::onCurrentFrameRenderRequestPosted()
 {
     assert( QThread::currentThread() == qApp->thread() );
 
-    //Okay we are at the end of the event loop, concatenate all similar events
+    //Okay we are at the end of the event loop, concatenate all similar events.
+    // The render reads the parameters as they are now: it must cover the regions changed by all the requests concatenated.
     RenderEnginePrivate::RefreshRequest r;
     bool rSet = false;
     while ( !_imp->refreshQueue.empty() ) {
-        const RenderEnginePrivate::RefreshRequest& queueBegin = _imp->refreshQueue.front();
-        if (!rSet) {
-            rSet = true;
-        } else {
-            if ( (queueBegin.enableAbort == r.enableAbort) && (queueBegin.enableStats == r.enableStats) ) {
-                _imp->refreshQueue.pop_front();
-                continue;
+        RenderEnginePrivate::RefreshRequest queueBegin = _imp->refreshQueue.front();
+        _imp->refreshQueue.pop_front();
+        if ( rSet && (queueBegin.enableAbort == r.enableAbort) && (queueBegin.enableStats == r.enableStats) ) {
+            if (!queueBegin.hasViewerRegion) {
+                r.hasViewerRegion = false;
+            } else if (r.hasViewerRegion) {
+                r.viewerRegion.merge(queueBegin.viewerRegion);
             }
+            continue;
+        }
+        if (rSet) {
+            renderCurrentFrameNowInternal(r.enableStats, r.hasViewerRegion ? &r.viewerRegion : 0);
         }
         r = queueBegin;
-        renderCurrentFrameNowInternal(r.enableStats);
-        _imp->refreshQueue.pop_front();
+        rSet = true;
+    }
+    if (rSet) {
+        renderCurrentFrameNowInternal(r.enableStats, r.hasViewerRegion ? &r.viewerRegion : 0);
     }
 }
 
 void
 RenderEngine::renderCurrentFrameWithRenderStats()
 {
-    renderCurrentFrameInternal(true);
+    renderCurrentFrameInternal(true, 0);
 }
 
 
 void
 RenderEngine::renderCurrentFrame()
 {
-    renderCurrentFrameInternal(_imp->output.lock()->getApp()->isRenderStatsActionChecked());
+    renderCurrentFrameInternal(_imp->output.lock()->getApp()->isRenderStatsActionChecked(), 0);
 }
 
 void
-RenderEngine::renderCurrentFrameInternal(bool enableStats)
+RenderEngine::renderCurrentFrameInRegion(const EffectInstancePtr& changedEffect,
+                                         const RectD& changedRegion,
+                                         TimeValue changedRegionTime)
+{
+    assert( QThread::currentThread() == qApp->thread() );
+    NodePtr output = getOutput();
+    bool enableStats = output->getApp()->isRenderStatsActionChecked();
+    ViewerNodePtr viewerNode = output->isEffectViewerNode();
+    if (!viewerNode || !changedEffect) {
+        renderCurrentFrameInternal(enableStats, 0);
+
+        return;
+    }
+
+    // Map the changed region to the images of the viewer processes at the current frame/view.
+    // The region is only valid at the time it was computed: if the viewer displays another time, render everything
+    TimeValue time( viewerNode->getTimeline()->currentFrame() );
+    if (time != changedRegionTime) {
+        renderCurrentFrameInternal(enableStats, 0);
+
+        return;
+    }
+    ViewIdx view = viewerNode->getRenderViewsCount() > 0 ? viewerNode->getCurrentRenderView() : ViewIdx(0);
+    RectD viewerRegion;
+    for (int i = 0; i < 2; ++i) {
+        ViewerInstancePtr viewerProcess = viewerNode->getViewerProcessNode(i);
+        if (!viewerProcess) {
+            continue;
+        }
+        RectD processRegion;
+        if ( !viewerProcess->getOutputRegionChangedByUpstreamEffect(changedEffect, changedRegion, time, view, &processRegion) ) {
+            renderCurrentFrameInternal(enableStats, 0);
+
+            return;
+        }
+        if ( processRegion.isNull() ) {
+            continue;
+        }
+        if ( viewerRegion.isNull() ) {
+            viewerRegion = processRegion;
+        } else {
+            viewerRegion.merge(processRegion);
+        }
+    }
+
+    // If the viewer does not seem to depend on the change, render as for any other change: it may still depend
+    // on it through other means than the inputs (e.g: expressions)
+    renderCurrentFrameInternal(enableStats, viewerRegion.isNull() ? 0 : &viewerRegion);
+} // renderCurrentFrameInRegion
+
+void
+RenderEngine::renderCurrentFrameInternal(bool enableStats,
+                                         const RectD* viewerRegion)
 {
     assert( QThread::currentThread() == qApp->thread() );
     RenderEnginePrivate::RefreshRequest r;
     r.enableStats = enableStats;
     r.enableAbort = true;
+    r.hasViewerRegion = viewerRegion != 0;
+    if (viewerRegion) {
+        r.viewerRegion = *viewerRegion;
+    }
     _imp->refreshQueue.push_back(r);
     Q_EMIT currentFrameRenderRequestPosted();
 }
@@ -2794,11 +3411,12 @@ RenderEngine::renderCurrentFrameInternal(bool enableStats)
 void
 RenderEngine::renderCurrentFrameNow()
 {
-    renderCurrentFrameNowInternal(_imp->output.lock()->getApp()->isRenderStatsActionChecked());
+    renderCurrentFrameNowInternal(_imp->output.lock()->getApp()->isRenderStatsActionChecked(), 0);
 }
 
 void
-RenderEngine::renderCurrentFrameNowInternal(bool enableRenderStats)
+RenderEngine::renderCurrentFrameNowInternal(bool enableRenderStats,
+                                            const RectD* viewerRegion)
 {
     assert( QThread::currentThread() == qApp->thread() );
 
@@ -2810,6 +3428,9 @@ RenderEngine::renderCurrentFrameNowInternal(bool enableRenderStats)
             _imp->scheduler->abortThreadedTask();
         }
         if ( working || isPlaybackAutoRestartEnabled() ) {
+            if (_imp->currentFrameScheduler) {
+                _imp->currentFrameScheduler->invalidateIncrementalRenderBase();
+            }
             RenderDirectionEnum lastDirection;
             std::vector<ViewIdx> lastViews;
             _imp->scheduler->getLastRunArgs(&lastDirection, &lastViews);
@@ -2832,7 +3453,7 @@ RenderEngine::renderCurrentFrameNowInternal(bool enableRenderStats)
         _imp->currentFrameScheduler = new ViewerCurrentFrameRequestScheduler(output);
     }
 
-    _imp->currentFrameScheduler->renderCurrentFrame(enableRenderStats);
+    _imp->currentFrameScheduler->renderCurrentFrame(enableRenderStats, viewerRegion);
 }
 
 
@@ -3104,6 +3725,8 @@ RenderEngine::reportStats(TimeValue time,
     for (std::map<NodePtr, NodeRenderStats >::const_iterator it = statsMap.begin(); it != statsMap.end(); ++it) {
         ofile << "------------------------------- " << it->first->getScriptName_mt_safe() << "------------------------------- " << std::endl;
         ofile << "Time spent rendering: " << Timer::printAsTime(it->second.getTotalTimeSpentRendering(), false).toStdString() << std::endl;
+        ofile << "Estimated render cost: " << Timer::printAsTime(it->second.getTotalEstimatedRenderCost(), false).toStdString() << std::endl;
+        ofile << "Critical path priority: " << Timer::printAsTime(it->second.getMaxCriticalPathPriority(), false).toStdString() << std::endl;
     }
 } // reportStats
 
@@ -3139,6 +3762,10 @@ public:
     RotoStrokeItemPtr strokeItem;
     U64 age;
 
+    // If true, only incrementalRenderRoI of the image displayed is re-rendered and updated in the viewer
+    bool isIncrementalRender;
+    RectD incrementalRenderRoI;
+
     CurrentFrameFunctorArgs()
         : GenericThreadStartArgs()
         , viewsToRender()
@@ -3148,6 +3775,8 @@ public:
         , scheduler(0)
         , strokeItem()
         , age(0)
+        , isIncrementalRender(false)
+        , incrementalRenderRoI()
     {
     }
 
@@ -3165,6 +3794,8 @@ public:
         , scheduler(scheduler)
         , strokeItem(strokeItem)
         , age(0)
+        , isIncrementalRender(false)
+        , incrementalRenderRoI()
     {
         viewsToRender.push_back(view);
     }
@@ -3192,6 +3823,162 @@ struct TreeRender_CompareAge
 
 typedef std::set<TreeRenderAndAge, TreeRender_CompareAge> TreeRenderSetOrderedByAge;
 
+/**
+ * @brief The parameters with which the viewer image was rendered. A render of a region of the image can only
+ * update the image displayed if the latter was rendered with the same parameters.
+ **/
+struct IncrementalRenderBase
+{
+    TimeValue time;
+    ViewIdx view;
+    unsigned int mipMapLevel;
+    bool draftMode;
+
+    // For each viewer process: the RoI rendered and its RoD
+    RectD roi[2];
+    RectD rod[2];
+
+    // False if the image was not entirely rendered by a render of the current frame (e.g: tracking or painting)
+    bool canBeUpdated;
+
+    IncrementalRenderBase()
+        : time(0)
+        , view(0)
+        , mipMapLevel(0)
+        , draftMode(false)
+        , roi()
+        , rod()
+        , canBeUpdated(false)
+    {
+    }
+
+    bool operator==(const IncrementalRenderBase& other) const
+    {
+        return time == other.time && view == other.view && mipMapLevel == other.mipMapLevel && draftMode == other.draftMode &&
+               roi[0] == other.roi[0] && roi[1] == other.roi[1] && rod[0] == other.rod[0] && rod[1] == other.rod[1];
+    }
+};
+
+static void
+getIncrementalRenderBase(const ViewerNodePtr& viewer,
+                         TimeValue time,
+                         ViewIdx view,
+                         IncrementalRenderBase* base)
+{
+    bool fullFrameProcessing = viewer->isFullFrameProcessingEnabled();
+
+    base->time = time;
+    base->view = view;
+    base->draftMode = viewer->getApp()->isDraftRenderEnabled();
+    base->mipMapLevel = ViewerRenderFrameRunnable::getViewerMipMapLevel(viewer, base->draftMode, fullFrameProcessing);
+    for (int i = 0; i < 2; ++i) {
+        ViewerInstancePtr viewerProcess = viewer->getViewerProcessNode(i);
+        if (!viewerProcess) {
+            continue;
+        }
+        if (!fullFrameProcessing) {
+            base->roi[i] = viewerProcess->getViewerRoI();
+        }
+        GetRegionOfDefinitionResultsPtr results;
+        ActionRetCodeEnum stat = viewerProcess->getRegionOfDefinition_public(time, RenderScale(1.), view, &results);
+        if ( !isFailureRetCode(stat) ) {
+            base->rod[i] = results->getRoD();
+        }
+    }
+} // getIncrementalRenderBase
+
+/**
+ * @brief Renders the viewer at a frame following the current frame without displaying it,
+ * so that the frame is already in the cache when the timeline moves forward.
+ * Scheduled with CacheBase::prefetch() from ViewerCurrentFrameRequestScheduler::renderCurrentFrame
+ **/
+class ViewerPrefetchTask
+    : public CachePrefetchTask
+{
+    ViewerNodeWPtr _viewer;
+    TimeValue _time;
+    ViewIdx _view;
+
+    // Protects _render
+    QMutex _renderMutex;
+
+    // The render in progress in run()
+    TreeRenderPtr _render;
+
+public:
+
+    ViewerPrefetchTask(const ViewerNodePtr& viewer,
+                       TimeValue time,
+                       ViewIdx view)
+        : CachePrefetchTask()
+        , _viewer(viewer)
+        , _time(time)
+        , _view(view)
+        , _renderMutex()
+        , _render()
+    {
+    }
+
+    virtual ~ViewerPrefetchTask()
+    {
+    }
+
+    virtual void run() OVERRIDE FINAL
+    {
+        ViewerNodePtr viewer = _viewer.lock();
+        if (!viewer || viewer->getNode()->isDoingSequentialRender()) {
+            // A playback already renders frames ahead of the current one
+            return;
+        }
+        ViewerInstancePtr viewerProcess = viewer->getViewerProcessNode(0);
+        if (!viewerProcess) {
+            return;
+        }
+
+        // Render with the same parameters as the current frame so that the cache keys match
+        bool fullFrameProcessing = viewer->isFullFrameProcessingEnabled();
+        RectD roi;
+        if (!fullFrameProcessing) {
+            roi = viewerProcess->getViewerRoI();
+        }
+
+        TreeRender::CtorArgsPtr args(new TreeRender::CtorArgs);
+        args->treeRootEffect = viewerProcess->getNode()->getEffectInstance();
+        args->time = _time;
+        args->view = _view;
+        args->plane = 0;
+        args->mipMapLevel = ViewerRenderFrameRunnable::getViewerMipMapLevel(viewer, false /*draftModeEnabled*/, fullFrameProcessing);
+        args->proxyScale = RenderScale(1.);
+        args->canonicalRoI = roi.isNull() ? 0 : &roi;
+        args->prefetch = true;
+
+        TreeRenderPtr render = TreeRender::create(args);
+        {
+            QMutexLocker k(&_renderMutex);
+            if ( isCancelled() ) {
+                return;
+            }
+            _render = render;
+        }
+
+        FrameViewRequestPtr outputRequest;
+        render->launchRender(&outputRequest);
+
+        QMutexLocker k(&_renderMutex);
+        _render.reset();
+    }
+
+protected:
+
+    virtual void onCancelled() OVERRIDE FINAL
+    {
+        QMutexLocker k(&_renderMutex);
+        if (_render) {
+            _render->setRenderAborted();
+        }
+    }
+};
+
 class RenderCurrentFrameFunctorRunnable;
 struct ViewerCurrentFrameRequestSchedulerPrivate
 {
@@ -3219,6 +4006,17 @@ struct ViewerCurrentFrameRequestSchedulerPrivate
     // A set of active renders and their age.
     TreeRenderSetOrderedByAge currentRenders;
 
+    // The parameters of the image displayed, if displayedBaseSet is true. Protected by renderAgeMutex
+    IncrementalRenderBase displayedBase;
+    bool displayedBaseSet;
+
+    // The parameters of the renders of the whole image not displayed yet, by age. Protected by renderAgeMutex
+    std::map<U64, IncrementalRenderBase> pendingBases;
+
+    // The regions of the viewer image that changed since the image displayed, by age of the render
+    // requested for them. Protected by renderAgeMutex
+    std::map<U64, RectD> dirtyRegions;
+
     ViewerCurrentFrameRequestSchedulerPrivate(ViewerCurrentFrameRequestScheduler* publicInterface, const NodePtr& viewer)
         : _publicInterface(publicInterface)
         , viewer(viewer)
@@ -3229,9 +4027,56 @@ struct ViewerCurrentFrameRequestSchedulerPrivate
         , renderAge(1)
         , displayAge(0)
         , currentRenders()
+        , displayedBase()
+        , displayedBaseSet(false)
+        , pendingBases()
+        , dirtyRegions()
     {
     }
 
+    /**
+     * @brief Decides whether the render args->age only has to update a region of the image displayed, in which case
+     * args->isIncrementalRender is set. Returns false if nothing visible changed and the render is not needed.
+     * Must be called with renderAgeMutex locked.
+     **/
+    bool prepareIncrementalRender(CurrentFrameFunctorArgs* args,
+                                  const IncrementalRenderBase& base,
+                                  const RectD* viewerRegion)
+    {
+        assert( !renderAgeMutex.tryLock() );
+
+        // If a render of the whole image is pending, it must be displayed first
+        if ( viewerRegion && base.canBeUpdated && displayedBaseSet && pendingBases.empty() && (displayedBase == base) ) {
+
+            // Also render the regions of the previous renders that were not displayed: they may have been aborted
+            RectD region = *viewerRegion;
+            for (std::map<U64, RectD>::const_iterator it = dirtyRegions.begin(); it != dirtyRegions.end(); ++it) {
+                region.merge(it->second);
+            }
+
+            // Only render what is visible
+            if ( !base.roi[0].isNull() || !base.roi[1].isNull() ) {
+                RectD visibleRoI = base.roi[0].isNull() ? base.roi[1] : base.roi[0];
+                if ( !base.roi[1].isNull() ) {
+                    visibleRoI.merge(base.roi[1]);
+                }
+                if ( !region.intersect(visibleRoI, &region) ) {
+                    return false;
+                }
+            }
+
+            dirtyRegions[args->age] = *viewerRegion;
+            args->isIncrementalRender = true;
+            args->incrementalRenderRoI = region;
+
+            return true;
+        }
+
+        pendingBases[args->age] = base;
+
+        return true;
+    } // prepareIncrementalRender
+
     void appendRunnableTask(const boost::shared_ptr<RenderCurrentFrameFunctorRunnable>& task)
     {
         {
@@ -3351,7 +4196,11 @@ public:
             ViewerRenderBufferedFramePtr bufferObject(new ViewerRenderBufferedFrame);
             bufferObject->view = view;
             bufferObject->stats = stats;
-            if (partialUpdateArea) {
+            if (_args->isIncrementalRender) {
+
+                // Only the region that changed is updated in the texture displayed
+                bufferObject->type = OpenGLViewerI::TextureTransferArgs::eTextureTransferTypeModify;
+            } else if (partialUpdateArea) {
                 bufferObject->type = OpenGLViewerI::TextureTransferArgs::eTextureTransferTypeOverlay;
             } else if (_args->strokeItem && _args->strokeItem->getRenderCloneCurrentStrokeStartPointIndex() > 0) {
 
@@ -3417,9 +4266,12 @@ public:
         ViewerRenderBufferedFrameContainerPtr framesContainer(new ViewerRenderBufferedFrameContainer);
         framesContainer->time = _args->time;
         framesContainer->recenterViewer = viewer->getViewerCenterPoint(&framesContainer->viewerCenter);
+        framesContainer->isIncrementalRender = _args->isIncrementalRender;
 
 
-        if (viewer->isDoingPartialUpdates()) {
+        if (_args->isIncrementalRender) {
+            computeViewsForRoI(viewer, &_args->incrementalRenderRoI, framesContainer);
+        } else if (viewer->isDoingPartialUpdates()) {
             // If the viewer is doing partial updates (i.e: during tracking we only update the markers areas)
             // Then we launch multiple renders over the partial areas
             std::list<RectD> partialUpdates = viewer->getPartialUpdateRects();
@@ -3478,17 +4330,22 @@ ViewerCurrentFrameRequestSchedulerPrivate::processProducedFrame(U64 age, const B
         return;
     }
     bool updateAge = false;
+    ViewerRenderBufferedFrameContainer* isViewerFrameContainer = dynamic_cast<ViewerRenderBufferedFrameContainer*>(frames.get());
+    assert(isViewerFrameContainer);
+
     // Do not process the produced frame if the age is now older than what is displayed
     {
         QMutexLocker k(&renderAgeMutex);
         if (age <= displayAge) {
+            pendingBases.erase(age);
             return;
         }
 
+        // A region can only be updated in the image it was rendered for
+        if (isViewerFrameContainer->isIncrementalRender && !displayedBaseSet) {
+            return;
+        }
     }
-
-    ViewerRenderBufferedFrameContainer* isViewerFrameContainer = dynamic_cast<ViewerRenderBufferedFrameContainer*>(frames.get());
-    assert(isViewerFrameContainer);
     
     ViewerNodePtr viewerNode = viewer->isEffectViewerNode();
 
@@ -3529,10 +4386,28 @@ ViewerCurrentFrameRequestSchedulerPrivate::processProducedFrame(U64 age, const B
         }
 
     }
-    if (updateAge) {
+    {
         QMutexLocker k(&renderAgeMutex);
-        // Update the display age
-        displayAge = age;
+        std::map<U64, IncrementalRenderBase>::iterator foundBase = pendingBases.find(age);
+        if (updateAge) {
+            // Update the display age
+            displayAge = age;
+
+            if (!isViewerFrameContainer->isIncrementalRender) {
+                displayedBaseSet = foundBase != pendingBases.end() && foundBase->second.canBeUpdated;
+                if (displayedBaseSet) {
+                    displayedBase = foundBase->second;
+                }
+            }
+
+            // The image displayed now includes all the changes requested up to this render
+            pendingBases.erase( pendingBases.begin(), pendingBases.upper_bound(age) );
+            dirtyRegions.erase( dirtyRegions.begin(), dirtyRegions.upper_bound(age) );
+        } else if ( foundBase != pendingBases.end() ) {
+            // The image displayed may no longer correspond to the parameters
+            pendingBases.erase(foundBase);
+            displayedBaseSet = false;
+        }
     }
     // At least redraw the viewer, we might be here when the user removed a node upstream of the viewer.
     viewerNode->redrawViewer();
@@ -3633,7 +4508,18 @@ ViewerCurrentFrameRequestScheduler::renderCurrentFrameInternal(const boost::shar
 } // renderCurrentFrameInternal
 
 void
-ViewerCurrentFrameRequestScheduler::renderCurrentFrame(bool enableRenderStats)
+ViewerCurrentFrameRequestScheduler::invalidateIncrementalRenderBase()
+{
+    QMutexLocker k(&_imp->renderAgeMutex);
+
+    _imp->displayedBaseSet = false;
+    _imp->pendingBases.clear();
+    _imp->dirtyRegions.clear();
+}
+
+void
+ViewerCurrentFrameRequestScheduler::renderCurrentFrame(bool enableRenderStats,
+                                                       const RectD* viewerRegion)
 {
     // Sanity check, also do not render viewer that are not made visible by the user
     NodePtr treeRoot = _imp->viewer;
@@ -3674,6 +4560,11 @@ ViewerCurrentFrameRequestScheduler::renderCurrentFrame(bool enableRenderStats)
 
 
 
+    // The parameters of the image that will be displayed, to know if a later render may only update a region of it
+    IncrementalRenderBase base;
+    getIncrementalRenderBase(viewerNode, frame, view, &base);
+    base.canBeUpdated = !curStroke && !isTracking;
+
     // Identify this render request with an age
 
     {
@@ -3685,11 +4576,33 @@ ViewerCurrentFrameRequestScheduler::renderCurrentFrame(bool enableRenderStats)
         } else {
             ++_imp->renderAge;
         }
+
+        if ( !_imp->prepareIncrementalRender(functorArgs.get(), base, viewerRegion) ) {
+            // Nothing visible changed
+            return;
+        }
     }
 
     // When painting, limit the number of threads to 1 to be sure strokes are painted in the right order
     renderCurrentFrameInternal(functorArgs, curStroke || isTracking);
 
+    // The frames that were prefetched for the previous render are no longer of interest: the current frame
+    // or the parameters changed. Prefetch the frames following the current one, unless the user
+    // is scrubbing, painting or tracking.
+    CacheBasePtr tileCache = appPTR->getTileCache();
+    if (tileCache) {
+        tileCache->cancelPrefetch();
+
+        int nFramesToPrefetch = appPTR->getCurrentSettings()->getViewerPrefetchFramesCount();
+        if ( (nFramesToPrefetch > 0) && !curStroke && !isTracking && !viewerNode->getApp()->isDraftRenderEnabled() ) {
+            int firstFrame, lastFrame;
+            viewerNode->getTimelineBounds(&firstFrame, &lastFrame);
+            for (int i = 1; i <= nFramesToPrefetch && (double)frame + i <= lastFrame; ++i) {
+                tileCache->prefetch( CachePrefetchTaskPtr( new ViewerPrefetchTask(viewerNode, TimeValue((double)frame + i), view) ) );
+            }
+        }
+    }
+
 
 
 } // ViewerCurrentFrameRequestScheduler::renderCurrentFrame
@@ -351,6 +351,25 @@ protected:
      **/
     virtual void onRenderStopped(bool /*aborted*/) {}
 
+    /**
+     * @brief Called when starting to render a frame range instead of creating one render thread per frame
+     * with createRunnable(). Returning true means the derived class renders the frames itself, starting at startingFrame,
+     * and picks the next frames with pickNextFrameToRender(). Each frame must still be notified with notifyFrameRendered().
+     **/
+    virtual bool startPipelinedRender(TimeValue /*startingFrame*/) { return false; }
+
+    /**
+     * @brief Returns in frame the next frame to render after the last one requested and marks it as requested.
+     * Returns false if there is no frame left to render.
+     **/
+    bool pickNextFrameToRender(TimeValue* frame);
+
+    /**
+     * @brief Starts the given task in the global thread pool. The task is registered as a render thread
+     * so that it gets aborted and waited for like the tasks created with createRunnable().
+     **/
+    void startRenderThreadTask(const boost::shared_ptr<RenderThreadTask>& task);
+
 
 
 private:
@@ -414,11 +433,17 @@ private:
     virtual void handleRenderFailure(ActionRetCodeEnum stat, const std::string& errorMessage) OVERRIDE FINAL;
     virtual void aboutToStartRender() OVERRIDE FINAL;
     virtual void onRenderStopped(bool aborted) OVERRIDE FINAL;
+    virtual bool startPipelinedRender(TimeValue startingFrame) OVERRIDE FINAL;
     
 private:
 
+    friend class DefaultSchedulerPipeline;
+
     mutable QMutex _currentTimeMutex;
     TimeValue _currentTime;
+
+    // The pipeline decoding, computing and encoding the frames of the current render, if any
+    FramePipelinePtr _pipeline;
 };
 
 
@@ -477,7 +502,18 @@ public:
 
     ~ViewerCurrentFrameRequestScheduler();
 
-    void renderCurrentFrame(bool enableRenderStats);
+    /**
+     * @brief Renders the current frame. If viewerRegion is set, the viewer image only changed within this region,
+     * in canonical coordinates, since the last render: if the image displayed is still valid elsewhere,
+     * only this region is re-rendered and updated in the viewer.
+     **/
+    void renderCurrentFrame(bool enableRenderStats, const RectD* viewerRegion = 0);
+
+    /**
+     * @brief Called when the image displayed by the viewer is about to be replaced by something else than
+     * this scheduler (e.g: playback): the next render cannot only update a region of it.
+     **/
+    void invalidateIncrementalRenderBase();
 
     void onWaitForAbortCompleted();
     void onWaitForThreadToQuit();
@@ -588,11 +624,18 @@ public:
      **/
     void renderCurrentFrameNow();
 
+    /**
+     * @brief Same as renderCurrentFrame() except that the output of changedEffect only changed within changedRegion,
+     * in canonical coordinates, at changedRegionTime. If the viewer displays this time and this region can be mapped
+     * through the effects between changedEffect and the viewer, only the corresponding portion of the viewer image is re-rendered.
+     **/
+    void renderCurrentFrameInRegion(const EffectInstancePtr& changedEffect, const RectD& changedRegion, TimeValue changedRegionTime);
+
 private:
 
-    void renderCurrentFrameInternal(bool enableStats);
+    void renderCurrentFrameInternal(bool enableStats, const RectD* viewerRegion);
 
-    void renderCurrentFrameNowInternal(bool enableStats);
+    void renderCurrentFrameNowInternal(bool enableStats, const RectD* viewerRegion);
 public:
 
 
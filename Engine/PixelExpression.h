@@ -0,0 +1,122 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2013-2017 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_PIXELEXPRESSION_H
+#define NATRON_ENGINE_PIXELEXPRESSION_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <list>
+#include <string>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/scoped_ptr.hpp>
+#endif
+
+#include "Engine/TimeValue.h"
+#include "Engine/ViewIdx.h"
+
+#include "Engine/EngineFwd.h"
+
+// Number of pixels evaluated at once by PixelExpression::evaluate()
+#define NATRON_PIXEL_EXPRESSION_BATCH_SIZE 64
+
+NATRON_NAMESPACE_ENTER;
+
+struct KnobDimViewKey;
+
+/**
+ * @brief A batch of pixels to evaluate. All arrays are planar and hold count values.
+ **/
+struct PixelExpressionBatch
+{
+    // Number of pixels in the batch, at most NATRON_PIXEL_EXPRESSION_BATCH_SIZE
+    int count;
+
+    // Canonical coordinates of the center of each pixel
+    double x[NATRON_PIXEL_EXPRESSION_BATCH_SIZE];
+    double y[NATRON_PIXEL_EXPRESSION_BATCH_SIZE];
+
+    // Input RGBA values of each pixel
+    double in[4][NATRON_PIXEL_EXPRESSION_BATCH_SIZE];
+
+    // Output RGBA values of each pixel
+    double out[4][NATRON_PIXEL_EXPRESSION_BATCH_SIZE];
+};
+
+/**
+ * @brief Four ExprTk expressions computing the R, G, B and A channels of a pixel from its coordinates and its input
+ * value. The variables x, y, r, g, b, a and frame are available to the expressions, as well as all functions
+ * available to ExprTk knob expressions (noise, fbm, turbulence, ...). Other symbols are resolved like in knob
+ * expressions, e.g. Blur1.size.x is the value of the knob at the render time.
+ * The random functions are seeded from the time and the coordinates of the pixel.
+ *
+ * This is implemented in ExprTk.cpp, which is the only file that includes exprtk.
+ **/
+struct PixelExpressionPrivate;
+class PixelExpression
+{
+public:
+
+    PixelExpression();
+
+    ~PixelExpression();
+
+    /**
+     * @brief Compile the expressions of the R, G, B and A channels.
+     * Symbols that are not pixel variables are resolved relative to the given knob, at the given time and view.
+     * @returns False and sets error if one of the expressions does not compile.
+     **/
+    bool compile(const std::string expressions[4],
+                 const KnobIPtr& knob,
+                 TimeValue time,
+                 ViewIdx view,
+                 std::string* error);
+
+    /**
+     * @brief Evaluates the expressions for all pixels of the batch.
+     * This is thread-safe: a compiled expression cannot be evaluated concurrently, hence the expressions
+     * are compiled once per concurrent evaluation and re-used by the following batches.
+     **/
+    void evaluate(PixelExpressionBatch* batch) const;
+
+    /**
+     * @brief Appends to dependencies the knobs referenced by the expression of the given channel when it was compiled
+     **/
+    void getKnobDependencies(int channel, std::list<KnobDimViewKey>* dependencies) const;
+
+    /**
+     * @brief Appends to dependencies the effects whose properties (e.g. the region of definition) are referenced
+     * by the expression of the given channel when it was compiled
+     **/
+    void getEffectDependencies(int channel, std::list<EffectInstanceWPtr>* dependencies) const;
+
+private:
+
+    boost::scoped_ptr<PixelExpressionPrivate> _imp;
+};
+
+NATRON_NAMESPACE_EXIT;
+
+#endif // NATRON_ENGINE_PIXELEXPRESSION_H
@@ -0,0 +1,614 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2013-2017 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "PixelExpressionNode.h"
+
+#include <algorithm> // min, max
+#include <cassert>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+
+#include "Engine/Hash64.h"
+#include "Engine/Image.h"
+#include "Engine/KnobTypes.h"
+#include "Engine/MultiThread.h"
+#include "Engine/Node.h"
+#include "Engine/NodeMetadata.h"
+#include "Engine/PixelExpression.h"
+
+#define kPixelExpressionParamRed "exprR"
+#define kPixelExpressionParamRedLabel "R"
+#define kPixelExpressionParamGreen "exprG"
+#define kPixelExpressionParamGreenLabel "G"
+#define kPixelExpressionParamBlue "exprB"
+#define kPixelExpressionParamBlueLabel "B"
+#define kPixelExpressionParamAlpha "exprA"
+#define kPixelExpressionParamAlphaLabel "A"
+#define kPixelExpressionParamHint "ExprTk expression computing the %1 channel of each pixel. The following variables are available:\n" \
+    "x, y: the canonical coordinates of the center of the pixel\n" \
+    "r, g, b, a: the value of the pixel in the Source input, or 0 if it is not connected\n" \
+    "frame: the current frame\n" \
+    "All functions available to ExprTk knob expressions can be used, e.g. noise(x, y), fbm(x, y, frame) or random(seed). " \
+    "Knob values of any node can be used as in knob expressions, e.g. Blur1.size.x."
+
+// Number of compiled expressions kept by a PixelExpression node for the following renders
+#define NATRON_PIXEL_EXPRESSION_COMPILED_CACHE_SIZE 4
+
+NATRON_NAMESPACE_ENTER;
+
+static const char* pixelExpressionParamNames[4] = { kPixelExpressionParamRed, kPixelExpressionParamGreen, kPixelExpressionParamBlue, kPixelExpressionParamAlpha };
+static const char* pixelExpressionParamLabels[4] = { kPixelExpressionParamRedLabel, kPixelExpressionParamGreenLabel, kPixelExpressionParamBlueLabel, kPixelExpressionParamAlphaLabel };
+static const char* pixelExpressionParamDefaults[4] = { "r", "g", "b", "a" };
+
+struct PixelExpressionNodePrivate
+{
+    KnobStringWPtr expressions[4];
+
+    // The following are only used on the main instance
+
+    // The expressions from which the dependencies were computed, empty if they did not compile
+    std::string dependenciesExpressions[4];
+
+    // Protects knobDependencies and effectDependencies
+    mutable QMutex dependenciesLock;
+
+    // The knobs and effects referenced by the expression of each channel. They are registered as dependencies of
+    // the channel knob so that the node is invalidated when they change.
+    std::list<KnobDimViewKey> knobDependencies[4];
+    std::list<EffectInstanceWPtr> effectDependencies[4];
+
+    // Protects compiledExpressions
+    QMutex compiledExpressionsLock;
+
+    // The last compiled expressions mapped against the hash of the node for the time and view of the render, most
+    // recently used first. All the tiles of a render and the following renders of the same frame share them.
+    std::list<std::pair<U64, PixelExpressionPtr> > compiledExpressions;
+
+    PixelExpressionNodePrivate()
+    : dependenciesLock()
+    , knobDependencies()
+    , effectDependencies()
+    , compiledExpressionsLock()
+    , compiledExpressions()
+    {
+    }
+
+    void getExpressions(std::string expressions[4]) const
+    {
+        for (int i = 0; i < 4; ++i) {
+            expressions[i] = this->expressions[i].lock()->getValue();
+        }
+    }
+};
+
+PluginPtr
+PixelExpressionNode::createPlugin()
+{
+    std::vector<std::string> grouping;
+    grouping.push_back(PLUGIN_GROUP_COLOR);
+    PluginPtr ret = Plugin::create((void*)PixelExpressionNode::create, (void*)PixelExpressionNode::createRenderClone, PLUGINID_NATRON_PIXELEXPRESSION, "PixelExpression", 1, 0, grouping);
+
+    QString desc =  tr("Computes each channel of each pixel with an ExprTk expression. The expressions are evaluated "
+                       "on the Source image if it is connected, or generate an image otherwise.");
+    ret->setProperty<std::string>(kNatronPluginPropDescription, desc.toStdString());
+    ret->setProperty<int>(kNatronPluginPropRenderSafety, (int)eRenderSafetyFullySafe);
+    return ret;
+}
+
+PixelExpressionNode::PixelExpressionNode(const NodePtr& node)
+    : EffectInstance(node)
+    , _imp( new PixelExpressionNodePrivate() )
+{
+}
+
+PixelExpressionNode::PixelExpressionNode(const EffectInstancePtr& mainInstance, const FrameViewRenderKey& key)
+: EffectInstance(mainInstance, key)
+, _imp( new PixelExpressionNodePrivate() )
+{
+
+}
+
+PixelExpressionNode::~PixelExpressionNode()
+{
+}
+
+void
+PixelExpressionNode::addAcceptedComponents(int /*inputNb*/,
+                                           std::bitset<4>* supported)
+{
+    (*supported)[0] = (*supported)[1] = (*supported)[2] = (*supported)[3] = 1;
+}
+
+void
+PixelExpressionNode::addSupportedBitDepth(std::list<ImageBitDepthEnum>* depths) const
+{
+    depths->push_back(eImageBitDepthFloat);
+}
+
+void
+PixelExpressionNode::initializeKnobs()
+{
+    KnobPagePtr page = createKnob<KnobPage>("controlsPage");
+    page->setLabel(tr("Controls"));
+
+    for (int i = 0; i < 4; ++i) {
+        KnobStringPtr param = createKnob<KnobString>(pixelExpressionParamNames[i]);
+        param->setLabel(tr(pixelExpressionParamLabels[i]));
+        param->setHintToolTip(tr(kPixelExpressionParamHint).arg( QString::fromUtf8(pixelExpressionParamLabels[i]) ));
+        param->setDefaultValue(pixelExpressionParamDefaults[i]);
+        param->setAnimationEnabled(false);
+        // The output may depend on the frame or be constant depending on the expressions
+        param->setIsMetadataSlave(true);
+        page->addKnob(param);
+        _imp->expressions[i] = param;
+    }
+}
+
+void
+PixelExpressionNode::fetchRenderCloneKnobs()
+{
+    EffectInstance::fetchRenderCloneKnobs();
+    for (int i = 0; i < 4; ++i) {
+        _imp->expressions[i] = toKnobString(getKnobByName(pixelExpressionParamNames[i]));
+    }
+}
+
+bool
+PixelExpressionNode::knobChanged(const KnobIPtr& knob,
+                                 ValueChangedReasonEnum /*reason*/,
+                                 ViewSetSpec /*view*/,
+                                 TimeValue /*time*/)
+{
+    if ( isRenderClone() || ( QThread::currentThread() != qApp->thread() ) ) {
+        return false;
+    }
+    for (int i = 0; i < 4; ++i) {
+        if ( knob == _imp->expressions[i].lock() ) {
+            refreshDependencies();
+
+            return true;
+        }
+    }
+
+    return false;
+} // knobChanged
+
+void
+PixelExpressionNode::refreshDependencies()
+{
+    assert( !isRenderClone() && QThread::currentThread() == qApp->thread() );
+
+    // The channel knobs are also notified when a dependency changes: only compile if the expressions changed
+    std::string expressions[4];
+    _imp->getExpressions(expressions);
+    if ( std::equal(expressions, expressions + 4, _imp->dependenciesExpressions) ) {
+        return;
+    }
+
+    // Compile the expressions to find the symbols they reference. If they do not compile (e.g. they reference a node
+    // that is not created yet while loading a project) there are no dependencies: they are computed again on the
+    // next call and the error is reported by the render.
+    std::list<KnobDimViewKey> knobDependencies[4];
+    std::list<EffectInstanceWPtr> effectDependencies[4];
+    {
+        PixelExpression expression;
+        std::string error;
+        if ( expression.compile(expressions, _imp->expressions[0].lock(), getTimelineCurrentTime(), ViewIdx(0), &error) ) {
+            for (int i = 0; i < 4; ++i) {
+                expression.getKnobDependencies(i, &knobDependencies[i]);
+                expression.getEffectDependencies(i, &effectDependencies[i]);
+                _imp->dependenciesExpressions[i] = expressions[i];
+            }
+        } else {
+            for (int i = 0; i < 4; ++i) {
+                _imp->dependenciesExpressions[i].clear();
+            }
+        }
+    }
+
+    // Swap with the previous dependencies. Only the main thread writes them, hence they may be (un)registered
+    // without holding the lock.
+    {
+        QMutexLocker k(&_imp->dependenciesLock);
+        for (int i = 0; i < 4; ++i) {
+            _imp->knobDependencies[i].swap(knobDependencies[i]);
+            _imp->effectDependencies[i].swap(effectDependencies[i]);
+        }
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        KnobIPtr channelKnob = _imp->expressions[i].lock();
+
+        // Unregister the previous dependencies, now in the local lists
+        for (std::list<KnobDimViewKey>::const_iterator it = knobDependencies[i].begin(); it != knobDependencies[i].end(); ++it) {
+            KnobIPtr knob = it->knob.lock();
+            if ( knob && (knob != channelKnob) ) {
+                knob->removeKnobListener(DimIdx(0), it->dimension, ViewIdx(0), it->view, channelKnob);
+            }
+        }
+        for (std::list<EffectInstanceWPtr>::const_iterator it = effectDependencies[i].begin(); it != effectDependencies[i].end(); ++it) {
+            EffectInstancePtr effect = it->lock();
+            if (effect) {
+                effect->removeExpressionHashListener(channelKnob);
+            }
+        }
+
+        // Register the new ones like the dependencies of an ExprTk knob expression
+        for (std::list<KnobDimViewKey>::const_iterator it = _imp->knobDependencies[i].begin(); it != _imp->knobDependencies[i].end(); ++it) {
+            KnobIPtr knob = it->knob.lock();
+            if ( knob && (knob != channelKnob) ) {
+                knob->addListener(DimIdx(0), it->dimension, ViewIdx(0), it->view, channelKnob, eExpressionLanguageExprTk);
+            }
+        }
+        for (std::list<EffectInstanceWPtr>::const_iterator it = _imp->effectDependencies[i].begin(); it != _imp->effectDependencies[i].end(); ++it) {
+            EffectInstancePtr effect = it->lock();
+            if (effect) {
+                effect->addExpressionHashListener(channelKnob);
+            }
+        }
+    }
+} // refreshDependencies
+
+PixelExpressionNodePrivate*
+PixelExpressionNode::getMainInstancePrivate() const
+{
+    KnobHolderPtr mainInstance = getMainInstance();
+    if (!mainInstance) {
+        return _imp.get();
+    }
+    PixelExpressionNode* mainNode = dynamic_cast<PixelExpressionNode*>( mainInstance.get() );
+    assert(mainNode);
+
+    return mainNode ? mainNode->_imp.get() : _imp.get();
+}
+
+void
+PixelExpressionNode::appendToHash(const ComputeHashArgs& args,
+                                  Hash64* hash)
+{
+    if (args.hashType != HashableObject::eComputeHashTypeOnlyMetadataSlaves) {
+        // The dependencies are held by the main instance
+        PixelExpressionNodePrivate* mainImp = getMainInstancePrivate();
+        std::list<KnobDimViewKey> knobDependencies;
+        std::list<EffectInstanceWPtr> effectDependencies;
+        {
+            QMutexLocker k(&mainImp->dependenciesLock);
+            for (int i = 0; i < 4; ++i) {
+                knobDependencies.insert(knobDependencies.end(), mainImp->knobDependencies[i].begin(), mainImp->knobDependencies[i].end());
+                effectDependencies.insert(effectDependencies.end(), mainImp->effectDependencies[i].begin(), mainImp->effectDependencies[i].end());
+            }
+        }
+
+        // The values of the referenced knobs are baked in the image: the hash of the channel knobs, which only
+        // depends on the text of the expressions, is not enough
+        for (std::list<KnobDimViewKey>::const_iterator it = knobDependencies.begin(); it != knobDependencies.end(); ++it) {
+            KnobIPtr knob = it->knob.lock();
+            if (knob) {
+                hash->append( knob->computeHash(args) );
+            }
+        }
+        KnobHolderPtr mainInstance = getMainInstance();
+        for (std::list<EffectInstanceWPtr>::const_iterator it = effectDependencies.begin(); it != effectDependencies.end(); ++it) {
+            EffectInstancePtr effect = it->lock();
+            if ( effect && (effect.get() != this) && (effect != mainInstance) ) {
+                hash->append( effect->computeHash(args) );
+            }
+        }
+    }
+
+    EffectInstance::appendToHash(args, hash);
+} // appendToHash
+
+ActionRetCodeEnum
+PixelExpressionNode::getTimeInvariantMetadata(NodeMetadata& metadata)
+{
+    // Always work in RGBA so that expressions may write any channel
+    metadata.setColorPlaneNComps(-1, 4);
+    metadata.setColorPlaneNComps(0, 4);
+
+    // This is also called once the project is loaded: the dependencies could not be registered before all nodes
+    // were created
+    if ( !isRenderClone() && ( QThread::currentThread() == qApp->thread() ) ) {
+        refreshDependencies();
+    }
+
+    // The output depends on the frame if an expression references a knob or an effect, which may be animated.
+    // Otherwise do not bother parsing: assume that it does if an expression references the frame or a function
+    // that is seeded by the frame
+    bool frameVarying = metadata.getIsFrameVarying();
+    {
+        PixelExpressionNodePrivate* mainImp = getMainInstancePrivate();
+        QMutexLocker k(&mainImp->dependenciesLock);
+        for (int i = 0; i < 4 && !frameVarying; ++i) {
+            frameVarying = !mainImp->knobDependencies[i].empty() || !mainImp->effectDependencies[i].empty();
+        }
+    }
+    std::string expressions[4];
+    _imp->getExpressions(expressions);
+    for (int i = 0; i < 4 && !frameVarying; ++i) {
+        frameVarying = expressions[i].find("frame") != std::string::npos || expressions[i].find("random") != std::string::npos;
+    }
+    metadata.setIsFrameVarying(frameVarying);
+
+    return eActionStatusOK;
+} // getTimeInvariantMetadata
+
+ActionRetCodeEnum
+PixelExpressionNode::isIdentity(TimeValue /*time*/,
+                                const RenderScale & /*scale*/,
+                                const RectI & /*roi*/,
+                                ViewIdx /*view*/,
+                                const ImagePlaneDesc& /*plane*/,
+                                TimeValue* /*inputTime*/,
+                                ViewIdx* /*inputView*/,
+                                int* inputNb,
+                                ImagePlaneDesc* /*inputPlane*/)
+{
+    *inputNb = -1;
+
+    // The default expressions copy the input
+    std::string expressions[4];
+    _imp->getExpressions(expressions);
+    for (int i = 0; i < 4; ++i) {
+        if (expressions[i] != pixelExpressionParamDefaults[i]) {
+            return eActionStatusOK;
+        }
+    }
+    if ( getInputRenderEffectAtAnyTimeView(0) ) {
+        *inputNb = 0;
+    }
+
+    return eActionStatusOK;
+} // isIdentity
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+class PixelExpressionProcessor : public ImageMultiThreadProcessorBase
+{
+    Image::CPUData _srcImage, _dstImage;
+    const PixelExpression* _expression;
+    RenderScale _scale;
+    double _par;
+    std::bitset<4> _processChannels;
+
+public:
+
+    PixelExpressionProcessor(const EffectInstancePtr& renderArgs)
+    : ImageMultiThreadProcessorBase(renderArgs)
+    , _srcImage()
+    , _dstImage()
+    , _expression(0)
+    , _scale(1.)
+    , _par(1.)
+    , _processChannels()
+    {
+
+    }
+
+    virtual ~PixelExpressionProcessor()
+    {
+    }
+
+    void setValues(const Image::CPUData& srcImage,
+                   const Image::CPUData& dstImage,
+                   const PixelExpression* expression,
+                   const RenderScale& scale,
+                   double par,
+                   const std::bitset<4>& processChannels)
+    {
+        _srcImage = srcImage;
+        _dstImage = dstImage;
+        _expression = expression;
+        _scale = scale;
+        _par = par;
+        _processChannels = processChannels;
+    }
+
+private:
+
+    /**
+     * @brief Returns the index in RGBA of the component comp of an image with nComps components
+     **/
+    static int getRGBAIndex(int nComps, int comp)
+    {
+        // A single channel image is alpha
+        return nComps == 1 ? 3 : comp;
+    }
+
+    virtual ActionRetCodeEnum multiThreadProcessImages(const RectI& renderWindow) OVERRIDE FINAL
+    {
+        assert(_dstImage.bitDepth == eImageBitDepthFloat && (!_srcImage.ptrs[0] || _srcImage.bitDepth == eImageBitDepthFloat));
+
+        // Allocated once per thread, the expressions are evaluated on batches of pixels of a scan-line
+        PixelExpressionBatch batch;
+
+        for (int y = renderWindow.y1; y < renderWindow.y2; ++y) {
+
+            // Check for abort on every scan-line
+            if ( _effect->isRenderAborted() ) {
+                return eActionStatusAborted;
+            }
+
+            const double canonicalY = (y + 0.5) / _scale.y;
+
+            for (int x = renderWindow.x1; x < renderWindow.x2; x += NATRON_PIXEL_EXPRESSION_BATCH_SIZE) {
+
+                batch.count = std::min(NATRON_PIXEL_EXPRESSION_BATCH_SIZE, renderWindow.x2 - x);
+
+                for (int i = 0; i < batch.count; ++i) {
+                    batch.x[i] = (x + i + 0.5) / _scale.x * _par;
+                    batch.y[i] = canonicalY;
+                }
+
+                // Fetch the source pixels, pixels outside of the source image are black and transparent
+                for (int c = 0; c < 4; ++c) {
+                    std::fill(batch.in[c], batch.in[c] + batch.count, 0.);
+                }
+                if ( _srcImage.ptrs[0] && (y >= _srcImage.bounds.y1) && (y < _srcImage.bounds.y2) ) {
+                    const int srcX1 = std::max(x, _srcImage.bounds.x1);
+                    const int srcX2 = std::min(x + batch.count, _srcImage.bounds.x2);
+                    if (srcX1 < srcX2) {
+                        int srcPixelStride;
+                        const float* srcPixels[4];
+                        Image::getChannelPointers<float>((const float**)_srcImage.ptrs, srcX1, y, _srcImage.bounds, _srcImage.nComps, (float**)srcPixels, &srcPixelStride);
+                        for (int k = 0; k < _srcImage.nComps; ++k) {
+                            double* in = batch.in[getRGBAIndex(_srcImage.nComps, k)] + (srcX1 - x);
+                            const float* src = srcPixels[k];
+                            for (int i = 0; i < srcX2 - srcX1; ++i, src += srcPixelStride) {
+                                in[i] = *src;
+                            }
+                        }
+                    }
+                }
+
+                _expression->evaluate(&batch);
+
+                int dstPixelStride;
+                float* dstPixels[4];
+                Image::getChannelPointers<float>((const float**)_dstImage.ptrs, x, y, _dstImage.bounds, _dstImage.nComps, dstPixels, &dstPixelStride);
+                for (int k = 0; k < _dstImage.nComps; ++k) {
+                    const int c = getRGBAIndex(_dstImage.nComps, k);
+
+                    // Channels that are not processed are copied from the source
+                    const double* out = _processChannels[c] ? batch.out[c] : batch.in[c];
+                    float* dst = dstPixels[k];
+                    for (int i = 0; i < batch.count; ++i, dst += dstPixelStride) {
+                        *dst = (float)out[i];
+                    }
+                }
+            }
+        }
+
+        return eActionStatusOK;
+    } // multiThreadProcessImages
+};
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+PixelExpressionPtr
+PixelExpressionNode::getCompiledExpression(const RenderActionArgs& args,
+                                           std::string* error)
+{
+    // The hash covers the expressions and the values of the knobs they reference at the render time and view
+    U64 hash;
+    {
+        ComputeHashArgs hashArgs;
+        hashArgs.time = args.time;
+        hashArgs.view = args.view;
+        hashArgs.hashType = HashableObject::eComputeHashTypeTimeViewVariant;
+        hash = computeHash(hashArgs);
+    }
+
+    // The compiled expressions are shared by the render clones through the main instance
+    PixelExpressionNodePrivate* mainImp = getMainInstancePrivate();
+    {
+        QMutexLocker k(&mainImp->compiledExpressionsLock);
+        for (std::list<std::pair<U64, PixelExpressionPtr> >::iterator it = mainImp->compiledExpressions.begin(); it != mainImp->compiledExpressions.end(); ++it) {
+            if (it->first == hash) {
+                PixelExpressionPtr ret = it->second;
+                mainImp->compiledExpressions.splice(mainImp->compiledExpressions.begin(), mainImp->compiledExpressions, it);
+
+                return ret;
+            }
+        }
+    }
+
+    // Symbols referencing knobs are resolved at the render time against the main instance: the compiled expressions
+    // may outlive this render
+    std::string expressions[4];
+    _imp->getExpressions(expressions);
+    PixelExpressionPtr ret(new PixelExpression);
+    if ( !ret->compile(expressions, mainImp->expressions[0].lock(), args.time, args.view, error) ) {
+        return PixelExpressionPtr();
+    }
+
+    QMutexLocker k(&mainImp->compiledExpressionsLock);
+    mainImp->compiledExpressions.push_front( std::make_pair(hash, ret) );
+    while ( (int)mainImp->compiledExpressions.size() > NATRON_PIXEL_EXPRESSION_COMPILED_CACHE_SIZE ) {
+        mainImp->compiledExpressions.pop_back();
+    }
+
+    return ret;
+} // getCompiledExpression
+
+ActionRetCodeEnum
+PixelExpressionNode::render(const RenderActionArgs& args)
+{
+    // Compile the expressions once for all the tiles of this render
+    PixelExpressionPtr expression;
+    {
+        std::string error;
+        expression = getCompiledExpression(args, &error);
+        if (!expression) {
+            getNode()->setPersistentMessage(eMessageTypeError, kNatronPersistentErrorGenericRenderMessage, error);
+            return eActionStatusFailed;
+        }
+    }
+
+    const RenderScale scale = EffectInstance::getCombinedScale(args.mipMapLevel, args.proxyScale);
+    const double par = getAspectRatio(-1);
+
+    for (std::list<std::pair<ImagePlaneDesc, ImagePtr > >::const_iterator it = args.outputPlanes.begin(); it != args.outputPlanes.end(); ++it) {
+
+        // The source is optional: without it the expressions generate the image
+        Image::CPUData srcImage;
+        {
+            GetImageInArgs inArgs(&args.mipMapLevel, &args.proxyScale, &args.roi, &args.backendType);
+            inArgs.inputNb = 0;
+            inArgs.plane = &it->first;
+            GetImageOutArgs outArgs;
+            if ( getImagePlane(inArgs, &outArgs) ) {
+                if (outArgs.image->getBitDepth() != eImageBitDepthFloat) {
+                    getNode()->setPersistentMessage(eMessageTypeError, kNatronPersistentErrorGenericRenderMessage, tr("Host did not take into account requested bit-depth").toStdString());
+                    return eActionStatusFailed;
+                }
+                outArgs.image->getCPUData(&srcImage);
+            }
+        }
+
+        Image::CPUData dstImage;
+        it->second->getCPUData(&dstImage);
+        if (dstImage.bitDepth != eImageBitDepthFloat) {
+            getNode()->setPersistentMessage(eMessageTypeError, kNatronPersistentErrorGenericRenderMessage, tr("Host did not take into account requested bit-depth").toStdString());
+            return eActionStatusFailed;
+        }
+
+        PixelExpressionProcessor processor(shared_from_this());
+        processor.setValues(srcImage, dstImage, expression.get(), scale, par, args.processChannels);
+        processor.setRenderWindow(args.roi);
+        ActionRetCodeEnum stat = processor.process();
+        if ( isFailureRetCode(stat) ) {
+            return stat;
+        }
+    }
+
+    return eActionStatusOK;
+} // render
+
+NATRON_NAMESPACE_EXIT;
+NATRON_NAMESPACE_USING;
+
+#include "moc_PixelExpressionNode.cpp"
@@ -0,0 +1,155 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2013-2017 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef ENGINE_PIXELEXPRESSIONNODE_H
+#define ENGINE_PIXELEXPRESSIONNODE_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/scoped_ptr.hpp>
+#endif
+
+#include "Engine/EffectInstance.h"
+
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER;
+
+/**
+ * @brief A node computing each pixel of its output with an ExprTk expression per channel, see PixelExpression.
+ **/
+struct PixelExpressionNodePrivate;
+class PixelExpressionNode
+    : public EffectInstance
+{
+GCC_DIAG_SUGGEST_OVERRIDE_OFF
+    Q_OBJECT
+GCC_DIAG_SUGGEST_OVERRIDE_ON
+
+private: // derives from EffectInstance
+    // constructors should be privatized in any class that derives from boost::enable_shared_from_this<>
+    PixelExpressionNode(const NodePtr& node);
+
+    PixelExpressionNode(const EffectInstancePtr& mainInstance, const FrameViewRenderKey& key);
+
+public:
+    static EffectInstancePtr create(const NodePtr& node) WARN_UNUSED_RETURN
+    {
+        return EffectInstancePtr( new PixelExpressionNode(node) );
+    }
+
+    static EffectInstancePtr createRenderClone(const EffectInstancePtr& mainInstance, const FrameViewRenderKey& key) WARN_UNUSED_RETURN
+    {
+        return EffectInstancePtr( new PixelExpressionNode(mainInstance, key) );
+    }
+
+    static PluginPtr createPlugin();
+
+    virtual ~PixelExpressionNode();
+
+    virtual int getMaxInputCount() const OVERRIDE FINAL WARN_UNUSED_RETURN
+    {
+        return 1;
+    }
+
+    virtual std::string getInputLabel (int /*inputNb*/) const OVERRIDE FINAL WARN_UNUSED_RETURN
+    {
+        return "Source";
+    }
+
+    virtual bool isInputOptional(int /*inputNb*/) const OVERRIDE FINAL WARN_UNUSED_RETURN
+    {
+        return true;
+    }
+
+    virtual void addAcceptedComponents(int inputNb, std::bitset<4>* comps) OVERRIDE FINAL;
+
+    virtual void addSupportedBitDepth(std::list<ImageBitDepthEnum>* depths) const OVERRIDE FINAL;
+
+    virtual bool supportsTiles() const OVERRIDE FINAL WARN_UNUSED_RETURN
+    {
+        return true;
+    }
+
+    virtual bool supportsMultiResolution() const OVERRIDE FINAL WARN_UNUSED_RETURN
+    {
+        return true;
+    }
+
+    virtual void initializeKnobs() OVERRIDE FINAL;
+
+    virtual void appendToHash(const ComputeHashArgs& args, Hash64* hash) OVERRIDE FINAL;
+
+private:
+
+    virtual void fetchRenderCloneKnobs() OVERRIDE FINAL;
+
+    virtual bool knobChanged(const KnobIPtr& knob,
+                             ValueChangedReasonEnum reason,
+                             ViewSetSpec view,
+                             TimeValue time) OVERRIDE FINAL;
+
+    virtual ActionRetCodeEnum getTimeInvariantMetadata(NodeMetadata& metadata) OVERRIDE FINAL WARN_UNUSED_RETURN;
+
+    virtual ActionRetCodeEnum isIdentity(TimeValue time,
+                                         const RenderScale & scale,
+                                         const RectI & roi,
+                                         ViewIdx view,
+                                         const ImagePlaneDesc& plane,
+                                         TimeValue* inputTime,
+                                         ViewIdx* inputView,
+                                         int* inputNb,
+                                         ImagePlaneDesc* inputPlane) OVERRIDE FINAL WARN_UNUSED_RETURN;
+
+    virtual ActionRetCodeEnum render(const RenderActionArgs& args) OVERRIDE FINAL WARN_UNUSED_RETURN;
+
+    /**
+     * @brief Registers the knobs and effects referenced by the expressions as dependencies of the channel knobs,
+     * if the expressions changed since the last call. Only called on the main instance, on the main thread.
+     **/
+    void refreshDependencies();
+
+    /**
+     * @brief Returns the private data of the main instance, which holds the dependencies and the compiled expressions
+     **/
+    PixelExpressionNodePrivate* getMainInstancePrivate() const;
+
+    /**
+     * @brief Returns the expressions compiled for the given render. They are shared by all renders with the same hash.
+     **/
+    PixelExpressionPtr getCompiledExpression(const RenderActionArgs& args, std::string* error);
+
+    boost::scoped_ptr<PixelExpressionNodePrivate> _imp;
+};
+
+inline PixelExpressionNodePtr
+toPixelExpressionNode(const EffectInstancePtr& effect)
+{
+    return boost::dynamic_pointer_cast<PixelExpressionNode>(effect);
+}
+
+NATRON_NAMESPACE_EXIT;
+
+#endif // ENGINE_PIXELEXPRESSIONNODE_H
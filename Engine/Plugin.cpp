@@ -38,6 +38,12 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/LibraryBinary.h"
 #include "Engine/Settings.h"
 
+// Estimated time to render a pixel with a plug-in that was never rendered, in seconds
+#define NATRON_DEFAULT_RENDER_COST_PER_PIXEL 1e-8
+
+// Weight of the last render in the moving average of the render cost of a plug-in
+#define NATRON_RENDER_COST_AVERAGE_WEIGHT 0.2
+
 NATRON_NAMESPACE_ENTER;
 
 void
@@ -151,6 +157,9 @@ Plugin::Plugin()
 , _openGLEnabled(true)
 , _multiThreadEnabled(true)
 , _renderScaleEnabled(true)
+, _hostTilingEnabled(false)
+, _renderCostLock(new QMutex)
+, _renderCostPerPixel(-1)
 {
 
 
@@ -387,6 +396,33 @@ Plugin::setRenderScaleEnabled(bool b)
     _renderScaleEnabled = b;
 }
 
+void
+Plugin::recordRenderCost(double seconds,
+                         double nPixels)
+{
+    if ( (nPixels <= 0) || (seconds < 0) ) {
+        return;
+    }
+    double costPerPixel = seconds / nPixels;
+    QMutexLocker k( _renderCostLock.get() );
+    if (_renderCostPerPixel < 0) {
+        _renderCostPerPixel = costPerPixel;
+    } else {
+        _renderCostPerPixel += (costPerPixel - _renderCostPerPixel) * NATRON_RENDER_COST_AVERAGE_WEIGHT;
+    }
+}
+
+double
+Plugin::getEstimatedRenderCostPerPixel() const
+{
+    QMutexLocker k( _renderCostLock.get() );
+    if (_renderCostPerPixel < 0) {
+        return NATRON_DEFAULT_RENDER_COST_PER_PIXEL;
+    }
+
+    return _renderCostPerPixel;
+}
+
 bool
 Plugin::isMultiThreadingEnabled() const
 {
@@ -411,6 +447,18 @@ Plugin::setOpenGLEnabled(bool b)
     _openGLEnabled = b;
 }
 
+bool
+Plugin::isHostTilingEnabled() const
+{
+    return _hostTilingEnabled;
+}
+
+void
+Plugin::setHostTilingEnabled(bool b)
+{
+    _hostTilingEnabled = b;
+}
+
 void
 Plugin::setIsHighestMajorVersion(bool isHighest)
 {
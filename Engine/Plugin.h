@@ -326,6 +326,17 @@ class Plugin : public PropertiesHolder
     // pass images of scale 1 to the plug-in.
     bool _renderScaleEnabled;
 
+    // When enabled, Natron splits the render window of an eRenderSafetyInstanceSafe plug-in into strips
+    // that are rendered concurrently. This is only correct if the plug-in can render disjoint windows of the same
+    // frame concurrently, hence disabled by default.
+    bool _hostTilingEnabled;
+
+    // Protects _renderCostPerPixel
+    boost::shared_ptr<QMutex> _renderCostLock;
+
+    // Moving average of the time in seconds spent to render a pixel with this plug-in, or -1 if it was never rendered
+    double _renderCostPerPixel;
+
 private:
     
     virtual void initializeProperties() const OVERRIDE FINAL;
@@ -386,10 +397,24 @@ public:
     bool isRenderScaleEnabled() const;
     bool isMultiThreadingEnabled() const;
     bool isOpenGLEnabled() const;
+    bool isHostTilingEnabled() const;
 
     void setRenderScaleEnabled(bool b);
     void setMultiThreadingEnabled(bool b);
     void setOpenGLEnabled(bool b);
+    void setHostTilingEnabled(bool b);
+
+    /**
+     * @brief Records the time spent by a render of this plug-in on the given number of pixels.
+     * This is used to estimate the cost of the next renders, see getEstimatedRenderCostPerPixel().
+     **/
+    void recordRenderCost(double seconds, double nPixels);
+
+    /**
+     * @brief Returns the estimated time in seconds to render a pixel with this plug-in, based on the previous renders.
+     * If this plug-in was never rendered, returns a default cost which is the same for all plug-ins.
+     **/
+    double getEstimatedRenderCostPerPixel() const;
 
     void addActionShortcut(const PluginActionShortcut& shortcut);
     const std::list<PluginActionShortcut>& getShortcuts() const;
@@ -190,6 +190,16 @@ public:
         return appPTR->getHardwareIdealThreadCount();
     }
 
+    inline void setCacheStatisticsEnabled(bool enabled)
+    {
+        appPTR->setTileCacheStatisticsEnabled(enabled);
+    }
+
+    inline QString getCacheStatistics() const
+    {
+        return QString::fromUtf8( appPTR->getTileCacheStatisticsJSON().c_str() );
+    }
+
     inline App* getInstance(int idx) const
     {
         AppInstancePtr app = appPTR->getAppInstance(idx);
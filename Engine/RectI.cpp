@@ -114,6 +114,38 @@ std::list<RectI> RectI::splitIntoSmallerRects(int splitsCount) const
     return ret;
 } // RectI::splitIntoSmallerRects
 
+/// Splits the rectangle in at most splitsCount horizontal strips spanning the whole width. The boundaries
+/// between strips fall on multiples of tileSizeY so that each tile of the image is covered by a single strip.
+std::list<RectI> RectI::splitIntoTileAlignedStrips(int tileSizeY, int splitsCount) const
+{
+    std::list<RectI> ret;
+
+    if ( isNull() ) {
+        return ret;
+    }
+    if ( (tileSizeY <= 0) || (splitsCount <= 1) ) {
+        ret.push_back(*this);
+
+        return ret;
+    }
+
+    int firstTileRow = (int)std::floor( (double)bottom() / tileSizeY );
+    int lastTileRow = (int)std::ceil( (double)top() / tileSizeY );
+    int nTileRows = lastTileRow - firstTileRow;
+    int tileRowsPerStrip = (nTileRows + splitsCount - 1) / splitsCount;
+    assert(tileRowsPerStrip > 0);
+
+    for (int row = firstTileRow; row < lastTileRow; row += tileRowsPerStrip) {
+        int y1_ = std::max(bottom(), row * tileSizeY);
+        int y2_ = std::min(top(), (row + tileRowsPerStrip) * tileSizeY);
+        if (y2_ > y1_) {
+            ret.push_back( RectI(left(), y1_, right(), y2_) );
+        }
+    }
+
+    return ret;
+} // RectI::splitIntoTileAlignedStrips
+
 void
 RectI::toCanonical(unsigned int thisLevel,
                    double par,
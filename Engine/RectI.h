@@ -445,6 +445,7 @@ public:
 
 #endif
     std::list<RectI> splitIntoSmallerRects(int splitsCount) const;
+    std::list<RectI> splitIntoTileAlignedStrips(int tileSizeY, int splitsCount) const;
     static RectI fromOfxRectI(const OfxRectI & r)
     {
         RectI ret(r.x1, r.y1, r.x2, r.y2);
@@ -24,6 +24,7 @@
 
 #include "RenderStats.h"
 
+#include <algorithm>
 #include <bitset>
 #include <cassert>
 #include <stdexcept>
@@ -42,9 +43,16 @@ struct NodeRenderStatsPrivate
     //The accumulated time spent in the EffectInstance::renderHandler function
     double totalTimeSpentRendering;
 
+    // The sum of the estimated cost of all renders of the node
+    double totalEstimatedRenderCost;
+
+    // The highest critical path priority of the renders of the node
+    double maxCriticalPathPriority;
 
     NodeRenderStatsPrivate()
     : totalTimeSpentRendering(0)
+    , totalEstimatedRenderCost(0)
+    , maxCriticalPathPriority(0)
     {
 
     }
@@ -69,6 +77,8 @@ void
 NodeRenderStats::operator=(const NodeRenderStats& other)
 {
     _imp->totalTimeSpentRendering = other._imp->totalTimeSpentRendering;
+    _imp->totalEstimatedRenderCost = other._imp->totalEstimatedRenderCost;
+    _imp->maxCriticalPathPriority = other._imp->maxCriticalPathPriority;
 }
 
 void
@@ -83,6 +93,30 @@ NodeRenderStats::getTotalTimeSpentRendering() const
     return _imp->totalTimeSpentRendering;
 }
 
+void
+NodeRenderStats::addEstimatedRenderCost(double cost)
+{
+    _imp->totalEstimatedRenderCost += cost;
+}
+
+double
+NodeRenderStats::getTotalEstimatedRenderCost() const
+{
+    return _imp->totalEstimatedRenderCost;
+}
+
+void
+NodeRenderStats::setMaxCriticalPathPriority(double priority)
+{
+    _imp->maxCriticalPathPriority = std::max(_imp->maxCriticalPathPriority, priority);
+}
+
+double
+NodeRenderStats::getMaxCriticalPathPriority() const
+{
+    return _imp->maxCriticalPathPriority;
+}
+
 
 struct RenderStatsPrivate
 {
@@ -163,6 +197,20 @@ RenderStats::addRenderInfosForNode(const NodePtr& node, double timeSpent)
     stats.addTimeSpentRendering(timeSpent);
 }
 
+void
+RenderStats::addPriorityInfosForNode(const NodePtr& node,
+                                     double estimatedCost,
+                                     double criticalPathPriority)
+{
+    QMutexLocker k(&_imp->lock);
+
+    assert(_imp->doNodesProfiling);
+
+    NodeRenderStats& stats = _imp->findOrCreateNodeStats(node);
+    stats.addEstimatedRenderCost(estimatedCost);
+    stats.setMaxCriticalPathPriority(criticalPathPriority);
+}
+
 std::map<NodePtr, NodeRenderStats >
 RenderStats::getStats(double *totalTimeSpent) const
 {
@@ -68,6 +68,18 @@ public:
     void addTimeSpentRendering(double time);
     double getTotalTimeSpentRendering() const;
 
+    /**
+     * @brief The estimated cost in seconds of all renders of the node, see FrameViewRequest::getEstimatedRenderCost()
+     **/
+    void addEstimatedRenderCost(double cost);
+    double getTotalEstimatedRenderCost() const;
+
+    /**
+     * @brief The highest priority given to a render of the node, see FrameViewRequest::getCriticalPathPriority()
+     **/
+    void setMaxCriticalPathPriority(double priority);
+    double getMaxCriticalPathPriority() const;
+
 
 private:
 
@@ -94,6 +106,8 @@ public:
 
     void addRenderInfosForNode(const NodePtr& node, double timeSpent);
 
+    void addPriorityInfosForNode(const NodePtr& node, double estimatedCost, double criticalPathPriority);
+
     std::map<NodePtr, NodeRenderStats > getStats(double *totalTimeSpent) const;
 
 private:
@@ -51,6 +51,7 @@
 #include "Engine/KnobTypes.h"
 #include "Engine/LibraryBinary.h"
 #include "Engine/MemoryInfo.h" // getSystemTotalRAM, isApplication32Bits, printAsRAM
+#include "Engine/MultiThread.h"
 #include "Engine/Node.h"
 #include "Engine/OSGLContext.h"
 #include "Engine/OutputSchedulerThread.h"
@@ -123,6 +124,8 @@ public:
     // General/Threading
     KnobPagePtr _threadingPage;
     KnobIntPtr _numberOfThreads;
+    KnobIntPtr _maxThreadsPerEffect;
+    KnobChoicePtr _threadAffinityPolicy;
     KnobBoolPtr _renderInSeparateProcess;
     KnobBoolPtr _queueRenders;
 
@@ -182,6 +185,11 @@ public:
     // The total disk space allowed for all Natron's caches
     KnobIntPtr _maxDiskCacheSizeGb;
     KnobPathPtr _diskCachePath;
+    KnobChoicePtr _cacheEvictionPolicy;
+    KnobChoicePtr _cacheCompression;
+    KnobChoicePtr _cacheKeyHashing;
+    KnobIntPtr _maxCompressedCacheSizeMb;
+    KnobIntPtr _viewerPrefetchFrames;
 
     // Viewer
     KnobPagePtr _viewersTab;
@@ -359,6 +367,10 @@ public:
 
     void refreshCacheSize();
 
+    void refreshCacheEvictionPolicy();
+
+    void refreshCacheCompression();
+
 };
 
 
@@ -937,6 +949,36 @@ SettingsPrivate::initializeKnobsThreading()
     _numberOfThreads->setDefaultValue(0);
     _threadingPage->addKnob(_numberOfThreads);
 
+    _maxThreadsPerEffect = _publicInterface->createKnob<KnobInt>("maxThreadsPerEffect");
+    _maxThreadsPerEffect->setLabel(tr("Maximum threads per effect (0=\"guess\")"));
+    _maxThreadsPerEffect->setHintToolTip( tr("Controls how many threads a single effect may use to render an image.\n"
+                                             "0: The render threads are shared between the effects rendering at the same time, "
+                                             "so that an effect rendering alone uses all of them.") );
+    _maxThreadsPerEffect->disableSlider();
+    _maxThreadsPerEffect->setRange(0, hwThreadsCount);
+    _maxThreadsPerEffect->setDisplayRange(0, hwThreadsCount);
+    _maxThreadsPerEffect->setDefaultValue(0);
+    _threadingPage->addKnob(_maxThreadsPerEffect);
+
+    _threadAffinityPolicy = _publicInterface->createKnob<KnobChoice>("threadAffinityPolicy");
+    _threadAffinityPolicy->setLabel(tr("Render threads affinity"));
+    {
+        std::vector<ChoiceOption> policies;
+        policies.push_back(ChoiceOption("None", tr("None").toStdString(), tr("Render threads are not pinned: the operating system moves them freely across the CPUs.").toStdString()));
+        policies.push_back(ChoiceOption("Core", tr("Per core").toStdString(), tr("Each render thread is pinned to a single core so that it keeps its data in the caches of that core.").toStdString()));
+        policies.push_back(ChoiceOption("NUMANode", tr("Per NUMA node").toStdString(), tr("Each render thread is pinned to the cores of a NUMA node (a socket on multi-socket computers) "
+                                                                                           "and all the nodes of a frame are rendered on the same NUMA node, so that the images of the frame "
+                                                                                           "are allocated in the memory local to that node.").toStdString()));
+        _threadAffinityPolicy->populateChoices(policies);
+    }
+    _threadAffinityPolicy->setHintToolTip( tr("Controls on which CPUs the render threads may run. This is only supported on Linux and "
+                                              "mostly useful on computers with several sockets. "
+                                              "This can be overridden with the --thread-affinity option of %1.\n"
+                                              "Changing this requires a restart of the application.").arg( QString::fromUtf8(NATRON_APPLICATION_NAME "Renderer") ) );
+    _threadAffinityPolicy->setDefaultValue(0);
+    _threadingPage->addKnob(_threadAffinityPolicy);
+    _knobsRequiringRestart.insert(_threadAffinityPolicy);
+
 
     _renderInSeparateProcess = _publicInterface->createKnob<KnobBool>("renderNewProcess");
     _renderInSeparateProcess->setLabel(tr("Render in a separate process"));
@@ -2128,6 +2170,75 @@ SettingsPrivate::initializeKnobsCaching()
 
     _cachingTab->addKnob(_diskCachePath);
 
+    _cacheEvictionPolicy = _publicInterface->createKnob<KnobChoice>("cacheEvictionPolicy");
+    _cacheEvictionPolicy->setLabel(tr("Cache Eviction Policy"));
+    {
+        std::vector<ChoiceOption> policies;
+        policies.push_back(ChoiceOption("LRU", tr("Least Recently Used").toStdString(), tr("When the cache is full, the entries that were not accessed for the longest time are removed first.").toStdString()));
+        policies.push_back(ChoiceOption("ScanResistant", tr("Scan Resistant").toStdString(), tr("When the cache is full, the entries that were accessed only once are removed before the entries that were re-used (2Q algorithm). "
+                                                                                                  "Scrubbing through a long sequence does not flush the images that are re-used across frames.").toStdString()));
+        policies.push_back(ChoiceOption("CostAware", tr("Cost Aware").toStdString(), tr("When the cache is full, among the least recently used entries, the ones that were the fastest to compute "
+                                                                                          "with respect to their size are removed first. Expensive results are kept longer in the cache.").toStdString()));
+        _cacheEvictionPolicy->populateChoices(policies);
+    }
+    _cacheEvictionPolicy->setHintToolTip( tr("Controls which entries are removed from the cache when it reaches its maximum size. "
+                                             "Hover each option with the mouse for a detailed description.") );
+    _cacheEvictionPolicy->setDefaultValue(0);
+    _cachingTab->addKnob(_cacheEvictionPolicy);
+
+    _cacheCompression = _publicInterface->createKnob<KnobChoice>("cacheCompression");
+    _cacheCompression->setLabel(tr("Evicted Tiles Compression"));
+    {
+        std::vector<ChoiceOption> compressions;
+        compressions.push_back(ChoiceOption("None", tr("None").toStdString(), tr("Tiles of images removed from the cache are dropped.").toStdString()));
+        compressions.push_back(ChoiceOption("Fast", tr("Fast").toStdString(), tr("Tiles of images removed from the cache are compressed quickly, with a lower compression ratio.").toStdString()));
+        compressions.push_back(ChoiceOption("High", tr("High").toStdString(), tr("Tiles of images removed from the cache are compressed with the highest compression ratio. "
+                                                                                 "More tiles can be kept in memory but removing and restoring them is slower.").toStdString()));
+        _cacheCompression->populateChoices(compressions);
+    }
+    _cacheCompression->setHintToolTip( tr("When the cache reaches its maximum size, the tiles of the images removed from the cache may be compressed and kept in memory "
+                                          "instead of being dropped. When an image is needed again, its tiles are uncompressed instead of being rendered again. "
+                                          "This uses a bit more CPU to hold more images in memory. Tiles are compressed in the background.") );
+    _cacheCompression->setDefaultValue(0);
+    _cachingTab->addKnob(_cacheCompression);
+
+    _maxCompressedCacheSizeMb = _publicInterface->createKnob<KnobInt>("maxCompressedCacheMb");
+    _maxCompressedCacheSizeMb->setLabel(tr("Maximum Compressed Tiles Size (MiB)"));
+    _maxCompressedCacheSizeMb->disableSlider();
+    _maxCompressedCacheSizeMb->setRange(0, INT_MAX);
+    _maxCompressedCacheSizeMb->setHintToolTip( tr("The maximum memory that may be used by the compressed tiles of the images removed from the cache (in MiB). "
+                                                  "Once reached, the tiles that were compressed first are dropped. "
+                                                  "The compressed tiles are part of the maximum RAM used by the cache and may not use more than a quarter of it.") );
+    _maxCompressedCacheSizeMb->setDefaultValue(2048);
+    _cachingTab->addKnob(_maxCompressedCacheSizeMb);
+
+    _cacheKeyHashing = _publicInterface->createKnob<KnobChoice>("cacheKeyHashing");
+    _cacheKeyHashing->setLabel(tr("Cache Keys Hashing"));
+    {
+        std::vector<ChoiceOption> algorithms;
+        algorithms.push_back(ChoiceOption("CRC64", tr("Compatible (CRC-64)").toStdString(), tr("Compute the keys of the cache like previous versions did. "
+                                                                                                 "Images that are already in the disk cache can be re-used.").toStdString()));
+        algorithms.push_back(ChoiceOption("Fast", tr("Fast").toStdString(), tr("Compute the keys of the cache with a much faster hash. "
+                                                                                "Images produced with the compatible hashing are not found in the cache.").toStdString()));
+        _cacheKeyHashing->populateChoices(algorithms);
+    }
+    _cacheKeyHashing->setHintToolTip( tr("The algorithm used to compute the hash of the parameters of the nodes, which identifies the images in the cache.") +
+                                      QLatin1Char('\n') +
+                                      tr("Changing this requires a restart of the application to take effect.") );
+    _cacheKeyHashing->setDefaultValue(1);
+    _knobsRequiringRestart.insert(_cacheKeyHashing);
+    _cachingTab->addKnob(_cacheKeyHashing);
+
+    _viewerPrefetchFrames = _publicInterface->createKnob<KnobInt>("viewerPrefetchFrames");
+    _viewerPrefetchFrames->setLabel(tr("Viewer Prefetch Frames"));
+    _viewerPrefetchFrames->disableSlider();
+    _viewerPrefetchFrames->setRange(0, 100);
+    _viewerPrefetchFrames->setHintToolTip( tr("When the viewer renders the current frame, the given number of frames following it are rendered "
+                                              "in the background with a low priority so that they are already in the cache when the timeline moves forward. "
+                                              "Background renders are cancelled as soon as the current frame changes. 0 disables this.") );
+    _viewerPrefetchFrames->setDefaultValue(0);
+    _cachingTab->addKnob(_viewerPrefetchFrames);
+
 
 } // Settings::initializeKnobsCaching
 
@@ -2337,8 +2448,9 @@ Settings::saveSettingsToFile()
             data.renderScaleEnabled = plugin->isRenderScaleEnabled();
             data.multiThreadingEnabled = plugin->isMultiThreadingEnabled();
             data.openGLEnabled = plugin->isOpenGLEnabled();
+            data.hostTilingEnabled = plugin->isHostTilingEnabled();
 
-            if (!data.enabled || !data.renderScaleEnabled || !data.multiThreadingEnabled || !data.openGLEnabled) {
+            if (!data.enabled || !data.renderScaleEnabled || !data.multiThreadingEnabled || !data.openGLEnabled || data.hostTilingEnabled) {
                 SERIALIZATION_NAMESPACE::SettingsSerialization::PluginID id;
                 id.identifier = plugin->getPluginID();
                 id.majorVersion = plugin->getMajorVersion();
@@ -2415,6 +2527,7 @@ SettingsPrivate::loadSettingsFromFileInternal(const SERIALIZATION_NAMESPACE::Set
             plugin->setRenderScaleEnabled(it->second.renderScaleEnabled);
             plugin->setMultiThreadingEnabled(it->second.multiThreadingEnabled);
             plugin->setOpenGLEnabled(it->second.openGLEnabled);
+            plugin->setHostTilingEnabled(it->second.hostTilingEnabled);
             
             
         } // for all plug-ins data
@@ -2665,6 +2778,7 @@ SettingsPrivate::restoreNumThreads()
     } else {
         QThreadPool::globalInstance()->setMaxThreadCount(nbThreads);
     }
+    MultiThread::setMaxThreadsPerEffect( _maxThreadsPerEffect->getValue() );
 }
 
 void
@@ -2681,6 +2795,62 @@ SettingsPrivate::refreshCacheSize()
     }
 }
 
+void
+SettingsPrivate::refreshCacheEvictionPolicy()
+{
+    CacheEvictionPolicyEnum policy = _publicInterface->getCacheEvictionPolicy();
+    CacheBasePtr tileCache = appPTR->getTileCache();
+    if (tileCache) {
+        tileCache->setEvictionPolicy(policy);
+    }
+
+    CacheBasePtr cache = appPTR->getGeneralPurposeCache();
+    if (cache) {
+        cache->setEvictionPolicy(policy);
+    }
+}
+
+CacheEvictionPolicyEnum
+Settings::getCacheEvictionPolicy() const
+{
+    return (CacheEvictionPolicyEnum)_imp->_cacheEvictionPolicy->getValue();
+}
+
+void
+SettingsPrivate::refreshCacheCompression()
+{
+    CacheBasePtr tileCache = appPTR->getTileCache();
+    if (tileCache) {
+        tileCache->setCompressedTierParameters(_publicInterface->getCacheCompression(), _publicInterface->getCompressedTilesCacheSize());
+    }
+}
+
+CacheCompressionEnum
+Settings::getCacheCompression() const
+{
+    return (CacheCompressionEnum)_imp->_cacheCompression->getValue();
+}
+
+Hash64AlgorithmEnum
+Settings::getCacheKeyHashingAlgorithm() const
+{
+    return (Hash64AlgorithmEnum)_imp->_cacheKeyHashing->getValue();
+}
+
+int
+Settings::getViewerPrefetchFramesCount() const
+{
+    return _imp->_viewerPrefetchFrames->getValue();
+}
+
+std::size_t
+Settings::getCompressedTilesCacheSize() const
+{
+    std::size_t kb = 1024;
+    std::size_t mb = kb * kb;
+    return (std::size_t)_imp->_maxCompressedCacheSizeMb->getValue() * mb;
+}
+
 std::size_t
 Settings::getGeneralPurposeCacheSize() const
 {
@@ -2713,7 +2883,11 @@ Settings::onKnobValueChanged(const KnobIPtr& k,
 
     if ( k == _imp->_maxDiskCacheSizeGb ) {
         _imp->refreshCacheSize();
-    }  else if ( k == _imp->_numberOfThreads ) {
+    } else if ( k == _imp->_cacheEvictionPolicy ) {
+        _imp->refreshCacheEvictionPolicy();
+    } else if ( k == _imp->_cacheCompression || k == _imp->_maxCompressedCacheSizeMb ) {
+        _imp->refreshCacheCompression();
+    }  else if ( ( k == _imp->_numberOfThreads ) || ( k == _imp->_maxThreadsPerEffect ) ) {
         _imp->restoreNumThreads();
     } else if ( k == _imp->_ocioConfigKnob ) {
         if (_imp->_ocioConfigKnob->getActiveEntry().id == NATRON_CUSTOM_OCIO_CONFIG_NAME) {
@@ -2901,6 +3075,12 @@ Settings::setNumberOfThreads(int threadsNb)
     _imp->_numberOfThreads->setValue(threadsNb);
 }
 
+ThreadAffinityPolicyEnum
+Settings::getThreadAffinityPolicy() const
+{
+    return (ThreadAffinityPolicyEnum)_imp->_threadAffinityPolicy->getValue();
+}
+
 bool
 Settings::isAutoPreviewOnForNewProjects() const
 {
@@ -3095,6 +3275,7 @@ Settings::restorePageToDefaults(const KnobPagePtr& tab)
                 (*it2)->setRenderScaleEnabled(true);
                 (*it2)->setMultiThreadingEnabled(true);
                 (*it2)->setOpenGLEnabled(true);
+                (*it2)->setHostTilingEnabled(false);
             }
         }
         _imp->pluginsData.clear();
@@ -127,12 +127,24 @@ public:
 
     std::size_t getTileCacheSize() const;
 
+    CacheEvictionPolicyEnum getCacheEvictionPolicy() const;
+
+    CacheCompressionEnum getCacheCompression() const;
+
+    std::size_t getCompressedTilesCacheSize() const;
+
+    Hash64AlgorithmEnum getCacheKeyHashingAlgorithm() const;
+
+    int getViewerPrefetchFramesCount() const;
+
     bool getColorPickerLinear() const;
 
     int getNumberOfThreads() const;
 
     void setNumberOfThreads(int threadsNb);
 
+    ThreadAffinityPolicyEnum getThreadAffinityPolicy() const;
+
     void populateSystemFonts(const std::vector<std::string>& fonts);
     
     bool doesKnobChangeRequireRestart(const KnobIPtr& knob);
@@ -0,0 +1,398 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "ThreadAffinity.h"
+
+#include <algorithm> // max
+#include <cassert>
+#include <cstdlib>
+#include <fstream>
+#include <sstream> // stringstream
+#include <vector>
+
+#if defined(__linux__)
+#define NATRON_THREAD_AFFINITY_LINUX
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+
+#include "Engine/ThreadStorage.h"
+
+NATRON_NAMESPACE_ENTER;
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+struct CPUTopology
+{
+    // The CPUs available to the process of each NUMA node
+    std::vector<std::vector<int> > nodes;
+
+    // All CPUs available to the process, ordered node by node, and the node of each of them
+    std::vector<int> cpus, cpuNodes;
+
+    // True if threads can be pinned
+    bool supported;
+
+    CPUTopology()
+        : nodes()
+        , cpus()
+        , cpuNodes()
+        , supported(false)
+    {
+    }
+};
+
+struct ThreadAffinityThreadData
+{
+    // The node to which the thread is bound: renders launched from this thread run on that node. -1 if none
+    int node;
+
+    // The node on whose CPUs the thread is currently allowed to run, or -1 if it may run on all CPUs.
+    // A thread of the thread pool may stay on the node of the last render it worked for, see ThreadAffinityNodeScope_RAII
+    int pinnedNode;
+
+    // The CPU to which the thread is pinned, or -1 if it may run on all the CPUs of pinnedNode
+    int cpu;
+
+    // True if the thread was pinned by pinCurrentThreadPoolThread()
+    bool isThreadPoolThread;
+
+    ThreadAffinityThreadData()
+        : node(-1)
+        , pinnedNode(-1)
+        , cpu(-1)
+        , isThreadPoolThread(false)
+    {
+    }
+};
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+static QMutex topologyMutex;
+static bool topologyInitialized = false;
+static CPUTopology topology;
+
+static QAtomicInt currentPolicy(eThreadAffinityPolicyNone);
+
+// Used to spread threads and renders in a round-robin fashion
+static QAtomicInt nextThreadIndex(0);
+static QAtomicInt nextRenderNode(0);
+
+static ThreadStorage<ThreadAffinityThreadData> threadsData;
+
+#ifdef NATRON_THREAD_AFFINITY_LINUX
+// Parses a list such as "0-3,8-11" as found in /sys/devices/system/node
+static std::vector<int>
+readCPUList(const std::string& filePath)
+{
+    std::vector<int> ret;
+    std::ifstream ifile( filePath.c_str() );
+
+    if ( !ifile.is_open() ) {
+        return ret;
+    }
+    std::string list;
+    std::getline(ifile, list);
+
+    std::stringstream ss(list);
+    std::string range;
+    while ( std::getline(ss, range, ',') ) {
+        if ( range.empty() || (range[0] < '0') || (range[0] > '9') ) {
+            continue;
+        }
+        int first = std::atoi( range.c_str() );
+        int last = first;
+        std::size_t dash = range.find('-');
+        if (dash != std::string::npos) {
+            last = std::atoi( range.c_str() + dash + 1 );
+        }
+        for (int i = first; i <= last; ++i) {
+            ret.push_back(i);
+        }
+    }
+
+    return ret;
+}
+
+static bool
+setCurrentThreadCPUs(const std::vector<int>& cpus)
+{
+    if ( cpus.empty() ) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (std::size_t i = 0; i < cpus.size(); ++i) {
+        CPU_SET(cpus[i], &set);
+    }
+
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+#else // !NATRON_THREAD_AFFINITY_LINUX
+
+static bool
+setCurrentThreadCPUs(const std::vector<int>& /*cpus*/)
+{
+    return false;
+}
+
+#endif // NATRON_THREAD_AFFINITY_LINUX
+
+// Returns the current value of the round-robin counter and advances it, modulo count, so that it never overflows
+// however many threads the thread pool spawns over the lifetime of the process
+static int
+takeRoundRobinIndex(QAtomicInt* counter,
+                    int count)
+{
+    for (;;) {
+        int index = (int)*counter;
+        if ( counter->testAndSetOrdered(index, (index + 1) % count) ) {
+            return index % count;
+        }
+    }
+}
+
+static void
+initializeTopology(CPUTopology* topo)
+{
+#ifdef NATRON_THREAD_AFFINITY_LINUX
+    // Only consider the CPUs on which the process may run (e.g: when launched with taskset or in a cgroup).
+    // This is called from the main thread before any thread is pinned.
+    cpu_set_t processSet;
+    CPU_ZERO(&processSet);
+    if (sched_getaffinity(0, sizeof(processSet), &processSet) != 0) {
+        return;
+    }
+
+    std::vector<int> nodeIds = readCPUList("/sys/devices/system/node/online");
+    for (std::size_t i = 0; i < nodeIds.size(); ++i) {
+        std::stringstream ss;
+        ss << "/sys/devices/system/node/node" << nodeIds[i] << "/cpulist";
+        std::vector<int> nodeCPUs = readCPUList( ss.str() );
+        std::vector<int> availableCPUs;
+        for (std::size_t c = 0; c < nodeCPUs.size(); ++c) {
+            if ( (nodeCPUs[c] < CPU_SETSIZE) && CPU_ISSET(nodeCPUs[c], &processSet) ) {
+                availableCPUs.push_back(nodeCPUs[c]);
+            }
+        }
+        // Nodes with memory only are not used
+        if ( !availableCPUs.empty() ) {
+            topo->nodes.push_back(availableCPUs);
+        }
+    }
+
+    // Without NUMA information, consider all CPUs belong to a single node
+    if ( topo->nodes.empty() ) {
+        std::vector<int> availableCPUs;
+        for (int c = 0; c < CPU_SETSIZE; ++c) {
+            if ( CPU_ISSET(c, &processSet) ) {
+                availableCPUs.push_back(c);
+            }
+        }
+        if ( availableCPUs.empty() ) {
+            return;
+        }
+        topo->nodes.push_back(availableCPUs);
+    }
+
+    for (std::size_t i = 0; i < topo->nodes.size(); ++i) {
+        for (std::size_t c = 0; c < topo->nodes[i].size(); ++c) {
+            topo->cpus.push_back(topo->nodes[i][c]);
+            topo->cpuNodes.push_back( (int)i );
+        }
+    }
+    topo->supported = true;
+#else
+    Q_UNUSED(topo);
+#endif
+} // initializeTopology
+
+static const CPUTopology&
+getTopology()
+{
+    QMutexLocker k(&topologyMutex);
+
+    if (!topologyInitialized) {
+        initializeTopology(&topology);
+        topologyInitialized = true;
+    }
+
+    return topology;
+}
+
+void
+ThreadAffinity::setPolicy(ThreadAffinityPolicyEnum policy)
+{
+    // Read the topology now, from the main thread, before any thread is pinned
+    (void)getTopology();
+    currentPolicy.fetchAndStoreOrdered( (int)policy );
+}
+
+ThreadAffinityPolicyEnum
+ThreadAffinity::getPolicy()
+{
+    return (ThreadAffinityPolicyEnum)(int)currentPolicy;
+}
+
+bool
+ThreadAffinity::getPolicyFromString(const std::string& str,
+                                    ThreadAffinityPolicyEnum* policy)
+{
+    if (str == "none") {
+        *policy = eThreadAffinityPolicyNone;
+    } else if (str == "core") {
+        *policy = eThreadAffinityPolicyCore;
+    } else if (str == "numa") {
+        *policy = eThreadAffinityPolicyNUMANode;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+bool
+ThreadAffinity::isPinningSupported()
+{
+    return getTopology().supported;
+}
+
+int
+ThreadAffinity::getNumNodes()
+{
+    return std::max( (int)getTopology().nodes.size(), 1 );
+}
+
+void
+ThreadAffinity::pinCurrentThreadPoolThread()
+{
+    ThreadAffinityPolicyEnum policy = getPolicy();
+
+    if (policy == eThreadAffinityPolicyNone) {
+        return;
+    }
+    const CPUTopology& topo = getTopology();
+    if (!topo.supported) {
+        return;
+    }
+
+    ThreadAffinityThreadData& data = threadsData.localData();
+    data.isThreadPoolThread = true;
+    if (policy == eThreadAffinityPolicyCore) {
+        // CPUs are ordered node by node: consecutive threads share the caches of the same socket
+        int cpuIndex = takeRoundRobinIndex( &nextThreadIndex, (int)topo.cpus.size() );
+        if ( setCurrentThreadCPUs( std::vector<int>(1, topo.cpus[cpuIndex]) ) ) {
+            data.node = topo.cpuNodes[cpuIndex];
+            data.pinnedNode = data.node;
+            data.cpu = topo.cpus[cpuIndex];
+        }
+    } else {
+        int node = takeRoundRobinIndex( &nextThreadIndex, (int)topo.nodes.size() );
+        if ( setCurrentThreadCPUs(topo.nodes[node]) ) {
+            data.node = node;
+            data.pinnedNode = node;
+            data.cpu = -1;
+        }
+    }
+} // pinCurrentThreadPoolThread
+
+int
+ThreadAffinity::getNodeForNewRender()
+{
+    if (getPolicy() != eThreadAffinityPolicyNUMANode) {
+        return -1;
+    }
+    const CPUTopology& topo = getTopology();
+    if ( !topo.supported || (topo.nodes.size() < 2) ) {
+        return -1;
+    }
+
+    int currentNode = threadsData.localData().node;
+    if (currentNode != -1) {
+        return currentNode;
+    }
+
+    return takeRoundRobinIndex( &nextRenderNode, (int)topo.nodes.size() );
+}
+
+ThreadAffinityNodeScope_RAII::ThreadAffinityNodeScope_RAII(int node)
+    : _previousNode(-1)
+    , _previousPinnedNode(-1)
+    , _previousCPU(-1)
+    , _bound(false)
+    , _repinned(false)
+{
+    if (node == -1) {
+        return;
+    }
+    ThreadAffinityThreadData& data = threadsData.localData();
+    _previousNode = data.node;
+    _bound = true;
+    data.node = node;
+
+    // A thread of the thread pool stays on the node of the last render it worked for: it is only re-pinned
+    // when it takes a task of a render bound to another node.
+    if ( (data.pinnedNode == node) && (data.cpu == -1) ) {
+        return;
+    }
+    const CPUTopology& topo = getTopology();
+    assert( node < (int)topo.nodes.size() );
+    if ( setCurrentThreadCPUs(topo.nodes[node]) ) {
+        _previousPinnedNode = data.pinnedNode;
+        _previousCPU = data.cpu;
+        _repinned = true;
+        data.pinnedNode = node;
+        data.cpu = -1;
+    }
+}
+
+ThreadAffinityNodeScope_RAII::~ThreadAffinityNodeScope_RAII()
+{
+    if (!_bound) {
+        return;
+    }
+    ThreadAffinityThreadData& data = threadsData.localData();
+    data.node = _previousNode;
+
+    // Other threads, e.g: the thread launching the render, get their affinity back
+    if (!_repinned || data.isThreadPoolThread) {
+        return;
+    }
+    const CPUTopology& topo = getTopology();
+    if (_previousCPU != -1) {
+        setCurrentThreadCPUs( std::vector<int>(1, _previousCPU) );
+    } else if (_previousPinnedNode != -1) {
+        setCurrentThreadCPUs(topo.nodes[_previousPinnedNode]);
+    } else {
+        setCurrentThreadCPUs(topo.cpus);
+    }
+    data.pinnedNode = _previousPinnedNode;
+    data.cpu = _previousCPU;
+}
+
+NATRON_NAMESPACE_EXIT;
@@ -0,0 +1,117 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef Engine_ThreadAffinity_h
+#define Engine_ThreadAffinity_h
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <string>
+
+#include "Global/GlobalDefines.h"
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER;
+
+/**
+ * @brief Pins the threads of the global thread pool to cores or NUMA nodes depending on the ThreadAffinityPolicyEnum.
+ * The topology is read from /sys/devices/system/node on Linux, restricted to the CPUs the process may run on.
+ * Pinning is only implemented on Linux: on other systems, or when the policy is eThreadAffinityPolicyNone,
+ * threads are left to the OS scheduler as before.
+ *
+ * With eThreadAffinityPolicyNUMANode, each TreeRender is assigned a node and all the FrameViewRequests of the
+ * frame are rendered by threads bound to that node. Since Linux allocates memory on the node of the thread that
+ * first touches it, the tiles of the frame are then allocated on that node as well.
+ *
+ * Threads of the thread pool are only pinned when they start if Qt was built with QT_CUSTOM_THREADPOOL (see ThreadPool.h).
+ * Otherwise eThreadAffinityPolicyCore has no effect and with eThreadAffinityPolicyNUMANode the threads are only bound to a
+ * node while they render a frame.
+ **/
+class ThreadAffinity
+{
+public:
+
+    /**
+     * @brief Set the policy applied to the threads of the thread pool. Threads already pinned keep their
+     * affinity until they exit, hence this should be called before any render is launched.
+     **/
+    static void setPolicy(ThreadAffinityPolicyEnum policy);
+
+    static ThreadAffinityPolicyEnum getPolicy();
+
+    /**
+     * @brief Converts "none", "core" or "numa" to a policy. Returns false if the string is not recognized.
+     **/
+    static bool getPolicyFromString(const std::string& str, ThreadAffinityPolicyEnum* policy);
+
+    /**
+     * @brief Returns true if threads can be pinned on this system.
+     **/
+    static bool isPinningSupported();
+
+    /**
+     * @brief Returns the number of NUMA nodes that have at least one CPU available to the process, at least 1.
+     **/
+    static int getNumNodes();
+
+    /**
+     * @brief Called by each thread of the global thread pool when it starts, pins it according to the policy.
+     * Successive threads are spread over the cores, or the nodes, in a round-robin fashion. Threads that expire
+     * and are spawned again by the pool keep going round the same CPUs, hence the spread is only even while the
+     * pool does not shrink.
+     **/
+    static void pinCurrentThreadPoolThread();
+
+    /**
+     * @brief Returns the node on which a new TreeRender should run, or -1 if renders should not be bound to a node.
+     * A render launched from a thread already bound to a node, e.g: a render launched by a plug-in during another render,
+     * stays on that node. Otherwise nodes are assigned in a round-robin fashion.
+     **/
+    static int getNodeForNewRender();
+};
+
+/**
+ * @brief Binds the calling thread to the given node during the scope of the object: renders it launches run on that node
+ * and it is pinned to the CPUs of the node if it was not already. Does nothing if node is -1.
+ * When destroyed, a thread of the thread pool stays pinned to the node, so that a thread working for renders of the same node
+ * is pinned once rather than twice per task. Other threads get their previous affinity back.
+ **/
+class ThreadAffinityNodeScope_RAII
+{
+    int _previousNode;
+    int _previousPinnedNode;
+    int _previousCPU;
+    bool _bound;
+    bool _repinned;
+
+public:
+
+    ThreadAffinityNodeScope_RAII(int node);
+
+    ~ThreadAffinityNodeScope_RAII();
+};
+
+NATRON_NAMESPACE_EXIT;
+
+#endif // Engine_ThreadAffinity_h
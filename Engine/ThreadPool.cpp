@@ -33,6 +33,7 @@
 #include <QtCore/QThreadPool>
 
 #include "Engine/Node.h"
+#include "Engine/ThreadAffinity.h"
 #include "Engine/TreeRender.h"
 
 NATRON_NAMESPACE_ENTER;
@@ -138,6 +139,13 @@ public:
     virtual bool isThreadPoolThread() const { return true; }
 
     virtual ~ThreadPoolThread() {}
+
+    virtual void run()
+    {
+        // Pin the thread once for its whole lifetime, before it runs any task
+        ThreadAffinity::pinCurrentThreadPoolThread();
+        QThreadPoolThread::run();
+    }
 };
 
 NATRON_NAMESPACE_ANONYMOUS_EXIT
@@ -776,6 +776,34 @@ transformRegionFromRoD(const RectD &srcRect,
 
     transformRegionFromPoints(p, dstRect);
 }
+
+// compute the bounding box of the transform of a rectangle by the inverse matrix
+bool
+inverseTransformRegion(const RectD &srcRect,
+                       const Matrix3x3 &transform,
+                       RectD* dstRect)
+{
+    double det = matDeterminant(transform);
+
+    if (det == 0.) {
+        return false;
+    }
+    Matrix3x3 invTransform = matInverse(transform, det);
+    Point3D p[4];
+    p[0] = matApply( invTransform, Point3D(srcRect.x1, srcRect.y1, 1) );
+    p[1] = matApply( invTransform, Point3D(srcRect.x1, srcRect.y2, 1) );
+    p[2] = matApply( invTransform, Point3D(srcRect.x2, srcRect.y2, 1) );
+    p[3] = matApply( invTransform, Point3D(srcRect.x2, srcRect.y1, 1) );
+    for (int i = 0; i < 4; ++i) {
+        if (p[i].z <= 0.) {
+            // the corner is mapped to or beyond infinity by a perspective matrix
+            return false;
+        }
+    }
+    transformRegionFromPoints(p, *dstRect);
+
+    return true;
+}
 } //namespace Transform
 NATRON_NAMESPACE_EXIT;
 
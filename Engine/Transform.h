@@ -282,6 +282,10 @@ Point4D matApply(const Matrix4x4 & m, const Point4D & p);
 // compute the bounding box of the transform of a rectangle
 void transformRegionFromRoD(const RectD &srcRect, const Matrix3x3 &transform, RectD &dstRect);
 
+// compute the bounding box of the transform of a rectangle by the inverse of the given matrix.
+// Returns false if the matrix cannot be inverted or if the line at infinity crosses the transformed rectangle.
+bool inverseTransformRegion(const RectD &srcRect, const Matrix3x3 &transform, RectD* dstRect);
+
 // Matrix4x4 matrix4x4FromMatrix3x3(const Matrix3x3& m);
 } // namespace Transform
 NATRON_NAMESPACE_EXIT;
@@ -25,25 +25,31 @@
 
 #include "TreeRender.h"
 
+#include <algorithm>
+#include <map>
 #include <set>
+#include <QtCore/QAtomicInt>
 #include <QtCore/QThread>
 #include <QMutex>
 #include <QTimer>
 #include <QDebug>
-#include <QWaitCondition>
-#include <QRunnable>
 
+#include "Engine/CancellationToken.h"
 #include "Engine/Image.h"
 #include "Engine/EffectInstance.h"
 #include "Engine/FrameViewRequest.h"
 #include "Engine/GPUContextPool.h"
 #include "Engine/Node.h"
 #include "Engine/NodeGroup.h"
+#include "Engine/Plugin.h"
+#include "Engine/RenderStats.h"
 #include "Engine/RotoStrokeItem.h"
 #include "Engine/Settings.h"
 #include "Engine/Timer.h"
+#include "Engine/ThreadAffinity.h"
 #include "Engine/ThreadPool.h"
 #include "Engine/TLSHolder.h"
+#include "Engine/WorkStealingExecutor.h"
 
 // After this amount of time, if any thread identified in this render is still remaining
 // that means they are stuck probably doing a long processing that cannot be aborted or in a separate thread
@@ -61,6 +67,11 @@ NATRON_NAMESPACE_ENTER;
 
 typedef std::set<AbortableThread*> ThreadSet;
 
+// Incremented for each render created, see TreeRender::getRenderIndex(). 64-bit so that it never wraps around,
+// which would let a render wait on a newer one.
+static QMutex renderIndexCounterMutex;
+static U64 renderIndexCounter = 0;
+
 enum TreeRenderStateEnum
 {
     eTreeRenderStateOK,
@@ -144,13 +155,18 @@ struct TreeRenderPrivate
     // the OpenGL contexts
     OSGLContextWPtr openGLContext, cpuOpenGLContext;
 
-    // Are we aborted ?
-    QAtomicInt aborted;
+    // Cancelled when the render is aborted. It is a child of CtorArgs::parentCancellationToken, if any.
+    CancellationTokenPtr cancellationToken;
 
+    // Increasing index of this render amongst all renders created by the process, see TreeRender::getRenderIndex()
+    U64 renderIndex;
 
     bool handleNaNs;
     bool useConcatenations;
 
+    // The NUMA node on which all the tasks of this render are executed so that the tiles are allocated
+    // on that node, or -1. See ThreadAffinity::getNodeForNewRender()
+    int numaNode;
 
     TreeRenderPrivate(TreeRender* publicInterface)
     : _publicInterface(publicInterface)
@@ -165,11 +181,12 @@ struct TreeRenderPrivate
     , activeStrokeUpdateAreaSet(false)
     , openGLContext()
     , cpuOpenGLContext()
-    , aborted()
+    , cancellationToken()
+    , renderIndex(0)
     , handleNaNs(true)
     , useConcatenations(true)
+    , numaNode(-1)
     {
-        aborted.fetchAndStoreAcquire(0);
 
     }
 
@@ -195,6 +212,12 @@ struct TreeRenderPrivate
                                            const ImagePlaneDesc* plane,
                                            const RectD* canonicalRoI,
                                            FrameViewRequestPtr* outputRequest);
+
+    /**
+     * @brief Estimates the cost of each render of the request pass and the critical path priority
+     * that the WorkStealingExecutor uses to launch first the renders that bound the duration of the whole tree render.
+     **/
+    void computeCriticalPathPriorities(const RequestPassSharedDataPtr& requestData);
 };
 
 TreeRender::CtorArgs::CtorArgs()
@@ -211,6 +234,8 @@ TreeRender::CtorArgs::CtorArgs()
 , draftMode(false)
 , playback(false)
 , byPassCache(false)
+, prefetch(false)
+, parentCancellationToken()
 {
 
 }
@@ -288,16 +313,25 @@ TreeRender::getCurrentlyDrawingItem() const
 bool
 TreeRender::isRenderAborted() const
 {
-    if ((int)_imp->aborted > 0) {
-        return true;
-    }
-    return false;
+    return _imp->cancellationToken->isCancelled();
 }
 
 void
 TreeRender::setRenderAborted()
 {
-    _imp->aborted.fetchAndAddAcquire(1);
+    _imp->cancellationToken->cancel();
+}
+
+CancellationTokenPtr
+TreeRender::getCancellationToken() const
+{
+    return _imp->cancellationToken;
+}
+
+U64
+TreeRender::getRenderIndex() const
+{
+    return _imp->renderIndex;
 }
 
 bool
@@ -306,6 +340,12 @@ TreeRender::isPlayback() const
     return _imp->ctorArgs->playback;
 }
 
+bool
+TreeRender::isPrefetchRender() const
+{
+    return _imp->ctorArgs->prefetch;
+}
+
 
 bool
 TreeRender::isDraftRender() const
@@ -447,6 +487,7 @@ TreeRenderPrivate::init(const TreeRender::CtorArgsPtr& inArgs)
     SettingsPtr settings = appPTR->getCurrentSettings();
     handleNaNs = settings && settings->isNaNHandlingEnabled();
     useConcatenations = settings && settings->isTransformConcatenationEnabled();
+    numaNode = ThreadAffinity::getNodeForNewRender();
     
     // Initialize all requested extra nodes to a null result
     for (std::list<NodePtr>::const_iterator it = inArgs->extraNodesToSample.begin(); it != inArgs->extraNodesToSample.end(); ++it) {
@@ -465,6 +506,13 @@ TreeRender::create(const CtorArgsPtr& inArgs)
     TreeRenderPtr render(new TreeRender());
 
     assert(!inArgs->treeRootEffect->isRenderClone());
+
+    // The token must exist even if the initialization fails
+    render->_imp->cancellationToken = CancellationToken::create(inArgs->parentCancellationToken);
+    {
+        QMutexLocker k(&renderIndexCounterMutex);
+        render->_imp->renderIndex = renderIndexCounter++;
+    }
     
     try {
         // Setup the render tree and make local copy of knob values for the render.
@@ -486,9 +534,7 @@ struct RequestPassSharedDataPrivate
     // Protects dependencyFreeRenders and allRenderTasks
     mutable QMutex dependencyFreeRendersMutex;
 
-    QWaitCondition dependencyFreeRendersEmptyCond;
-
-    // A set of renders that we can launch right now
+    // A set of renders that we can launch right now, filled by the request pass
     boost::scoped_ptr<DependencyFreeRenderSet> dependencyFreeRenders;
 
     // All renders left to do
@@ -501,7 +547,6 @@ struct RequestPassSharedDataPrivate
 
     RequestPassSharedDataPrivate()
     : dependencyFreeRendersMutex()
-    , dependencyFreeRendersEmptyCond()
     , dependencyFreeRenders()
     , allRenderTasksToProcess()
     , stat(eActionStatusOK)
@@ -577,29 +622,52 @@ public:
 };
 
 
-class FrameViewRenderRunnable : public QRunnable
+// Number of pixels to render for a request at its scale
+static double
+getRequestPixelsCount(const FrameViewRequestPtr& request)
+{
+    RectD roi = request->getCurrentRoI();
+    if ( roi.isNull() ) {
+        return 0.;
+    }
+    const RenderScale& proxyScale = request->getProxyScale();
+    double mipMapScale = Image::getScaleFromMipMapLevel( request->getMipMapLevel() );
+
+    return roi.width() * proxyScale.x * mipMapScale * roi.height() * proxyScale.y * mipMapScale;
+}
+
+class FrameViewRenderTask : public WorkStealingTask
 {
 
     RequestPassSharedDataWPtr _sharedData;
     FrameViewRequestWPtr _request;
     TreeRenderPrivate* _imp;
+    double _priority;
 public:
 
-    FrameViewRenderRunnable(TreeRenderPrivate* imp, const RequestPassSharedDataPtr& sharedData, const FrameViewRequestPtr& request)
-    : QRunnable()
+    FrameViewRenderTask(TreeRenderPrivate* imp, const RequestPassSharedDataPtr& sharedData, const FrameViewRequestPtr& request)
+    : WorkStealingTask()
     , _sharedData(sharedData)
     , _request(request)
     , _imp(imp)
+    , _priority(request->getCriticalPathPriority(sharedData))
     {
         assert(request);
     }
 
-    virtual ~FrameViewRenderRunnable()
+    virtual double getPriority() const OVERRIDE FINAL
     {
+        return _priority;
     }
 
-    virtual void run() OVERRIDE FINAL
+    virtual ~FrameViewRenderTask()
     {
+    }
+
+    virtual void run(WorkStealingExecutor* executor, int workerIndex) OVERRIDE FINAL
+    {
+        // The task may have been stolen by a thread of another node
+        ThreadAffinityNodeScope_RAII affinityScope(_imp->numaNode);
 
         RequestPassSharedDataPtr sharedData = _sharedData.lock();
 
@@ -612,63 +680,135 @@ public:
         FrameViewRequestPtr request = _request.lock();
         EffectInstancePtr renderClone = request->getEffect();
 
+        // Tasks that were queued before the render got aborted only release their listeners
+        CancellationTokenPtr cancellationToken = request->getCancellationToken();
+        if ( !isFailureRetCode(stat) && cancellationToken && cancellationToken->isCancelled() ) {
+            stat = eActionStatusAborted;
+        }
+
         if (!isFailureRetCode(stat)) {
 #ifdef TRACE_RENDER_DEPENDENCIES
             qDebug() << sharedData.get() << "Launching render of" << renderClone->getScriptName_mt_safe().c_str() << request->getPlaneDesc().getPlaneLabel().c_str();
 #endif
+            // Learn the cost of the plug-in from the renders that actually had to be computed
+            bool mustRender = request->getStatus() == FrameViewRequest::eFrameViewRequestStatusNotRendered;
+            TimeLapse timer;
             stat = renderClone->launchRender(sharedData, request);
+            if (mustRender && stat == eActionStatusOK) {
+                PluginPtr plugin = renderClone->getNode()->getPlugin();
+                if (plugin) {
+                    plugin->recordRenderCost( timer.getTimeSinceCreation(), getRequestPixelsCount(request) );
+                }
+            }
         }
 
         // Remove all stashed input frame view requests that we kept around.
         request->clearRenderedDependencies(sharedData);
 
-        QMutexLocker k(&sharedData->_imp->dependencyFreeRendersMutex);
+        {
+            QMutexLocker k(&sharedData->_imp->dependencyFreeRendersMutex);
 
-        if (isFailureRetCode(stat)) {
-            sharedData->_imp->stat = stat;
-        }
+            if (isFailureRetCode(stat)) {
+                sharedData->_imp->stat = stat;
+            }
 
-        // Remove this render from all tasks left
-        {
-            std::set<FrameViewRequestPtr>::const_iterator foundTask = sharedData->_imp->allRenderTasksToProcess.find(request);
+            // Remove this render from all tasks left
+            std::set<FrameViewRequestPtr>::iterator foundTask = sharedData->_imp->allRenderTasksToProcess.find(request);
             assert(foundTask != sharedData->_imp->allRenderTasksToProcess.end());
             if (foundTask != sharedData->_imp->allRenderTasksToProcess.end()) {
                 sharedData->_imp->allRenderTasksToProcess.erase(foundTask);
             }
         }
 
+        // If the results for this node were requested by the caller, insert them
+        {
+            QMutexLocker k(&_imp->extraRequestedResultsMutex);
+            std::map<NodePtr, FrameViewRequestPtr>::iterator foundRequested = _imp->extraRequestedResults.find(renderClone->getNode());
+            if (foundRequested != _imp->extraRequestedResults.end() && !foundRequested->second) {
+                foundRequested->second = request;
+            }
+        }
+
         // For each frame/view that depend on this frame, remove it from the dependencies list.
+        // The FrameViewRequest is locked internally so that only the last of its dependencies to finish sees 0 dependencies left.
         std::list<FrameViewRequestPtr> listeners = request->getListeners(sharedData);
         for (std::list<FrameViewRequestPtr>::const_iterator it = listeners.begin(); it != listeners.end(); ++it) {
             int numDepsLeft = (*it)->markDependencyAsRendered(sharedData, request);
 
-            // If the task has all its dependencies available, add it to the render queue.
+            // If the task has all its dependencies available, give it to this worker: it will be executed by this thread
+            // right after unless an idle thread steals it.
             if (numDepsLeft == 0) {
-                if (sharedData->_imp->dependencyFreeRenders->find(*it) == sharedData->_imp->dependencyFreeRenders->end()) {
 #ifdef TRACE_RENDER_DEPENDENCIES
-                    qDebug() << sharedData.get() << "Adding" << (*it)->getEffect()->getScriptName_mt_safe().c_str() << (*it)->getPlaneDesc().getPlaneLabel().c_str()  << "(" << it->get() << ") to the dependency-free list";
+                qDebug() << sharedData.get() << "Enqueuing" << (*it)->getEffect()->getScriptName_mt_safe().c_str() << (*it)->getPlaneDesc().getPlaneLabel().c_str()  << "(" << it->get() << ")";
 #endif
-                    assert(sharedData->_imp->allRenderTasksToProcess.find(*it) != sharedData->_imp->allRenderTasksToProcess.end());
-                    sharedData->_imp->dependencyFreeRenders->insert(*it);
-                }
+                executor->enqueue(WorkStealingTaskPtr( new FrameViewRenderTask(_imp, sharedData, *it) ), workerIndex);
             }
         }
+    }
+};
 
 
-        // If the results for this node were requested by the caller, insert them
-        {
-            QMutexLocker k(&_imp->extraRequestedResultsMutex);
-            std::map<NodePtr, FrameViewRequestPtr>::iterator foundRequested = _imp->extraRequestedResults.find(renderClone->getNode());
-            if (foundRequested != _imp->extraRequestedResults.end() && !foundRequested->second) {
-                foundRequested->second = request;
+static double
+computeCriticalPathPriority(const FrameViewRequestPtr& request,
+                            const RequestPassSharedDataPtr& requestData,
+                            const std::set<FrameViewRequestPtr>& tasks,
+                            std::map<FrameViewRequestPtr, double>* priorities)
+{
+    std::map<FrameViewRequestPtr, double>::const_iterator found = priorities->find(request);
+    if ( found != priorities->end() ) {
+        return found->second;
+    }
+
+    // The listeners cannot start before this request is done: this request is on the path of the most expensive of them
+    double maxListenerPriority = 0.;
+    std::list<FrameViewRequestPtr> listeners = request->getListeners(requestData);
+    for (std::list<FrameViewRequestPtr>::const_iterator it = listeners.begin(); it != listeners.end(); ++it) {
+        if ( !*it || ( tasks.find(*it) == tasks.end() ) ) {
+            continue;
+        }
+        maxListenerPriority = std::max( maxListenerPriority, computeCriticalPathPriority(*it, requestData, tasks, priorities) );
+    }
+
+    double priority = request->getEstimatedRenderCost() + maxListenerPriority;
+    request->setCriticalPathPriority(requestData, priority);
+    (*priorities)[request] = priority;
+
+    return priority;
+} // computeCriticalPathPriority
+
+void
+TreeRenderPrivate::computeCriticalPathPriorities(const RequestPassSharedDataPtr& requestData)
+{
+    std::set<FrameViewRequestPtr> tasks;
+    {
+        QMutexLocker k(&requestData->_imp->dependencyFreeRendersMutex);
+        tasks = requestData->_imp->allRenderTasksToProcess;
+    }
+
+    // Requests that are cached or pass-through are almost free
+    for (std::set<FrameViewRequestPtr>::const_iterator it = tasks.begin(); it != tasks.end(); ++it) {
+        double cost = 0.;
+        if ( (*it)->getStatus() == FrameViewRequest::eFrameViewRequestStatusNotRendered ) {
+            PluginPtr plugin = (*it)->getEffect()->getNode()->getPlugin();
+            if (plugin) {
+                cost = plugin->getEstimatedRenderCostPerPixel() * getRequestPixelsCount(*it);
             }
         }
+        (*it)->setEstimatedRenderCost(cost);
+    }
 
-        // Notify the main render thread that some more stuff can be rendered (or that we are done)
-        sharedData->_imp->dependencyFreeRendersEmptyCond.wakeOne();
+    std::map<FrameViewRequestPtr, double> priorities;
+    for (std::set<FrameViewRequestPtr>::const_iterator it = tasks.begin(); it != tasks.end(); ++it) {
+        computeCriticalPathPriority(*it, requestData, tasks, &priorities);
     }
-};
 
+    const RenderStatsPtr& stats = ctorArgs->stats;
+    if ( stats && stats->isInDepthProfilingEnabled() ) {
+        for (std::set<FrameViewRequestPtr>::const_iterator it = tasks.begin(); it != tasks.end(); ++it) {
+            stats->addPriorityInfosForNode( (*it)->getEffect()->getNode(), (*it)->getEstimatedRenderCost(), priorities[*it] );
+        }
+    }
+} // computeCriticalPathPriorities
 
 ActionRetCodeEnum
 TreeRenderPrivate::launchRenderInternal(bool removeRenderClonesWhenFinished,
@@ -728,6 +868,9 @@ TreeRenderPrivate::launchRenderInternal(bool removeRenderClonesWhenFinished,
     }
     ActionRetCodeEnum stat = eActionStatusOK;
     {
+        // The request pass and the tasks executed by this thread allocate on the node of the render
+        ThreadAffinityNodeScope_RAII affinityScope(numaNode);
+
         RequestPassSharedDataPtr requestData(new RequestPassSharedData());
         requestData->_imp->dependencyFreeRenders.reset(new DependencyFreeRenderSet(FrameViewRequestComparePriority(requestData)));
 
@@ -754,66 +897,34 @@ TreeRenderPrivate::launchRenderInternal(bool removeRenderClonesWhenFinished,
             return eActionStatusFailed;
         }
 
-        int numTasksRemaining;
-        {
-            QMutexLocker k(&requestData->_imp->dependencyFreeRendersMutex);
-            numTasksRemaining = requestData->_imp->allRenderTasksToProcess.size();
-        }
-
-#ifndef TREE_RENDER_DISABLE_MT
-        QThreadPool* threadPool = QThreadPool::globalInstance();
-        bool isThreadPoolThread = isRunningInThreadPoolThread();
-#endif
-
-        // See bug https://bugreports.qt.io/browse/QTBUG-20251
-        // The Qt thread-pool mem-leaks the runnable if using release/reserveThread
-        // Instead we explicitly manage them and ensure they do not hold any external strong refs.
-        std::vector<boost::shared_ptr<FrameViewRenderRunnable> > runnables;
-
-        // While we still have tasks to render loop
-        while (numTasksRemaining > 0) {
 
+        computeCriticalPathPriorities(requestData);
 
-            // Launch all dependency-free tasks in parallel
-            QMutexLocker k(&requestData->_imp->dependencyFreeRendersMutex);
-            while (requestData->_imp->dependencyFreeRenders->size() > 0) {
-
-                FrameViewRequestPtr request = *requestData->_imp->dependencyFreeRenders->begin();
-                requestData->_imp->dependencyFreeRenders->erase(requestData->_imp->dependencyFreeRenders->begin());
-#ifdef TRACE_RENDER_DEPENDENCIES
-                qDebug() << "Queuing " << request->getEffect()->getScriptName_mt_safe().c_str() << " in task pool";
-#endif
-                boost::shared_ptr<FrameViewRenderRunnable> runnable(new FrameViewRenderRunnable(this, requestData, request));
+        // Each task enqueues the renders it unblocks when done, so that the executor runs the whole graph.
+        // This thread executes tasks as well instead of waiting for the thread pool.
 #ifdef TREE_RENDER_DISABLE_MT
-                k.unlock();
-                runnable->run();
-                k.relock();
+        const int maxWorkers = 0;
 #else
-                runnable->setAutoDelete(false);
-                runnables.push_back(runnable);
-                threadPool->start(runnable.get());
+        const int maxWorkers = QThreadPool::globalInstance()->maxThreadCount();
 #endif
+        // Interactive renders (e.g: the viewer displaying the current frame) take precedence over
+        // playback, renders on disk and prefetching which render frames ahead of time.
+        WorkStealingExecutorPriorityEnum priority = (ctorArgs->playback || ctorArgs->prefetch) ? eWorkStealingExecutorPriorityNormal : eWorkStealingExecutorPriorityHigh;
+        WorkStealingExecutorPtr executor = WorkStealingExecutor::create(QThreadPool::globalInstance(), maxWorkers, priority);
+        {
+            QMutexLocker k(&requestData->_imp->dependencyFreeRendersMutex);
+            for (DependencyFreeRenderSet::const_iterator it = requestData->_imp->dependencyFreeRenders->begin(); it != requestData->_imp->dependencyFreeRenders->end(); ++it) {
+#ifdef TRACE_RENDER_DEPENDENCIES
+                qDebug() << "Queuing " << (*it)->getEffect()->getScriptName_mt_safe().c_str() << " in the executor";
+#endif
+                executor->enqueue( WorkStealingTaskPtr( new FrameViewRenderTask(this, requestData, *it) ) );
             }
-
-#ifndef TREE_RENDER_DISABLE_MT
-            // If this thread is a threadpool thread, it may wait for a while that results gets available.
-            // Release the thread to the thread pool so that it may use this thread for other runnables
-            // and reserve it back when done waiting.
-            if (isThreadPoolThread) {
-                QThreadPool::globalInstance()->releaseThread();
-            }
-
-            // Wait until a task is finished: we should be able to launch more tasks afterwards.
-            requestData->_imp->dependencyFreeRendersEmptyCond.wait(&requestData->_imp->dependencyFreeRendersMutex);
-            
-            if (isThreadPoolThread) {
-                QThreadPool::globalInstance()->reserveThread();
-            }
-#endif   
-            numTasksRemaining = requestData->_imp->allRenderTasksToProcess.size();
+            requestData->_imp->dependencyFreeRenders->clear();
         }
-        runnables.clear();
+        executor->run();
 
+        QMutexLocker k(&requestData->_imp->dependencyFreeRendersMutex);
+        assert(requestData->_imp->allRenderTasksToProcess.empty());
         stat = requestData->_imp->stat;
     } // requestData
 
@@ -62,7 +62,7 @@ public:
 
 private:
 
-    friend class FrameViewRenderRunnable;
+    friend class FrameViewRenderTask;
     friend struct TreeRenderPrivate;
     boost::scoped_ptr<RequestPassSharedDataPrivate> _imp;
 };
@@ -133,6 +133,14 @@ public:
         // Make sure each node in the tree gets rendered at least once
         bool byPassCache;
 
+        // Is this render populating the cache ahead of time (see CacheBase::prefetch()) ?
+        // Images cached by such a render are accounted for in the prefetch hit rate of the cache.
+        bool prefetch;
+
+        // If set, the render is aborted when this token is cancelled. This is used to abort at once
+        // all the renders launched on behalf of a single task.
+        CancellationTokenPtr parentCancellationToken;
+
         CtorArgs();
     };
 
@@ -208,14 +216,32 @@ public:
 
     /**
      * @brief Set this render as aborted, cannot be reversed. This is called when the function GenericSchedulerThread::abortThreadedTask() is called
+     * This cancels the token returned by getCancellationToken().
      **/
     void setRenderAborted();
 
+    /**
+     * @brief Returns the token cancelled when this render is aborted. Threads working for this render
+     * should wait on it rather than sleep so that they return as soon as the render is aborted.
+     **/
+    CancellationTokenPtr getCancellationToken() const;
+
+    /**
+     * @brief Returns the index of this render in the order renders were created by the process: a render created
+     * after another one has a greater index. This is used to order the renders sharing an in-flight request.
+     **/
+    U64 getRenderIndex() const;
+
     /**
      * @brief Returns whether this render is part of a playback render or just a single render
      **/
     bool isPlayback() const;
 
+    /**
+     * @brief Returns whether this render only populates the cache ahead of time, its results are not displayed.
+     **/
+    bool isPrefetchRender() const;
+
     /**
      * @brief Returns whether this render is a bad quality render (typically used when scrubbing a slider or the timeline) or normal quality render
      **/
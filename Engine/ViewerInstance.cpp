@@ -289,6 +289,18 @@ ViewerInstance::getViewerRoI()
     return rod;
 }
 
+bool
+ViewerInstance::getOutputRegionChangedByInput(int /*inputNb*/,
+                                              TimeValue /*time*/,
+                                              ViewIdx /*view*/,
+                                              const RectD& inputRegion,
+                                              RectD* outputRegion)
+{
+    *outputRegion = inputRegion;
+
+    return true;
+}
+
 void
 ViewerInstance::initializeKnobs()
 {
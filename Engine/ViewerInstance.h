@@ -157,6 +157,15 @@ public:
 
     RectD getViewerRoI();
 
+    /**
+     * @brief The viewer process only converts the colors of its input pixel per pixel
+     **/
+    virtual bool getOutputRegionChangedByInput(int inputNb,
+                                               TimeValue time,
+                                               ViewIdx view,
+                                               const RectD& inputRegion,
+                                               RectD* outputRegion) OVERRIDE FINAL;
+
 private:
 
     virtual void initializeKnobs() OVERRIDE FINAL;
@@ -0,0 +1,448 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "WorkStealingExecutor.h"
+
+#include <algorithm>
+#include <vector>
+#include <cassert>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+#include <QtCore/QWaitCondition>
+
+#include "Global/GlobalDefines.h"
+
+#include "Engine/ThreadPool.h"
+
+NATRON_NAMESPACE_ENTER;
+
+// Number of executors of high priority currently in run()
+static QAtomicInt nRunningHighPriorityExecutors;
+
+struct QueuedTask
+{
+    WorkStealingTaskPtr task;
+    double priority;
+
+    // Incremented for each task enqueued in a queue: tasks of equal priority are executed from the most recent one,
+    // which was most likely unblocked by the task we just finished and has its inputs still hot in the CPU caches.
+    U64 sequence;
+};
+
+struct QueuedTask_CompareLess
+{
+    bool operator() (const QueuedTask& lhs,
+                     const QueuedTask& rhs) const
+    {
+        if (lhs.priority != rhs.priority) {
+            return lhs.priority < rhs.priority;
+        }
+
+        return lhs.sequence < rhs.sequence;
+    }
+};
+
+struct WorkerQueue
+{
+    // Protects tasks and sequence
+    QMutex lock;
+
+    // A heap whose front is the task to execute first
+    std::vector<QueuedTask> tasks;
+
+    U64 sequence;
+
+    WorkerQueue()
+    : lock()
+    , tasks()
+    , sequence(0)
+    {
+    }
+
+    void push(const WorkStealingTaskPtr& task)
+    {
+        QueuedTask t;
+        t.task = task;
+        t.priority = task->getPriority();
+        t.sequence = sequence++;
+        tasks.push_back(t);
+        std::push_heap( tasks.begin(), tasks.end(), QueuedTask_CompareLess() );
+    }
+
+    WorkStealingTaskPtr pop()
+    {
+        std::pop_heap( tasks.begin(), tasks.end(), QueuedTask_CompareLess() );
+        WorkStealingTaskPtr ret = tasks.back().task;
+        tasks.pop_back();
+
+        return ret;
+    }
+};
+
+typedef boost::shared_ptr<WorkerQueue> WorkerQueuePtr;
+
+struct WorkStealingExecutorPrivate
+{
+    QThreadPool* threadPool;
+
+    WorkStealingExecutorPriorityEnum priority;
+
+    // Index 0 is the queue of the thread calling run(), the others are the queues of the workers
+    std::vector<WorkerQueuePtr> queues;
+
+    // Number of tasks in all queues
+    QAtomicInt nQueuedTasks;
+
+    // Number of tasks enqueued that are not finished yet
+    QAtomicInt nPendingTasks;
+
+    // Number of workers running in the thread pool, excluding the thread calling run()
+    QAtomicInt nActiveWorkers;
+
+    // 1 while the thread calling run() sleeps on stateCond
+    QAtomicInt callerWaiting;
+
+    QAtomicInt nSteals;
+
+    // Protects activeWorkerSlots and is used with stateCond to wake-up the thread calling run()
+    QMutex stateMutex;
+    QWaitCondition stateCond;
+
+    // For each queue, whether a worker is currently running on it
+    std::vector<bool> activeWorkerSlots;
+
+    WorkStealingExecutorPrivate(QThreadPool* threadPool,
+                                int maxWorkers,
+                                WorkStealingExecutorPriorityEnum priority)
+    : threadPool(threadPool)
+    , priority(priority)
+    , queues(maxWorkers + 1)
+    , nQueuedTasks()
+    , nPendingTasks()
+    , nActiveWorkers()
+    , callerWaiting()
+    , nSteals()
+    , stateMutex()
+    , stateCond()
+    , activeWorkerSlots(maxWorkers + 1, false)
+    {
+        for (std::size_t i = 0; i < queues.size(); ++i) {
+            queues[i].reset(new WorkerQueue);
+        }
+        // The slot of the thread calling run() is never given to a worker
+        activeWorkerSlots[0] = true;
+    }
+
+    int getMaxWorkers() const
+    {
+        return (int)queues.size() - 1;
+    }
+
+    // True if workers should give their thread back to make room for executors of higher priority
+    bool mustYieldToHigherPriority() const
+    {
+        return priority == eWorkStealingExecutorPriorityNormal && (int)nRunningHighPriorityExecutors > 0;
+    }
+
+    bool popTask(int workerIndex, WorkStealingTaskPtr* task);
+
+    void executeTask(WorkStealingExecutor* executor, int workerIndex, const WorkStealingTaskPtr& task);
+
+    void launchWorkerIfNeeded(WorkStealingExecutor* executor);
+
+    /**
+     * @brief Called by a worker that did not find any task: returns true if it may exit, or false if a task
+     * was enqueued in the meantime. If force is true, the worker exits anyway: the tasks left in its queue are stolen
+     * by the thread calling run().
+     **/
+    bool releaseWorkerSlot(int workerIndex, bool force);
+};
+
+class WorkStealingWorkerRunnable
+    : public QRunnable
+{
+    // Keep the executor alive until the worker is done, run() may have returned already
+    WorkStealingExecutorPtr _executor;
+    int _workerIndex;
+
+public:
+
+    WorkStealingWorkerRunnable(const WorkStealingExecutorPtr& executor,
+                               int workerIndex)
+    : QRunnable()
+    , _executor(executor)
+    , _workerIndex(workerIndex)
+    {
+        setAutoDelete(true);
+    }
+
+    virtual ~WorkStealingWorkerRunnable()
+    {
+    }
+
+    virtual void run() OVERRIDE FINAL
+    {
+        WorkStealingExecutorPrivate* imp = _executor->_imp.get();
+        for (;;) {
+            WorkStealingTaskPtr task;
+            if ( imp->popTask(_workerIndex, &task) ) {
+                imp->executeTask(_executor.get(), _workerIndex, task);
+                if ( imp->mustYieldToHigherPriority() && imp->releaseWorkerSlot(_workerIndex, true) ) {
+                    return;
+                }
+                continue;
+            }
+            if ( imp->releaseWorkerSlot(_workerIndex, false) ) {
+                return;
+            }
+        }
+    }
+};
+
+bool
+WorkStealingExecutorPrivate::popTask(int workerIndex,
+                                     WorkStealingTaskPtr* task)
+{
+    if ( (int)nQueuedTasks <= 0 ) {
+        return false;
+    }
+
+    // Pop the best task of our own queue
+    {
+        WorkerQueue& queue = *queues[workerIndex];
+        QMutexLocker k(&queue.lock);
+        if ( !queue.tasks.empty() ) {
+            *task = queue.pop();
+            nQueuedTasks.fetchAndAddOrdered(-1);
+
+            return true;
+        }
+    }
+
+    // Otherwise steal the task of highest priority among the other workers
+    int nQueues = (int)queues.size();
+    for (;;) {
+        int bestQueue = -1;
+        double bestPriority = 0.;
+        for (int i = 1; i < nQueues; ++i) {
+            int queueIndex = (workerIndex + i) % nQueues;
+            WorkerQueue& queue = *queues[queueIndex];
+            QMutexLocker k(&queue.lock);
+            if ( !queue.tasks.empty() && ( (bestQueue == -1) || (queue.tasks.front().priority > bestPriority) ) ) {
+                bestQueue = queueIndex;
+                bestPriority = queue.tasks.front().priority;
+            }
+        }
+        if (bestQueue == -1) {
+            return false;
+        }
+
+        WorkerQueue& queue = *queues[bestQueue];
+        QMutexLocker k(&queue.lock);
+        // The owner may have emptied its queue in the meantime, look again
+        if ( !queue.tasks.empty() ) {
+            *task = queue.pop();
+            nQueuedTasks.fetchAndAddOrdered(-1);
+            nSteals.fetchAndAddOrdered(1);
+
+            return true;
+        }
+    }
+} // popTask
+
+void
+WorkStealingExecutorPrivate::executeTask(WorkStealingExecutor* executor,
+                                         int workerIndex,
+                                         const WorkStealingTaskPtr& task)
+{
+    task->run(executor, workerIndex);
+
+    // Tasks unblocked by this task were enqueued from run(), hence if this was the last pending task, the graph is done
+    if (nPendingTasks.fetchAndAddOrdered(-1) == 1) {
+        QMutexLocker k(&stateMutex);
+        stateCond.wakeAll();
+    }
+}
+
+void
+WorkStealingExecutorPrivate::launchWorkerIfNeeded(WorkStealingExecutor* executor)
+{
+    // The thread that enqueued the task will most likely execute it itself, only launch a worker
+    // if more tasks are waiting.
+    if ( ( (int)nQueuedTasks <= 1 ) || ( (int)nActiveWorkers >= getMaxWorkers() ) || mustYieldToHigherPriority() ) {
+        return;
+    }
+
+    QMutexLocker k(&stateMutex);
+    if ( (int)nActiveWorkers >= getMaxWorkers() ) {
+        return;
+    }
+    int freeSlot = -1;
+    for (std::size_t i = 1; i < activeWorkerSlots.size(); ++i) {
+        if (!activeWorkerSlots[i]) {
+            freeSlot = (int)i;
+            break;
+        }
+    }
+    if (freeSlot == -1) {
+        return;
+    }
+
+    // Do not queue the worker if the thread pool is busy: the thread calling run() will execute the task anyway
+    // and a worker started later would only find an empty queue.
+    WorkStealingWorkerRunnable* worker = new WorkStealingWorkerRunnable(executor->shared_from_this(), freeSlot);
+    if ( !threadPool->tryStart(worker) ) {
+        delete worker;
+
+        return;
+    }
+    activeWorkerSlots[freeSlot] = true;
+    nActiveWorkers.fetchAndAddOrdered(1);
+} // launchWorkerIfNeeded
+
+bool
+WorkStealingExecutorPrivate::releaseWorkerSlot(int workerIndex,
+                                              bool force)
+{
+    QMutexLocker k(&stateMutex);
+
+    nActiveWorkers.fetchAndAddOrdered(-1);
+
+    // A task may have been enqueued after popTask() failed: since nActiveWorkers was still counting this worker,
+    // the thread that enqueued it may not have launched another worker.
+    if ( !force && ( (int)nQueuedTasks > 0 ) ) {
+        nActiveWorkers.fetchAndAddOrdered(1);
+
+        return false;
+    }
+    activeWorkerSlots[workerIndex] = false;
+
+    // The thread calling run() may be sleeping while tasks are left in our queue
+    if (force) {
+        stateCond.wakeAll();
+    }
+
+    return true;
+}
+
+WorkStealingExecutor::WorkStealingExecutor(QThreadPool* threadPool,
+                                           int maxWorkers,
+                                           WorkStealingExecutorPriorityEnum priority)
+    : _imp( new WorkStealingExecutorPrivate(threadPool, std::max(0, maxWorkers), priority) )
+{
+}
+
+WorkStealingExecutor::~WorkStealingExecutor()
+{
+}
+
+void
+WorkStealingExecutor::enqueue(const WorkStealingTaskPtr& task,
+                              int workerIndex)
+{
+    assert(task && workerIndex >= 0 && workerIndex < (int)_imp->queues.size());
+
+    _imp->nPendingTasks.fetchAndAddOrdered(1);
+    {
+        WorkerQueue& queue = *_imp->queues[workerIndex];
+        QMutexLocker k(&queue.lock);
+        queue.push(task);
+    }
+    _imp->nQueuedTasks.fetchAndAddOrdered(1);
+
+    if ( (int)_imp->callerWaiting ) {
+        QMutexLocker k(&_imp->stateMutex);
+        _imp->stateCond.wakeAll();
+    }
+
+    _imp->launchWorkerIfNeeded(this);
+}
+
+void
+WorkStealingExecutor::run()
+{
+    // If this thread is a thread pool thread, it may wait for a while that other workers finish their tasks.
+    // Release the thread to the thread pool so that it may use this thread for other runnables
+    // and reserve it back when done waiting.
+    bool isThreadPoolThread = isRunningInThreadPoolThread();
+
+    if (_imp->priority == eWorkStealingExecutorPriorityHigh) {
+        nRunningHighPriorityExecutors.fetchAndAddOrdered(1);
+    }
+
+    // Start workers for the tasks enqueued before calling run()
+    _imp->launchWorkerIfNeeded(this);
+
+    for (;;) {
+        WorkStealingTaskPtr task;
+        if ( _imp->popTask(0, &task) ) {
+            _imp->executeTask(this, 0, task);
+
+            // Executors of higher priority may have finished since our workers yielded
+            _imp->launchWorkerIfNeeded(this);
+            continue;
+        }
+
+        QMutexLocker k(&_imp->stateMutex);
+        if ( (int)_imp->nPendingTasks == 0 ) {
+            break;
+        }
+        _imp->callerWaiting.fetchAndStoreOrdered(1);
+        if ( (int)_imp->nQueuedTasks > 0 ) {
+            _imp->callerWaiting.fetchAndStoreOrdered(0);
+            continue;
+        }
+
+        // All tasks left are running in other workers: wait until one of them enqueues a new task or the graph is done
+        if (isThreadPoolThread) {
+            _imp->threadPool->releaseThread();
+        }
+        _imp->stateCond.wait(&_imp->stateMutex);
+        if (isThreadPoolThread) {
+            _imp->threadPool->reserveThread();
+        }
+        _imp->callerWaiting.fetchAndStoreOrdered(0);
+    }
+
+    if (_imp->priority == eWorkStealingExecutorPriorityHigh) {
+        nRunningHighPriorityExecutors.fetchAndAddOrdered(-1);
+    }
+} // run
+
+int
+WorkStealingExecutor::getNumSteals() const
+{
+    return (int)_imp->nSteals;
+}
+
+bool
+WorkStealingExecutor::isHighPriorityExecutorRunning()
+{
+    return (int)nRunningHighPriorityExecutors > 0;
+}
+
+NATRON_NAMESPACE_EXIT;
@@ -0,0 +1,151 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef Engine_WorkStealingExecutor_h
+#define Engine_WorkStealingExecutor_h
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/scoped_ptr.hpp>
+#endif
+
+#include "Engine/EngineFwd.h"
+
+class QThreadPool;
+
+NATRON_NAMESPACE_ENTER;
+
+class WorkStealingExecutor;
+
+/**
+ * @brief A task executed by a WorkStealingExecutor.
+ **/
+class WorkStealingTask
+{
+public:
+
+    WorkStealingTask()
+    {
+    }
+
+    virtual ~WorkStealingTask()
+    {
+    }
+
+    /**
+     * @brief Executes the task. The tasks that can run once this task is finished should be enqueued
+     * from this function with the given workerIndex: they are then executed by the same thread
+     * unless another idle thread steals them first.
+     **/
+    virtual void run(WorkStealingExecutor* executor, int workerIndex) = 0;
+
+    /**
+     * @brief Among the tasks that are ready to run, those with the highest priority are executed first.
+     * Tasks of equal priority are executed from the most recently enqueued one.
+     **/
+    virtual double getPriority() const
+    {
+        return 0.;
+    }
+};
+
+typedef boost::shared_ptr<WorkStealingTask> WorkStealingTaskPtr;
+
+enum WorkStealingExecutorPriorityEnum
+{
+    eWorkStealingExecutorPriorityNormal = 0,
+    eWorkStealingExecutorPriorityHigh
+};
+
+/**
+ * @brief Executes a graph of tasks with a work-stealing scheduler: each worker owns a queue
+ * in which it pushes the tasks that it unblocks and from which it pops the task of highest priority first.
+ * When its queue is empty, a worker steals the best task of another worker, and exits when there
+ * is nothing left to steal so that its thread goes back to the thread pool.
+ *
+ * The thread calling run() is worker 0: it executes tasks as well and only sleeps when all tasks
+ * left are being executed by other workers. Other workers are started in the given thread pool
+ * only when a thread is immediately available, hence run() always makes progress even if the thread
+ * pool is busy, e.g: when run() is called recursively from within a task.
+ *
+ * While an executor of high priority is running, executors of normal priority do not start new workers
+ * and their workers give their thread back to the thread pool after each task: only the thread
+ * calling run() keeps executing their tasks.
+ **/
+struct WorkStealingExecutorPrivate;
+class WorkStealingExecutor
+    : public boost::enable_shared_from_this<WorkStealingExecutor>
+{
+    WorkStealingExecutor(QThreadPool* threadPool,
+                         int maxWorkers,
+                         WorkStealingExecutorPriorityEnum priority);
+
+public:
+
+    /**
+     * @brief Creates an executor that uses at most maxWorkers threads of the thread pool in addition
+     * to the thread calling run(). If maxWorkers is 0, all tasks are executed by the thread calling run().
+     **/
+    static WorkStealingExecutorPtr create(QThreadPool* threadPool,
+                                          int maxWorkers,
+                                          WorkStealingExecutorPriorityEnum priority = eWorkStealingExecutorPriorityNormal)
+    {
+        return WorkStealingExecutorPtr( new WorkStealingExecutor(threadPool, maxWorkers, priority) );
+    }
+
+    ~WorkStealingExecutor();
+
+    /**
+     * @brief Adds a task that is ready to run. When called from WorkStealingTask::run(), pass the workerIndex
+     * that was given to the task, otherwise the task is given to the thread calling run().
+     **/
+    void enqueue(const WorkStealingTaskPtr& task, int workerIndex = 0);
+
+    /**
+     * @brief Executes tasks until all tasks enqueued, including those enqueued by the tasks themselves, are finished.
+     **/
+    void run();
+
+    /**
+     * @brief Returns the number of times a worker took a task from the queue of another worker.
+     **/
+    int getNumSteals() const;
+
+    /**
+     * @brief Returns true while an executor of high priority is in run(), i.e: an interactive render is running.
+     **/
+    static bool isHighPriorityExecutorRunning();
+
+private:
+
+    friend class WorkStealingWorkerRunnable;
+    boost::scoped_ptr<WorkStealingExecutorPrivate> _imp;
+};
+
+NATRON_NAMESPACE_EXIT;
+
+#endif // Engine_WorkStealingExecutor_h
@@ -539,6 +539,59 @@ enum CacheAccessModeEnum
     eCacheAccessModeWriteOnly
 };
 
+enum CacheEvictionPolicyEnum
+{
+    // The least recently used entry is evicted first
+    eCacheEvictionPolicyLRU = 0,
+
+    // Scan resistant 2Q policy: new entries go to a FIFO probation queue and move to an LRU protected queue
+    // once accessed again. The probation queue is evicted first, and entries re-inserted shortly after
+    // their eviction from it are protected right away.
+    // Scrubbing through a long sequence thus does not flush the entries that are re-used.
+    eCacheEvictionPolicyScanResistant,
+
+    // Among the least recently used entries, the one that is the cheapest to re-compute
+    // per byte it takes in the cache is evicted first.
+    eCacheEvictionPolicyCostAware
+};
+
+enum CacheCompressionEnum
+{
+    // Tiles evicted from the cache are dropped
+    eCacheCompressionNone = 0,
+
+    // Tiles evicted from the cache are compressed with a fast compression level
+    eCacheCompressionFast,
+
+    // Tiles evicted from the cache are compressed with the highest compression level:
+    // the compressed tier holds more tiles but evicting and restoring tiles is slower.
+    eCacheCompressionHigh
+};
+
+enum Hash64AlgorithmEnum
+{
+    // CRC-64 of the appended values. This is the algorithm that was used to produce
+    // the keys of existing caches on disk.
+    eHash64AlgorithmCRC64 = 0,
+
+    // Multiply-and-fold mixing of the appended values, much faster than the CRC-64
+    // but producing different keys.
+    eHash64AlgorithmFast
+};
+
+enum ThreadAffinityPolicyEnum
+{
+    // Threads are not pinned, the OS scheduler moves them freely across CPUs
+    eThreadAffinityPolicyNone = 0,
+
+    // Each thread of the thread pool is pinned to a single core
+    eThreadAffinityPolicyCore,
+
+    // Each thread of the thread pool is pinned to the cores of a NUMA node (a socket)
+    // and all the tasks of a frame are rendered on the same node.
+    eThreadAffinityPolicyNUMANode
+};
+
 enum ImageBufferLayoutEnum
 {
     // This will make an image with an internal storage composed
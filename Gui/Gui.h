@@ -407,6 +407,8 @@ public:
 
     void renderAllViewers();
 
+    void renderAllViewersInRegion(const EffectInstancePtr& changedEffect, const RectD& changedRegion, TimeValue changedRegionTime);
+
     void abortAllViewers(bool autoRestartPlayback);
 
     void toggleAutoHideGraphInputs();
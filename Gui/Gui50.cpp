@@ -806,6 +806,19 @@ Gui::renderAllViewers()
     }
 }
 
+void
+Gui::renderAllViewersInRegion(const EffectInstancePtr& changedEffect,
+                              const RectD& changedRegion,
+                              TimeValue changedRegionTime)
+{
+    assert( QThread::currentThread() == qApp->thread() );
+    for (std::list<ViewerTab*>::const_iterator it = _imp->_viewerTabs.begin(); it != _imp->_viewerTabs.end(); ++it) {
+        if ( (*it)->isVisible() ) {
+            (*it)->getInternalNode()->getNode()->getRenderEngine()->renderCurrentFrameInRegion(changedEffect, changedRegion, changedRegionTime);
+        }
+    }
+}
+
 void
 Gui::abortAllViewers(bool autoRestartPlayback)
 {
@@ -953,6 +953,14 @@ GuiAppInstance::renderAllViewers()
     _imp->_gui->renderAllViewers();
 }
 
+void
+GuiAppInstance::renderAllViewersInRegion(const EffectInstancePtr& changedEffect,
+                                         const RectD& changedRegion,
+                                         TimeValue changedRegionTime)
+{
+    _imp->_gui->renderAllViewersInRegion(changedEffect, changedRegion, changedRegionTime);
+}
+
 void
 GuiAppInstance::refreshAllPreviews()
 {
@@ -178,6 +178,7 @@ public:
     virtual void closeLoadPRojectSplashScreen() OVERRIDE FINAL;
     virtual void getAllViewers(std::list<ViewerNodePtr>* viewers) const OVERRIDE FINAL;
     virtual void renderAllViewers() OVERRIDE FINAL;
+    virtual void renderAllViewersInRegion(const EffectInstancePtr& changedEffect, const RectD& changedRegion, TimeValue changedRegionTime) OVERRIDE FINAL;
     virtual void refreshAllPreviews() OVERRIDE FINAL;
     virtual void getViewersOpenGLContextFormat(int* bitdepthPerComponent, bool *hasAlpha) const OVERRIDE FINAL;
     virtual void abortAllViewers(bool autoRestartPlayback) OVERRIDE FINAL;
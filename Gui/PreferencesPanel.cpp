@@ -69,6 +69,7 @@ CLANG_DIAG_ON(uninitialized)
 #define COL_RS_ENABLED COL_ENABLED + 1
 #define COL_MT_ENABLED COL_RS_ENABLED + 1
 #define COL_GL_ENABLED COL_MT_ENABLED + 1
+#define COL_HT_ENABLED COL_GL_ENABLED + 1
 
 NATRON_NAMESPACE_ENTER;
 
@@ -96,6 +97,7 @@ struct PluginTreeNode
         , rsCheckbox(NULL)
         , mtCheckbox(NULL)
         , glCheckbox(NULL)
+        , htCheckbox(NULL)
         , plugin()
     {
     }
@@ -105,6 +107,7 @@ struct PluginTreeNode
     AnimatedCheckBox* rsCheckbox;
     AnimatedCheckBox* mtCheckbox;
     AnimatedCheckBox* glCheckbox;
+    AnimatedCheckBox* htCheckbox;
     PluginWPtr plugin;
 };
 
@@ -457,6 +460,10 @@ PreferencesPanel::createPluginsView(QGridLayout* pluginsFrameLayout)
     treeHeader->setText( COL_MT_ENABLED, tr("M-T") );
     treeHeader->setToolTip(COL_GL_ENABLED, tr("If unchecked, OpenGL rendering is disabled for any node with this plug-in. If the checkbox is disabled, the plug-in does not support OpenGL rendering"));
     treeHeader->setText( COL_GL_ENABLED, tr("OpenGL") );
+    treeHeader->setToolTip(COL_HT_ENABLED, tr("If checked, the render window of this instance-safe plug-in is split in strips that are rendered concurrently. "
+                                              "Only check this for plug-ins that can render different parts of the same image concurrently, otherwise renders may be wrong or crash. "
+                                              "If the checkbox is disabled, the plug-in is either fully thread-safe and already rendered concurrently, or unsafe and never rendered concurrently."));
+    treeHeader->setText( COL_HT_ENABLED, tr("H-T") );
     _imp->pluginsView->setHeaderItem(treeHeader);
     _imp->pluginsView->setSelectionMode(QAbstractItemView::NoSelection);
 #if QT_VERSION < 0x050000
@@ -551,6 +558,23 @@ PreferencesPanel::createPluginsView(QGridLayout* pluginsFrameLayout)
                 }
                 node.glCheckbox = checkbox;
             }
+            {
+                QWidget *checkboxContainer = new QWidget(0);
+                QHBoxLayout* checkboxLayout = new QHBoxLayout(checkboxContainer);
+                AnimatedCheckBox* checkbox = new AnimatedCheckBox(checkboxContainer);
+                checkboxLayout->addWidget(checkbox, Qt::AlignLeft | Qt::AlignVCenter);
+                checkboxLayout->setContentsMargins(0, 0, 0, 0);
+                checkboxLayout->setSpacing(0);
+                checkbox->setFixedSize( TO_DPIX(NATRON_SMALL_BUTTON_SIZE), TO_DPIY(NATRON_SMALL_BUTTON_SIZE) );
+                checkbox->setChecked( plugin->isHostTilingEnabled() );
+                QObject::connect( checkbox, SIGNAL(clicked(bool)), this, SLOT(onHTEnabledCheckBoxChecked(bool)) );
+                _imp->pluginsView->setItemWidget(node.item, COL_HT_ENABLED, checkbox);
+                if ((RenderSafetyEnum)plugin->getPropertyUnsafe<int>(kNatronPluginPropRenderSafety) != eRenderSafetyInstanceSafe) {
+                    checkbox->setChecked(false);
+                    checkbox->setReadOnly(true);
+                }
+                node.htCheckbox = checkbox;
+            }
 
             _imp->pluginsList.push_back(node);
         }
@@ -870,6 +894,23 @@ PreferencesPanel::onGLEnabledCheckBoxChecked(bool checked)
     }
 }
 
+void
+PreferencesPanel::onHTEnabledCheckBoxChecked(bool checked)
+{
+    AnimatedCheckBox* cb = qobject_cast<AnimatedCheckBox*>( sender() );
+
+    if (!cb) {
+        return;
+    }
+    for (PluginTreeNodeList::iterator it = _imp->pluginsList.begin(); it != _imp->pluginsList.end(); ++it) {
+        if (it->htCheckbox == cb) {
+            it->plugin.lock()->setHostTilingEnabled(checked);
+            _imp->pluginSettingsChanged = true;
+            break;
+        }
+    }
+}
+
 void
 PreferencesPanelPrivate::setVisiblePage(int index)
 {
@@ -1145,6 +1186,9 @@ PreferencesPanel::onRestoreCurrentTabDefaultsClicked()
         if (it->glCheckbox) {
             it->glCheckbox->setChecked(true);
         }
+        if (it->htCheckbox) {
+            it->htCheckbox->setChecked(false);
+        }
     }
 }
 
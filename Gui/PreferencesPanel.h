@@ -89,6 +89,7 @@ public Q_SLOTS:
     void onRSEnabledCheckBoxChecked(bool);
     void onMTEnabledCheckBoxChecked(bool);
     void onGLEnabledCheckBoxChecked(bool);
+    void onHTEnabledCheckBoxChecked(bool);
 
     void filterPlugins(const QString & txt);
 
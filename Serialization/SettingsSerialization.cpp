@@ -74,6 +74,10 @@ SettingsSerialization::encode(YAML::Emitter& em) const
             if (!it->second.openGLEnabled) {
                 em << "OpenGL_Disabled";
             }
+
+            if (it->second.hostTilingEnabled) {
+                em << "HostTiling_Enabled";
+            }
             em << YAML::EndSeq;
             
         }
@@ -143,6 +147,8 @@ SettingsSerialization::decode(const YAML::Node& node)
                     data.multiThreadingEnabled = false;
                 } else if (prop == "OpenGL_Disabled") {
                     data.openGLEnabled = false;
+                } else if (prop == "HostTiling_Enabled") {
+                    data.hostTilingEnabled = true;
                 }
             }
 
@@ -70,11 +70,19 @@ public:
         // True by default
         bool openGLEnabled;
 
+        // If true, the render window of a plug-in that is not fully thread-safe is split by Natron
+        // in strips that are rendered concurrently. This is only correct for plug-ins that can
+        // render disjoint windows of the same frame concurrently.
+        //
+        // False by default
+        bool hostTilingEnabled;
+
         PluginData()
         : enabled(true)
         , renderScaleEnabled(true)
         , multiThreadingEnabled(true)
         , openGLEnabled(true)
+        , hostTilingEnabled(false)
         {
 
         }
@@ -0,0 +1,203 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <iostream>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+
+#include "Engine/CancellationToken.h"
+#include "Engine/Timer.h"
+
+NATRON_NAMESPACE_USING
+
+// Simulates a thread waiting for a result computed by another thread, as CacheEntryLocker::waitForPendingEntry()
+// does: it polls with an increasing interval until the token is cancelled.
+class PollingWaiter
+    : public QRunnable
+{
+    CancellationTokenPtr _token;
+    QAtomicInt* _nStarted;
+
+public:
+
+    PollingWaiter(const CancellationTokenPtr& token,
+                  QAtomicInt* nStarted)
+        : QRunnable()
+        , _token(token)
+        , _nStarted(nStarted)
+    {
+    }
+
+    virtual void run() OVERRIDE FINAL
+    {
+        _nStarted->fetchAndAddOrdered(1);
+        std::size_t timeToWaitMS = 20;
+        while ( !_token->waitForCancellation(timeToWaitMS) ) {
+            timeToWaitMS *= 1.2;
+        }
+    }
+};
+
+class CancellingTask
+    : public QRunnable
+{
+    CancellationTokenPtr _token;
+
+public:
+
+    CancellingTask(const CancellationTokenPtr& token)
+        : QRunnable()
+        , _token(token)
+    {
+    }
+
+    virtual void run() OVERRIDE FINAL
+    {
+        _token->cancel();
+    }
+};
+
+TEST(CancellationToken, CancelPropagatesToDescendants) {
+    CancellationTokenPtr root = CancellationToken::create();
+    CancellationTokenPtr child = CancellationToken::create(root);
+    CancellationTokenPtr sibling = CancellationToken::create(root);
+    CancellationTokenPtr grandChild = CancellationToken::create(child);
+
+    EXPECT_FALSE( root->isCancelled() );
+    EXPECT_FALSE( grandChild->isCancelled() );
+
+    // Cancelling a child does not cancel its parent nor its siblings
+    child->cancel();
+    EXPECT_TRUE( child->isCancelled() );
+    EXPECT_TRUE( grandChild->isCancelled() );
+    EXPECT_FALSE( root->isCancelled() );
+    EXPECT_FALSE( sibling->isCancelled() );
+
+    root->cancel();
+    EXPECT_TRUE( root->isCancelled() );
+    EXPECT_TRUE( sibling->isCancelled() );
+
+    // Cancelling twice has no effect
+    root->cancel();
+    EXPECT_TRUE( root->isCancelled() );
+}
+
+TEST(CancellationToken, ChildOfCancelledTokenIsCancelled) {
+    CancellationTokenPtr root = CancellationToken::create();
+
+    root->cancel();
+    CancellationTokenPtr child = CancellationToken::create(root);
+    EXPECT_TRUE( child->isCancelled() );
+}
+
+TEST(CancellationToken, ChildrenDoNotKeepParentAlive) {
+    CancellationTokenPtr child;
+    {
+        CancellationTokenPtr root = CancellationToken::create();
+        child = CancellationToken::create(root);
+    }
+    EXPECT_FALSE( child->isCancelled() );
+    child->cancel();
+    EXPECT_TRUE( child->isCancelled() );
+}
+
+TEST(CancellationToken, WaitTimesOutWhenNotCancelled) {
+    CancellationTokenPtr token = CancellationToken::create();
+    TimeLapse timer;
+
+    EXPECT_FALSE( token->waitForCancellation(50) );
+    EXPECT_GE( timer.getTimeSinceCreation(), 0.04 );
+
+    token->cancel();
+    TimeLapse cancelledTimer;
+    EXPECT_TRUE( token->waitForCancellation(10000) );
+    EXPECT_LT( cancelledTimer.getTimeSinceCreation(), 1. );
+}
+
+// Measures the time between the cancellation of a render and the moment all the threads waiting on its behalf
+// returned (abort-to-idle latency). The waits would last up to several seconds without the token.
+TEST(CancellationToken, AbortToIdleLatency) {
+    const int nWaiters = 32;
+    QThreadPool pool;
+
+    pool.setMaxThreadCount(nWaiters);
+
+    CancellationTokenPtr render = CancellationToken::create();
+    std::vector<CancellationTokenPtr> frames;
+    for (int i = 0; i < 4; ++i) {
+        frames.push_back( CancellationToken::create(render) );
+    }
+
+    QAtomicInt nStarted;
+    for (int i = 0; i < nWaiters; ++i) {
+        pool.start( new PollingWaiter(frames[i % frames.size()], &nStarted) );
+    }
+
+    // Let the waiters reach a long sleep interval
+    while ( (int)nStarted < nWaiters ) {
+        CancellationToken::create()->waitForCancellation(1);
+    }
+    CancellationToken::create()->waitForCancellation(500);
+
+    TimeLapse timer;
+    render->cancel();
+    pool.waitForDone();
+    double latency = timer.getTimeSinceCreation();
+
+    std::cout << "Abort-to-idle latency with " << nWaiters << " waiting threads: " << latency * 1000. << " ms" << std::endl;
+    EXPECT_LT( latency, 0.5 );
+}
+
+TEST(CancellationToken, ConcurrentCancelAndCreate) {
+    for (int iteration = 0; iteration < 20; ++iteration) {
+        CancellationTokenPtr root = CancellationToken::create();
+        QThreadPool pool;
+        QAtomicInt nStarted;
+
+        // One thread more than the waiters for the cancelling task
+        pool.setMaxThreadCount(9);
+        for (int i = 0; i < 8; ++i) {
+            pool.start( new PollingWaiter(CancellationToken::create(root), &nStarted) );
+        }
+
+        // Children created while the root is being cancelled by another thread are cancelled either way
+        std::vector<CancellationTokenPtr> children;
+        for (int i = 0; i < 100; ++i) {
+            children.push_back( CancellationToken::create(root) );
+            if (i == 50) {
+                pool.start( new CancellingTask(root) );
+            }
+        }
+        pool.waitForDone();
+        for (std::size_t i = 0; i < children.size(); ++i) {
+            EXPECT_TRUE( children[i]->isCancelled() );
+        }
+    }
+}
@@ -0,0 +1,135 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "Engine/ConcurrentFramesController.h"
+
+NATRON_NAMESPACE_USING
+
+// Simulates the render of nSamples frames: the throughput with n concurrent frames is fps[n - 1], or the last value
+// if n is higher. Returns the number of decisions taken.
+static int
+simulateFrames(ConcurrentFramesController& controller,
+               double* time,
+               int nSamples,
+               const std::vector<double>& fps,
+               double cpuUsage,
+               double freeRAMRatio)
+{
+    int nDecisions = 0;
+
+    for (int i = 0; i < nSamples; ++i) {
+        int n = controller.getConcurrentFrames();
+        *time += 1. / fps[std::min( (std::size_t)n, fps.size() ) - 1];
+
+        ConcurrentFramesControllerSample sample;
+        sample.timestamp = *time;
+        sample.cpuUsage = cpuUsage;
+        sample.freeRAMRatio = freeRAMRatio;
+
+        int nFrames = 0;
+        std::string decision;
+        if ( controller.addSample(sample, &nFrames, &decision) ) {
+            EXPECT_EQ( nFrames, controller.getConcurrentFrames() );
+            EXPECT_FALSE( decision.empty() );
+            ++nDecisions;
+        }
+    }
+
+    return nDecisions;
+}
+
+TEST(ConcurrentFramesController, GrowsWhileThroughputImproves) {
+    ConcurrentFramesController controller(1, 1, 4);
+    double time = 0;
+    std::vector<double> fps;
+
+    fps.push_back(10);
+    fps.push_back(20);
+    fps.push_back(30);
+    fps.push_back(40);
+
+    simulateFrames(controller, &time, 200, fps, 0.2, 0.5);
+    EXPECT_EQ( 4, controller.getConcurrentFrames() );
+}
+
+TEST(ConcurrentFramesController, RevertsWhenThroughputDoesNotImprove) {
+    ConcurrentFramesController controller(1, 1, 4);
+    double time = 0;
+    std::vector<double> fps(1, 10);
+
+    // The first window measures 1 frame, the second one tries 2 frames, which does not pay off
+    simulateFrames(controller, &time, 5, fps, 0.2, 0.5);
+    EXPECT_EQ( 2, controller.getConcurrentFrames() );
+    simulateFrames(controller, &time, 4, fps, 0.2, 0.5);
+    EXPECT_EQ( 1, controller.getConcurrentFrames() );
+
+    // Then it waits before trying again, instead of oscillating at each window
+    int nDecisions = simulateFrames(controller, &time, 16, fps, 0.2, 0.5);
+    EXPECT_EQ(0, nDecisions);
+    EXPECT_EQ( 1, controller.getConcurrentFrames() );
+}
+
+TEST(ConcurrentFramesController, DoesNotGrowWhenThreadsAreBusy) {
+    ConcurrentFramesController controller(1, 1, 4);
+    double time = 0;
+    std::vector<double> fps(1, 10);
+
+    int nDecisions = simulateFrames(controller, &time, 100, fps, 0.9, 0.5);
+    EXPECT_EQ(0, nDecisions);
+    EXPECT_EQ( 1, controller.getConcurrentFrames() );
+}
+
+TEST(ConcurrentFramesController, DoesNotGrowWhenMemoryIsShort) {
+    ConcurrentFramesController controller(1, 1, 4);
+    double time = 0;
+    std::vector<double> fps(1, 10);
+
+    int nDecisions = simulateFrames(controller, &time, 100, fps, 0.2, 0.07);
+    EXPECT_EQ(0, nDecisions);
+    EXPECT_EQ( 1, controller.getConcurrentFrames() );
+}
+
+TEST(ConcurrentFramesController, ShrinksImmediatelyOnLowMemory) {
+    ConcurrentFramesController controller(3, 1, 4);
+    double time = 0;
+    std::vector<double> fps(1, 10);
+
+    simulateFrames(controller, &time, 1, fps, 0.2, 0.5);
+    EXPECT_EQ( 3, controller.getConcurrentFrames() );
+    simulateFrames(controller, &time, 1, fps, 0.2, 0.01);
+    EXPECT_EQ( 2, controller.getConcurrentFrames() );
+    simulateFrames(controller, &time, 10, fps, 0.2, 0.01);
+    EXPECT_EQ( 1, controller.getConcurrentFrames() );
+}
+
+TEST(ConcurrentFramesController, ClampsInitialValue) {
+    EXPECT_EQ( 4, ConcurrentFramesController(10, 1, 4).getConcurrentFrames() );
+    EXPECT_EQ( 2, ConcurrentFramesController(0, 2, 4).getConcurrentFrames() );
+}
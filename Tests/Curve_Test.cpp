@@ -24,12 +24,14 @@
 
 #include "Global/Macros.h"
 
+#include <vector>
 #include <gtest/gtest.h>
 
 #include <QtCore/QString>
 #include <QtCore/QDir>
 
 #include "Engine/Curve.h"
+#include "Engine/ImageConvertSIMD.h"
 
 NATRON_NAMESPACE_USING
 
@@ -123,3 +125,78 @@ TEST(Curve, Basic)
 }
 
 
+
+TEST(Curve, GetValuesAt)
+{
+    Curve c;
+    const int nTimes = 12;
+    const double times[nTimes] = { -10., 0., 0.25, 1., 1.5, 2., 3.75, 4., 10., 2.5, -1., 0.5 };
+    double values[nTimes];
+
+    // empty curve
+    c.getValuesAt(times, values, nTimes);
+    for (int i = 0; i < nTimes; ++i) {
+        EXPECT_EQ( 0., values[i] );
+    }
+
+    EXPECT_TRUE( c.addKeyFrame( KeyFrame(0., 10.) ) );
+    EXPECT_TRUE( c.addKeyFrame( KeyFrame(1., 20., 0., 0., eKeyframeTypeConstant) ) );
+    EXPECT_TRUE( c.addKeyFrame( KeyFrame(2., -5., 0., 0., eKeyframeTypeLinear) ) );
+    EXPECT_TRUE( c.addKeyFrame( KeyFrame(4., 3.) ) );
+
+    // the batch evaluation gives the same results as getValueAt(), whatever the order of the times
+    c.getValuesAt(times, values, nTimes);
+    for (int i = 0; i < nTimes; ++i) {
+        EXPECT_EQ( c.getValueAt( TimeValue(times[i]) ), values[i] );
+    }
+    EXPECT_EQ( 20., values[4] ); // constant interpolation
+
+    // the curve is evaluated again after it changed
+    c.setYRange(0., 15.);
+    c.getValuesAt(times, values, nTimes, true);
+    EXPECT_EQ( 15., values[4] );
+    c.getValuesAt(times, values, nTimes, false);
+    EXPECT_EQ( 20., values[4] );
+    c.setKeyFrameValueAndTime(TimeValue(1.), 12., 1);
+    c.getValuesAt(times, values, nTimes);
+    EXPECT_EQ( 12., values[4] );
+    for (int i = 0; i < nTimes; ++i) {
+        EXPECT_EQ( c.getValueAt( TimeValue(times[i]) ), values[i] );
+    }
+
+    // periodic curve
+    Curve p;
+    p.setPeriodic(true);
+    p.setXRange(0., 4.);
+    EXPECT_TRUE( p.addKeyFrame( KeyFrame(0., 0.) ) );
+    EXPECT_TRUE( p.addKeyFrame( KeyFrame(2., 1.) ) );
+    p.getValuesAt(times, values, nTimes);
+    for (int i = 0; i < nTimes; ++i) {
+        EXPECT_EQ( p.getValueAt( TimeValue(times[i]) ), values[i] );
+    }
+    EXPECT_EQ( p.getValueAt( TimeValue(0.5) ), p.getValueAt( TimeValue(4.5) ) );
+}
+
+// More times than Curve::getValuesAt() evaluates at once, with every instruction set of the vectorized kernel
+TEST(Curve, GetValuesAtInstructionSets)
+{
+    Curve c;
+    for (int i = 0; i < 20; ++i) {
+        EXPECT_TRUE( c.addKeyFrame( KeyFrame(i * 3., (i * 7) % 11, 0., 0., (i % 4 == 0) ? eKeyframeTypeLinear : eKeyframeTypeCatmullRom) ) );
+    }
+
+    std::vector<double> times(1001), values( times.size() );
+    for (std::size_t i = 0; i < times.size(); ++i) {
+        // Mostly increasing times, with some going back
+        times[i] = (i % 17 == 0) ? 60. - i * 0.05 : -5. + i * 0.07;
+    }
+
+    for (int i = (int)ImageConvertSIMD::eInstructionSetScalar; i <= (int)ImageConvertSIMD::getSupportedInstructionSet(); ++i) {
+        ImageConvertSIMD::setMaximumInstructionSet( (ImageConvertSIMD::InstructionSetEnum)i );
+        c.getValuesAt( &times[0], &values[0], (int)times.size() );
+        ImageConvertSIMD::setMaximumInstructionSet(ImageConvertSIMD::eInstructionSetAVX2);
+        for (std::size_t j = 0; j < times.size(); ++j) {
+            EXPECT_EQ( c.getValueAt( TimeValue(times[j]) ), values[j] ) << "time: " << times[j] << " instruction set: " << i;
+        }
+    }
+}
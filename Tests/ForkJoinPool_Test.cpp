@@ -0,0 +1,231 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2013-2017 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QThreadPool>
+#include <QtConcurrentMap> // QtCore on Qt4, QtConcurrent on Qt5
+
+GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
+#include <boost/bind.hpp>
+GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
+
+#include "Engine/ForkJoinPool.h"
+#include "Engine/Timer.h"
+
+NATRON_NAMESPACE_USING
+
+// Amount of work done for each index: it is small so that the launch latency dominates
+#define N_ITERATIONS_PER_INDEX 1000
+
+static double
+doSomeWork(unsigned int index)
+{
+    double result = index;
+    for (int i = 0; i < N_ITERATIONS_PER_INDEX; ++i) {
+        result = result * 0.5 + i;
+    }
+
+    return result;
+}
+
+// Counts how many times each index was executed
+class CountingTask
+    : public ForkJoinTask
+{
+public:
+
+    std::vector<QAtomicInt> nExecutions;
+    unsigned int failingIndex;
+
+    CountingTask(unsigned int count)
+    : ForkJoinTask()
+    , nExecutions(count)
+    , failingIndex(count)
+    {
+    }
+
+    virtual ActionRetCodeEnum run(unsigned int index,
+                                  unsigned int count) OVERRIDE
+    {
+        EXPECT_EQ( nExecutions.size(), (std::size_t)count );
+        nExecutions[index].fetchAndAddOrdered(1);
+        (void)doSomeWork(index);
+
+        return index == failingIndex ? eActionStatusFailed : eActionStatusOK;
+    }
+
+    void checkExecutedOnce() const
+    {
+        for (std::size_t i = 0; i < nExecutions.size(); ++i) {
+            EXPECT_EQ( 1, (int)nExecutions[i] );
+        }
+    }
+};
+
+// Each index forks again in the same pool
+class NestedTask
+    : public ForkJoinTask
+{
+public:
+
+    ForkJoinPool* pool;
+    unsigned int nestedCount;
+    QAtomicInt nNestedExecutions;
+
+    NestedTask(ForkJoinPool* pool,
+               unsigned int nestedCount)
+    : ForkJoinTask()
+    , pool(pool)
+    , nestedCount(nestedCount)
+    , nNestedExecutions()
+    {
+    }
+
+    virtual ActionRetCodeEnum run(unsigned int /*index*/,
+                                  unsigned int /*count*/) OVERRIDE
+    {
+        boost::shared_ptr<CountingTask> nested( new CountingTask(nestedCount) );
+        ActionRetCodeEnum stat = pool->run( nested, nestedCount, QThreadPool::globalInstance()->maxThreadCount() );
+        nested->checkExecutedOnce();
+        nNestedExecutions.fetchAndAddOrdered(nestedCount);
+
+        return stat;
+    }
+};
+
+TEST(ForkJoinPool, AllIndicesExecutedOnce) {
+    ForkJoinPool pool( QThreadPool::globalInstance() );
+    const unsigned int counts[] = {0, 1, 2, 7, 64, 1000};
+
+    for (std::size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+        boost::shared_ptr<CountingTask> task( new CountingTask(counts[i]) );
+        EXPECT_EQ( eActionStatusOK, pool.run( task, counts[i], QThreadPool::globalInstance()->maxThreadCount() ) );
+        task->checkExecutedOnce();
+    }
+    EXPECT_EQ( 0, pool.getNumActiveForks() );
+}
+
+TEST(ForkJoinPool, SingleThread) {
+    ForkJoinPool pool( QThreadPool::globalInstance() );
+    boost::shared_ptr<CountingTask> task( new CountingTask(100) );
+
+    EXPECT_EQ( eActionStatusOK, pool.run(task, 100, 1) );
+    task->checkExecutedOnce();
+}
+
+TEST(ForkJoinPool, Failure) {
+    ForkJoinPool pool( QThreadPool::globalInstance() );
+    boost::shared_ptr<CountingTask> task( new CountingTask(100) );
+
+    task->failingIndex = 42;
+    EXPECT_EQ( eActionStatusFailed, pool.run( task, 100, QThreadPool::globalInstance()->maxThreadCount() ) );
+
+    // Indices after a failure are executed as well
+    task->checkExecutedOnce();
+}
+
+TEST(ForkJoinPool, NonBlocking) {
+    ForkJoinPool pool( QThreadPool::globalInstance() );
+    boost::shared_ptr<CountingTask> task( new CountingTask(200) );
+
+    ForkJoinPtr f = pool.fork( task, 200, QThreadPool::globalInstance()->maxThreadCount() );
+    EXPECT_EQ( 1, pool.getNumActiveForks() );
+    EXPECT_EQ( eActionStatusOK, f->join() );
+    EXPECT_EQ( 0, pool.getNumActiveForks() );
+    task->checkExecutedOnce();
+}
+
+// A fork made from within a fork must not wait for threads of the pool that are busy with the outer fork
+TEST(ForkJoinPool, NestedParallelism) {
+    ForkJoinPool pool( QThreadPool::globalInstance() );
+    unsigned int count = QThreadPool::globalInstance()->maxThreadCount() * 2;
+    boost::shared_ptr<NestedTask> task( new NestedTask(&pool, 50) );
+
+    EXPECT_EQ( eActionStatusOK, pool.run( task, count, QThreadPool::globalInstance()->maxThreadCount() ) );
+    EXPECT_EQ( (int)(count * 50), (int)task->nNestedExecutions );
+    EXPECT_EQ( 0, pool.getNumActiveForks() );
+}
+
+TEST(ForkJoinPool, MaxThreadsPerFork) {
+    ForkJoinPool pool( QThreadPool::globalInstance() );
+    unsigned int poolSize = QThreadPool::globalInstance()->maxThreadCount();
+
+    EXPECT_EQ( poolSize, pool.getMaxThreadsPerFork(poolSize, 0) );
+    EXPECT_EQ( 1u, pool.getMaxThreadsPerFork(1, 0) );
+    EXPECT_EQ( 1u, pool.getMaxThreadsPerFork(poolSize, 1) );
+    EXPECT_EQ( poolSize, pool.getMaxThreadsPerFork(poolSize, poolSize * 4) );
+
+    // While a fork is running, a new fork gets half of the pool
+    boost::shared_ptr<CountingTask> task( new CountingTask(1) );
+    ForkJoinPtr f = pool.fork(task, 1, 1);
+    EXPECT_EQ( std::max(1u, (poolSize + 1) / 2), pool.getMaxThreadsPerFork(poolSize, 0) );
+    f->join();
+}
+
+static ActionRetCodeEnum
+mappedFunction(unsigned int index)
+{
+    (void)doSomeWork(index);
+
+    return eActionStatusOK;
+}
+
+// Compares the launch latency of the fork-join pool with the QtConcurrent::mapped implementation it replaces in MultiThread
+TEST(ForkJoinPool, Benchmark) {
+    ForkJoinPool pool( QThreadPool::globalInstance() );
+    unsigned int nThreads = QThreadPool::globalInstance()->maxThreadCount();
+    const int nRuns = 2000;
+
+    std::vector<unsigned int> indices(nThreads);
+    for (unsigned int i = 0; i < nThreads; ++i) {
+        indices[i] = i;
+    }
+    TimeLapse mappedTimer;
+    for (int i = 0; i < nRuns; ++i) {
+        QFuture<ActionRetCodeEnum> future = QtConcurrent::mapped( indices, boost::bind(mappedFunction, _1) );
+        future.waitForFinished();
+    }
+    double mappedDuration = mappedTimer.getTimeSinceCreation() / nRuns;
+
+    boost::shared_ptr<CountingTask> task( new CountingTask(nThreads) );
+    TimeLapse forkJoinTimer;
+    for (int i = 0; i < nRuns; ++i) {
+        EXPECT_EQ( eActionStatusOK, pool.run(task, nThreads, nThreads) );
+    }
+    double forkJoinDuration = forkJoinTimer.getTimeSinceCreation() / nRuns;
+    for (unsigned int i = 0; i < nThreads; ++i) {
+        EXPECT_EQ( nRuns, (int)task->nExecutions[i] );
+    }
+
+    std::cout << nThreads << " indices on " << nThreads << " threads: "
+              << "QtConcurrent::mapped: " << mappedDuration * 1e6 << " us, "
+              << "fork-join pool: " << forkJoinDuration * 1e6 << " us" << std::endl;
+}
@@ -0,0 +1,311 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <algorithm>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <QtCore/QMutex>
+#include <QtCore/QThreadPool>
+#include <QtCore/QWaitCondition>
+
+#include "Engine/FramePipeline.h"
+
+NATRON_NAMESPACE_USING
+
+class TestItem
+    : public FramePipelineItem
+{
+public:
+
+    int index;
+
+    TestItem(int index)
+        : FramePipelineItem()
+        , index(index)
+    {
+    }
+};
+
+class TestPipeline;
+
+// Records the order in which items are processed
+class TestStage
+    : public FramePipelineStage
+{
+public:
+
+    TestPipeline* pipeline;
+    int stageIndex;
+    int failingIndex;
+    QMutex lock;
+    std::vector<int> processedIndices;
+    int nConcurrent, maxConcurrent;
+
+    TestStage(TestPipeline* pipeline,
+              int stageIndex)
+        : FramePipelineStage()
+        , pipeline(pipeline)
+        , stageIndex(stageIndex)
+        , failingIndex(-1)
+        , lock()
+        , processedIndices()
+        , nConcurrent(0)
+        , maxConcurrent(0)
+    {
+    }
+
+    virtual ActionRetCodeEnum process(const FramePipelineItemPtr& item) OVERRIDE;
+};
+
+typedef boost::shared_ptr<TestStage> TestStagePtr;
+
+class TestPipeline
+    : public FramePipeline
+{
+public:
+
+    int nItems;
+    QMutex lock;
+    QWaitCondition cond;
+    int nPulled, nFinished, maxInFlight;
+    std::vector<int> failedIndices;
+    std::vector<TestStagePtr> stages;
+
+    // Item 0 is blocked in the last stage until item 1 starts in the stage before, to check that stages overlap
+    bool blockUntilOverlap;
+    bool overlapped;
+
+private:
+
+    TestPipeline(int nItems,
+                 bool preserveOrder)
+        : FramePipeline(QThreadPool::globalInstance(), preserveOrder)
+        , nItems(nItems)
+        , lock()
+        , cond()
+        , nPulled(0)
+        , nFinished(0)
+        , maxInFlight(0)
+        , failedIndices()
+        , stages()
+        , blockUntilOverlap(false)
+        , overlapped(false)
+    {
+    }
+
+public:
+
+    static boost::shared_ptr<TestPipeline> create(int nItems,
+                                                  int nStages,
+                                                  int maxConcurrentItems,
+                                                  int maxQueuedItems,
+                                                  bool preserveOrder)
+    {
+        boost::shared_ptr<TestPipeline> ret( new TestPipeline(nItems, preserveOrder) );
+        for (int i = 0; i < nStages; ++i) {
+            TestStagePtr stage( new TestStage(ret.get(), i) );
+            ret->stages.push_back(stage);
+            ret->addStage(stage, maxConcurrentItems, maxQueuedItems);
+        }
+
+        return ret;
+    }
+
+    virtual FramePipelineItemPtr pullNextItem() OVERRIDE
+    {
+        QMutexLocker k(&lock);
+
+        if (nPulled == nItems) {
+            return FramePipelineItemPtr();
+        }
+        FramePipelineItemPtr ret( new TestItem(nPulled) );
+        ++nPulled;
+        maxInFlight = std::max(maxInFlight, nPulled - nFinished);
+
+        return ret;
+    }
+
+    virtual void onItemFailed(const FramePipelineItemPtr& item,
+                              int /*stageIndex*/,
+                              ActionRetCodeEnum /*stat*/) OVERRIDE
+    {
+        QMutexLocker k(&lock);
+
+        failedIndices.push_back( static_cast<TestItem*>( item.get() )->index );
+        ++nFinished;
+    }
+
+    void onItemProcessed(int stageIndex,
+                         int itemIndex)
+    {
+        QMutexLocker k(&lock);
+
+        if ( (stageIndex == (int)stages.size() - 2) && (itemIndex == 1) ) {
+            overlapped = true;
+            cond.wakeAll();
+        }
+        if ( blockUntilOverlap && (stageIndex == (int)stages.size() - 1) && (itemIndex == 0) ) {
+            while (!overlapped) {
+                if ( !cond.wait(&lock, 5000) ) {
+                    break;
+                }
+            }
+        }
+        if ( stageIndex == (int)stages.size() - 1 ) {
+            ++nFinished;
+        }
+    }
+};
+
+ActionRetCodeEnum
+TestStage::process(const FramePipelineItemPtr& item)
+{
+    int index = static_cast<TestItem*>( item.get() )->index;
+    {
+        QMutexLocker k(&lock);
+        ++nConcurrent;
+        maxConcurrent = std::max(maxConcurrent, nConcurrent);
+        processedIndices.push_back(index);
+    }
+
+    pipeline->onItemProcessed(stageIndex, index);
+
+    {
+        QMutexLocker k(&lock);
+        --nConcurrent;
+    }
+
+    return index == failingIndex ? eActionStatusFailed : eActionStatusOK;
+}
+
+TEST(FramePipeline, ProcessesAllItemsInOrder) {
+    const int nItems = 100;
+    boost::shared_ptr<TestPipeline> pipeline = TestPipeline::create(nItems, 3, 4, 2, true /*preserveOrder*/);
+
+    pipeline->start();
+    pipeline->waitForFinished();
+    EXPECT_TRUE( pipeline->isFinished() );
+
+    for (std::size_t s = 0; s < pipeline->stages.size(); ++s) {
+        std::vector<int>& indices = pipeline->stages[s]->processedIndices;
+        ASSERT_EQ( (std::size_t)nItems, indices.size() );
+        std::sort( indices.begin(), indices.end() );
+        for (int i = 0; i < nItems; ++i) {
+            EXPECT_EQ(i, indices[i]);
+        }
+        EXPECT_LE(pipeline->stages[s]->maxConcurrent, 4);
+        EXPECT_EQ( 0, pipeline->getNumItemsInStage( (int)s ) );
+    }
+    EXPECT_TRUE( pipeline->failedIndices.empty() );
+}
+
+TEST(FramePipeline, SequentialStagesKeepOrder) {
+    // With one item at a time per stage and the order preserved, each stage sees the items in order
+    const int nItems = 50;
+    boost::shared_ptr<TestPipeline> pipeline = TestPipeline::create(nItems, 3, 1, 1, true /*preserveOrder*/);
+
+    pipeline->start();
+    pipeline->waitForFinished();
+
+    for (std::size_t s = 0; s < pipeline->stages.size(); ++s) {
+        const std::vector<int>& indices = pipeline->stages[s]->processedIndices;
+        ASSERT_EQ( (std::size_t)nItems, indices.size() );
+        for (int i = 0; i < nItems; ++i) {
+            EXPECT_EQ(i, indices[i]);
+        }
+        EXPECT_EQ(1, pipeline->stages[s]->maxConcurrent);
+    }
+}
+
+TEST(FramePipeline, ItemsInFlightAreBounded) {
+    const int nItems = 100;
+    const int nStages = 3, maxConcurrentItems = 2, maxQueuedItems = 1;
+    boost::shared_ptr<TestPipeline> pipeline = TestPipeline::create(nItems, nStages, maxConcurrentItems, maxQueuedItems, true /*preserveOrder*/);
+
+    pipeline->start();
+    pipeline->waitForFinished();
+
+    // Each stage holds at most its queue and its slots, plus the item being pulled
+    EXPECT_LE( pipeline->maxInFlight, nStages * (maxConcurrentItems + maxQueuedItems) + 1 );
+    EXPECT_EQ(nItems, pipeline->nFinished);
+}
+
+TEST(FramePipeline, StagesOverlap) {
+    // The last stage cannot finish the first item before the previous stage started the second one
+    boost::shared_ptr<TestPipeline> pipeline = TestPipeline::create(10, 3, 1, 1, true /*preserveOrder*/);
+
+    pipeline->blockUntilOverlap = true;
+    pipeline->start();
+    pipeline->waitForFinished();
+    EXPECT_TRUE(pipeline->overlapped);
+    EXPECT_EQ(10, pipeline->nFinished);
+}
+
+TEST(FramePipeline, ConcurrencyCanChangeWhileRunning) {
+    const int nItems = 200;
+    boost::shared_ptr<TestPipeline> pipeline = TestPipeline::create(nItems, 2, 1, 4, true /*preserveOrder*/);
+
+    pipeline->start();
+    pipeline->setStageMaxConcurrentItems(0, 3);
+    EXPECT_EQ( 3, pipeline->getStageMaxConcurrentItems(0) );
+    pipeline->waitForFinished();
+
+    EXPECT_EQ(nItems, pipeline->nFinished);
+    EXPECT_LE(pipeline->stages[0]->maxConcurrent, 3);
+    EXPECT_EQ(1, pipeline->stages[1]->maxConcurrent);
+}
+
+TEST(FramePipeline, FailedItemIsRemoved) {
+    const int nItems = 20;
+    boost::shared_ptr<TestPipeline> pipeline = TestPipeline::create(nItems, 3, 2, 2, true /*preserveOrder*/);
+
+    pipeline->stages[1]->failingIndex = 7;
+    pipeline->start();
+    pipeline->waitForFinished();
+
+    ASSERT_EQ( (std::size_t)1, pipeline->failedIndices.size() );
+    EXPECT_EQ(7, pipeline->failedIndices[0]);
+
+    // The last stage never saw the failed item but processed all others
+    std::vector<int>& indices = pipeline->stages[2]->processedIndices;
+    EXPECT_EQ( (std::size_t)nItems - 1, indices.size() );
+    EXPECT_TRUE( std::find(indices.begin(), indices.end(), 7) == indices.end() );
+}
+
+TEST(FramePipeline, Abort) {
+    boost::shared_ptr<TestPipeline> pipeline = TestPipeline::create(1000000, 3, 2, 2, true /*preserveOrder*/);
+
+    pipeline->start();
+    pipeline->abort();
+    pipeline->waitForFinished();
+    EXPECT_TRUE( pipeline->isAborted() );
+    EXPECT_TRUE( pipeline->isFinished() );
+    EXPECT_LT(pipeline->nPulled, 1000000);
+    for (int s = 0; s < pipeline->getNumStages(); ++s) {
+        EXPECT_EQ( 0, pipeline->getNumItemsInStage(s) );
+    }
+}
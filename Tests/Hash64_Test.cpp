@@ -24,9 +24,17 @@
 
 #include "Global/Macros.h"
 
+#include <algorithm>
 #include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <vector>
 #include <gtest/gtest.h>
 
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/crc.hpp>
+#endif
+
 #include "Engine/Hash64.h"
 
 NATRON_NAMESPACE_USING
@@ -90,3 +98,125 @@ TEST(Hash64,
     EXPECT_NE(hash1, hash2);
 } // TEST
 
+
+// The checksum that was computed before hashes were streamed: the CRC-64 of the buffer of values
+static U64
+computeBufferedCRC64(const std::vector<U64>& values)
+{
+    boost::crc_optimal<64, 0x42F0E1EBA9EA3693ULL, 0, 0, false, false> crc_64;
+    crc_64.process_bytes( &values.front(), values.size() * sizeof(values[0]) );
+
+    return crc_64.checksum();
+}
+
+TEST(Hash64,
+     CRC64Compatibility)
+{
+    srand(2000);
+    std::vector<U64> values;
+    Hash64 hash(eHash64AlgorithmCRC64);
+    for (int i = 0; i < 1000; ++i) {
+        // coverity[dont_call]
+        double v = rand() / (double)RAND_MAX;
+        values.push_back( Hash64::toU64(v) );
+        hash.append(v);
+        // coverity[dont_call]
+        int iv = rand();
+        values.push_back( Hash64::toU64(iv) );
+        hash.append(iv);
+    }
+    hash.computeHash();
+    ASSERT_TRUE( hash.valid() );
+    EXPECT_EQ( computeBufferedCRC64(values), hash.value() ) << "The compatible algorithm must produce the keys of existing caches.";
+
+    // Appending after a computation continues the stream
+    values.push_back( Hash64::toU64(true) );
+    hash.append(true);
+    hash.computeHash();
+    EXPECT_EQ( computeBufferedCRC64(values), hash.value() );
+}
+
+TEST(Hash64,
+     FastAlgorithm)
+{
+    // Trailing zeroes must change the hash
+    Hash64 hash1(eHash64AlgorithmFast), hash2(eHash64AlgorithmFast);
+    hash1.append<int>(0);
+    hash1.computeHash();
+    hash2.append<int>(0);
+    hash2.append<int>(0);
+    hash2.computeHash();
+    EXPECT_NE( hash1.value(), hash2.value() );
+
+    // The order of the values matters
+    hash1.reset();
+    hash2.reset();
+    hash1.append<int>(1);
+    hash1.append<int>(2);
+    hash2.append<int>(2);
+    hash2.append<int>(1);
+    hash1.computeHash();
+    hash2.computeHash();
+    EXPECT_NE( hash1.value(), hash2.value() );
+
+    // Single bit flips in any value change the hash
+    for (int bit = 0; bit < 64; ++bit) {
+        Hash64 ref(eHash64AlgorithmFast), flipped(eHash64AlgorithmFast);
+        for (int i = 0; i < 4; ++i) {
+            ref.append<U64>(i);
+            flipped.append<U64>( i == 2 ? ( i ^ (1ULL << bit) ) : i );
+        }
+        ref.computeHash();
+        flipped.computeHash();
+        EXPECT_NE( ref.value(), flipped.value() );
+    }
+}
+
+// Not a real test: prints the time taken to hash the keyframes of a heavily animated node
+// with the former buffered CRC-64, the streamed CRC-64 and the fast algorithm.
+TEST(Hash64,
+     Benchmark)
+{
+    const int nKeyFrames = 100000;
+    const int nIterations = 20;
+    std::vector<double> keys(nKeyFrames * 4);
+    srand(2000);
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        // coverity[dont_call]
+        keys[i] = rand() / (double)RAND_MAX;
+    }
+
+    U64 buffered = 0;
+    std::clock_t start = std::clock();
+    for (int it = 0; it < nIterations; ++it) {
+        std::vector<U64> values;
+        for (std::size_t i = 0; i < keys.size(); ++i) {
+            values.push_back( Hash64::toU64(keys[i]) );
+        }
+        buffered = computeBufferedCRC64(values);
+    }
+    double bufferedSecs = (std::clock() - start) / (double)CLOCKS_PER_SEC;
+
+    U64 results[2] = {0, 0};
+    double secs[2] = {0, 0};
+    for (int a = 0; a < 2; ++a) {
+        Hash64AlgorithmEnum algo = a == 0 ? eHash64AlgorithmCRC64 : eHash64AlgorithmFast;
+        start = std::clock();
+        for (int it = 0; it < nIterations; ++it) {
+            Hash64 hash(algo);
+            for (std::size_t i = 0; i < keys.size(); ++i) {
+                hash.append(keys[i]);
+            }
+            hash.computeHash();
+            results[a] = hash.value();
+        }
+        secs[a] = (std::clock() - start) / (double)CLOCKS_PER_SEC;
+    }
+    EXPECT_EQ(buffered, results[0]);
+
+    double mb = nIterations * keys.size() * sizeof(U64) / (1024. * 1024.);
+    std::cout << "Hashing " << nKeyFrames << " keyframes " << nIterations << " times:" << std::endl;
+    std::cout << "    buffered CRC-64: " << bufferedSecs << " s (" << mb / std::max(bufferedSecs, 1e-6) << " MiB/s)" << std::endl;
+    std::cout << "    streamed CRC-64: " << secs[0] << " s (" << mb / std::max(secs[0], 1e-6) << " MiB/s)" << std::endl;
+    std::cout << "    fast: " << secs[1] << " s (" << mb / std::max(secs[1], 1e-6) << " MiB/s)" << std::endl;
+}
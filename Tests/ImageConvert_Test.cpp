@@ -0,0 +1,374 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2013-2017 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "Engine/ImageConvertSIMD.h"
+#include "Engine/ImagePrivate.h"
+#include "Engine/Lut.h"
+#include "Engine/RectI.h"
+
+NATRON_NAMESPACE_USING
+using namespace NATRON_NAMESPACE::ImageConvertSIMD;
+
+// Odd number of values so that the scalar tail of each kernel is exercised as well
+#define N_VALUES 4099
+
+// The vectorized instruction sets that can be tested on this CPU
+static std::vector<InstructionSetEnum>
+getVectorInstructionSets()
+{
+    std::vector<InstructionSetEnum> ret;
+    for (int i = (int)eInstructionSetSSE41; i <= (int)getSupportedInstructionSet(); ++i) {
+        ret.push_back( (InstructionSetEnum)i );
+    }
+
+    return ret;
+}
+
+// Floats around and inside [0, 1], including the values on which the rounding is the most sensitive
+static std::vector<float>
+makeFloatValues()
+{
+    std::vector<float> values;
+    values.push_back(-1.f);
+    values.push_back(-0.f);
+    values.push_back(0.f);
+    values.push_back(1e-30f);
+    values.push_back(1.f);
+    values.push_back(1.5f);
+    values.push_back(1e30f);
+    for (int i = 0; i < 256; ++i) {
+        float f = (i + 0.5f) / 255.f;
+        values.push_back(f);
+        values.push_back( f * (1.f - 1e-7f) );
+        values.push_back( f * (1.f + 1e-7f) );
+    }
+    srand(2000);
+    while ( (int)values.size() < N_VALUES ) {
+        // coverity[dont_call]
+        values.push_back( -0.1f + 1.2f * (rand() / (float)RAND_MAX) );
+    }
+
+    return values;
+}
+
+TEST(ImageConvertSIMD, FloatToInt) {
+    std::vector<float> src = makeFloatValues();
+    int n = (int)src.size();
+
+    std::vector<unsigned char> ref8(n), out8(n);
+    std::vector<unsigned short> ref16(n), out16(n), ref8xx(n), out8xx(n);
+
+    convertFloatToUint8(&src[0], &ref8[0], n, eInstructionSetScalar);
+    convertFloatToUint16(&src[0], &ref16[0], n, eInstructionSetScalar);
+    convertFloatToUint8xx(&src[0], &ref8xx[0], n, eInstructionSetScalar);
+    for (int i = 0; i < n; ++i) {
+        EXPECT_EQ( Color::floatToInt<256>(src[i]), ref8[i] );
+        EXPECT_EQ( Color::floatToInt<65536>(src[i]), ref16[i] );
+        EXPECT_EQ( Color::floatToInt<0xff01>(src[i]), ref8xx[i] );
+    }
+
+    std::vector<InstructionSetEnum> sets = getVectorInstructionSets();
+    for (std::size_t s = 0; s < sets.size(); ++s) {
+        convertFloatToUint8(&src[0], &out8[0], n, sets[s]);
+        convertFloatToUint16(&src[0], &out16[0], n, sets[s]);
+        convertFloatToUint8xx(&src[0], &out8xx[0], n, sets[s]);
+        EXPECT_EQ( 0, std::memcmp( &ref8[0], &out8[0], n * sizeof(unsigned char) ) );
+        EXPECT_EQ( 0, std::memcmp( &ref16[0], &out16[0], n * sizeof(unsigned short) ) );
+        EXPECT_EQ( 0, std::memcmp( &ref8xx[0], &out8xx[0], n * sizeof(unsigned short) ) );
+    }
+}
+
+TEST(ImageConvertSIMD, IntToFloat) {
+    std::vector<unsigned char> src8(N_VALUES);
+    std::vector<unsigned short> src16(N_VALUES);
+    for (int i = 0; i < N_VALUES; ++i) {
+        src8[i] = (unsigned char)(i & 0xff);
+        src16[i] = (unsigned short)(i * 17);
+    }
+
+    std::vector<float> ref8(N_VALUES), out8(N_VALUES), ref16(N_VALUES), out16(N_VALUES);
+    convertUint8ToFloat(&src8[0], &ref8[0], N_VALUES, eInstructionSetScalar);
+    convertUint16ToFloat(&src16[0], &ref16[0], N_VALUES, eInstructionSetScalar);
+
+    std::vector<InstructionSetEnum> sets = getVectorInstructionSets();
+    for (std::size_t s = 0; s < sets.size(); ++s) {
+        convertUint8ToFloat(&src8[0], &out8[0], N_VALUES, sets[s]);
+        convertUint16ToFloat(&src16[0], &out16[0], N_VALUES, sets[s]);
+        EXPECT_EQ( 0, std::memcmp( &ref8[0], &out8[0], N_VALUES * sizeof(float) ) );
+        EXPECT_EQ( 0, std::memcmp( &ref16[0], &out16[0], N_VALUES * sizeof(float) ) );
+    }
+}
+
+TEST(ImageConvertSIMD, Lut) {
+    const Color::Lut* lut = Color::LutManager::sRGBLut();
+    lut->validate();
+
+    std::vector<float> srcFloat = makeFloatValues();
+    int n = (int)srcFloat.size();
+    std::vector<unsigned short> ref8xx(n), out8xx(n);
+    convertFloatToUint8xxLut(lut, &srcFloat[0], &ref8xx[0], n, eInstructionSetScalar);
+    for (int i = 0; i < n; ++i) {
+        EXPECT_EQ( lut->toColorSpaceUint8xxFromLinearFloatFast(srcFloat[i]), ref8xx[i] );
+    }
+
+    std::vector<unsigned char> src8(N_VALUES);
+    for (int i = 0; i < N_VALUES; ++i) {
+        src8[i] = (unsigned char)( (i * 7) & 0xff );
+    }
+    std::vector<float> ref[4], out(N_VALUES);
+    for (int nComps = 1; nComps <= 4; ++nComps) {
+        ref[nComps - 1].resize(N_VALUES);
+        convertUint8ToFloatLut(lut, &src8[0], &ref[nComps - 1][0], N_VALUES, nComps, eInstructionSetScalar);
+    }
+    // Alpha is the only channel converted linearly
+    EXPECT_EQ( Color::intToFloat<256>(src8[3]), ref[3][3] );
+    EXPECT_EQ( lut->fromColorSpaceUint8ToLinearFloatFast(src8[3]), ref[2][3] );
+
+    std::vector<InstructionSetEnum> sets = getVectorInstructionSets();
+    for (std::size_t s = 0; s < sets.size(); ++s) {
+        convertFloatToUint8xxLut(lut, &srcFloat[0], &out8xx[0], n, sets[s]);
+        EXPECT_EQ( 0, std::memcmp( &ref8xx[0], &out8xx[0], n * sizeof(unsigned short) ) );
+        for (int nComps = 1; nComps <= 4; ++nComps) {
+            convertUint8ToFloatLut(lut, &src8[0], &out[0], N_VALUES, nComps, sets[s]);
+            EXPECT_EQ( 0, std::memcmp( &ref[nComps - 1][0], &out[0], N_VALUES * sizeof(float) ) );
+        }
+    }
+}
+
+template <typename PIX>
+static void
+testRGBToRGBA(PIX alpha)
+{
+    // Try all sizes up to a few vectors to check the loop bounds
+    for (int nPixels = 1; nPixels < 40; ++nPixels) {
+        std::vector<PIX> src(nPixels * 3);
+        for (std::size_t i = 0; i < src.size(); ++i) {
+            src[i] = (PIX)(i + 1);
+        }
+        std::vector<PIX> ref(nPixels * 4), out(nPixels * 4);
+        convertRGBToRGBA(&src[0], &ref[0], nPixels, alpha, eInstructionSetScalar);
+        EXPECT_EQ( src[nPixels * 3 - 1], ref[nPixels * 4 - 2] );
+        EXPECT_EQ( alpha, ref[nPixels * 4 - 1] );
+
+        std::vector<InstructionSetEnum> sets = getVectorInstructionSets();
+        for (std::size_t s = 0; s < sets.size(); ++s) {
+            convertRGBToRGBA(&src[0], &out[0], nPixels, alpha, sets[s]);
+            EXPECT_EQ( 0, std::memcmp( &ref[0], &out[0], out.size() * sizeof(PIX) ) );
+        }
+    }
+}
+
+TEST(ImageConvertSIMD, RGBToRGBA) {
+    testRGBToRGBA<unsigned char>(255);
+    testRGBToRGBA<unsigned short>(65535);
+    testRGBToRGBA<float>(1.f);
+}
+
+template <typename PIX>
+static void
+testHalveScanLine(int maxValue)
+{
+    srand(2000);
+    for (int nComps = 1; nComps <= 4; ++nComps) {
+        // Try all widths up to a few vectors to check the loop bounds
+        for (int dstWidth = 1; dstWidth < 40; ++dstWidth) {
+            std::vector<PIX> src0(dstWidth * 2 * nComps), src1(dstWidth * 2 * nComps);
+            for (std::size_t i = 0; i < src0.size(); ++i) {
+                // coverity[dont_call]
+                src0[i] = (PIX)( (rand() / (double)RAND_MAX) * maxValue );
+                // coverity[dont_call]
+                src1[i] = (PIX)( (rand() / (double)RAND_MAX) * maxValue );
+            }
+            std::vector<PIX> ref(dstWidth * nComps), out(dstWidth * nComps);
+            halveScanLine(&src0[0], &src1[0], &ref[0], dstWidth, nComps, eInstructionSetScalar);
+            EXPECT_EQ( (PIX)( (src0[0] + src0[nComps] + src1[0] + src1[nComps]) / 4 ), ref[0] );
+
+            std::vector<InstructionSetEnum> sets = getVectorInstructionSets();
+            for (std::size_t s = 0; s < sets.size(); ++s) {
+                halveScanLine(&src0[0], &src1[0], &out[0], dstWidth, nComps, sets[s]);
+                EXPECT_EQ( 0, std::memcmp( &ref[0], &out[0], out.size() * sizeof(PIX) ) );
+            }
+        }
+    }
+}
+
+TEST(ImageConvertSIMD, HalveScanLine) {
+    testHalveScanLine<unsigned char>(255);
+    testHalveScanLine<unsigned short>(65535);
+    testHalveScanLine<float>(1);
+}
+
+TEST(ImageConvertSIMD, EvaluateCubicSegments) {
+    // Segments with null coefficients, for which the result does not depend on the sign of t or on it being infinite
+    const int nSegments = 17;
+    std::vector<double> segmentStart(nSegments), segmentEnd(nSegments), c0(nSegments), c1(nSegments), c2(nSegments), c3(nSegments);
+    srand(2000);
+    for (int s = 0; s < nSegments; ++s) {
+        segmentStart[s] = s - 1.;
+        segmentEnd[s] = s;
+        // coverity[dont_call]
+        c0[s] = (s % 5 == 0) ? -0. : rand() / (double)RAND_MAX;
+        // coverity[dont_call]
+        c1[s] = (s % 4 == 0) ? 0. : rand() / (double)RAND_MAX - 0.5;
+        // coverity[dont_call]
+        c2[s] = (s % 3 == 0) ? 0. : rand() / (double)RAND_MAX - 0.5;
+        // coverity[dont_call]
+        c3[s] = (s % 2 == 0) ? 0. : rand() / (double)RAND_MAX - 0.5;
+    }
+
+    std::vector<int> segments(N_VALUES);
+    std::vector<double> times(N_VALUES);
+    for (int i = 0; i < N_VALUES; ++i) {
+        // coverity[dont_call]
+        segments[i] = rand() % nSegments;
+        // coverity[dont_call]
+        times[i] = segmentStart[segments[i]] - 0.5 + 2. * rand() / (double)RAND_MAX;
+    }
+    times[1] = std::numeric_limits<double>::infinity();
+    times[2] = -std::numeric_limits<double>::infinity();
+    times[3] = -1e300;
+
+    std::vector<double> ref(N_VALUES), out(N_VALUES);
+    evaluateCubicSegments(&segmentStart[0], &segmentEnd[0], &c0[0], &c1[0], &c2[0], &c3[0], &segments[0], &times[0], &ref[0], N_VALUES, eInstructionSetScalar);
+
+    std::vector<InstructionSetEnum> sets = getVectorInstructionSets();
+    for (std::size_t s = 0; s < sets.size(); ++s) {
+        evaluateCubicSegments(&segmentStart[0], &segmentEnd[0], &c0[0], &c1[0], &c2[0], &c3[0], &segments[0], &times[0], &out[0], N_VALUES, sets[s]);
+        EXPECT_EQ( 0, std::memcmp( &ref[0], &out[0], N_VALUES * sizeof(double) ) );
+    }
+}
+
+template <typename PIX>
+static ImageBitDepthEnum
+getBitDepth();
+
+template <>
+ImageBitDepthEnum
+getBitDepth<unsigned char>()
+{
+    return eImageBitDepthByte;
+}
+
+template <>
+ImageBitDepthEnum
+getBitDepth<unsigned short>()
+{
+    return eImageBitDepthShort;
+}
+
+template <>
+ImageBitDepthEnum
+getBitDepth<float>()
+{
+    return eImageBitDepthFloat;
+}
+
+// Converts a packed image with ImagePrivate::convertCPUImage. The buffers are offset by one value
+// so that the scan-lines are not aligned.
+template <typename SRCPIX, typename DSTPIX>
+static std::vector<DSTPIX>
+convertPackedImage(const std::vector<SRCPIX>& src,
+                   int srcNComps,
+                   int dstNComps,
+                   const RectI& bounds,
+                   ViewerColorSpaceEnum srcColorSpace,
+                   ViewerColorSpaceEnum dstColorSpace)
+{
+    std::vector<SRCPIX> srcBuffer(src.size() + 1);
+    std::copy( src.begin(), src.end(), srcBuffer.begin() + 1 );
+    std::vector<DSTPIX> dstBuffer(bounds.area() * dstNComps + 1);
+
+    const void* srcPtrs[4] = { &srcBuffer[1], 0, 0, 0 };
+    void* dstPtrs[4] = { &dstBuffer[1], 0, 0, 0 };
+
+    // Both the generic code and the kernels start the error diffusion at a random position of each scan-line
+    srand(2000);
+    ActionRetCodeEnum stat = ImagePrivate::convertCPUImage(bounds, srcColorSpace, dstColorSpace, false /*requiresUnpremult*/, 3 /*conversionChannel*/,
+                                                           Image::eAlphaChannelHandlingCreateFill1, Image::eMonoToPackedConversionCopyToChannelAndFillOthers,
+                                                           srcPtrs, srcNComps, getBitDepth<SRCPIX>(), bounds,
+                                                           dstPtrs, dstNComps, getBitDepth<DSTPIX>(), bounds, EffectInstancePtr());
+    EXPECT_EQ(eActionStatusOK, stat);
+
+    return std::vector<DSTPIX>( dstBuffer.begin() + 1, dstBuffer.end() );
+}
+
+// Checks that converting through the vectorized kernels gives the same image as the generic code of ImageConvert.cpp
+template <typename SRCPIX, typename DSTPIX>
+static void
+testConvertCPUImage(double srcMinValue,
+                    double srcMaxValue,
+                    ViewerColorSpaceEnum srcColorSpace,
+                    ViewerColorSpaceEnum dstColorSpace)
+{
+    srand(2000);
+    for (int srcNComps = 1; srcNComps <= 4; ++srcNComps) {
+        // Only RGB to RGBA has a kernel among the conversions changing the number of components
+        int dstNComps = srcNComps == 3 ? 4 : srcNComps;
+        for (int nComps = srcNComps; nComps <= dstNComps; ++nComps) {
+            // Odd widths so that the scalar tail of the kernels is exercised
+            for (int width = 1; width < 40; width += 3) {
+                RectI bounds(3, -2, 3 + width, 3);
+                std::vector<SRCPIX> src(bounds.area() * srcNComps);
+                for (std::size_t i = 0; i < src.size(); ++i) {
+                    // coverity[dont_call]
+                    src[i] = (SRCPIX)( srcMinValue + (srcMaxValue - srcMinValue) * rand() / (double)RAND_MAX );
+                }
+
+                ImageConvertSIMD::setMaximumInstructionSet(ImageConvertSIMD::eInstructionSetScalar);
+                std::vector<DSTPIX> ref = convertPackedImage<SRCPIX, DSTPIX>(src, srcNComps, nComps, bounds, srcColorSpace, dstColorSpace);
+                ImageConvertSIMD::setMaximumInstructionSet(ImageConvertSIMD::eInstructionSetAVX2);
+
+                std::vector<InstructionSetEnum> sets = getVectorInstructionSets();
+                for (std::size_t s = 0; s < sets.size(); ++s) {
+                    ImageConvertSIMD::setMaximumInstructionSet(sets[s]);
+                    std::vector<DSTPIX> out = convertPackedImage<SRCPIX, DSTPIX>(src, srcNComps, nComps, bounds, srcColorSpace, dstColorSpace);
+                    ImageConvertSIMD::setMaximumInstructionSet(ImageConvertSIMD::eInstructionSetAVX2);
+                    EXPECT_EQ( 0, std::memcmp( &ref[0], &out[0], out.size() * sizeof(DSTPIX) ) ) << "nComps: " << srcNComps << "->" << nComps << " width: " << width << " instruction set: " << sets[s];
+                }
+            }
+        }
+    }
+}
+
+TEST(ImageConvertSIMD, ConvertCPUImage) {
+    // Same bit depth: only RGB to RGBA uses a kernel
+    testConvertCPUImage<unsigned char, unsigned char>(0, 255, eViewerColorSpaceLinear, eViewerColorSpaceLinear);
+    testConvertCPUImage<float, float>(-0.1, 1.1, eViewerColorSpaceLinear, eViewerColorSpaceLinear);
+
+    testConvertCPUImage<unsigned char, float>(0, 255, eViewerColorSpaceLinear, eViewerColorSpaceLinear);
+    testConvertCPUImage<unsigned char, float>(0, 255, eViewerColorSpaceSRGB, eViewerColorSpaceLinear);
+    testConvertCPUImage<unsigned short, float>(0, 65535, eViewerColorSpaceLinear, eViewerColorSpaceLinear);
+    testConvertCPUImage<float, unsigned short>(-0.1, 1.1, eViewerColorSpaceLinear, eViewerColorSpaceLinear);
+    testConvertCPUImage<float, unsigned char>(-0.1, 1.1, eViewerColorSpaceLinear, eViewerColorSpaceLinear);
+    testConvertCPUImage<float, unsigned char>(-0.1, 1.1, eViewerColorSpaceLinear, eViewerColorSpaceSRGB);
+}
@@ -24,12 +24,16 @@
 
 #include "Global/Macros.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
+#include <vector>
 #include <gtest/gtest.h>
 
 #include "Engine/Image.h"
 #include "Engine/ImageCacheKey.h"
 #include "Engine/ImageCacheEntryProcessing.h"
+#include "Engine/ImagePrivate.h"
 #include "Engine/CacheEntryKeyBase.h"
 #include "Engine/ViewIdx.h"
 
@@ -311,3 +315,98 @@ TEST(ImageCacheEntryProcessing, RepeatEdgesGeneralCase) {
 #undef getBufAt
 
 
+
+// Halves a packed image once: each pixel is the average of the 2x2 pixels of the input that exist
+template <typename PIX>
+static std::vector<PIX>
+halveImageOnce(const std::vector<PIX>& src,
+               const RectI& srcBounds,
+               int nComps,
+               RectI* dstBounds)
+{
+    *dstBounds = srcBounds.downscalePowerOfTwoSmallestEnclosing(1);
+    std::vector<PIX> dst(dstBounds->area() * nComps);
+    for (int y = dstBounds->y1; y < dstBounds->y2; ++y) {
+        for (int x = dstBounds->x1; x < dstBounds->x2; ++x) {
+            for (int k = 0; k < nComps; ++k) {
+                PIX values[4];
+                int sum = 0;
+                for (int j = 0; j < 2; ++j) {
+                    for (int i = 0; i < 2; ++i) {
+                        const int srcx = x * 2 + i;
+                        const int srcy = y * 2 + j;
+                        if ( srcBounds.contains(srcx, srcy) ) {
+                            values[j * 2 + i] = src[( (srcy - srcBounds.y1) * srcBounds.width() + (srcx - srcBounds.x1) ) * nComps + k];
+                            ++sum;
+                        } else {
+                            values[j * 2 + i] = 0;
+                        }
+                    }
+                }
+                dst[( (y - dstBounds->y1) * dstBounds->width() + (x - dstBounds->x1) ) * nComps + k] = (values[0] + values[1] + values[2] + values[3]) / sum;
+            }
+        }
+    }
+
+    return dst;
+}
+
+// Checks that downscaling several levels at once gives the same result as halving the image once per level
+template <typename PIX>
+static void
+testDownscaleMipMap(ImageBitDepthEnum bitDepth,
+                    double maxValue)
+{
+    // Odd sizes and odd origins, so that the borders average less than 4 pixels at each level
+    const RectI rois[] = { RectI(0, 0, 1, 1), RectI(-3, 1, 4, 8), RectI(1, -5, 300, 158), RectI(-7, 3, 129, 131) };
+
+    srand(2000);
+    for (std::size_t r = 0; r < sizeof(rois) / sizeof(rois[0]); ++r) {
+        // The source buffer is larger than the region to downscale
+        const RectI srcRoI = rois[r];
+        const RectI srcBounds(srcRoI.x1 - 2, srcRoI.y1 - 3, srcRoI.x2 + 1, srcRoI.y2 + 5);
+
+        for (int nComps = 1; nComps <= 4; ++nComps) {
+            std::vector<PIX> src(srcBounds.area() * nComps);
+            for (std::size_t i = 0; i < src.size(); ++i) {
+                // coverity[dont_call]
+                src[i] = (PIX)(maxValue * rand() / (double)RAND_MAX);
+            }
+
+            // The region to downscale only, as the reference
+            std::vector<PIX> ref(srcRoI.area() * nComps);
+            for (int y = srcRoI.y1; y < srcRoI.y2; ++y) {
+                std::memcpy( &ref[(y - srcRoI.y1) * srcRoI.width() * nComps],
+                             &src[( (y - srcBounds.y1) * srcBounds.width() + (srcRoI.x1 - srcBounds.x1) ) * nComps],
+                             srcRoI.width() * nComps * sizeof(PIX) );
+            }
+            RectI refBounds = srcRoI;
+
+            for (unsigned int levels = 1; levels <= 4; ++levels) {
+                ref = halveImageOnce<PIX>(ref, refBounds, nComps, &refBounds);
+
+                const RectI dstBounds = srcRoI.downscalePowerOfTwoSmallestEnclosing(levels);
+                ASSERT_TRUE(refBounds == dstBounds);
+
+                std::vector<PIX> dst(dstBounds.area() * nComps);
+                const void* srcPtrs[4] = { &src[0], 0, 0, 0 };
+                void* dstPtrs[4] = { &dst[0], 0, 0, 0 };
+
+                // Split the destination in bands of 3 rows, as the multi-threaded processor would
+                for (int y = dstBounds.y1; y < dstBounds.y2; y += 3) {
+                    const RectI renderWindow( dstBounds.x1, y, dstBounds.x2, std::min(y + 3, dstBounds.y2) );
+                    ActionRetCodeEnum stat = ImagePrivate::downscaleMipMapCPU(srcPtrs, nComps, bitDepth, srcBounds, srcRoI, levels, dstPtrs, dstBounds, renderWindow, EffectInstancePtr());
+                    ASSERT_EQ(eActionStatusOK, stat);
+                }
+
+                EXPECT_EQ( 0, std::memcmp( &ref[0], &dst[0], dst.size() * sizeof(PIX) ) ) << "roi: " << r << " nComps: " << nComps << " levels: " << levels;
+            }
+        }
+    }
+}
+
+TEST(ImagePrivate, DownscaleMipMap) {
+    testDownscaleMipMap<unsigned char>(eImageBitDepthByte, 255);
+    testDownscaleMipMap<unsigned short>(eImageBitDepthShort, 65535);
+    testDownscaleMipMap<float>(eImageBitDepthFloat, 1.);
+}
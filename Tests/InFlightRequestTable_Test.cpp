@@ -0,0 +1,170 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <gtest/gtest.h>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+
+#include "Engine/CancellationToken.h"
+#include "Engine/InFlightRequestTable.h"
+#include "Engine/Timer.h"
+
+NATRON_NAMESPACE_USING
+
+// Simulates the request of a render attached to the in-flight request of another render
+class AttachedRequest
+    : public QRunnable
+{
+    InFlightRequestPtr _request;
+    QAtomicInt* _nSucceeded;
+
+public:
+
+    AttachedRequest(const InFlightRequestPtr& request,
+                    QAtomicInt* nSucceeded)
+        : QRunnable()
+        , _request(request)
+        , _nSucceeded(nSucceeded)
+    {
+    }
+
+    virtual void run() OVERRIDE FINAL
+    {
+        ActionRetCodeEnum stat;
+        RectD roi;
+        ImagePtr requestedScaleImage, fullScaleImage;
+
+        // Wait without timeout, like renders do
+        if ( _request->waitForResults(CancellationTokenPtr(), 0 /*timeoutMS*/, &stat, &roi, &requestedScaleImage, &fullScaleImage) &&
+             !isFailureRetCode(stat) && roi.contains( RectD(0, 0, 10, 10) ) ) {
+            _nSucceeded->fetchAndAddOrdered(1);
+        }
+    }
+};
+
+TEST(InFlightRequestTable, OnlyNewerRendersAttach) {
+    InFlightRequestTable table;
+    RectD roi(0, 0, 100, 100);
+    bool isOwner;
+
+    InFlightRequestPtr owner = table.registerRequest(1, 5, roi, &isOwner);
+    ASSERT_TRUE(owner);
+    EXPECT_TRUE(isOwner);
+    EXPECT_EQ( (U64)5, owner->getOwnerRenderIndex() );
+
+    // A render created after the owner attaches to it
+    InFlightRequestPtr attached = table.registerRequest(1, 6, roi, &isOwner);
+    EXPECT_EQ(owner, attached);
+    EXPECT_FALSE(isOwner);
+
+    // An older render does not wait for a newer one
+    EXPECT_FALSE( table.registerRequest(1, 4, roi, &isOwner) );
+    EXPECT_FALSE(isOwner);
+
+    // Other keys are independent
+    InFlightRequestPtr other = table.registerRequest(2, 6, roi, &isOwner);
+    EXPECT_TRUE(isOwner);
+    EXPECT_NE(owner, other);
+    EXPECT_EQ( (std::size_t)2, table.getNumRequests() );
+}
+
+TEST(InFlightRequestTable, FinishedRequests) {
+    InFlightRequestTable table;
+    RectD roi(0, 0, 100, 100);
+    bool isOwner;
+
+    InFlightRequestPtr owner = table.registerRequest(1, 5, roi, &isOwner);
+    owner->notifyRenderStarted();
+    owner->notifyRenderFinished(eActionStatusOK, roi, ImagePtr(), ImagePtr());
+
+    // Available results may be shared with any render
+    EXPECT_EQ( owner, table.registerRequest(1, 2, roi, &isOwner) );
+    EXPECT_FALSE(isOwner);
+
+    // A failed or aborted request is replaced
+    InFlightRequestPtr aborted = table.registerRequest(2, 5, roi, &isOwner);
+    aborted->notifyRenderFinished(eActionStatusAborted, roi, ImagePtr(), ImagePtr());
+    InFlightRequestPtr replacement = table.registerRequest(2, 6, roi, &isOwner);
+    EXPECT_TRUE(isOwner);
+    EXPECT_NE(aborted, replacement);
+
+    // The table does not keep the requests alive
+    owner.reset();
+    aborted.reset();
+    replacement.reset();
+    EXPECT_EQ( (std::size_t)0, table.getNumRequests() );
+    table.registerRequest(1, 7, roi, &isOwner);
+    EXPECT_TRUE(isOwner);
+}
+
+TEST(InFlightRequestTable, WaitForResults) {
+    InFlightRequestTable table;
+    bool isOwner;
+    InFlightRequestPtr owner = table.registerRequest(1, 0, RectD(0, 0, 10, 10), &isOwner);
+
+    owner->notifyRenderStarted();
+    EXPECT_EQ(InFlightRequest::eStateRendering, owner->getState());
+
+    const int nAttached = 8;
+    QThreadPool pool;
+    pool.setMaxThreadCount(nAttached);
+    QAtomicInt nSucceeded;
+    for (int i = 0; i < nAttached; ++i) {
+        InFlightRequestPtr attached = table.registerRequest(1, i + 1, RectD(0, 0, 10, 10), &isOwner);
+        ASSERT_EQ(owner, attached);
+        pool.start( new AttachedRequest(attached, &nSucceeded) );
+    }
+
+    // The owner merged the RoI of another branch of its tree before publishing
+    owner->setRoI( RectD(0, 0, 20, 20) );
+    owner->notifyRenderFinished( eActionStatusOK, owner->getRoI(), ImagePtr(), ImagePtr() );
+    pool.waitForDone();
+    EXPECT_EQ( nAttached, (int)nSucceeded );
+}
+
+TEST(InFlightRequestTable, WaitIsCancellable) {
+    InFlightRequestTable table;
+    bool isOwner;
+    InFlightRequestPtr owner = table.registerRequest(1, 0, RectD(0, 0, 10, 10), &isOwner);
+
+    owner->notifyRenderStarted();
+
+    ActionRetCodeEnum stat;
+    RectD roi;
+    ImagePtr requestedScaleImage, fullScaleImage;
+
+    // The owner never finishes: the wait times out
+    EXPECT_FALSE( owner->waitForResults(CancellationTokenPtr(), 50, &stat, &roi, &requestedScaleImage, &fullScaleImage) );
+
+    // The render of the attached request is aborted: the wait returns right away, even without timeout
+    CancellationTokenPtr token = CancellationToken::create();
+    token->cancel();
+    TimeLapse timer;
+    EXPECT_FALSE( owner->waitForResults(token, 0 /*timeoutMS*/, &stat, &roi, &requestedScaleImage, &fullScaleImage) );
+    EXPECT_LT( timer.getTimeSinceCreation(), 1. );
+}
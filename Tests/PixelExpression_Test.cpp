@@ -0,0 +1,182 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2013-2017 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <list>
+#include <string>
+
+#include "BaseTest.h"
+
+#include "Engine/EffectInstance.h"
+#include "Engine/KnobTypes.h"
+#include "Engine/Node.h"
+#include "Engine/PixelExpression.h"
+
+NATRON_NAMESPACE_USING
+
+// Fills the batch with count pixels of coordinates (x + i, y) and input values (i, 2i, 3i, 4i)
+static void
+fillBatch(PixelExpressionBatch* batch,
+          int count,
+          double x,
+          double y)
+{
+    batch->count = count;
+    for (int i = 0; i < count; ++i) {
+        batch->x[i] = x + i;
+        batch->y[i] = y;
+        for (int c = 0; c < 4; ++c) {
+            batch->in[c][i] = i * (c + 1);
+            batch->out[c][i] = -1.;
+        }
+    }
+}
+
+TEST_F(BaseTest, PixelExpressionChannels)
+{
+    NodePtr node = createNode( QString::fromUtf8(PLUGINID_NATRON_PIXELEXPRESSION) );
+    ASSERT_TRUE(node);
+    KnobIPtr knob = node->getKnobByName("exprR");
+    ASSERT_TRUE(knob);
+
+    // Each channel is computed by its own expression from the input of all channels
+    const std::string expressions[4] = { "r * 2", "g + 1", "b - a", "0.25" };
+    PixelExpression expression;
+    std::string error;
+    ASSERT_TRUE( expression.compile(expressions, knob, TimeValue(0), ViewIdx(0), &error) ) << error;
+
+    PixelExpressionBatch batch;
+    fillBatch(&batch, 10, 0., 0.);
+    expression.evaluate(&batch);
+    for (int i = 0; i < batch.count; ++i) {
+        EXPECT_EQ(i * 2., batch.out[0][i]);
+        EXPECT_EQ(i * 2. + 1., batch.out[1][i]);
+        EXPECT_EQ(i * 3. - i * 4., batch.out[2][i]);
+        EXPECT_EQ(0.25, batch.out[3][i]);
+    }
+
+    // An expression that does not compile is reported
+    const std::string invalidExpressions[4] = { "r", "g +", "b", "a" };
+    PixelExpression invalid;
+    error.clear();
+    EXPECT_FALSE( invalid.compile(invalidExpressions, knob, TimeValue(0), ViewIdx(0), &error) );
+    EXPECT_FALSE( error.empty() );
+}
+
+TEST_F(BaseTest, PixelExpressionVariables)
+{
+    NodePtr node = createNode( QString::fromUtf8(PLUGINID_NATRON_PIXELEXPRESSION) );
+    ASSERT_TRUE(node);
+    KnobIPtr knob = node->getKnobByName("exprR");
+    ASSERT_TRUE(knob);
+
+    const std::string expressions[4] = { "x", "y", "frame", "x * 10 + y" };
+    PixelExpression expression;
+    std::string error;
+    ASSERT_TRUE( expression.compile(expressions, knob, TimeValue(7), ViewIdx(0), &error) ) << error;
+
+    PixelExpressionBatch batch;
+    fillBatch(&batch, NATRON_PIXEL_EXPRESSION_BATCH_SIZE, 3.5, 12.5);
+    expression.evaluate(&batch);
+    for (int i = 0; i < batch.count; ++i) {
+        EXPECT_EQ(3.5 + i, batch.out[0][i]);
+        EXPECT_EQ(12.5, batch.out[1][i]);
+        EXPECT_EQ(7., batch.out[2][i]);
+        EXPECT_EQ( (3.5 + i) * 10. + 12.5, batch.out[3][i] );
+    }
+}
+
+TEST_F(BaseTest, PixelExpressionRandom)
+{
+    NodePtr node = createNode( QString::fromUtf8(PLUGINID_NATRON_PIXELEXPRESSION) );
+    ASSERT_TRUE(node);
+    KnobIPtr knob = node->getKnobByName("exprR");
+    ASSERT_TRUE(knob);
+
+    const std::string expressions[4] = { "random()", "random(1)", "random(2)", "randomInt(1, 0, 1000000)" };
+    PixelExpression expression;
+    std::string error;
+    ASSERT_TRUE( expression.compile(expressions, knob, TimeValue(1), ViewIdx(0), &error) ) << error;
+
+    PixelExpressionBatch batch;
+    fillBatch(&batch, 2, 0., 0.);
+    expression.evaluate(&batch);
+
+    // Each pixel gets its own random values
+    for (int c = 0; c < 4; ++c) {
+        EXPECT_NE(batch.out[c][0], batch.out[c][1]);
+    }
+    for (int i = 0; i < batch.count; ++i) {
+        EXPECT_TRUE(batch.out[0][i] >= 0. && batch.out[0][i] < 1.);
+
+        // Small seeds are not lost
+        EXPECT_NE(batch.out[1][i], batch.out[2][i]);
+    }
+
+    // The values do not depend on the order in which the pixels are evaluated
+    PixelExpressionBatch other;
+    fillBatch(&other, 1, 1., 0.);
+    expression.evaluate(&other);
+    for (int c = 0; c < 4; ++c) {
+        EXPECT_EQ(batch.out[c][1], other.out[c][0]);
+    }
+
+    // They vary over time
+    PixelExpression nextFrame;
+    ASSERT_TRUE( nextFrame.compile(expressions, knob, TimeValue(2), ViewIdx(0), &error) ) << error;
+    fillBatch(&other, 1, 0., 0.);
+    nextFrame.evaluate(&other);
+    EXPECT_NE(batch.out[0][0], other.out[0][0]);
+}
+
+TEST_F(BaseTest, PixelExpressionKnobDependencies)
+{
+    NodePtr generator = createNode(_generatorPluginID);
+    NodePtr node = createNode( QString::fromUtf8(PLUGINID_NATRON_PIXELEXPRESSION) );
+    ASSERT_TRUE(generator && node);
+    KnobDoublePtr slope = toKnobDouble( generator->getKnobByName("noiseZSlope") );
+    ASSERT_TRUE(slope);
+    slope->setValue(0.5);
+    KnobIPtr knob = node->getKnobByName("exprR");
+    ASSERT_TRUE(knob);
+
+    // The referenced knob is registered as a dependency of the channel and its value is used at the compile time
+    const std::string expressions[4] = { "r", generator->getScriptName_mt_safe() + ".noiseZSlope * 2", "b", "a" };
+    PixelExpression expression;
+    std::string error;
+    ASSERT_TRUE( expression.compile(expressions, knob, TimeValue(0), ViewIdx(0), &error) ) << error;
+
+    std::list<KnobDimViewKey> dependencies;
+    expression.getKnobDependencies(0, &dependencies);
+    EXPECT_TRUE( dependencies.empty() );
+    expression.getKnobDependencies(1, &dependencies);
+    ASSERT_EQ(1, (int)dependencies.size());
+    EXPECT_TRUE(dependencies.front().knob.lock() == slope);
+
+    PixelExpressionBatch batch;
+    fillBatch(&batch, 1, 0., 0.);
+    expression.evaluate(&batch);
+    EXPECT_EQ(1., batch.out[1][0]);
+}
@@ -0,0 +1,114 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2013-2017 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <list>
+#include <gtest/gtest.h>
+
+#include "Engine/RectI.h"
+
+NATRON_NAMESPACE_USING
+
+// Checks that the strips cover rect exactly, span its whole width and only start or end inside it on a tile row
+static void
+checkTileAlignedStrips(const RectI& rect,
+                       int tileSizeY,
+                       int splitsCount)
+{
+    std::list<RectI> strips = rect.splitIntoTileAlignedStrips(tileSizeY, splitsCount);
+
+    ASSERT_FALSE( strips.empty() );
+    EXPECT_LE( (int)strips.size(), splitsCount );
+
+    int y = rect.y1;
+    for (std::list<RectI>::const_iterator it = strips.begin(); it != strips.end(); ++it) {
+        EXPECT_FALSE( it->isNull() );
+        EXPECT_EQ(rect.x1, it->x1);
+        EXPECT_EQ(rect.x2, it->x2);
+        EXPECT_EQ(y, it->y1);
+        if (it->y1 != rect.y1) {
+            EXPECT_EQ(0, it->y1 % tileSizeY);
+        }
+        if (it->y2 != rect.y2) {
+            EXPECT_EQ(0, it->y2 % tileSizeY);
+        }
+        y = it->y2;
+    }
+    EXPECT_EQ(rect.y2, y);
+}
+
+TEST(RectI, SplitIntoTileAlignedStrips) {
+    // Even number of tile rows
+    {
+        std::list<RectI> strips = RectI(0, 0, 10, 16).splitIntoTileAlignedStrips(4, 2);
+        ASSERT_EQ(2, (int)strips.size());
+        EXPECT_TRUE( strips.front() == RectI(0, 0, 10, 8) );
+        EXPECT_TRUE( strips.back() == RectI(0, 8, 10, 16) );
+    }
+
+    // Edges in the middle of a tile row, on negative coordinates: the first and last strips are clipped
+    {
+        std::list<RectI> strips = RectI(-3, -5, 7, 11).splitIntoTileAlignedStrips(4, 3);
+        ASSERT_EQ(3, (int)strips.size());
+        std::list<RectI>::const_iterator it = strips.begin();
+        EXPECT_TRUE( *it == RectI(-3, -5, 7, 0) );
+        ++it;
+        EXPECT_TRUE( *it == RectI(-3, 0, 7, 8) );
+        ++it;
+        EXPECT_TRUE( *it == RectI(-3, 8, 7, 11) );
+    }
+
+    // Smaller than a tile: a single strip whatever the number of splits
+    {
+        std::list<RectI> strips = RectI(1, 1, 3, 3).splitIntoTileAlignedStrips(4, 8);
+        ASSERT_EQ(1, (int)strips.size());
+        EXPECT_TRUE( strips.front() == RectI(1, 1, 3, 3) );
+    }
+
+    // No split requested or invalid tile size
+    {
+        std::list<RectI> strips = RectI(0, 0, 5, 7).splitIntoTileAlignedStrips(4, 1);
+        ASSERT_EQ(1, (int)strips.size());
+        EXPECT_TRUE( strips.front() == RectI(0, 0, 5, 7) );
+
+        strips = RectI(0, 0, 5, 7).splitIntoTileAlignedStrips(0, 4);
+        ASSERT_EQ(1, (int)strips.size());
+        EXPECT_TRUE( strips.front() == RectI(0, 0, 5, 7) );
+    }
+
+    // An empty rectangle has no strip
+    EXPECT_TRUE( RectI().splitIntoTileAlignedStrips(4, 4).empty() );
+    EXPECT_TRUE( RectI(3, 3, 3, 10).splitIntoTileAlignedStrips(4, 4).empty() );
+
+    // Odd sizes and origins
+    const RectI rects[] = { RectI(0, 0, 1, 1), RectI(-7, -13, 5, 2), RectI(3, 1, 1921, 1081), RectI(-100, 255, -99, 257), RectI(0, -1, 64, 1) };
+    for (std::size_t i = 0; i < sizeof(rects) / sizeof(rects[0]); ++i) {
+        for (int tileSizeY = 1; tileSizeY <= 256; tileSizeY *= 4) {
+            for (int splitsCount = 2; splitsCount <= 17; splitsCount += 3) {
+                checkTileAlignedStrips(rects[i], tileSizeY, splitsCount);
+            }
+        }
+    }
+}
@@ -50,11 +50,21 @@ SOURCES += \
     google-mock/src/gmock-all.cc \
     BaseTest.cpp \
     Hash64_Test.cpp \
+    RectI_Test.cpp \
+    Transform_Test.cpp \
     Image_Test.cpp \
+    ImageConvert_Test.cpp \
     Lut_Test.cpp \
     KnobFile_Test.cpp \
     Curve_Test.cpp \
     Tracker_Test.cpp \
+    WorkStealingExecutor_Test.cpp \
+    ForkJoinPool_Test.cpp \
+    FramePipeline_Test.cpp \
+    ConcurrentFramesController_Test.cpp \
+    CancellationToken_Test.cpp \
+    InFlightRequestTable_Test.cpp \
+    PixelExpression_Test.cpp \
     wmain.cpp
 
 HEADERS += \
@@ -0,0 +1,84 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2013-2017 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+
+#include "Global/Macros.h"
+
+#include <cmath>
+#include <gtest/gtest.h>
+
+#include "Engine/RectD.h"
+#include "Engine/Transform.h"
+
+NATRON_NAMESPACE_USING
+
+static void
+expectRectNear(const RectD& expected,
+               const RectD& rect)
+{
+    EXPECT_NEAR(expected.x1, rect.x1, 1e-9);
+    EXPECT_NEAR(expected.y1, rect.y1, 1e-9);
+    EXPECT_NEAR(expected.x2, rect.x2, 1e-9);
+    EXPECT_NEAR(expected.y2, rect.y2, 1e-9);
+}
+
+// The matrices below map output positions to input positions, as returned by the getDistortion action:
+// the region of the output that depends on a region of the input is its transform by the inverse matrix
+TEST(Transform, InverseTransformRegion)
+{
+    RectD region;
+
+    // Translation: the input at (x + 10, y + 5) is moved to (x, y)
+    ASSERT_TRUE( Transform::inverseTransformRegion(RectD(20., 20., 40., 30.), Transform::Matrix3x3(1., 0., 10., 0., 1., 5., 0., 0., 1.), &region) );
+    expectRectNear(RectD(10., 15., 30., 25.), region);
+
+    // Scale: the output is twice as large as the input
+    ASSERT_TRUE( Transform::inverseTransformRegion(RectD(-5., 0., 10., 10.), Transform::matScale(0.5, 0.5), &region) );
+    expectRectNear(RectD(-10., 0., 20., 20.), region);
+
+    // Rotation by 90 degrees: the bounding box of the rotated corners
+    ASSERT_TRUE( Transform::inverseTransformRegion(RectD(0., 0., 10., 20.), Transform::matRotation(M_PI / 2.), &region) );
+    expectRectNear(RectD(-20., 0., 0., 10.), region);
+
+    // A translation of 10 pixels of an effect that only supports transforms in pixel coordinates, with a pixel aspect ratio of 2:
+    // once converted to canonical coordinates as in EffectInstance::getOutputRegionChangedByInput(), this is a translation of 20
+    {
+        double par = 2.;
+        Transform::Matrix3x3 mat(1., 0., 10., 0., 1., 0., 0., 0., 1.);
+        mat = Transform::matMul(Transform::matPixelToCanonical(par, 1, 1, false), mat);
+        mat = Transform::matMul( mat, Transform::matCanonicalToPixel(par, 1, 1, false) );
+        ASSERT_TRUE( Transform::inverseTransformRegion(RectD(0., 0., 100., 50.), mat, &region) );
+        expectRectNear(RectD(-20., 0., 80., 50.), region);
+    }
+
+    // A singular matrix cannot be inverted
+    EXPECT_FALSE( Transform::inverseTransformRegion(RectD(0., 0., 10., 10.), Transform::matScale(0., 1.), &region) );
+
+    // Perspective: the inverse matrix divides by x + 1
+    Transform::Matrix3x3 invPerspective(1., 0., 0., 0., 1., 0., 1., 0., 1.);
+    Transform::Matrix3x3 perspective = Transform::matInverse(invPerspective);
+    ASSERT_TRUE( Transform::inverseTransformRegion(RectD(0., 0., 1., 2.), perspective, &region) );
+    expectRectNear(RectD(0., 0., 0.5, 2.), region);
+
+    // The line at infinity x = -1 crosses the region: the output region cannot be bounded
+    EXPECT_FALSE( Transform::inverseTransformRegion(RectD(-2., 0., 1., 2.), perspective, &region) );
+}
@@ -0,0 +1,398 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2013-2017 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+#include <QtCore/QWaitCondition>
+
+#include "Engine/Timer.h"
+#include "Engine/WorkStealingExecutor.h"
+
+NATRON_NAMESPACE_USING
+
+// Number of nodes of the synthetic graph, similar to a very deep compositing tree
+#define N_NODES 1000
+
+// Number of nodes per layer: each node depends on up to 3 nodes of the previous layer
+#define N_NODES_PER_LAYER 8
+
+// Amount of work done by each node: nodes are cheap so that the scheduling overhead dominates
+#define N_ITERATIONS_PER_NODE 2000
+
+struct GraphNode
+{
+    std::vector<int> dependencies;
+    std::vector<int> listeners;
+    QAtomicInt nDependenciesLeft;
+    QAtomicInt nExecutions;
+    double result;
+
+    GraphNode()
+    : dependencies()
+    , listeners()
+    , nDependenciesLeft()
+    , nExecutions()
+    , result(0)
+    {
+    }
+};
+
+class SyntheticGraph
+{
+public:
+
+    std::vector<GraphNode> nodes;
+
+    // Set if a node was executed before one of its dependencies
+    QAtomicInt orderingErrors;
+
+    SyntheticGraph()
+    : nodes(N_NODES)
+    , orderingErrors()
+    {
+        srand(2000);
+        for (int i = N_NODES_PER_LAYER; i < N_NODES; ++i) {
+            int layerStart = (i / N_NODES_PER_LAYER - 1) * N_NODES_PER_LAYER;
+            std::set<int> deps;
+            // coverity[dont_call]
+            int nDeps = 1 + rand() % 3;
+            for (int d = 0; d < nDeps; ++d) {
+                // coverity[dont_call]
+                deps.insert( layerStart + rand() % N_NODES_PER_LAYER );
+            }
+            for (std::set<int>::iterator it = deps.begin(); it != deps.end(); ++it) {
+                nodes[i].dependencies.push_back(*it);
+                nodes[*it].listeners.push_back(i);
+            }
+        }
+        reset();
+    }
+
+    void reset()
+    {
+        for (int i = 0; i < N_NODES; ++i) {
+            nodes[i].nDependenciesLeft.fetchAndStoreOrdered( (int)nodes[i].dependencies.size() );
+            nodes[i].nExecutions.fetchAndStoreOrdered(0);
+            nodes[i].result = 0;
+        }
+        orderingErrors.fetchAndStoreOrdered(0);
+    }
+
+    // Does some work with the results of the dependencies
+    void execute(int index)
+    {
+        GraphNode& node = nodes[index];
+        double value = index;
+        for (std::size_t i = 0; i < node.dependencies.size(); ++i) {
+            const GraphNode& dep = nodes[node.dependencies[i]];
+            if ( (int)dep.nExecutions != 1 ) {
+                orderingErrors.fetchAndAddOrdered(1);
+            }
+            value += dep.result;
+        }
+        for (int i = 0; i < N_ITERATIONS_PER_NODE; ++i) {
+            value = value * 0.999 + 1.;
+        }
+        node.result = value;
+        node.nExecutions.fetchAndAddOrdered(1);
+    }
+
+    bool markDependencyAsRendered(int listener)
+    {
+        return nodes[listener].nDependenciesLeft.fetchAndAddOrdered(-1) == 1;
+    }
+
+    void checkResults()
+    {
+        EXPECT_EQ( 0, (int)orderingErrors );
+        for (int i = 0; i < N_NODES; ++i) {
+            EXPECT_EQ( 1, (int)nodes[i].nExecutions );
+        }
+    }
+};
+
+class SyntheticGraphTask
+    : public WorkStealingTask
+{
+    SyntheticGraph* _graph;
+    int _index;
+
+public:
+
+    SyntheticGraphTask(SyntheticGraph* graph,
+                       int index)
+    : WorkStealingTask()
+    , _graph(graph)
+    , _index(index)
+    {
+    }
+
+    virtual void run(WorkStealingExecutor* executor,
+                     int workerIndex) OVERRIDE FINAL
+    {
+        _graph->execute(_index);
+        const std::vector<int>& listeners = _graph->nodes[_index].listeners;
+        for (std::size_t i = 0; i < listeners.size(); ++i) {
+            if ( _graph->markDependencyAsRendered(listeners[i]) ) {
+                executor->enqueue(WorkStealingTaskPtr( new SyntheticGraphTask(_graph, listeners[i]) ), workerIndex);
+            }
+        }
+    }
+};
+
+static void
+runWithWorkStealingExecutor(SyntheticGraph& graph)
+{
+    WorkStealingExecutorPtr executor = WorkStealingExecutor::create( QThreadPool::globalInstance(), QThreadPool::globalInstance()->maxThreadCount() );
+
+    for (int i = 0; i < N_NODES; ++i) {
+        if (graph.nodes[i].dependencies.empty()) {
+            executor->enqueue( WorkStealingTaskPtr( new SyntheticGraphTask(&graph, i) ) );
+        }
+    }
+    executor->run();
+}
+
+// The scheduling scheme that TreeRender used before the WorkStealingExecutor: the launching thread
+// starts a runnable in the thread pool for each dependency-free node and sleeps until a runnable is finished.
+struct PollingScheduler
+{
+    SyntheticGraph* graph;
+    QMutex mutex;
+    QWaitCondition cond;
+    std::set<int> dependencyFree;
+    int nTasksLeft;
+};
+
+class PollingSchedulerRunnable
+    : public QRunnable
+{
+    PollingScheduler* _scheduler;
+    int _index;
+
+public:
+
+    PollingSchedulerRunnable(PollingScheduler* scheduler,
+                             int index)
+    : QRunnable()
+    , _scheduler(scheduler)
+    , _index(index)
+    {
+    }
+
+    virtual void run() OVERRIDE FINAL
+    {
+        _scheduler->graph->execute(_index);
+
+        QMutexLocker k(&_scheduler->mutex);
+        --_scheduler->nTasksLeft;
+        const std::vector<int>& listeners = _scheduler->graph->nodes[_index].listeners;
+        for (std::size_t i = 0; i < listeners.size(); ++i) {
+            if ( _scheduler->graph->markDependencyAsRendered(listeners[i]) ) {
+                _scheduler->dependencyFree.insert(listeners[i]);
+            }
+        }
+        _scheduler->cond.wakeOne();
+    }
+};
+
+static void
+runWithPollingScheduler(SyntheticGraph& graph)
+{
+    PollingScheduler scheduler;
+    scheduler.graph = &graph;
+    scheduler.nTasksLeft = N_NODES;
+    for (int i = 0; i < N_NODES; ++i) {
+        if (graph.nodes[i].dependencies.empty()) {
+            scheduler.dependencyFree.insert(i);
+        }
+    }
+
+    QMutexLocker k(&scheduler.mutex);
+    while (scheduler.nTasksLeft > 0) {
+        while ( !scheduler.dependencyFree.empty() ) {
+            int index = *scheduler.dependencyFree.begin();
+            scheduler.dependencyFree.erase( scheduler.dependencyFree.begin() );
+            QThreadPool::globalInstance()->start( new PollingSchedulerRunnable(&scheduler, index) );
+        }
+        scheduler.cond.wait(&scheduler.mutex);
+    }
+    k.unlock();
+
+    // Runnables may still be exiting after their last wakeOne()
+    QThreadPool::globalInstance()->waitForDone();
+}
+
+TEST(WorkStealingExecutor, DependencyOrder) {
+    SyntheticGraph graph;
+
+    for (int i = 0; i < 10; ++i) {
+        graph.reset();
+        runWithWorkStealingExecutor(graph);
+        graph.checkResults();
+    }
+}
+
+TEST(WorkStealingExecutor, SingleThread) {
+    SyntheticGraph graph;
+    WorkStealingExecutorPtr executor = WorkStealingExecutor::create(QThreadPool::globalInstance(), 0);
+
+    for (int i = 0; i < N_NODES; ++i) {
+        if (graph.nodes[i].dependencies.empty()) {
+            executor->enqueue( WorkStealingTaskPtr( new SyntheticGraphTask(&graph, i) ) );
+        }
+    }
+    executor->run();
+    graph.checkResults();
+    EXPECT_EQ( 0, executor->getNumSteals() );
+}
+
+// Runs a whole graph with an executor of high priority from within a task of an executor of normal priority,
+// like a viewer render started while a playback render is in flight
+class NestedGraphTask
+    : public WorkStealingTask
+{
+    SyntheticGraph* _graph;
+
+public:
+
+    NestedGraphTask(SyntheticGraph* graph)
+    : WorkStealingTask()
+    , _graph(graph)
+    {
+    }
+
+    virtual void run(WorkStealingExecutor* /*executor*/,
+                     int /*workerIndex*/) OVERRIDE FINAL
+    {
+        WorkStealingExecutorPtr executor = WorkStealingExecutor::create( QThreadPool::globalInstance(), QThreadPool::globalInstance()->maxThreadCount(), eWorkStealingExecutorPriorityHigh );
+
+        for (int i = 0; i < N_NODES; ++i) {
+            if (_graph->nodes[i].dependencies.empty()) {
+                executor->enqueue( WorkStealingTaskPtr( new SyntheticGraphTask(_graph, i) ) );
+            }
+        }
+        executor->run();
+    }
+};
+
+TEST(WorkStealingExecutor, NestedPriorities) {
+    SyntheticGraph normalGraph, highGraph;
+    WorkStealingExecutorPtr executor = WorkStealingExecutor::create( QThreadPool::globalInstance(), QThreadPool::globalInstance()->maxThreadCount() );
+
+    for (int i = 0; i < N_NODES; ++i) {
+        if (normalGraph.nodes[i].dependencies.empty()) {
+            executor->enqueue( WorkStealingTaskPtr( new SyntheticGraphTask(&normalGraph, i) ) );
+        }
+    }
+    executor->enqueue( WorkStealingTaskPtr( new NestedGraphTask(&highGraph) ) );
+    executor->run();
+
+    normalGraph.checkResults();
+    highGraph.checkResults();
+}
+
+class RecordOrderTask
+    : public WorkStealingTask
+{
+    std::vector<int>* _order;
+    int _index;
+    double _priority;
+
+public:
+
+    RecordOrderTask(std::vector<int>* order,
+                    int index,
+                    double priority)
+    : WorkStealingTask()
+    , _order(order)
+    , _index(index)
+    , _priority(priority)
+    {
+    }
+
+    virtual void run(WorkStealingExecutor* /*executor*/,
+                     int /*workerIndex*/) OVERRIDE FINAL
+    {
+        _order->push_back(_index);
+    }
+
+    virtual double getPriority() const OVERRIDE FINAL
+    {
+        return _priority;
+    }
+};
+
+TEST(WorkStealingExecutor, Priority) {
+    std::vector<int> order;
+    WorkStealingExecutorPtr executor = WorkStealingExecutor::create(QThreadPool::globalInstance(), 0);
+
+    // Highest priority first, then the most recent task among tasks of equal priority
+    executor->enqueue( WorkStealingTaskPtr( new RecordOrderTask(&order, 0, 1.) ) );
+    executor->enqueue( WorkStealingTaskPtr( new RecordOrderTask(&order, 1, 3.) ) );
+    executor->enqueue( WorkStealingTaskPtr( new RecordOrderTask(&order, 2, 1.) ) );
+    executor->enqueue( WorkStealingTaskPtr( new RecordOrderTask(&order, 3, 2.) ) );
+    executor->run();
+
+    ASSERT_EQ( 4, (int)order.size() );
+    EXPECT_EQ( 1, order[0] );
+    EXPECT_EQ( 3, order[1] );
+    EXPECT_EQ( 2, order[2] );
+    EXPECT_EQ( 0, order[3] );
+}
+
+TEST(WorkStealingExecutor, Benchmark) {
+    SyntheticGraph graph;
+    const int nRuns = 20;
+
+    TimeLapse pollingTimer;
+    for (int i = 0; i < nRuns; ++i) {
+        graph.reset();
+        runWithPollingScheduler(graph);
+    }
+    double pollingDuration = pollingTimer.getTimeSinceCreation() / nRuns;
+    graph.checkResults();
+
+    TimeLapse workStealingTimer;
+    for (int i = 0; i < nRuns; ++i) {
+        graph.reset();
+        runWithWorkStealingExecutor(graph);
+    }
+    double workStealingDuration = workStealingTimer.getTimeSinceCreation() / nRuns;
+    graph.checkResults();
+
+    std::cout << N_NODES << " nodes graph on " << QThreadPool::globalInstance()->maxThreadCount() << " threads: "
+              << "thread pool + condition variable: " << pollingDuration * 1000. << " ms, "
+              << "work-stealing executor: " << workStealingDuration * 1000. << " ms" << std::endl;
+}